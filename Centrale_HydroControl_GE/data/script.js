@@ -6,48 +6,101 @@ document.addEventListener('DOMContentLoaded', function() {
     const assignForm = document.getElementById('assign-form');
     const assignStatus = document.getElementById('assign-status');
 
-    function updateDashboard() {
-        fetch('/api/status')
-            .then(response => response.json())
-            .then(data => {
-                // Vider les contenus actuels
-                nodesTbody.innerHTML = '';
-                reservoirSelect.innerHTML = '';
-                wellSelect.innerHTML = '';
+    // État local, indexé par ID de noeud : la Centrale pousse l'état complet à la
+    // connexion ("update") puis un événement "node" par noeud modifié. Seules les
+    // cellules qui changent sont réécrites, une fois par image au plus.
+    const nodes = new Map();
+    const rows = new Map();
+    const options = new Map();
+    const pending = new Set();
+    let frameRequested = false;
+    let clockOffset = 0; // Date.now() - millis() de la Centrale, pour afficher lastSeen
 
-                // Remplir la table des noeuds
-                data.nodes.forEach(node => {
-                    let row = nodesTbody.insertRow();
+    function applyNode(node) {
+        node.lastSeenAt = node.lastSeen + clockOffset;
+        nodes.set(node.id, node);
+        pending.add(node.id);
+        if (!frameRequested) {
+            frameRequested = true;
+            requestAnimationFrame(flush);
+        }
+    }
+
+    function flush() {
+        frameRequested = false;
+        pending.forEach(id => patchNode(nodes.get(id)));
+        pending.clear();
+    }
+
+    function setText(cell, text) {
+        if (cell.textContent !== text) cell.textContent = text;
+    }
+
+    function createRow(id) {
+        const row = nodesTbody.insertRow();
+        for (let i = 0; i < 6; i++) row.insertCell();
+        const editButton = document.createElement('button');
+        editButton.textContent = 'Éditer';
+        editButton.onclick = function() { editNodeName(id); };
+        row.insertCell().appendChild(editButton);
+        rows.set(id, row);
+        return row;
+    }
 
-                    let nameCell = row.insertCell(0);
-                    nameCell.innerHTML = node.name ? `<strong>${node.name}</strong>` : '<i>Non défini</i>';
+    function patchNode(node) {
+        const row = rows.get(node.id) || createRow(node.id);
 
-                    row.insertCell(1).textContent = node.id;
-                    row.insertCell(2).textContent = node.type;
-                    row.insertCell(3).textContent = node.status;
-                    row.insertCell(4).textContent = node.rssi;
-                    row.insertCell(5).textContent = new Date(node.lastSeen).toLocaleTimeString();
+        const nameCell = row.cells[0];
+        if (nameCell.dataset.name !== node.name) {
+            nameCell.dataset.name = node.name;
+            const label = document.createElement(node.name ? 'strong' : 'i');
+            label.textContent = node.name || 'Non défini';
+            nameCell.replaceChildren(label);
+        }
+        setText(row.cells[1], node.id);
+        setText(row.cells[2], node.type);
+        setText(row.cells[3], node.status);
+        setText(row.cells[4], String(node.rssi));
+        setText(row.cells[5], new Date(node.lastSeenAt).toLocaleTimeString());
 
-                    let actionCell = row.insertCell(6);
-                    let editButton = document.createElement('button');
-                    editButton.textContent = 'Éditer';
-                    editButton.onclick = function() { editNodeName(node.id); };
-                    actionCell.appendChild(editButton);
+        patchOption(node);
+    }
 
-                    // Remplir les menus déroulants (avec le nom si disponible)
-                    let displayName = node.name && node.name.length > 0 ? `${node.name} (${node.id})` : node.id;
-                    if (node.type === 'AquaReservPro') {
-                        let option = new Option(displayName, node.id);
-                        reservoirSelect.add(option);
-                    } else if (node.type === 'WellguardPro') {
-                        let option = new Option(displayName, node.id);
-                        wellSelect.add(option);
-                    }
-                });
-            })
-            .catch(error => console.error('Error fetching status:', error));
+    // Les options ne sont jamais recréées : la sélection en cours est conservée.
+    function patchOption(node) {
+        const select = node.type === 'AquaReservPro' ? reservoirSelect
+                     : node.type === 'WellguardPro' ? wellSelect : null;
+        let option = options.get(node.id);
+        if (option && option.parentNode !== select) {
+            option.remove();
+            options.delete(node.id);
+            option = null;
+        }
+        if (!select) return;
+        if (!option) {
+            option = new Option('', node.id);
+            select.add(option);
+            options.set(node.id, option);
+        }
+        const displayName = node.name && node.name.length > 0 ? `${node.name} (${node.id})` : node.id;
+        if (option.text !== displayName) option.text = displayName;
     }
 
+    const source = new EventSource('/events');
+    source.addEventListener('update', function(event) {
+        const data = JSON.parse(event.data);
+        if (!data.nodes) return;
+        clockOffset = Date.now() - data.now;
+        data.nodes.forEach(node => applyNode(node));
+    });
+    source.addEventListener('node', function(event) {
+        const node = JSON.parse(event.data);
+        clockOffset = Date.now() - node.now;
+        applyNode(node);
+    });
+    // EventSource se reconnecte seul ; l'état complet est renvoyé à chaque connexion.
+    source.onerror = () => console.warn('Event stream interrupted, reconnecting...');
+
     // Gérer la soumission du formulaire d'assignation
     assignForm.addEventListener('submit', function(event) {
         event.preventDefault();
@@ -66,10 +119,6 @@ document.addEventListener('DOMContentLoaded', function() {
             assignStatus.textContent = 'Erreur: ' + error;
         });
     });
-
-    // Mettre à jour le tableau de bord toutes les 2 secondes
-    setInterval(updateDashboard, 2000);
-    updateDashboard(); // Premier appel
 });
 
 function editNodeName(nodeId) {
@@ -78,22 +127,14 @@ function editNodeName(nodeId) {
         return; // Annulé ou vide
     }
 
+    // Le nouveau nom revient par le flux d'événements, sur tous les tableaux de bord ouverts.
     fetch('/api/set-name', {
         method: 'POST',
         headers: { 'Content-Type': 'application/json' },
         body: JSON.stringify({ id: nodeId, name: newName })
     })
     .then(response => {
-        if (response.ok) {
-            // Mettre à jour le nom directement dans la table pour un retour visuel immédiat
-            let table = document.getElementById('nodes-table');
-            for (let i = 1; i < table.rows.length; i++) {
-                if (table.rows[i].cells[1].textContent === nodeId) {
-                    table.rows[i].cells[0].innerHTML = `<strong>${newName}</strong>`;
-                    break;
-                }
-            }
-        } else {
+        if (!response.ok) {
             alert("Erreur lors de la mise à jour du nom.");
         }
     })
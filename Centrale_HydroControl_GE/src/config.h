@@ -16,6 +16,9 @@
 // --- Limites du système ---
 #define MAX_NODES 32 // Nombre maximum de modules gérés
 
+// --- Tableau de bord (SSE) ---
+#define SSE_PUSH_INTERVAL_MS 500 // Regroupement des changements de noeuds avant envoi
+
 // --- Configuration des LEDs de Diagnostic ---
 #define RED_LED_PIN    13
 #define YELLOW_LED_PIN 12
@@ -9,6 +9,7 @@
 #include "config.h"
 #include "Message.h"
 #include "Crypto.h"
+#include "StaticAssets.h"
 
 // --- FreeRTOS Handles ---
 QueueHandle_t loraRxQueue;
@@ -46,21 +47,26 @@ struct Node {
 
 Node nodeList[MAX_NODES];
 int nodeCount = 0;
+bool nodeDirty[MAX_NODES]; // À pousser au tableau de bord (protégé par nodeListMutex)
 
 // Objets globaux
 AsyncWebServer server(80);
+StaticAssetHandler staticAssets(LittleFS, "/index.html");
 AsyncEventSource events("/events");
 Preferences preferences;
 
 // Prototypes
 void startApMode();
 void startStaMode();
+void onWifiEvent(WiFiEvent_t event);
 bool loadConfiguration();
 void onReceive(int packetSize);
 void handleLoRaPacket(String packet, int rssi);
 void handlePumpRequest(String requesterId, MessageType requestType); // NOUVEAU
 void registerOrUpdateNode(String id, NodeRole type, String status, int rssi);
 String getSystemStatusJson();
+void fillNodeJson(JsonObject node, int index);
+void pushDirtyNodes();
 void sendLoRaMessage(const String& message);
 void Task_LoRa_Handler(void *pvParameters);
 void Task_Node_Janitor(void *pvParameters);
@@ -110,10 +116,10 @@ void setup() {
 }
 
 void loop() {
-     if (WiFi.getMode() == WIFI_STA) {
-        events.send(getSystemStatusJson().c_str(), "update", millis());
-        delay(2000);
+    if (WiFi.getMode() == WIFI_STA) {
+        pushDirtyNodes();
     }
+    delay(SSE_PUSH_INTERVAL_MS);
 }
 
 // ... (loadConfiguration et startApMode restent les mêmes) ...
@@ -188,21 +194,24 @@ void startApMode() {
     });
     server.begin();
 }
-void startStaMode() {
-    WiFi.mode(WIFI_STA);
-    WiFi.begin(currentConfig.wifi_ssid.c_str(), currentConfig.wifi_pass.c_str());
 
-    int retries = 0;
-    while (WiFi.status() != WL_CONNECTED) {
-        delay(500);
-        Serial.print(".");
-        if (++retries > 20) { // Environ 10 secondes
-            LED_State errorState = CONNECTIVITY_ERROR;
-            xQueueSend(ledStateQueue, &errorState, 0);
-        }
+void onWifiEvent(WiFiEvent_t event) {
+    if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP) {
+        Serial.println("WiFi Connected. IP: " + WiFi.localIP().toString());
+        LED_State opState = OPERATIONAL;
+        xQueueSend(ledStateQueue, &opState, 0);
+    } else if (event == ARDUINO_EVENT_WIFI_STA_DISCONNECTED) {
+        LED_State errorState = CONNECTIVITY_ERROR;
+        xQueueSend(ledStateQueue, &errorState, 0);
     }
+}
 
-    Serial.println("\nWiFi Connected. IP: " + WiFi.localIP().toString());
+void startStaMode() {
+    WiFi.mode(WIFI_STA);
+    WiFi.setAutoReconnect(true);
+    WiFi.onEvent(onWifiEvent);
+    // L'association Wi-Fi se poursuit en arrière-plan : LittleFS, LoRa et les tâches démarrent sans l'attendre.
+    WiFi.begin(currentConfig.wifi_ssid.c_str(), currentConfig.wifi_pass.c_str());
 
     if(!LittleFS.begin(true)) {
         Serial.println("LittleFS Mount Failed");
@@ -224,17 +233,14 @@ void startStaMode() {
     LoRa.receive();
     Serial.println("LoRa Initialized.");
 
-    LED_State opState = OPERATIONAL;
-    xQueueSend(ledStateQueue, &opState, 0);
-
     xTaskCreate(Task_LED_Manager, "LED Manager", 2048, NULL, 0, NULL);
     xTaskCreate(Task_LoRa_Handler, "LoRa Handler", 4096, NULL, 3, NULL);
     xTaskCreate(Task_Node_Janitor, "Node Janitor", 2048, NULL, 1, NULL);
 
     // --- Serveur Web ---
-    server.on("/", HTTP_GET, [](AsyncWebServerRequest *request){ request->send(LittleFS, "/index.html", "text/html"); });
-    server.on("/style.css", HTTP_GET, [](AsyncWebServerRequest *request){ request->send(LittleFS, "/style.css", "text/css"); });
-    server.on("/script.js", HTTP_GET, [](AsyncWebServerRequest *request){ request->send(LittleFS, "/script.js", "application/javascript"); });
+    // Page, style et script : compressés et empreintés à la compilation (scripts/compress_assets.py).
+    staticAssets.begin();
+    server.addHandler(&staticAssets);
     server.on("/api/assign", HTTP_POST, [](AsyncWebServerRequest *request) {
         String reservoirId, wellId;
         if (request->hasParam("reservoir", true)) reservoirId = request->getParam("reservoir", true)->value();
@@ -247,6 +253,7 @@ void startStaMode() {
                 for (int i = 0; i < nodeCount; i++) {
                     if (nodeList[i].id.equals(reservoirId)) {
                         nodeList[i].assignedTo = wellId;
+                        nodeDirty[i] = true;
                         break;
                     }
                 }
@@ -297,22 +304,17 @@ void startStaMode() {
             String nodeName = doc["name"].as<String>();
 
             if (nodeId.length() > 0 && nodeName.length() > 0) {
-                bool updated = false;
                 if (xSemaphoreTake(nodeListMutex, portMAX_DELAY) == pdTRUE) {
                     for (int i = 0; i < nodeCount; i++) {
                         if (nodeList[i].id.equals(nodeId)) {
                             nodeList[i].name = nodeName;
+                            nodeDirty[i] = true;
                             saveNodeName(nodeId, nodeName);
-                            updated = true;
                             break;
                         }
                     }
                     xSemaphoreGive(nodeListMutex);
                 }
-
-                if (updated) {
-                    events.send(getSystemStatusJson().c_str(), "update", millis());
-                }
                 request->send(200, "text/plain", "Name updated successfully.");
             } else {
                 request->send(400, "text/plain", "Invalid request.");
@@ -320,6 +322,11 @@ void startStaMode() {
         }
     );
 
+    // Le tableau de bord ne sonde plus /api/status : l'état complet part à la connexion,
+    // puis seuls les noeuds modifiés sont poussés (événements "node", voir pushDirtyNodes).
+    events.onConnect([](AsyncEventSourceClient *client) {
+        client->send(getSystemStatusJson().c_str(), "update", millis(), 2000);
+    });
     server.addHandler(&events);
     server.begin();
 }
@@ -483,6 +490,7 @@ void registerOrUpdateNode(String id, NodeRole role, String status, int rssi) {
             if (role != ROLE_UNKNOWN) { // Mettre à jour le rôle si fourni
                 nodeList[existingNodeIndex].type = role;
             }
+            nodeDirty[existingNodeIndex] = true;
         } else if (nodeCount < MAX_NODES) { // Nouveau noeud
             nodeList[nodeCount].id = id;
             nodeList[nodeCount].name = loadNodeName(id); // Charger le nom
@@ -491,6 +499,7 @@ void registerOrUpdateNode(String id, NodeRole role, String status, int rssi) {
             nodeList[nodeCount].rssi = rssi;
             nodeList[nodeCount].status = status;
             nodeList[nodeCount].assignedTo = ""; // Initialisation
+            nodeDirty[nodeCount] = true;
             nodeCount++;
         }
         xSemaphoreGive(nodeListMutex);
@@ -509,23 +518,14 @@ void sendLoRaMessage(const String& message) {
 String getSystemStatusJson() {
     String output;
     if (xSemaphoreTake(nodeListMutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
-        StaticJsonDocument<1024> doc;
+        // Dimensionné sur le nombre de noeuds : un document fixe de 1 Ko tronquait la liste.
+        DynamicJsonDocument doc(128 + nodeCount * 256);
         doc["nodeCount"] = nodeCount;
+        doc["now"] = millis(); // Référence pour lastSeen côté navigateur
         JsonArray nodes = doc.createNestedArray("nodes");
 
         for (int i = 0; i < nodeCount; i++) {
-            JsonObject node = nodes.createNestedObject();
-            node["id"] = nodeList[i].id;
-            node["name"] = nodeList[i].name;
-            switch(nodeList[i].type) {
-                case ROLE_AQUA_RESERV_PRO: node["type"] = "AquaReservPro"; break;
-                case ROLE_WELLGUARD_PRO: node["type"] = "WellguardPro"; break;
-                default: node["type"] = "Unknown"; break;
-            }
-            node["rssi"] = nodeList[i].rssi;
-            node["status"] = nodeList[i].status;
-            node["lastSeen"] = nodeList[i].lastSeen;
-            node["assignedTo"] = nodeList[i].assignedTo;
+            fillNodeJson(nodes.createNestedObject(), i);
         }
         serializeJson(doc, output);
         xSemaphoreGive(nodeListMutex);
@@ -536,6 +536,45 @@ String getSystemStatusJson() {
     return output;
 }
 
+// À appeler avec nodeListMutex pris.
+void fillNodeJson(JsonObject node, int index) {
+    node["id"] = nodeList[index].id;
+    node["name"] = nodeList[index].name;
+    switch(nodeList[index].type) {
+        case ROLE_AQUA_RESERV_PRO: node["type"] = "AquaReservPro"; break;
+        case ROLE_WELLGUARD_PRO: node["type"] = "WellguardPro"; break;
+        default: node["type"] = "Unknown"; break;
+    }
+    node["rssi"] = nodeList[index].rssi;
+    node["status"] = nodeList[index].status;
+    node["lastSeen"] = nodeList[index].lastSeen;
+    node["assignedTo"] = nodeList[index].assignedTo;
+}
+
+// Envoie un événement "node" par noeud modifié depuis le dernier passage.
+// Les changements sont regroupés sur SSE_PUSH_INTERVAL_MS ; sans client, rien n'est sérialisé.
+void pushDirtyNodes() {
+    if (events.count() == 0) return;
+
+    String messages[MAX_NODES];
+    int messageCount = 0;
+    if (xSemaphoreTake(nodeListMutex, pdMS_TO_TICKS(100)) != pdTRUE) return;
+    for (int i = 0; i < nodeCount; i++) {
+        if (!nodeDirty[i]) continue;
+        nodeDirty[i] = false;
+        StaticJsonDocument<384> doc;
+        fillNodeJson(doc.to<JsonObject>(), i);
+        doc["now"] = millis();
+        serializeJson(doc, messages[messageCount++]);
+    }
+    xSemaphoreGive(nodeListMutex);
+
+    // Envoyé hors du mutex : la file de chaque client peut être pleine.
+    for (int i = 0; i < messageCount; i++) {
+        events.send(messages[i].c_str(), "node", millis());
+    }
+}
+
 void Task_Node_Janitor(void *pvParameters) {
     const long NODE_TIMEOUT_MS = 300000; // 5 minutes
     const TickType_t TASK_INTERVAL_TICKS = pdMS_TO_TICKS(30000); // 30 secondes
@@ -545,11 +584,10 @@ void Task_Node_Janitor(void *pvParameters) {
 
         if (xSemaphoreTake(nodeListMutex, portMAX_DELAY) == pdTRUE) {
             unsigned long currentTime = millis();
-            bool changed = false;
             for (int i = 0; i < nodeCount; i++) {
                 if (nodeList[i].status != "DISCONNECTED" && (currentTime - nodeList[i].lastSeen > NODE_TIMEOUT_MS)) {
                     nodeList[i].status = "DISCONNECTED";
-                    changed = true;
+                    nodeDirty[i] = true;
                     Serial.printf("Node %s timed out. Marked as DISCONNECTED.\n", nodeList[i].id.c_str());
                 }
             }
@@ -18,6 +18,9 @@
 // --- Limites du système ---
 #define MAX_NODES 32 // Nombre maximum de modules gérés
 
+// --- Tableau de bord (SSE) ---
+#define SSE_PUSH_INTERVAL_MS 500 // Regroupement des changements de noeuds avant envoi
+
 // --- Configuration des LEDs de Diagnostic ---
 // Broches choisies pour éviter les conflits et les problèmes de démarrage (strapping pins)
 #define RED_LED_PIN    13 // GPIO13
@@ -0,0 +1,307 @@
+#include "DashboardSocket.h"
+#include <rom/crc.h>
+#include "Metrics.h"
+#include "Profiler.h"
+
+#define WS_FRAME_MAX       160 // Largest NODE frame is 130 bytes
+#define WS_CLOSE_TRY_LATER 1013
+#define WS_CLOSE_POLICY    1008
+
+// Bounds-checked little-endian reader; any overrun clears ok.
+struct WsReader {
+    const uint8_t* data;
+    size_t len;
+    size_t pos = 0;
+    bool ok = true;
+
+    WsReader(const uint8_t* data, size_t len) : data(data), len(len) {}
+
+    uint8_t u8() {
+        if (pos + 1 > len) { ok = false; return 0; }
+        return data[pos++];
+    }
+    uint16_t u16() {
+        uint16_t lo = u8();
+        return lo | (uint16_t)u8() << 8;
+    }
+    void str(char* out, size_t size) {
+        uint8_t n = u8();
+        if (!ok || pos + n > len || n >= size) { ok = false; out[0] = '\0'; return; }
+        memcpy(out, data + pos, n);
+        out[n] = '\0';
+        pos += n;
+    }
+};
+
+static size_t putU8(uint8_t* out, size_t pos, uint8_t v) {
+    out[pos] = v;
+    return pos + 1;
+}
+
+static size_t putU16(uint8_t* out, size_t pos, uint16_t v) {
+    out[pos] = v & 0xFF;
+    out[pos + 1] = v >> 8;
+    return pos + 2;
+}
+
+static size_t putU32(uint8_t* out, size_t pos, uint32_t v) {
+    for (int i = 0; i < 4; i++) out[pos + i] = (v >> (8 * i)) & 0xFF;
+    return pos + 4;
+}
+
+static size_t putStr(uint8_t* out, size_t pos, const char* s) {
+    size_t n = strlen(s);
+    out[pos] = n;
+    memcpy(out + pos + 1, s, n);
+    return pos + 1 + n;
+}
+
+DashboardSocket::DashboardSocket(const char* url) : ws(url) {
+    memset(clients, 0, sizeof(clients));
+    memset(recordCrc, 0, sizeof(recordCrc));
+    memset(recordVersion, 0, sizeof(recordVersion));
+}
+
+void DashboardSocket::begin(CommandHandler onCommand, SnapshotProvider snapshot, void* context) {
+    this->onCommand = onCommand;
+    this->snapshot = snapshot;
+    this->context = context;
+    commands = xQueueCreate(WS_COMMAND_QUEUE_LEN, sizeof(WsCommand));
+    mutex = xSemaphoreCreateMutex();
+    ws.onEvent([this](AsyncWebSocket* server, AsyncWebSocketClient* client, AwsEventType type, void* arg, uint8_t* data, size_t len) {
+        onEvent(client, type, arg, data, len);
+    });
+    xTaskCreate(Task_Socket, "WsApi", Profiler::stackSize("WsApi", 4096), this, 2, NULL);
+}
+
+// Must be called with the mutex held.
+DashboardSocket::Client* DashboardSocket::findClient(uint32_t id) {
+    for (uint8_t i = 0; i < WS_MAX_CLIENTS; i++) {
+        if (clients[i].id == id) return &clients[i];
+    }
+    return nullptr;
+}
+
+// Must be called with the mutex held.
+uint8_t DashboardSocket::connectedCount() {
+    uint8_t n = 0;
+    for (uint8_t i = 0; i < WS_MAX_CLIENTS; i++) {
+        if (clients[i].id != 0) n++;
+    }
+    return n;
+}
+
+// Web server task: only bookkeeping and parsing, the work is queued.
+void DashboardSocket::onEvent(AsyncWebSocketClient* client, AwsEventType type, void* arg, uint8_t* data, size_t len) {
+    switch (type) {
+        case WS_EVT_CONNECT: {
+            xSemaphoreTake(mutex, portMAX_DELAY);
+            Client* slot = findClient(0);
+            if (slot != nullptr) {
+                memset(slot, 0, sizeof(Client));
+                slot->id = client->id();
+            }
+            Metrics::setGauge(MG_WS_CLIENTS, connectedCount());
+            xSemaphoreGive(mutex);
+            if (slot == nullptr) {
+                Metrics::inc(MC_WS_REJECTED);
+                client->close(WS_CLOSE_TRY_LATER, "Too many clients");
+            }
+            break;
+        }
+        case WS_EVT_DISCONNECT: {
+            xSemaphoreTake(mutex, portMAX_DELAY);
+            Client* slot = findClient(client->id());
+            if (slot != nullptr) slot->id = 0;
+            Metrics::setGauge(MG_WS_CLIENTS, connectedCount());
+            xSemaphoreGive(mutex);
+            break;
+        }
+        case WS_EVT_DATA: {
+            AwsFrameInfo* info = (AwsFrameInfo*)arg;
+            // Every request fits in one frame; anything else is not this protocol.
+            if (!info->final || info->index != 0 || info->len != len || info->opcode != WS_BINARY) {
+                Metrics::inc(MC_WS_BAD_REQUESTS);
+                return;
+            }
+            onMessage(client, data, len);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void DashboardSocket::onMessage(AsyncWebSocketClient* client, const uint8_t* data, size_t len) {
+    WsCommand command;
+    memset(&command, 0, sizeof(command));
+    command.receivedUs = micros();
+    command.clientId = client->id();
+
+    WsReader in(data, len);
+    command.type = (WsMessageType)in.u8();
+    command.seq = in.u16();
+    switch (command.type) {
+        case WSM_SUBSCRIBE:
+            command.topics = in.u8();
+            break;
+        case WSM_ASSIGN:
+            in.str(command.id, sizeof(command.id));
+            in.str(command.target, sizeof(command.target));
+            break;
+        case WSM_SET_NAME:
+            in.str(command.id, sizeof(command.id));
+            in.str(command.name, sizeof(command.name));
+            command.hasNotes = in.u8() != 0;
+            if (command.hasNotes) in.str(command.notes, sizeof(command.notes));
+            break;
+        case WSM_PING:
+            break;
+        default:
+            in.ok = false;
+            break;
+    }
+
+    if (!in.ok) {
+        Metrics::inc(MC_WS_BAD_REQUESTS);
+        sendAck(command.clientId, command.seq, WS_STATUS_BAD_REQUEST, command.receivedUs);
+    } else if (xQueueSend(commands, &command, 0) != pdPASS) {
+        sendAck(command.clientId, command.seq, WS_STATUS_BUSY, command.receivedUs);
+    }
+}
+
+void DashboardSocket::sendAck(uint32_t clientId, uint16_t seq, WsStatus status, uint32_t receivedUs) {
+    AsyncWebSocketClient* client = ws.client(clientId);
+    if (client == nullptr || client->queueIsFull()) return;
+    uint8_t frame[12];
+    size_t pos = putU8(frame, 0, WSM_ACK);
+    pos = putU16(frame, pos, seq);
+    pos = putU8(frame, pos, status);
+    pos = putU32(frame, pos, micros() - receivedUs);
+    client->binary(frame, pos);
+}
+
+size_t DashboardSocket::encodeNode(uint8_t* out, const WsNodeRecord& record, uint32_t now) {
+    size_t pos = putU8(out, 0, WSM_NODE);
+    pos = putU16(out, pos, 0);
+    pos = putU32(out, pos, now);
+    pos = putStr(out, pos, record.id);
+    pos = putStr(out, pos, record.name);
+    pos = putU8(out, pos, record.role);
+    pos = putU16(out, pos, (uint16_t)record.rssi);
+    pos = putStr(out, pos, record.status);
+    pos = putU32(out, pos, record.lastSeen);
+    pos = putStr(out, pos, record.assignedTo);
+    return pos;
+}
+
+// A node's version changes only when its record does.
+void DashboardSocket::refreshRecords() {
+    memset(records, 0, sizeof(records)); // The CRC covers the padding and string tails
+    recordCount = snapshot(records, WS_MAX_NODES, context);
+    for (uint8_t i = 0; i < recordCount; i++) {
+        uint32_t crc = crc32_le(0, (const uint8_t*)&records[i], sizeof(WsNodeRecord));
+        if (crc != recordCrc[i] || recordVersion[i] == 0) {
+            recordCrc[i] = crc;
+            recordVersion[i]++;
+        }
+    }
+}
+
+void DashboardSocket::publish() {
+    refreshRecords();
+    uint32_t now = millis();
+    uint8_t frame[WS_FRAME_MAX];
+    uint32_t evicted[WS_MAX_CLIENTS];
+    uint8_t evictedCount = 0;
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    for (uint8_t c = 0; c < WS_MAX_CLIENTS; c++) {
+        Client& slot = clients[c];
+        if (slot.id == 0 || !(slot.topics & WS_TOPIC_NODES)) continue;
+        AsyncWebSocketClient* client = ws.client(slot.id);
+        if (client == nullptr) continue;
+
+        bool blocked = false;
+        for (uint8_t i = 0; i < recordCount && !blocked; i++) {
+            if (slot.sentVersion[i] == recordVersion[i]) continue;
+            // Never queue past the client's limit: what it misses now is sent as the
+            // latest record once it drains, older versions are never replayed.
+            if (client->queueIsFull()) {
+                blocked = true;
+                break;
+            }
+            client->binary(frame, encodeNode(frame, records[i], now));
+            slot.sentVersion[i] = recordVersion[i];
+        }
+        if (!blocked && !slot.synced) {
+            if (client->queueIsFull()) {
+                blocked = true;
+            } else {
+                size_t pos = putU8(frame, 0, WSM_SYNC);
+                pos = putU16(frame, pos, 0);
+                pos = putU32(frame, pos, now);
+                client->binary(frame, pos);
+                slot.synced = true;
+            }
+        }
+
+        if (!blocked) {
+            slot.blockedSinceMs = 0;
+            continue;
+        }
+        Metrics::inc(MC_WS_DEFERRED);
+        if (slot.blockedSinceMs == 0) {
+            slot.blockedSinceMs = now | 1;
+        } else if (now - slot.blockedSinceMs >= WS_STALL_TIMEOUT_MS) {
+            evicted[evictedCount++] = slot.id;
+            slot.blockedSinceMs = 0;
+        }
+    }
+    xSemaphoreGive(mutex);
+
+    for (uint8_t i = 0; i < evictedCount; i++) {
+        AsyncWebSocketClient* client = ws.client(evicted[i]);
+        if (client == nullptr) continue;
+        Metrics::inc(MC_WS_EVICTED);
+        client->close(WS_CLOSE_POLICY, "Client too slow");
+    }
+}
+
+void DashboardSocket::Task_Socket(void* pvParameters) {
+    DashboardSocket* self = (DashboardSocket*)pvParameters;
+    uint32_t lastPublishMs = 0;
+
+    for (;;) {
+        uint32_t since = millis() - lastPublishMs;
+        TickType_t wait = since >= WS_PUBLISH_INTERVAL_MS ? 0 : pdMS_TO_TICKS(WS_PUBLISH_INTERVAL_MS - since);
+        WsCommand command;
+        bool publishNow = false;
+
+        if (xQueueReceive(self->commands, &command, wait) == pdPASS) {
+            WsStatus status = WS_STATUS_OK;
+            if (command.type == WSM_SUBSCRIBE) {
+                xSemaphoreTake(self->mutex, portMAX_DELAY);
+                Client* slot = self->findClient(command.clientId);
+                if (slot != nullptr) {
+                    slot->topics = command.topics;
+                    slot->synced = false;
+                    memset(slot->sentVersion, 0, sizeof(slot->sentVersion)); // Full snapshot
+                }
+                xSemaphoreGive(self->mutex);
+                publishNow = true;
+            } else if (command.type != WSM_PING) {
+                status = self->onCommand(command, self->context);
+                publishNow = true; // Let the sender see the effect right away
+            }
+            self->sendAck(command.clientId, command.seq, status, command.receivedUs);
+            Metrics::observe(MH_WS_COMMAND_US, micros() - command.receivedUs);
+        }
+
+        if (publishNow || millis() - lastPublishMs >= WS_PUBLISH_INTERVAL_MS) {
+            lastPublishMs = millis();
+            self->publish();
+            self->ws.cleanupClients(WS_MAX_CLIENTS);
+        }
+    }
+}
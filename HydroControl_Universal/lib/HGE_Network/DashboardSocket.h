@@ -0,0 +1,124 @@
+#ifndef DASHBOARD_SOCKET_H
+#define DASHBOARD_SOCKET_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include "config.h"
+
+// Binary WebSocket API of the Centrale (/ws), for the dashboard and integrations.
+// One message per binary frame, little-endian:
+//
+//   [u8 type][u16 seq][payload]          strings are [u8 length][bytes]
+//
+// Client -> Centrale (seq chosen by the client, echoed in the ACK):
+//   WSM_SUBSCRIBE  u8 topics                         -> ACK, a NODE per node, SYNC
+//   WSM_ASSIGN     str reservoirId, str wellId       -> ACK
+//   WSM_SET_NAME   str id, str name, u8 hasNotes[, str notes] -> ACK
+//   WSM_PING                                         -> ACK
+// Centrale -> client:
+//   WSM_ACK        u8 status, u32 handleUs (receive -> ACK, queueing included)
+//   WSM_NODE       u32 now, str id, str name, u8 role, i16 rssi, str status,
+//                  u32 lastSeen, str assignedTo     (millis() of the Centrale)
+//   WSM_SYNC       u32 now                           (end of the initial snapshot)
+//
+// Node deltas: a NODE is sent when a node's record changes. A client whose send
+// queue is full is skipped and later gets only the latest record of each node it
+// missed; one that stays blocked for WS_STALL_TIMEOUT_MS is closed.
+enum WsMessageType : uint8_t {
+    WSM_SUBSCRIBE = 0x01,
+    WSM_ASSIGN    = 0x02,
+    WSM_SET_NAME  = 0x03,
+    WSM_PING      = 0x04,
+    WSM_ACK       = 0x80,
+    WSM_NODE      = 0x81,
+    WSM_SYNC      = 0x82,
+};
+
+enum WsTopic : uint8_t {
+    WS_TOPIC_NODES = 0x01,
+};
+
+enum WsStatus : uint8_t {
+    WS_STATUS_OK = 0,
+    WS_STATUS_BAD_REQUEST,
+    WS_STATUS_UNKNOWN_NODE,
+    WS_STATUS_BUSY,          // Command queue full, try again
+};
+
+#define WS_ID_LEN      24
+#define WS_NAME_LEN    48
+#define WS_NOTES_LEN   128
+#define WS_STATUS_LEN  16
+
+struct WsCommand {
+    uint32_t clientId;
+    WsMessageType type;
+    uint16_t seq;
+    uint32_t receivedUs;
+    uint8_t topics;          // SUBSCRIBE
+    char id[WS_ID_LEN];      // Reservoir (ASSIGN) or node (SET_NAME)
+    char target[WS_ID_LEN];  // Well (ASSIGN)
+    char name[WS_NAME_LEN];
+    bool hasNotes;
+    char notes[WS_NOTES_LEN];
+};
+
+struct WsNodeRecord {
+    char id[WS_ID_LEN];
+    char name[WS_NAME_LEN];
+    uint8_t role;
+    int16_t rssi;
+    char status[WS_STATUS_LEN];
+    uint32_t lastSeen;
+    char assignedTo[WS_ID_LEN];
+};
+
+class DashboardSocket {
+public:
+    // Both run on the socket task, never on the web server's.
+    typedef WsStatus (*CommandHandler)(const WsCommand& command, void* context);
+    typedef uint8_t (*SnapshotProvider)(WsNodeRecord* records, uint8_t max, void* context);
+
+    DashboardSocket(const char* url);
+
+    AsyncWebSocket& handler() { return ws; }
+    void begin(CommandHandler onCommand, SnapshotProvider snapshot, void* context);
+
+private:
+    struct Client {
+        uint32_t id;             // 0 = free slot
+        uint8_t topics;
+        bool synced;             // Initial snapshot sent
+        uint32_t blockedSinceMs; // 0 = not blocked
+        uint32_t sentVersion[WS_MAX_NODES];
+    };
+
+    AsyncWebSocket ws;
+    CommandHandler onCommand = nullptr;
+    SnapshotProvider snapshot = nullptr;
+    void* context = nullptr;
+    QueueHandle_t commands = NULL;
+    SemaphoreHandle_t mutex = NULL;
+
+    Client clients[WS_MAX_CLIENTS];
+    // Only touched by the socket task
+    WsNodeRecord records[WS_MAX_NODES];
+    uint32_t recordCrc[WS_MAX_NODES];
+    uint32_t recordVersion[WS_MAX_NODES];
+    uint8_t recordCount = 0;
+
+    void onEvent(AsyncWebSocketClient* client, AwsEventType type, void* arg, uint8_t* data, size_t len);
+    void onMessage(AsyncWebSocketClient* client, const uint8_t* data, size_t len);
+    Client* findClient(uint32_t id);
+    uint8_t connectedCount();
+    void sendAck(uint32_t clientId, uint16_t seq, WsStatus status, uint32_t receivedUs);
+    void refreshRecords();
+    void publish();
+    static size_t encodeNode(uint8_t* out, const WsNodeRecord& record, uint32_t now);
+    static void Task_Socket(void* pvParameters);
+};
+
+#endif // DASHBOARD_SOCKET_H
@@ -0,0 +1,196 @@
+#include "EventStream.h"
+#include <AsyncTCP.h>
+#include "Metrics.h"
+
+// Writes the response head, then hands the connection over to the stream once
+// the head is acknowledged (the same hand-over as AsyncEventSource).
+class EventStreamResponse : public AsyncWebServerResponse {
+public:
+    EventStreamResponse(EventStream* stream, uint8_t slot) : stream(stream), slot(slot) {
+        _code = 200;
+        _contentType = "text/event-stream";
+        _sendContentLength = false;
+        addHeader("Cache-Control", "no-cache");
+        addHeader("Connection", "keep-alive");
+    }
+
+    // Deleted with its request: if that happens before the hand-over, the
+    // connection never became a subscriber.
+    ~EventStreamResponse() {
+        if (!attached) stream->release(slot);
+    }
+
+    void _respond(AsyncWebServerRequest* request) override {
+        String head = _assembleHead(request->version());
+        request->client()->write(head.c_str(), _headLength);
+        _state = RESPONSE_WAIT_ACK;
+    }
+
+    size_t _ack(AsyncWebServerRequest* request, size_t len, uint32_t time) override {
+        if (len && !attached) {
+            attached = true;
+            EventStream* target = stream;
+            uint8_t index = slot;
+            target->attach(request, index); // Deletes the request, and this response
+        }
+        return 0;
+    }
+
+    bool _sourceValid() const override { return true; }
+
+private:
+    EventStream* stream;
+    uint8_t slot;
+    bool attached = false;
+};
+
+EventStream::EventStream(const char* url) : url(url) {
+    memset(clients, 0, sizeof(clients));
+}
+
+void EventStream::begin() {
+    mutex = xSemaphoreCreateRecursiveMutex();
+}
+
+bool EventStream::canHandle(AsyncWebServerRequest* request) {
+    return request->method() == HTTP_GET && request->url() == url;
+}
+
+// A slot is taken as soon as the request arrives, so the limit also holds for
+// connections still in their handshake.
+void EventStream::handleRequest(AsyncWebServerRequest* request) {
+    int slot = -1;
+    xSemaphoreTakeRecursive(mutex, portMAX_DELAY);
+    for (uint8_t i = 0; i < SSE_MAX_CLIENTS; i++) {
+        if (clients[i].tcp == nullptr) {
+            memset(&clients[i], 0, sizeof(Client));
+            clients[i].tcp = request->client();
+            slot = i;
+            break;
+        }
+    }
+    xSemaphoreGiveRecursive(mutex);
+
+    if (slot < 0) {
+        Metrics::inc(MC_SSE_REJECTED);
+        request->send(503, "text/plain", "Too many clients");
+        return;
+    }
+    request->send(new EventStreamResponse(this, slot));
+}
+
+// Async TCP task. From here on the connection belongs to the stream: the
+// request's callbacks are replaced before it is deleted.
+void EventStream::attach(AsyncWebServerRequest* request, uint8_t slot) {
+    AsyncClient* tcp = request->client();
+    tcp->setRxTimeout(0);
+    tcp->onError(NULL, NULL);
+    tcp->onData(NULL, NULL);
+    tcp->onPoll(NULL, NULL);
+    tcp->onAck([](void* arg, AsyncClient* c, size_t len, uint32_t time) {
+        ((EventStream*)arg)->onAck(c, len);
+    }, this);
+    // No ACK for ASYNC_MAX_ACK_TIME: the browser is gone.
+    tcp->onTimeout([](void* arg, AsyncClient* c, uint32_t time) {
+        Metrics::inc(MC_SSE_EVICTED);
+        c->close(true);
+    }, this);
+    tcp->onDisconnect([](void* arg, AsyncClient* c) {
+        ((EventStream*)arg)->detach(c);
+        delete c;
+    }, this);
+    delete request;
+
+    xSemaphoreTakeRecursive(mutex, portMAX_DELAY);
+    Client& client = clients[slot];
+    client.attached = true;
+    Metrics::setGauge(MG_SSE_CLIENTS, attachedCount());
+    trySend(client); // Current state right away
+    xSemaphoreGiveRecursive(mutex);
+}
+
+void EventStream::release(uint8_t slot) {
+    xSemaphoreTakeRecursive(mutex, portMAX_DELAY);
+    memset(&clients[slot], 0, sizeof(Client));
+    xSemaphoreGiveRecursive(mutex);
+}
+
+void EventStream::detach(AsyncClient* tcp) {
+    xSemaphoreTakeRecursive(mutex, portMAX_DELAY);
+    for (uint8_t i = 0; i < SSE_MAX_CLIENTS; i++) {
+        if (clients[i].tcp == tcp) memset(&clients[i], 0, sizeof(Client));
+    }
+    Metrics::setGauge(MG_SSE_CLIENTS, attachedCount());
+    xSemaphoreGiveRecursive(mutex);
+}
+
+// A drained client gets the latest state, whatever it missed in between.
+void EventStream::onAck(AsyncClient* tcp, size_t len) {
+    xSemaphoreTakeRecursive(mutex, portMAX_DELAY);
+    for (uint8_t i = 0; i < SSE_MAX_CLIENTS; i++) {
+        Client& client = clients[i];
+        if (client.tcp != tcp || !client.attached) continue;
+        client.delivery.acked(len);
+        trySend(client);
+    }
+    xSemaphoreGiveRecursive(mutex);
+}
+
+// Must be called with the mutex held. Returns false if the client still has an
+// older event to drain.
+bool EventStream::trySend(Client& client) {
+    if (!client.attached || client.closing || client.delivery.upToDate(version)) {
+        client.delivery.keepingUp();
+        return true;
+    }
+    if (!client.delivery.canWrite(client.tcp->space(), message.length()) ||
+        client.tcp->add(message.c_str(), message.length()) != message.length()) {
+        client.delivery.blocked(millis());
+        return false;
+    }
+    client.tcp->send();
+    uint32_t skipped = client.delivery.sent(version, message.length());
+    if (skipped > 0) Metrics::inc(MC_SSE_SKIPPED, skipped);
+    return true;
+}
+
+void EventStream::publish(const char* event, const String& data) {
+    String formatted;
+    formatted.reserve(data.length() + strlen(event) + 16);
+    formatted += "event: ";
+    formatted += event;
+    formatted += "\ndata: ";
+    formatted += data;
+    formatted += "\n\n";
+
+    xSemaphoreTakeRecursive(mutex, portMAX_DELAY);
+    message = formatted;
+    version++;
+    uint32_t now = millis();
+    for (uint8_t i = 0; i < SSE_MAX_CLIENTS; i++) {
+        Client& client = clients[i];
+        if (client.tcp == nullptr || trySend(client)) continue;
+        if (client.delivery.stalled(now, SSE_STALL_TIMEOUT_MS)) {
+            Metrics::inc(MC_SSE_EVICTED);
+            client.closing = true;
+            client.tcp->close(true); // Calls back into detach(), which frees the slot
+        }
+    }
+    xSemaphoreGiveRecursive(mutex);
+}
+
+uint8_t EventStream::count() {
+    xSemaphoreTakeRecursive(mutex, portMAX_DELAY);
+    uint8_t n = attachedCount();
+    xSemaphoreGiveRecursive(mutex);
+    return n;
+}
+
+// Must be called with the mutex held.
+uint8_t EventStream::attachedCount() {
+    uint8_t n = 0;
+    for (uint8_t i = 0; i < SSE_MAX_CLIENTS; i++) {
+        if (clients[i].attached) n++;
+    }
+    return n;
+}
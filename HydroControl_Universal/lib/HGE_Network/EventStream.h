@@ -0,0 +1,63 @@
+#ifndef EVENT_STREAM_H
+#define EVENT_STREAM_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "SseSubscriber.h"
+#include "config.h"
+
+// Server-Sent Events endpoint with bounded memory per subscriber, in place of
+// AsyncEventSource (which queues every message for every client, without limit,
+// when a browser stops reading).
+//
+// Every event carries the full state, so a client only ever needs the latest
+// one: each client has at most one event in flight (written, not acknowledged)
+// and the latest one waiting. When it falls behind, the intermediate events are
+// skipped and it gets the newest once its backlog is acknowledged. A client that
+// cannot take anything for SSE_STALL_TIMEOUT_MS is closed, and connections
+// beyond SSE_MAX_CLIENTS are refused with 503.
+//
+// An event must fit in a client's TCP send buffer (TCP_SND_BUF, 5744 bytes by
+// default); the node table is well below that.
+class EventStream : public AsyncWebHandler {
+public:
+    EventStream(const char* url);
+
+    void begin();
+
+    // Replaces the current state. Sent right away to the clients that can take
+    // it, later to the others. The data must not contain line breaks.
+    void publish(const char* event, const String& data);
+    // Subscribers currently attached
+    uint8_t count();
+
+    bool canHandle(AsyncWebServerRequest* request) override;
+    void handleRequest(AsyncWebServerRequest* request) override;
+
+private:
+    friend class EventStreamResponse;
+
+    struct Client {
+        AsyncClient* tcp;        // nullptr = free slot
+        bool attached;           // Headers acknowledged, the stream owns the connection
+        bool closing;
+        SseSubscriber delivery;
+    };
+
+    const char* url;
+    SemaphoreHandle_t mutex = NULL; // Recursive: closing a client calls back into detach()
+    Client clients[SSE_MAX_CLIENTS];
+    String message;                 // Latest event, formatted
+    uint32_t version = 0;
+
+    void attach(AsyncWebServerRequest* request, uint8_t slot);
+    void release(uint8_t slot);
+    void detach(AsyncClient* tcp);
+    void onAck(AsyncClient* tcp, size_t len);
+    bool trySend(Client& client);
+    uint8_t attachedCount();
+};
+
+#endif // EVENT_STREAM_H
@@ -13,7 +13,10 @@ enum MessageType {
     RELAY_REQUEST,
     SYNC_COMMAND,
     REQUEST_PUMP_ON,
-    REQUEST_PUMP_OFF
+    REQUEST_PUMP_OFF,
+    BEACON,
+    METRICS_DIGEST,
+    DIAGNOSTICS
 };
 
 enum NodeRole {
@@ -30,64 +33,231 @@ enum CommandType {
     CMD_SET_MODE_MANUAL
 };
 
+// --- Résumé des métriques d'un noeud (compteurs cumulés depuis la mise sous tension) ---
+struct MetricsDigest {
+    uint32_t uptimeS;
+    uint32_t rxFrames;
+    uint32_t txFrames;
+    uint32_t decryptFailures;
+    uint32_t parseFailures;
+    uint32_t ackTimeouts;
+    uint32_t ackRetries;
+    uint32_t commandFailures;
+    uint32_t heapMin;
+    uint32_t ackLatencyAvgMs;
+};
+
+// --- Diagnostic mémoire et CPU d'un noeud (profileur) ---
+#define DIAG_TASK_NAME_LEN 13 // Nom tronqué pour tenir dans une trame
+
+struct NodeDiagnostics {
+    uint32_t heapFree;
+    uint32_t heapMin;
+    uint32_t heapLargest;           // Plus grand bloc allouable : la fragmentation se lit contre heapFree
+    char worstTask[DIAG_TASK_NAME_LEN]; // Tâche avec le moins de pile restante
+    uint32_t worstStackFree;        // Octets
+    uint8_t cpuBusyPct;             // 100 - tâches idle, deux coeurs confondus
+};
+
+// --- Défauts détectés par un puits sur sa pompe ("ft") ---
+// La pompe est arrêtée et verrouillée par le puits, qui le signale aussitôt.
+enum PumpFaultCode {
+    PUMP_FAULT_NONE,
+    PUMP_FAULT_NO_FLOW,     // Pompe en marche sans débit (débitmètre)
+    PUMP_FAULT_DRY_RUN,     // Courant moteur trop faible : marche à sec
+    PUMP_FAULT_OVERLOAD,    // Courant moteur trop fort : surcharge
+    PUMP_FAULT_LOCKED_ROTOR // Courant de démarrage qui persiste : rotor bloqué
+};
+
+// --- Mesures d'un puits : débitmètre, courant moteur, défaut ---
+struct PumpReport {
+    int32_t flowLph;    // Débit, L/h ; -1 : pas de débitmètre
+    uint32_t volumeL;   // Volume total pompé, L
+    int32_t currentMa;  // Courant moteur efficace, mA ; -1 : pas de capteur
+    uint8_t fault;      // PumpFaultCode
+};
+
 // --- Structure de base d'un message ---
 // Note: L'utilisation de templates ou de classes plus complexes est évitée
 // pour rester simple et compatible avec les contraintes mémoire de l'ESP32.
 
 class LoRaMessage {
 public:
+    // --- Traçage de latence ---
+    // "tr" : identifiant choisi par le réservoir à l'origine de la commande, repris à chaque saut.
+    // "d" : durées mesurées localement par l'émetteur, en ms (d0 < 0 : aucune).
+    static void addTrace(JsonDocument& doc, uint16_t traceId, int32_t d0, int32_t d1) {
+        if (traceId == 0) return;
+        doc["tr"] = traceId;
+        if (d0 < 0) return;
+        JsonArray d = doc.createNestedArray("d");
+        d.add(d0);
+        d.add(d1);
+    }
+
     // --- Sérialisation d'un message de découverte ---
-    static String serializeDiscovery(const char* deviceId, NodeRole role) {
+    // rxWindowMs > 0 : noeud sur batterie, joignable seulement pendant cette fenêtre après chacune de ses émissions.
+    // pingSlots : noeud synchronisé sur les balises, joignable seulement pendant ses créneaux de réception.
+    static String serializeDiscovery(const char* deviceId, NodeRole role, uint16_t rxWindowMs = 0, bool pingSlots = false) {
         StaticJsonDocument<128> doc;
         doc["type"] = MessageType::DISCOVERY;
         doc["id"] = deviceId;
         doc["role"] = role;
+        if (rxWindowMs > 0) doc["rxw"] = rxWindowMs;
+        if (pingSlots) doc["ps"] = 1;
+        String output;
+        serializeJson(doc, output);
+        return output;
+    }
+
+    // --- Sérialisation d'une balise de synchronisation ---
+    static String serializeBeacon(uint32_t seq) {
+        StaticJsonDocument<64> doc;
+        doc["type"] = MessageType::BEACON;
+        doc["seq"] = seq;
         String output;
         serializeJson(doc, output);
         return output;
     }
 
     // --- Sérialisation d'une commande ---
-    static String serializeCommand(const char* sourceId, const char* targetId, CommandType cmd) {
+    // Depuis un réservoir, d = [anti-rebond, contrôle] ; depuis la Centrale, "tr" seul.
+    static String serializeCommand(const char* sourceId, const char* targetId, CommandType cmd, uint16_t traceId = 0, int32_t d0 = -1, int32_t d1 = -1) {
         StaticJsonDocument<256> doc;
         doc["type"] = MessageType::COMMAND;
         doc["src"] = sourceId;
         doc["tgt"] = targetId;
         doc["cmd"] = cmd;
+        addTrace(doc, traceId, d0, d1);
         String output;
         serializeJson(doc, output);
         return output;
     }
 
     // --- Sérialisation d'un ACK de commande ---
-     static String serializeCommandAck(const char* sourceId, const char* targetId, bool success) {
+    // d = [réception -> relais commuté, réception -> émission de l'ACK]
+    // "pg" : commande retenue par la protection de la pompe (PumpHold), "eta" : secondes avant son application.
+    // "fl" : débit en L/h (puits avec débitmètre, flowLph >= 0). Le volume n'y tient pas : il suit dans le statut.
+     static String serializeCommandAck(const char* sourceId, const char* targetId, bool success, uint16_t traceId = 0, int32_t d0 = -1, int32_t d1 = -1,
+                                       uint8_t hold = 0, uint32_t etaS = 0, int32_t flowLph = -1) {
         StaticJsonDocument<256> doc;
         doc["type"] = MessageType::COMMAND_ACK;
         doc["src"] = sourceId;
         doc["tgt"] = targetId;
         doc["success"] = success;
+        addTrace(doc, traceId, d0, d1);
+        if (hold != 0) {
+            doc["pg"] = hold;
+            doc["eta"] = etaS;
+        }
+        if (flowLph >= 0) doc["fl"] = flowLph;
         String output;
         serializeJson(doc, output);
         return output;
     }
 
     // --- Sérialisation d'une mise à jour de statut ---
-    static String serializeStatusUpdate(const char* deviceId, const char* status, int rssi) {
+    // "lv" : niveau mesuré en ‰ (0 à 1000), absent avec des flotteurs ou en défaut capteur.
+    // "fl", "vol" : débit (L/h) et volume total (L) d'un puits avec débitmètre ; "ia" : courant moteur (mA)
+    // d'un puits avec capteur de courant ; "ft" : défaut (PumpFaultCode, absent si aucun).
+    static String serializeStatusUpdate(const char* deviceId, const char* status, int rssi, uint16_t rxWindowMs = 0, bool pingSlots = false,
+                                        int16_t levelPermille = -1, const PumpReport* pump = nullptr) {
         StaticJsonDocument<256> doc;
         doc["type"] = MessageType::STATUS_UPDATE;
         doc["id"] = deviceId;
         doc["status"] = status;
         doc["rssi"] = rssi;
+        if (rxWindowMs > 0) doc["rxw"] = rxWindowMs;
+        if (pingSlots) doc["ps"] = 1;
+        if (levelPermille >= 0) doc["lv"] = levelPermille;
+        if (pump != nullptr) {
+            if (pump->flowLph >= 0) {
+                doc["fl"] = pump->flowLph;
+                doc["vol"] = pump->volumeL;
+            }
+            if (pump->currentMa >= 0) doc["ia"] = pump->currentMa;
+            if (pump->fault != PUMP_FAULT_NONE) doc["ft"] = pump->fault;
+        }
+        String output;
+        serializeJson(doc, output);
+        return output;
+    }
+
+    // --- Sérialisation d'un résumé de métriques ---
+    // Tableau "m" dans l'ordre de MetricsDigest : le message chiffré doit tenir dans une trame
+    // (moins de 112 caractères en clair).
+    static String serializeMetricsDigest(const char* deviceId, const MetricsDigest& digest) {
+        StaticJsonDocument<256> doc;
+        doc["type"] = MessageType::METRICS_DIGEST;
+        doc["id"] = deviceId;
+        JsonArray m = doc.createNestedArray("m");
+        m.add(digest.uptimeS);
+        m.add(digest.rxFrames);
+        m.add(digest.txFrames);
+        m.add(digest.decryptFailures);
+        m.add(digest.parseFailures);
+        m.add(digest.ackTimeouts);
+        m.add(digest.ackRetries);
+        m.add(digest.commandFailures);
+        m.add(digest.heapMin);
+        m.add(digest.ackLatencyAvgMs);
         String output;
         serializeJson(doc, output);
         return output;
     }
 
+    static bool deserializeMetricsDigest(JsonVariantConst m, MetricsDigest& digest) {
+        if (!m.is<JsonArrayConst>() || m.size() < 10) return false;
+        digest.uptimeS = m[0];
+        digest.rxFrames = m[1];
+        digest.txFrames = m[2];
+        digest.decryptFailures = m[3];
+        digest.parseFailures = m[4];
+        digest.ackTimeouts = m[5];
+        digest.ackRetries = m[6];
+        digest.commandFailures = m[7];
+        digest.heapMin = m[8];
+        digest.ackLatencyAvgMs = m[9];
+        return true;
+    }
+
+    // --- Sérialisation d'un diagnostic ---
+    // Moins de 112 caractères en clair avec un nom de tâche de 12 caractères.
+    static String serializeDiagnostics(const char* deviceId, const NodeDiagnostics& diag) {
+        StaticJsonDocument<256> doc;
+        doc["type"] = MessageType::DIAGNOSTICS;
+        doc["id"] = deviceId;
+        JsonArray h = doc.createNestedArray("h");
+        h.add(diag.heapFree);
+        h.add(diag.heapMin);
+        h.add(diag.heapLargest);
+        doc["w"] = diag.worstTask;
+        doc["ws"] = diag.worstStackFree;
+        doc["cpu"] = diag.cpuBusyPct;
+        String output;
+        serializeJson(doc, output);
+        return output;
+    }
+
+    static bool deserializeDiagnostics(const JsonDocument& doc, NodeDiagnostics& diag) {
+        JsonArrayConst h = doc["h"];
+        if (h.isNull() || h.size() < 3) return false;
+        diag.heapFree = h[0];
+        diag.heapMin = h[1];
+        diag.heapLargest = h[2];
+        snprintf(diag.worstTask, sizeof(diag.worstTask), "%s", doc["w"] | "");
+        diag.worstStackFree = doc["ws"] | 0;
+        diag.cpuBusyPct = doc["cpu"] | 0;
+        return true;
+    }
+
     // --- Sérialisation d'une requête de pompe ---
-    static String serializePumpRequest(const char* sourceId, MessageType requestType) {
+    // d = [anti-rebond, contrôle]
+    static String serializePumpRequest(const char* sourceId, MessageType requestType, uint16_t traceId = 0, int32_t d0 = -1, int32_t d1 = -1) {
         StaticJsonDocument<128> doc;
         doc["type"] = requestType; // REQUEST_PUMP_ON ou REQUEST_PUMP_OFF
         doc["src"] = sourceId;
+        addTrace(doc, traceId, d0, d1);
         String output;
         serializeJson(doc, output);
         return output;
@@ -0,0 +1,299 @@
+#include "ModbusServer.h"
+#include "Message.h"
+#include "Metrics.h"
+#include "Profiler.h"
+#include "TimeSeriesStore.h"
+
+// Function codes
+#define MB_READ_COILS          0x01
+#define MB_READ_HOLDING        0x03
+#define MB_READ_INPUT          0x04
+#define MB_WRITE_COIL          0x05
+#define MB_WRITE_COILS         0x0F
+
+// Exception codes
+#define MB_ILLEGAL_FUNCTION    0x01
+#define MB_ILLEGAL_ADDRESS     0x02
+#define MB_ILLEGAL_VALUE       0x03
+#define MB_BUSY                0x06
+
+#define MBAP_LEN               7
+#define MODBUS_READ_ATTEMPTS   4  // Image copies before answering busy
+
+static uint16_t be16(const uint8_t* p) {
+    return ((uint16_t)p[0] << 8) | p[1];
+}
+
+static void putBe16(uint8_t* p, uint16_t value) {
+    p[0] = value >> 8;
+    p[1] = value & 0xFF;
+}
+
+static size_t exception(uint8_t* reply, uint8_t function, uint8_t code) {
+    Metrics::inc(MC_MODBUS_EXCEPTIONS);
+    reply[0] = function | 0x80;
+    reply[1] = code;
+    return 2;
+}
+
+static uint16_t pumpState(const WsNodeRecord& record) {
+    if (strcmp(record.status, "ON") == 0) return 1;
+    if (strcmp(record.status, "OFF") == 0) return 0;
+    return 2;
+}
+
+ModbusServer::ModbusServer() : server(MODBUS_PORT), sequence(0), clientCount(0) {
+    memset(&image, 0, sizeof(image));
+    memset(clients, 0, sizeof(clients));
+}
+
+void ModbusServer::begin(SnapshotProvider snapshot, PumpHandler onPump, void* context) {
+    this->snapshot = snapshot;
+    this->onPump = onPump;
+    this->context = context;
+    commands = xQueueCreate(MODBUS_COMMAND_QUEUE_LEN, sizeof(Command));
+    xTaskCreate(Task_Modbus, "Modbus", Profiler::stackSize("Modbus", 4096), this, 1, NULL);
+
+    server.onClient([](void* arg, AsyncClient* c) {
+        ((ModbusServer*)arg)->onConnect(c);
+    }, this);
+    server.setNoDelay(true);
+    server.begin();
+    Serial.printf("Modbus TCP server listening on port %u\n", MODBUS_PORT);
+}
+
+// --- Async TCP task ---
+
+void ModbusServer::onConnect(AsyncClient* tcp) {
+    tcp->onDisconnect([](void* arg, AsyncClient* c) {
+        ((ModbusServer*)arg)->onDisconnect(c);
+        delete c;
+    }, this);
+
+    Client* client = nullptr;
+    for (uint8_t i = 0; i < MODBUS_MAX_CLIENTS; i++) {
+        if (clients[i].tcp == nullptr) {
+            client = &clients[i];
+            break;
+        }
+    }
+    if (client == nullptr) {
+        Metrics::inc(MC_MODBUS_REJECTED);
+        tcp->close(true);
+        return;
+    }
+    client->tcp = tcp;
+    client->rxLen = 0;
+    Metrics::setGauge(MG_MODBUS_CLIENTS, ++clientCount);
+
+    tcp->setRxTimeout(MODBUS_IDLE_TIMEOUT_S);
+    tcp->onTimeout([](void* arg, AsyncClient* c, uint32_t time) {
+        c->close(true);
+    }, this);
+    tcp->onData([](void* arg, AsyncClient* c, void* data, size_t len) {
+        ((ModbusServer*)arg)->onData(c, (const uint8_t*)data, len);
+    }, this);
+
+    // The image is only kept up to date while someone polls it.
+    Command wake = { MODBUS_WAKE, false };
+    xQueueSend(commands, &wake, 0);
+}
+
+void ModbusServer::onDisconnect(AsyncClient* tcp) {
+    for (uint8_t i = 0; i < MODBUS_MAX_CLIENTS; i++) {
+        if (clients[i].tcp == tcp) {
+            clients[i].tcp = nullptr;
+            Metrics::setGauge(MG_MODBUS_CLIENTS, --clientCount);
+        }
+    }
+}
+
+// Frames may arrive split or several per segment: they are reassembled from the
+// MBAP length field.
+void ModbusServer::onData(AsyncClient* tcp, const uint8_t* data, size_t len) {
+    Client* client = nullptr;
+    for (uint8_t i = 0; i < MODBUS_MAX_CLIENTS; i++) {
+        if (clients[i].tcp == tcp) client = &clients[i];
+    }
+    if (client == nullptr) return;
+
+    while (len > 0) {
+        size_t take = min(len, (size_t)(MODBUS_FRAME_MAX - client->rxLen));
+        memcpy(client->rx + client->rxLen, data, take);
+        client->rxLen += take;
+        data += take;
+        len -= take;
+
+        while (client->rxLen >= MBAP_LEN) {
+            size_t frameLen = 6 + be16(client->rx + 4);
+            if (be16(client->rx + 2) != 0 || frameLen < MBAP_LEN + 1 || frameLen > MODBUS_FRAME_MAX) {
+                tcp->close(true); // Not Modbus TCP, nothing to resynchronise on
+                return;
+            }
+            if (client->rxLen < frameLen) break;
+
+            Metrics::inc(MC_MODBUS_REQUESTS);
+            uint8_t reply[MODBUS_FRAME_MAX];
+            memcpy(reply, client->rx, MBAP_LEN); // Transaction, protocol and unit echoed
+            size_t pduLen = handleRequest(client->rx + MBAP_LEN, frameLen - MBAP_LEN, reply + MBAP_LEN);
+            putBe16(reply + 4, pduLen + 1);
+            tcp->write((const char*)reply, MBAP_LEN + pduLen);
+
+            client->rxLen -= frameLen;
+            memmove(client->rx, client->rx + frameLen, client->rxLen);
+        }
+    }
+}
+
+// Returns the length of the reply PDU.
+size_t ModbusServer::handleRequest(const uint8_t* pdu, size_t len, uint8_t* reply) {
+    uint8_t function = pdu[0];
+    Image current;
+
+    switch (function) {
+        case MB_READ_HOLDING:
+        case MB_READ_INPUT: {
+            if (len != 5) return exception(reply, function, MB_ILLEGAL_VALUE);
+            uint16_t first = be16(pdu + 1);
+            uint16_t count = be16(pdu + 3);
+            if (count == 0 || count > 125) return exception(reply, function, MB_ILLEGAL_VALUE);
+            if (first + count > MODBUS_REGISTERS) return exception(reply, function, MB_ILLEGAL_ADDRESS);
+            if (!readImage(current)) return exception(reply, function, MB_BUSY);
+            reply[0] = function;
+            reply[1] = count * 2;
+            for (uint16_t i = 0; i < count; i++) putBe16(reply + 2 + i * 2, current.registers[first + i]);
+            return 2 + count * 2;
+        }
+        case MB_READ_COILS: {
+            if (len != 5) return exception(reply, function, MB_ILLEGAL_VALUE);
+            uint16_t first = be16(pdu + 1);
+            uint16_t count = be16(pdu + 3);
+            if (count == 0 || count > 2000) return exception(reply, function, MB_ILLEGAL_VALUE);
+            if (first + count > WS_MAX_NODES) return exception(reply, function, MB_ILLEGAL_ADDRESS);
+            if (!readImage(current)) return exception(reply, function, MB_BUSY);
+            uint8_t bytes = (count + 7) / 8;
+            reply[0] = function;
+            reply[1] = bytes;
+            memset(reply + 2, 0, bytes);
+            for (uint16_t i = 0; i < count; i++) {
+                if (current.coils & (1 << (first + i))) reply[2 + i / 8] |= 1 << (i % 8);
+            }
+            return 2 + bytes;
+        }
+        case MB_WRITE_COIL:
+        case MB_WRITE_COILS: {
+            if (!MODBUS_COILS_WRITABLE) return exception(reply, function, MB_ILLEGAL_FUNCTION);
+            uint16_t first = be16(pdu + 1);
+            uint16_t count;
+            uint8_t values[2] = { 0, 0 };
+            if (function == MB_WRITE_COIL) {
+                uint16_t value = be16(pdu + 3);
+                if (len != 5 || (value != 0xFF00 && value != 0x0000)) return exception(reply, function, MB_ILLEGAL_VALUE);
+                count = 1;
+                values[0] = value == 0xFF00 ? 1 : 0;
+            } else {
+                count = be16(pdu + 3);
+                if (len < 6 || count == 0 || count > 0x7B0 || pdu[5] != (count + 7) / 8 || len != 6u + pdu[5]) {
+                    return exception(reply, function, MB_ILLEGAL_VALUE);
+                }
+                if (first + count <= WS_MAX_NODES) memcpy(values, pdu + 6, pdu[5]);
+            }
+            if (first + count > WS_MAX_NODES) return exception(reply, function, MB_ILLEGAL_ADDRESS);
+            if (!readImage(current)) return exception(reply, function, MB_BUSY);
+            uint16_t targets = ((1u << count) - 1) << first;
+            if ((current.writable & targets) != targets) return exception(reply, function, MB_ILLEGAL_ADDRESS);
+            if (!queueCommands(first, count, values)) return exception(reply, function, MB_BUSY);
+            memcpy(reply, pdu, 5); // Both replies echo function, address and value / count
+            return 5;
+        }
+        default:
+            return exception(reply, function, MB_ILLEGAL_FUNCTION);
+    }
+}
+
+// Copies the image without locking. A copy taken while the server task was
+// rewriting it may be torn: the sequence tells, and it is taken again.
+bool ModbusServer::readImage(Image& out) {
+    for (uint8_t attempt = 0; attempt < MODBUS_READ_ATTEMPTS; attempt++) {
+        if (attempt > 0) {
+            Metrics::inc(MC_MODBUS_IMAGE_RETRIES);
+            vTaskDelay(1); // The writer may run on this core, below us
+        }
+        uint32_t before = sequence.load(std::memory_order_acquire);
+        if (before & 1) continue;
+        memcpy(&out, &image, sizeof(Image));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence.load(std::memory_order_relaxed) == before) return true;
+    }
+    return false;
+}
+
+// All or nothing, so a multiple-coil write is never half applied.
+bool ModbusServer::queueCommands(uint16_t first, uint16_t count, const uint8_t* values) {
+    if (uxQueueSpacesAvailable(commands) < count) return false;
+    for (uint16_t i = 0; i < count; i++) {
+        Command command = { (uint8_t)(first + i), (values[i / 8] & (1 << (i % 8))) != 0 };
+        xQueueSend(commands, &command, 0);
+    }
+    return true;
+}
+
+// --- Server task ---
+
+void ModbusServer::refresh() {
+    recordCount = snapshot(records, WS_MAX_NODES, context);
+    memset(&staging, 0, sizeof(staging));
+    uint32_t now = millis();
+    uint32_t uptime = now / 1000;
+    staging.registers[0] = MODBUS_MAP_VERSION;
+    staging.registers[1] = recordCount;
+    staging.registers[2] = uptime >> 16;
+    staging.registers[3] = uptime & 0xFFFF;
+    staging.registers[4] = image.registers[4] + 1; // Only this task writes the image
+
+    for (uint8_t i = 0; i < recordCount; i++) {
+        const WsNodeRecord& record = records[i];
+        uint16_t* regs = staging.registers + MODBUS_NODE_BASE + i * MODBUS_NODE_REGS;
+        int assigned = -1;
+        for (uint8_t j = 0; j < recordCount && record.assignedTo[0] != '\0'; j++) {
+            if (strcmp(records[j].id, record.assignedTo) == 0) assigned = j;
+        }
+
+        regs[MBR_ROLE] = record.role;
+        regs[MBR_STATUS] = TimeSeriesStore::valueFromStatus(record.status);
+        if (record.role == ROLE_WELLGUARD_PRO) {
+            regs[MBR_PUMP] = pumpState(record);
+        } else if (record.role == ROLE_AQUA_RESERV_PRO) {
+            regs[MBR_PUMP] = assigned >= 0 ? pumpState(records[assigned]) : 2;
+            staging.writable |= 1 << i;
+        }
+        if (regs[MBR_PUMP] == 1) staging.coils |= 1 << i;
+        regs[MBR_RSSI] = (uint16_t)record.rssi;
+        regs[MBR_AGE_S] = min((now - record.lastSeen) / 1000, (uint32_t)0xFFFF);
+        regs[MBR_ASSIGNED] = assigned + 1;
+        for (uint8_t k = 0; k < 12 && record.id[k] != '\0'; k++) {
+            regs[MBR_ID + k / 2] |= (uint8_t)record.id[k] << (k % 2 ? 0 : 8);
+        }
+    }
+
+    uint32_t seq = sequence.load(std::memory_order_relaxed);
+    sequence.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(&image, &staging, sizeof(Image));
+    sequence.store(seq + 2, std::memory_order_release);
+}
+
+// Pump commands are executed here, never on the async TCP task: arbitration
+// waits for the node list.
+void ModbusServer::Task_Modbus(void* pvParameters) {
+    ModbusServer* self = (ModbusServer*)pvParameters;
+    for (;;) {
+        Command command;
+        TickType_t wait = self->clientCount > 0 ? pdMS_TO_TICKS(MODBUS_REFRESH_MS) : portMAX_DELAY;
+        if (xQueueReceive(self->commands, &command, wait) == pdPASS && command.slot < self->recordCount &&
+            self->records[command.slot].role == ROLE_AQUA_RESERV_PRO) {
+            self->onPump(self->records[command.slot].id, command.on, self->context);
+        }
+        self->refresh();
+    }
+}
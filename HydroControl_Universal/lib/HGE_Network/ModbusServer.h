@@ -0,0 +1,108 @@
+#ifndef MODBUS_SERVER_H
+#define MODBUS_SERVER_H
+
+#include <Arduino.h>
+#include <AsyncTCP.h>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include "DashboardSocket.h"
+#include "config.h"
+
+#define MODBUS_MAP_VERSION   1
+#define MODBUS_NODE_BASE     16  // First register of node slot 0
+#define MODBUS_NODE_REGS     16  // Registers per node slot
+#define MODBUS_REGISTERS     (MODBUS_NODE_BASE + WS_MAX_NODES * MODBUS_NODE_REGS)
+#define MODBUS_FRAME_MAX     260 // MBAP header + largest PDU
+#define MODBUS_WAKE          0xFF
+
+static_assert(WS_MAX_NODES <= 16, "one coil bit per node slot");
+
+// Node slot registers, from MODBUS_NODE_BASE + slot * MODBUS_NODE_REGS
+enum ModbusNodeRegister : uint8_t {
+    MBR_ROLE       = 0,  // NodeRole, 0 = free slot
+    MBR_STATUS     = 1,  // TS_VALUE_* (level for reservoirs, pump for wells)
+    MBR_PUMP       = 2,  // 0 off, 1 on, 2 unknown; a reservoir shows its well's pump
+    MBR_RSSI       = 3,  // dBm, signed
+    MBR_AGE_S      = 4,  // Seconds since the node was last heard, saturates at 65535
+    MBR_ASSIGNED   = 5,  // Slot of the assigned well + 1, 0 = none
+    MBR_ID         = 6,  // 6 registers: node ID in ASCII, 2 characters per register
+};
+
+// Modbus TCP server of the Centrale, for PLC and SCADA polling (port MODBUS_PORT).
+//
+//   0x03 / 0x04  Read holding / input registers: the same read-only image
+//                  0   MODBUS_MAP_VERSION      2-3  uptime (s, high word first)
+//                  1   node slots in use       4    image sequence (wraps)
+//                  MODBUS_NODE_BASE + slot * MODBUS_NODE_REGS: ModbusNodeRegister
+//   0x01         Read coils: coil <slot> = 1 when MBR_PUMP is 1
+//   0x05 / 0x0F  Write coils: pump request from reservoir <slot>, arbitrated
+//                like a LoRa request. The reply only means the request was
+//                queued; the coil follows once the well reports its state.
+//
+// Slots are the Centrale's registry order, so a node keeps its addresses until
+// the registry is reset. The unit ID is ignored and echoed.
+//
+// Requests are answered on the async TCP task from a register image that the
+// server task rebuilds every MODBUS_REFRESH_MS while a client is connected. The
+// image is published with a sequence lock: readers never wait for the writer or
+// the node list, they copy it again if it changed under them (exception 0x06
+// if it keeps changing).
+class ModbusServer {
+public:
+    // Both run on the server task.
+    typedef uint8_t (*SnapshotProvider)(WsNodeRecord* records, uint8_t max, void* context);
+    typedef void (*PumpHandler)(const char* reservoirId, bool on, void* context);
+
+    ModbusServer();
+
+    void begin(SnapshotProvider snapshot, PumpHandler onPump, void* context);
+
+private:
+    struct Image {
+        uint16_t registers[MODBUS_REGISTERS];
+        uint16_t coils;      // Bit <slot>: pump on
+        uint16_t writable;   // Bit <slot>: reservoir
+    };
+
+    struct Client {
+        AsyncClient* tcp;    // nullptr = free slot
+        uint8_t rx[MODBUS_FRAME_MAX];
+        uint16_t rxLen;
+    };
+
+    struct Command {
+        uint8_t slot;        // MODBUS_WAKE: refresh only
+        bool on;
+    };
+
+    AsyncServer server;
+    SnapshotProvider snapshot = nullptr;
+    PumpHandler onPump = nullptr;
+    void* context = nullptr;
+    QueueHandle_t commands = NULL;
+
+    // Sequence lock: odd while the server task rewrites the image
+    std::atomic<uint32_t> sequence;
+    Image image;
+    std::atomic<uint8_t> clientCount;
+
+    // Async TCP task only
+    Client clients[MODBUS_MAX_CLIENTS];
+
+    // Server task only
+    WsNodeRecord records[WS_MAX_NODES];
+    uint8_t recordCount = 0;
+    Image staging;
+
+    void onConnect(AsyncClient* tcp);
+    void onDisconnect(AsyncClient* tcp);
+    void onData(AsyncClient* tcp, const uint8_t* data, size_t len);
+    size_t handleRequest(const uint8_t* pdu, size_t len, uint8_t* reply);
+    bool readImage(Image& out);
+    void refresh();
+    bool queueCommands(uint16_t first, uint16_t count, const uint8_t* values);
+    static void Task_Modbus(void* pvParameters);
+};
+
+#endif // MODBUS_SERVER_H
@@ -0,0 +1,249 @@
+#include "MqttBridge.h"
+#include <rom/crc.h>
+#include "Clock.h"
+#include "Metrics.h"
+#include "Profiler.h"
+
+#define MQTT_REPLAY_BLOCK 8 // Spooled events read from flash per block
+
+MqttBridge::MqttBridge() : client(net) {
+    root[0] = '\0';
+    memset(publishedCrc, 0, sizeof(publishedCrc));
+}
+
+bool MqttBridge::begin(const String& host, uint16_t port, const String& user, const String& password,
+                       const String& deviceId, SnapshotProvider snapshot, CommandHandler onCommand, void* context) {
+    this->host = host;
+    this->port = port;
+    this->user = user;
+    this->password = password;
+    this->snapshot = snapshot;
+    this->onCommand = onCommand;
+    this->context = context;
+    snprintf(root, sizeof(root), "%s/%s", MQTT_TOPIC_ROOT, deviceId.c_str());
+
+    spoolMutex = xSemaphoreCreateMutex();
+    spool.init(MQTT_SPOOL_DIR, sizeof(Event), MQTT_SPOOL_SEGMENTS, MQTT_SPOOL_SEGMENT_RECORDS);
+    spool.scan();
+    if (spool.recordCount() > 0) {
+        Serial.printf("MQTT: %u events spooled from a previous run.\n", (unsigned)spool.recordCount());
+    }
+
+    events = xQueueCreate(MQTT_EVENT_QUEUE_LEN, sizeof(Event));
+    client.setServer(this->host.c_str(), port);
+    client.setBufferSize(MQTT_BUFFER_SIZE);
+    client.setKeepAlive(MQTT_KEEPALIVE_S);
+    client.setCallback([this](char* topic, uint8_t* payload, unsigned int len) {
+        onMessage(topic, payload, len);
+    });
+    xTaskCreate(Task_Mqtt, "Mqtt", Profiler::stackSize("Mqtt", 6144), this, 1, NULL);
+    return true;
+}
+
+void MqttBridge::postEvent(const char* kind, uint32_t timestamp, const char* json) {
+    if (events == NULL) return;
+    Event event;
+    memset(&event, 0, sizeof(event));
+    event.timestamp = timestamp;
+    strncpy(event.kind, kind, MQTT_KIND_LEN - 1);
+    strncpy(event.payload, json, MQTT_PAYLOAD_LEN - 1);
+    if (xQueueSend(events, &event, 0) != pdPASS) Metrics::inc(MC_MQTT_EVENTS_DROPPED);
+}
+
+void MqttBridge::topic(char* out, const char* suffix) {
+    snprintf(out, MQTT_TOPIC_LEN, "%s/%s", root, suffix);
+}
+
+bool MqttBridge::connect() {
+    char status[MQTT_TOPIC_LEN];
+    topic(status, "status");
+    char clientId[MQTT_TOPIC_LEN];
+    snprintf(clientId, sizeof(clientId), "%s", root);
+    for (char* c = clientId; *c; c++) {
+        if (*c == '/') *c = '-';
+    }
+    const char* login = user.length() > 0 ? user.c_str() : NULL;
+    const char* secret = user.length() > 0 ? password.c_str() : NULL;
+    if (!client.connect(clientId, login, secret, status, 1, true, "offline")) {
+        Serial.printf("MQTT: connection to %s:%u failed (state %d)\n", host.c_str(), port, client.state());
+        return false;
+    }
+    Metrics::inc(MC_MQTT_CONNECTS);
+    Serial.printf("MQTT: connected to %s:%u\n", host.c_str(), port);
+
+    char commands[MQTT_TOPIC_LEN];
+    topic(commands, "cmd/+");
+    client.publish(status, "online", true);
+    client.subscribe(commands, 1);
+
+    // The broker may have lost the retained states: send them all again, after
+    // the spooled events (see flush()).
+    memset(publishedCrc, 0, sizeof(publishedCrc));
+    pendingSinceMs = (millis() - MQTT_LINGER_MS) | 1;
+    return true;
+}
+
+// Picks up node changes and posted events.
+void MqttBridge::collect() {
+    memset(records, 0, sizeof(records)); // The CRC covers the padding and string tails
+    recordCount = snapshot(records, WS_MAX_NODES, context);
+    for (uint8_t i = 0; i < recordCount; i++) {
+        if (crc32_le(0, (const uint8_t*)&records[i], sizeof(WsNodeRecord)) != publishedCrc[i] && pendingSinceMs == 0) {
+            pendingSinceMs = millis() | 1;
+        }
+    }
+
+    Event event;
+    while (xQueueReceive(events, &event, 0) == pdPASS) {
+        if (!client.connected()) {
+            spoolEvents(&event, 1);
+            continue;
+        }
+        if (batchCount == MQTT_EVENT_QUEUE_LEN) flush();
+        if (batchCount == MQTT_EVENT_QUEUE_LEN) {
+            spoolEvents(&event, 1); // Broker stopped taking them
+            continue;
+        }
+        batch[batchCount++] = event;
+        if (pendingSinceMs == 0) pendingSinceMs = millis() | 1;
+    }
+}
+
+// One burst per linger period: with Nagle on, the small publishes share segments.
+// Spooled events go first, so events always reach the broker in order.
+void MqttBridge::flush() {
+    bool ok = spool.recordCount() == 0 || replaySpool();
+    for (uint8_t i = 0; i < recordCount && ok; i++) {
+        uint32_t crc = crc32_le(0, (const uint8_t*)&records[i], sizeof(WsNodeRecord));
+        if (crc == publishedCrc[i]) continue;
+        ok = publishNode(records[i]);
+        if (ok) publishedCrc[i] = crc;
+    }
+
+    uint8_t sent = 0;
+    while (ok && sent < batchCount) {
+        ok = publishEvent(batch[sent]);
+        if (ok) sent++;
+    }
+    if (sent < batchCount) spoolEvents(batch + sent, batchCount - sent);
+    batchCount = 0;
+    pendingSinceMs = 0;
+}
+
+bool MqttBridge::publishNode(const WsNodeRecord& record) {
+    bool synced;
+    uint32_t now = Clock::now(synced);
+    StaticJsonDocument<384> doc;
+    doc["id"] = record.id;
+    doc["name"] = record.name;
+    doc["type"] = record.role;
+    doc["rssi"] = record.rssi;
+    doc["status"] = record.status;
+    doc["lastSeen"] = now - (millis() - record.lastSeen) / 1000;
+    if (!synced) doc["uptime"] = true; // lastSeen in seconds since boot
+    doc["assignedTo"] = record.assignedTo;
+
+    char payload[MQTT_BUFFER_SIZE / 2];
+    size_t len = serializeJson(doc, payload, sizeof(payload));
+    char name[MQTT_TOPIC_LEN];
+    snprintf(name, sizeof(name), "%s/node/%s", root, record.id);
+    if (!client.publish(name, (const uint8_t*)payload, len, true)) return false;
+    Metrics::inc(MC_MQTT_PUBLISHED);
+    return true;
+}
+
+bool MqttBridge::publishEvent(const Event& event) {
+    char name[MQTT_TOPIC_LEN];
+    snprintf(name, sizeof(name), "%s/event/%s", root, event.kind);
+    if (!client.publish(name, event.payload)) return false;
+    Metrics::inc(MC_MQTT_PUBLISHED);
+    return true;
+}
+
+void MqttBridge::spoolEvents(const Event* pending, size_t count) {
+    xSemaphoreTake(spoolMutex, portMAX_DELAY);
+    size_t written = spool.append((const uint8_t*)pending, count);
+    xSemaphoreGive(spoolMutex);
+    Metrics::inc(MC_MQTT_SPOOLED, written);
+    if (written < count) Metrics::inc(MC_MQTT_EVENTS_DROPPED, count - written);
+}
+
+// Replays the spool oldest first and clears it once everything went out. If the
+// broker drops us halfway, the whole spool is replayed next time.
+bool MqttBridge::replaySpool() {
+    uint32_t sent = 0;
+    bool ok = true;
+    {
+        SegmentRing::Cursor cursor(&spool, spoolMutex, 0, UINT32_MAX, MQTT_REPLAY_BLOCK);
+        const uint8_t* record;
+        while (ok && (record = cursor.next()) != nullptr) {
+            Event event;
+            memcpy(&event, record, sizeof(event));
+            event.kind[MQTT_KIND_LEN - 1] = '\0';
+            event.payload[MQTT_PAYLOAD_LEN - 1] = '\0';
+            ok = publishEvent(event) && client.loop();
+            if (ok) sent++;
+        }
+    }
+    if (!ok) return false;
+    xSemaphoreTake(spoolMutex, portMAX_DELAY);
+    spool.clear();
+    xSemaphoreGive(spoolMutex);
+    Serial.printf("MQTT: %u spooled events replayed.\n", (unsigned)sent);
+    return true;
+}
+
+void MqttBridge::onMessage(char* name, uint8_t* payload, unsigned int len) {
+    // name is <root>/cmd/<command>
+    size_t rootLen = strlen(root);
+    if (strncmp(name, root, rootLen) != 0 || strncmp(name + rootLen, "/cmd/", 5) != 0) return;
+    const char* command = name + rootLen + 5;
+    Metrics::inc(MC_MQTT_COMMANDS);
+
+    StaticJsonDocument<256> doc;
+    const char* error = nullptr;
+    if (deserializeJson(doc, (const char*)payload, len) || !doc.is<JsonObject>()) {
+        error = "invalid JSON";
+    } else {
+        error = onCommand(command, doc.as<JsonObjectConst>(), context);
+    }
+
+    StaticJsonDocument<192> result;
+    result["ok"] = error == nullptr;
+    if (error != nullptr) result["error"] = error;
+    if (!doc["ref"].isNull()) result["ref"] = doc["ref"];
+    char body[160];
+    size_t bodyLen = serializeJson(result, body, sizeof(body));
+    char reply[MQTT_TOPIC_LEN];
+    snprintf(reply, sizeof(reply), "%s/result", name);
+    client.publish(reply, (const uint8_t*)body, bodyLen);
+}
+
+void MqttBridge::Task_Mqtt(void* pvParameters) {
+    MqttBridge* self = (MqttBridge*)pvParameters;
+    uint32_t lastAttemptMs = 0;
+    bool wasConnected = false;
+
+    for (;;) {
+        if (self->client.connected()) {
+            self->client.loop();
+        } else {
+            if (wasConnected) {
+                wasConnected = false;
+                Metrics::setGauge(MG_MQTT_CONNECTED, 0);
+                Serial.println("MQTT: connection lost, spooling events.");
+            }
+            if (WiFi.status() == WL_CONNECTED && (lastAttemptMs == 0 || millis() - lastAttemptMs >= MQTT_RECONNECT_MS)) {
+                lastAttemptMs = millis() | 1;
+                wasConnected = self->connect();
+                Metrics::setGauge(MG_MQTT_CONNECTED, wasConnected ? 1 : 0);
+            }
+        }
+
+        self->collect();
+        if (self->client.connected() && self->pendingSinceMs != 0 && millis() - self->pendingSinceMs >= MQTT_LINGER_MS) {
+            self->flush();
+        }
+        vTaskDelay(pdMS_TO_TICKS(MQTT_POLL_MS));
+    }
+}
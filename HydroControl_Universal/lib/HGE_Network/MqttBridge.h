@@ -0,0 +1,94 @@
+#ifndef MQTT_BRIDGE_H
+#define MQTT_BRIDGE_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <PubSubClient.h>
+#include <ArduinoJson.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include "DashboardSocket.h"
+#include "SegmentRing.h"
+#include "config.h"
+
+#define MQTT_SPOOL_DIR    "/mqtt"
+#define MQTT_KIND_LEN     16
+#define MQTT_PAYLOAD_LEN  220 // A journal event is ~190 bytes of JSON
+#define MQTT_TOPIC_LEN    64
+
+// Bridge from the Centrale to a plant MQTT broker. Topics, under
+// MQTT_TOPIC_ROOT/<centrale id>/:
+//
+//   status                "online" / "offline" (retained, offline is the will)
+//   node/<node id>        node state as JSON (retained)
+//   event/<kind>          one message per event, e.g. event/PUMP_REQUEST
+//   cmd/<command>         JSON commands, see CommandHandler
+//   cmd/<command>/result  {"ok":true} or {"ok":false,"error":"..."}, with the
+//                         command's "ref" echoed if it had one
+//
+// Node states are compared with what was last published and coalesced: changes
+// within MQTT_LINGER_MS go out together, a node only with its latest state.
+// Events are batched the same way. While the broker is unreachable events are
+// spooled to LittleFS (bounded ring, oldest dropped first) and replayed in order
+// on reconnection, so a consumer may see an event twice but never out of order;
+// node states are republished in full instead.
+//
+// Everything runs on one task; postEvent() is the only entry point for others.
+class MqttBridge {
+public:
+    // Runs on the bridge task. Returns nullptr on success, or a short error.
+    typedef const char* (*CommandHandler)(const char* command, JsonObjectConst args, void* context);
+    // Same records as the WebSocket API
+    typedef uint8_t (*SnapshotProvider)(WsNodeRecord* records, uint8_t max, void* context);
+
+    MqttBridge();
+
+    // Starts the bridge task; the broker is retried until it answers.
+    bool begin(const String& host, uint16_t port, const String& user, const String& password,
+               const String& deviceId, SnapshotProvider snapshot, CommandHandler onCommand, void* context);
+
+    // Any task, never blocks. Dropped (and counted) if the queue is full.
+    void postEvent(const char* kind, uint32_t timestamp, const char* json);
+
+private:
+    // Also the spool record: starts with the timestamp, as SegmentRing expects.
+    struct Event {
+        uint32_t timestamp;
+        char kind[MQTT_KIND_LEN];
+        char payload[MQTT_PAYLOAD_LEN];
+    } __attribute__((packed));
+
+    WiFiClient net;
+    PubSubClient client;
+    String host, user, password;
+    uint16_t port = 0;
+    char root[MQTT_TOPIC_LEN];      // MQTT_TOPIC_ROOT "/" deviceId
+    SnapshotProvider snapshot = nullptr;
+    CommandHandler onCommand = nullptr;
+    void* context = nullptr;
+    QueueHandle_t events = NULL;
+
+    // Bridge task only
+    WsNodeRecord records[WS_MAX_NODES];
+    uint32_t publishedCrc[WS_MAX_NODES]; // 0 = publish
+    uint8_t recordCount = 0;
+    Event batch[MQTT_EVENT_QUEUE_LEN];
+    uint8_t batchCount = 0;
+    uint32_t pendingSinceMs = 0;        // 0 = nothing waiting
+    SegmentRing spool;
+    SemaphoreHandle_t spoolMutex = NULL;
+
+    bool connect();
+    void collect();
+    void flush();
+    bool publishNode(const WsNodeRecord& record);
+    bool publishEvent(const Event& event);
+    void spoolEvents(const Event* events, size_t count);
+    bool replaySpool();
+    void onMessage(char* topic, uint8_t* payload, unsigned int len);
+    void topic(char* out, const char* suffix);
+    static void Task_Mqtt(void* pvParameters);
+};
+
+#endif // MQTT_BRIDGE_H
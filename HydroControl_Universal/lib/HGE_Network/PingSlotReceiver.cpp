@@ -0,0 +1,100 @@
+#include "PingSlotReceiver.h"
+#include <LoRa.h>
+#include "Profiler.h"
+#include "config.h"
+
+#define RADIO_SCHEDULER_TICK_MS 10
+
+void PingSlotReceiver::begin(const String& nodeId, SyncCallback callback) {
+    deviceId = nodeId;
+    onSyncChanged = callback;
+    config = RxSchedule::defaultConfig();
+    xTaskCreate(Task_Radio_Scheduler, "RadioScheduler", Profiler::stackSize("RadioScheduler", 3072), this, 3, NULL);
+}
+
+void PingSlotReceiver::onBeacon(uint32_t seq) {
+    heardBeaconAtMs = millis();
+    heardBeaconSeq = seq;
+    beaconHeard = true;
+}
+
+void PingSlotReceiver::beginTransmit() {
+    transmitting = true;
+}
+
+void PingSlotReceiver::endTransmit() {
+    // endPacket() leaves the radio in standby: listen for the answer, the scheduler closes it later.
+    rxHoldUntilMs = millis() + TX_RX_HOLD_MS;
+    LoRa.receive();
+    radioListening = true;
+    transmitting = false;
+}
+
+uint32_t PingSlotReceiver::msUntilSlotOf(const String& nodeId) const {
+    if (!synchronized) return 0;
+
+    uint32_t since = millis() - beaconAtMs;
+    uint32_t offset = RxSchedule::slotOffsetMs(config, nodeId.c_str(), beaconSeq);
+    uint32_t start = RxSchedule::nextSlotStartMs(config, offset, since);
+    if (start == RxSchedule::NO_SLOT) {
+        // First slot after the next beacon
+        offset = RxSchedule::slotOffsetMs(config, nodeId.c_str(), beaconSeq + 1);
+        start = config.beaconPeriodMs + RxSchedule::nextSlotStartMs(config, offset, 0);
+    }
+    // Aim a little after the slot opens, the target only starts listening on its next tick.
+    return start - since + PING_SLOT_TX_TOLERANCE_MS / 2;
+}
+
+void PingSlotReceiver::tick() {
+    uint32_t now = millis();
+
+    if (beaconHeard) {
+        beaconHeard = false;
+        beaconAtMs = heardBeaconAtMs;
+        beaconSeq = heardBeaconSeq;
+        missedBeacons = 0;
+        if (!synchronized) {
+            synchronized = true;
+            Serial.println("Beacon received, switching to scheduled receive slots.");
+            if (onSyncChanged) onSyncChanged(true);
+        }
+    }
+
+    bool listen = true;
+    if (synchronized) {
+        uint32_t since = now - beaconAtMs;
+        if (since > config.beaconPeriodMs + config.beaconGuardMs) {
+            // Expected beacon window closed without a beacon: keep the schedule running on our own clock.
+            beaconAtMs += config.beaconPeriodMs;
+            beaconSeq++;
+            since = now - beaconAtMs;
+            if (++missedBeacons > BEACON_LOSS_MAX) {
+                synchronized = false;
+                Serial.println("Beacons lost, back to continuous receive.");
+                if (onSyncChanged) onSyncChanged(false);
+            }
+        }
+        if (synchronized) {
+            uint32_t offset = RxSchedule::slotOffsetMs(config, deviceId.c_str(), beaconSeq);
+            listen = RxSchedule::isListening(config, offset, since);
+        }
+    }
+    if ((int32_t)(rxHoldUntilMs - now) > 0) listen = true;
+
+    if (!transmitting && listen != radioListening) {
+        if (listen) {
+            LoRa.receive();
+        } else {
+            LoRa.sleep();
+        }
+        radioListening = listen;
+    }
+}
+
+void PingSlotReceiver::Task_Radio_Scheduler(void *pvParameters) {
+    PingSlotReceiver* self = (PingSlotReceiver*)pvParameters;
+    for (;;) {
+        self->tick();
+        vTaskDelay(pdMS_TO_TICKS(RADIO_SCHEDULER_TICK_MS));
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef PING_SLOT_RECEIVER_H
+#define PING_SLOT_RECEIVER_H
+
+#include <Arduino.h>
+#include "RxSchedule.h"
+
+// Node side of the beacon schedule. Keeps the radio in continuous receive until a
+// beacon is heard, then only powers the receiver for the beacon windows, the node's
+// own ping slots and a short hold after each transmission. Falls back to continuous
+// receive after BEACON_LOSS_MAX missed beacons.
+class PingSlotReceiver {
+public:
+    typedef void (*SyncCallback)(bool synchronized);
+
+    void begin(const String& nodeId, SyncCallback onSyncChanged);
+
+    // Called from the LoRa receive callback (ISR context): only records the beacon.
+    void onBeacon(uint32_t seq);
+
+    bool isSynchronized() const { return synchronized; }
+
+    // Wrap every transmission, including those made from the receive callback.
+    void beginTransmit();
+    void endTransmit();
+
+    // Time to wait before transmitting to another slotted node, 0 when not synchronised.
+    uint32_t msUntilSlotOf(const String& nodeId) const;
+
+private:
+    String deviceId;
+    RxScheduleConfig config;
+    SyncCallback onSyncChanged = nullptr;
+
+    volatile bool synchronized = false;
+    volatile bool beaconHeard = false;
+    volatile uint32_t heardBeaconAtMs = 0;
+    volatile uint32_t heardBeaconSeq = 0;
+    volatile uint32_t beaconAtMs = 0;   // Reference of the current (possibly missed) beacon
+    volatile uint32_t beaconSeq = 0;
+    uint8_t missedBeacons = 0;
+
+    volatile bool transmitting = false;
+    volatile uint32_t rxHoldUntilMs = 0;
+    bool radioListening = true;
+
+    void tick();
+    static void Task_Radio_Scheduler(void *pvParameters);
+};
+
+#endif // PING_SLOT_RECEIVER_H
@@ -0,0 +1,119 @@
+#include "RxSchedule.h"
+#include "config.h"
+
+RxScheduleConfig RxSchedule::defaultConfig() {
+    RxScheduleConfig c;
+    c.beaconPeriodMs = BEACON_PERIOD_MS;
+    c.beaconGuardMs = BEACON_GUARD_MS;
+    c.beaconWindowMs = airtimeMs(LORA_BEACON_PAYLOAD_LEN, LORA_SPREADING_FACTOR, LORA_BANDWIDTH_HZ) + 2 * BEACON_GUARD_MS;
+    c.pingPeriodMs = PING_SLOT_PERIOD_MS;
+    c.slotLenMs = airtimeMs(LORA_MAX_PAYLOAD_LEN, LORA_SPREADING_FACTOR, LORA_BANDWIDTH_HZ) + 2 * PING_SLOT_TX_TOLERANCE_MS;
+    return c;
+}
+
+uint32_t RxSchedule::airtimeMs(uint16_t payloadLen, uint8_t spreadingFactor, uint32_t bandwidthHz) {
+    const int32_t sf = spreadingFactor;
+    const bool lowDataRateOptimize = (sf >= 11 && bandwidthHz <= 125000);
+    const int32_t de = lowDataRateOptimize ? 1 : 0;
+    const float symbolMs = (float)(1UL << sf) * 1000.0f / (float)bandwidthHz;
+
+    int32_t numerator = 8 * (int32_t)payloadLen - 4 * sf + 28 + 16;
+    int32_t denominator = 4 * (sf - 2 * de);
+    int32_t payloadSymbols = 8;
+    if (numerator > 0) {
+        payloadSymbols += ((numerator + denominator - 1) / denominator) * 5;
+    }
+    return (uint32_t)((8 + 4.25f + payloadSymbols) * symbolMs + 0.999f);
+}
+
+uint32_t RxSchedule::slotOffsetMs(const RxScheduleConfig& config, const char* nodeId, uint32_t beaconSeq) {
+    // FNV-1a over the node ID then the beacon sequence number
+    uint32_t hash = 2166136261u;
+    for (const char* p = nodeId; *p; p++) {
+        hash = (hash ^ (uint8_t)*p) * 16777619u;
+    }
+    for (int i = 0; i < 4; i++) {
+        hash = (hash ^ ((beaconSeq >> (8 * i)) & 0xFF)) * 16777619u;
+    }
+
+    // 10 ms granularity is far below the slot length and keeps offsets readable in logs.
+    uint32_t positions = (config.pingPeriodMs - config.slotLenMs) / 10 + 1;
+    return (hash % positions) * 10;
+}
+
+uint32_t RxSchedule::nextSlotStartMs(const RxScheduleConfig& config, uint32_t offsetMs, uint32_t sinceBeaconMs) {
+    const uint32_t firstSlot = config.beaconGuardMs + offsetMs;
+    const uint32_t lastSlotEnd = config.beaconPeriodMs - (config.beaconWindowMs - config.beaconGuardMs);
+
+    uint32_t start = firstSlot;
+    if (sinceBeaconMs > firstSlot) {
+        uint32_t k = (sinceBeaconMs - firstSlot + config.pingPeriodMs - 1) / config.pingPeriodMs;
+        start = firstSlot + k * config.pingPeriodMs;
+    }
+    return (start + config.slotLenMs <= lastSlotEnd) ? start : NO_SLOT;
+}
+
+bool RxSchedule::isListening(const RxScheduleConfig& config, uint32_t offsetMs, uint32_t sinceBeaconMs) {
+    // Tail of the current beacon window, and the head of the next one
+    if (sinceBeaconMs <= config.beaconGuardMs) return true;
+    if (sinceBeaconMs >= config.beaconPeriodMs - (config.beaconWindowMs - config.beaconGuardMs)) return true;
+
+    const uint32_t firstSlot = config.beaconGuardMs + offsetMs;
+    if (sinceBeaconMs < firstSlot) return false;
+    uint32_t intoPeriod = (sinceBeaconMs - firstSlot) % config.pingPeriodMs;
+    uint32_t slotStart = sinceBeaconMs - intoPeriod;
+    return intoPeriod < config.slotLenMs && nextSlotStartMs(config, offsetMs, slotStart) == slotStart;
+}
+
+RxSimulationResult RxSchedule::simulate(const RxScheduleConfig& config, uint32_t durationMs,
+                                        uint32_t meanCommandIntervalMs, uint32_t seed) {
+    RxSimulationResult result = {0, 0.0f, 0.0f, 0};
+    const char* nodeId = "SIMNODE";
+    uint32_t rng = seed ? seed : 1;
+    auto nextRandom = [&rng]() {
+        rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+        return rng;
+    };
+
+    uint32_t listeningMs = 0;
+    uint64_t latencySumMs = 0;
+    uint32_t nextCommandMs = nextRandom() % (2 * meanCommandIntervalMs + 1);
+    uint32_t pendingSinceMs = 0;
+    bool pending = false;
+    uint32_t beaconSeq = 0;
+    uint32_t beaconAtMs = 0;
+    uint32_t offsetMs = slotOffsetMs(config, nodeId, beaconSeq);
+
+    for (uint32_t now = 0; now < durationMs; now++) {
+        if (now - beaconAtMs >= config.beaconPeriodMs) {
+            beaconAtMs = now;
+            beaconSeq++;
+            offsetMs = slotOffsetMs(config, nodeId, beaconSeq);
+        }
+        uint32_t since = now - beaconAtMs;
+
+        if (now == nextCommandMs) {
+            // Commands queued behind a pending one leave in the same slot; the oldest sets the latency.
+            if (!pending) {
+                pending = true;
+                pendingSinceMs = now;
+            }
+            nextCommandMs = now + 1 + nextRandom() % (2 * meanCommandIntervalMs + 1);
+        }
+
+        // The Centrale transmits at the very start of the node's slot.
+        if (pending && nextSlotStartMs(config, offsetMs, since) == since && isListening(config, offsetMs, since)) {
+            uint32_t latency = now - pendingSinceMs;
+            latencySumMs += latency;
+            if (latency > result.maxLatencyMs) result.maxLatencyMs = latency;
+            result.commands++;
+            pending = false;
+        }
+
+        if (isListening(config, offsetMs, since)) listeningMs++;
+    }
+
+    result.radioOnRatio = durationMs ? (float)listeningMs / durationMs : 0.0f;
+    result.meanLatencyMs = result.commands ? (float)latencySumMs / result.commands : 0.0f;
+    return result;
+}
@@ -0,0 +1,54 @@
+#ifndef RX_SCHEDULE_H
+#define RX_SCHEDULE_H
+
+#include <stdint.h>
+
+// Timing of the beacon-synchronised receive windows. Every time is in ms relative
+// to the reference point of the current beacon, i.e. the end of its transmission.
+//
+//   [beacon window]  slot  ...  slot  ...  slot  [next beacon window]
+//   0 .. guard       guard + offset + k * pingPeriod
+//
+// Pure functions only: the Centrale, the nodes and the host simulator share them.
+struct RxScheduleConfig {
+    uint32_t beaconPeriodMs;
+    uint32_t beaconWindowMs;  // Receive window around each expected beacon
+    uint32_t beaconGuardMs;   // Part of that window after the expected beacon end
+    uint32_t pingPeriodMs;
+    uint32_t slotLenMs;       // Long enough for the largest frame sent at the slot start
+};
+
+struct RxSimulationResult {
+    uint32_t commands;
+    float radioOnRatio;       // Fraction of time the receiver is powered
+    float meanLatencyMs;      // Command generated at the Centrale -> transmission starts
+    uint32_t maxLatencyMs;
+};
+
+class RxSchedule {
+public:
+    static const uint32_t NO_SLOT = 0xFFFFFFFF;
+
+    static RxScheduleConfig defaultConfig();
+
+    // LoRa time on air (explicit header, CRC on, coding rate 4/5, 8 symbol preamble).
+    static uint32_t airtimeMs(uint16_t payloadLen, uint8_t spreadingFactor, uint32_t bandwidthHz);
+
+    // Offset of the node's slots within the ping period. It is re-hashed with every
+    // beacon: two nodes can still land on the same offset, but a collision is unlikely
+    // to repeat on the next period.
+    static uint32_t slotOffsetMs(const RxScheduleConfig& config, const char* nodeId, uint32_t beaconSeq);
+
+    // Start of the first slot beginning at or after sinceBeaconMs, or NO_SLOT if none is left
+    // before the next beacon.
+    static uint32_t nextSlotStartMs(const RxScheduleConfig& config, uint32_t offsetMs, uint32_t sinceBeaconMs);
+
+    static bool isListening(const RxScheduleConfig& config, uint32_t offsetMs, uint32_t sinceBeaconMs);
+
+    // Runs a node and the Centrale side by side for durationMs, 1 ms at a time, with commands
+    // generated at random (mean interval meanCommandIntervalMs) and queued until the node's slot.
+    static RxSimulationResult simulate(const RxScheduleConfig& config, uint32_t durationMs,
+                                       uint32_t meanCommandIntervalMs, uint32_t seed);
+};
+
+#endif // RX_SCHEDULE_H
@@ -0,0 +1,23 @@
+#include "SseSubscriber.h"
+
+uint32_t SseSubscriber::sent(uint32_t version, size_t length) {
+    uint32_t skipped = sentVersion != 0 && version - sentVersion > 1 ? version - sentVersion - 1 : 0;
+    sentVersion = version;
+    inFlight = length;
+    waiting = false;
+    return skipped;
+}
+
+void SseSubscriber::acked(size_t length) {
+    inFlight = length >= inFlight ? 0 : inFlight - length;
+}
+
+void SseSubscriber::blocked(uint32_t nowMs) {
+    if (waiting) return;
+    waiting = true;
+    waitingSinceMs = nowMs;
+}
+
+bool SseSubscriber::stalled(uint32_t nowMs, uint32_t timeoutMs) const {
+    return waiting && nowMs - waitingSinceMs >= timeoutMs;
+}
@@ -0,0 +1,33 @@
+#ifndef SSE_SUBSCRIBER_H
+#define SSE_SUBSCRIBER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Delivery state of one EventStream subscriber: at most one event in flight and
+// only the latest one waiting, so the memory held for a slow client is bounded by
+// one event whatever it misses. Pure logic: no Arduino, RTOS or network, time
+// passed in by the caller, so it runs the same on a PC.
+//
+// Events are numbered by the stream from 1. Plain data: a zeroed subscriber has
+// been sent nothing and is keeping up.
+struct SseSubscriber {
+    uint32_t sentVersion;    // 0 = nothing sent yet
+    uint32_t inFlight;       // Bytes written, not acknowledged yet
+    bool waiting;            // A newer event waits since waitingSinceMs
+    uint32_t waitingSinceMs;
+
+    bool upToDate(uint32_t version) const { return sentVersion == version; }
+    // Nothing in flight and room for the whole event in the send buffer.
+    bool canWrite(size_t space, size_t length) const { return inFlight == 0 && space >= length; }
+
+    // The event was written. Returns how many events the subscriber skipped.
+    uint32_t sent(uint32_t version, size_t length);
+    void acked(size_t length);
+    // The latest event could not be written.
+    void blocked(uint32_t nowMs);
+    void keepingUp() { waiting = false; }
+    bool stalled(uint32_t nowMs, uint32_t timeoutMs) const;
+};
+
+#endif // SSE_SUBSCRIBER_H
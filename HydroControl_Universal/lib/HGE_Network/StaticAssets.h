@@ -0,0 +1,51 @@
+#ifndef STATIC_ASSETS_H
+#define STATIC_ASSETS_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include <ESPAsyncWebServer.h>
+
+#define STATIC_ASSETS_MAX      16
+#define STATIC_ASSET_PATH_LEN  40
+
+// Serves the web assets prepared by scripts/compress_assets.py: the pages and
+// their files are stored gzipped ("/page.html.gz") and everything except the
+// pages carries a content hash in its name ("/style.1a2b3c4d.css.gz").
+//
+// Responses are sent with Content-Encoding: gzip and a strong ETag (CRC32 of the
+// stored file). Pages are revalidated on every load (no-cache, 304 when the ETag
+// matches); fingerprinted files never change under their name, so they are
+// cached for a year as immutable. Plain files (not gzipped by the build, or
+// uploaded by hand) are served the same way, without Content-Encoding.
+class StaticAssetHandler : public AsyncWebHandler {
+public:
+    // indexFile is served for "/".
+    StaticAssetHandler(fs::FS& fs, const char* indexFile);
+
+    // Indexes the web files at the root of the file system. Call once it is
+    // mounted; runtime files (.bin, ...) are left out.
+    void begin();
+
+    bool canHandle(AsyncWebServerRequest* request) override;
+    void handleRequest(AsyncWebServerRequest* request) override;
+
+private:
+    struct Asset {
+        char url[STATIC_ASSET_PATH_LEN];  // As requested, without ".gz"
+        char path[STATIC_ASSET_PATH_LEN]; // As stored
+        char etag[12];                    // Quoted CRC32
+        bool gzip;
+        bool immutable;                   // Fingerprinted name
+    };
+
+    fs::FS& fs;
+    const char* indexFile;
+    Asset assets[STATIC_ASSETS_MAX];
+    uint8_t count = 0;
+
+    const Asset* find(const String& url) const;
+    static const char* contentType(const char* url);
+    static bool isFingerprinted(const char* url);
+};
+
+#endif // STATIC_ASSETS_H
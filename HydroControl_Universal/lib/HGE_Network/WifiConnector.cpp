@@ -0,0 +1,89 @@
+#include "WifiConnector.h"
+#include <Preferences.h>
+#include "config.h"
+
+String WifiConnector::ssid;
+String WifiConnector::password;
+bool WifiConnector::fastAttempt = false;
+volatile bool WifiConnector::reported = false;
+WifiConnector::ResultCallback WifiConnector::onFirstResult = nullptr;
+void* WifiConnector::callbackContext = nullptr;
+TimerHandle_t WifiConnector::timeoutTimer = NULL;
+
+void WifiConnector::begin(const String& wifiSsid, const String& wifiPassword, ResultCallback callback, void* context) {
+    ssid = wifiSsid;
+    password = wifiPassword;
+    onFirstResult = callback;
+    callbackContext = context;
+
+    uint8_t bssid[6];
+    Preferences prefs;
+    prefs.begin("network_config", true);
+    bool haveAccessPoint = prefs.getBytes("ap_bssid", bssid, sizeof(bssid)) == sizeof(bssid);
+    uint8_t channel = prefs.getUChar("ap_channel", 0);
+    prefs.end();
+
+    WiFi.persistent(false); // Credentials already live in our own namespace
+    WiFi.mode(WIFI_STA);
+    WiFi.setAutoReconnect(true);
+    WiFi.onEvent(onWifiEvent);
+
+    timeoutTimer = xTimerCreate("WifiTimeout", pdMS_TO_TICKS(WIFI_CONNECT_TIMEOUT_MS), pdFALSE, NULL, onConnectTimeout);
+    xTimerStart(timeoutTimer, 0);
+
+    fastAttempt = haveAccessPoint && channel > 0;
+    if (fastAttempt) {
+        Serial.printf("WiFi: fast reconnect on channel %u.\n", channel);
+        WiFi.begin(ssid.c_str(), password.c_str(), channel, bssid);
+    } else {
+        WiFi.begin(ssid.c_str(), password.c_str());
+    }
+}
+
+void WifiConnector::onWifiEvent(WiFiEvent_t event) {
+    if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP) {
+        Serial.print("WiFi connected, IP Address: ");
+        Serial.println(WiFi.localIP());
+        saveAccessPoint();
+        reportFirstResult(true);
+    } else if (event == ARDUINO_EVENT_WIFI_STA_DISCONNECTED && fastAttempt) {
+        // The cached access point did not answer (moved channel, replaced...): scan normally.
+        fastAttempt = false;
+        Serial.println("WiFi: fast reconnect failed, scanning.");
+        WiFi.disconnect();
+        WiFi.begin(ssid.c_str(), password.c_str());
+    }
+}
+
+void WifiConnector::onConnectTimeout(TimerHandle_t timer) {
+    if (!reported) {
+        Serial.println("WiFi not connected yet, still trying in the background.");
+    }
+    reportFirstResult(false);
+}
+
+void WifiConnector::reportFirstResult(bool connected) {
+    if (reported) return;
+    reported = true;
+    xTimerStop(timeoutTimer, 0);
+    if (onFirstResult) onFirstResult(connected, callbackContext);
+}
+
+void WifiConnector::saveAccessPoint() {
+    uint8_t* bssid = WiFi.BSSID();
+    uint8_t channel = (uint8_t)WiFi.channel();
+    if (bssid == nullptr || channel == 0) return;
+
+    uint8_t savedBssid[6];
+    Preferences prefs;
+    prefs.begin("network_config", false);
+    bool known = prefs.getBytes("ap_bssid", savedBssid, sizeof(savedBssid)) == sizeof(savedBssid)
+                 && memcmp(savedBssid, bssid, sizeof(savedBssid)) == 0
+                 && prefs.getUChar("ap_channel", 0) == channel;
+    if (!known) {
+        // Only write on change to spare the flash
+        prefs.putBytes("ap_bssid", bssid, sizeof(savedBssid));
+        prefs.putUChar("ap_channel", channel);
+    }
+    prefs.end();
+}
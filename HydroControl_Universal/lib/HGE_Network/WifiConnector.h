@@ -0,0 +1,35 @@
+#ifndef WIFI_CONNECTOR_H
+#define WIFI_CONNECTOR_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <freertos/timers.h>
+
+// Non-blocking station bring-up. The BSSID and channel of the last successful
+// association are kept in NVS ("network_config") so that the next boot skips the
+// scan; if that access point is gone, a normal scan is started instead.
+class WifiConnector {
+public:
+    typedef void (*ResultCallback)(bool connected, void* context);
+
+    // Returns at once. onFirstResult is called once, from the Wi-Fi event task or a
+    // timer, when the link is up or after WIFI_CONNECT_TIMEOUT_MS. Reconnection then
+    // continues in the background.
+    static void begin(const String& ssid, const String& password, ResultCallback onFirstResult, void* context);
+
+private:
+    static String ssid;
+    static String password;
+    static bool fastAttempt;
+    static volatile bool reported;
+    static ResultCallback onFirstResult;
+    static void* callbackContext;
+    static TimerHandle_t timeoutTimer;
+
+    static void onWifiEvent(WiFiEvent_t event);
+    static void onConnectTimeout(TimerHandle_t timer);
+    static void reportFirstResult(bool connected);
+    static void saveAccessPoint();
+};
+
+#endif // WIFI_CONNECTOR_H
@@ -3,6 +3,7 @@
 #include <LittleFS.h>
 #include "RoleManager.h"
 #include <ESPmDNS.h>
+#include "config.h"
 
 
 // Global instance to be accessible by the web server handler
@@ -41,6 +42,28 @@ void handleProvisioningRequest(AsyncWebServerRequest *request) {
                 prefs.end();
             }
 
+            // Optional MQTT broker for the Centrale, "host" or "host:port"
+            if (role == CENTRALE && request->hasParam("mqtt_host", true)) {
+                String broker = request->getParam("mqtt_host", true)->value();
+                broker.trim();
+                int colon = broker.indexOf(':');
+                Preferences prefs;
+                prefs.begin("mqtt_config", false);
+                prefs.putString("host", colon < 0 ? broker : broker.substring(0, colon));
+                prefs.putUShort("port", colon < 0 ? MQTT_DEFAULT_PORT : broker.substring(colon + 1).toInt());
+                prefs.putString("user", request->hasParam("mqtt_user", true) ? request->getParam("mqtt_user", true)->value() : "");
+                prefs.putString("password", request->hasParam("mqtt_password", true) ? request->getParam("mqtt_password", true)->value() : "");
+                prefs.end();
+            }
+
+            // Save the battery/deep-sleep option for AquaReservPro
+            if (role == AQUA_RESERV_PRO) {
+                Preferences prefs;
+                prefs.begin("hydro_config", false);
+                prefs.putBool("low_power", request->hasParam("low_power", true));
+                prefs.end();
+            }
+
             // Save LoRa PSK
             if (request->hasParam("lora_psk", true)) {
                 String lora_psk = request->getParam("lora_psk", true)->value();
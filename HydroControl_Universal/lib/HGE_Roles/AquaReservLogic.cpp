@@ -2,13 +2,29 @@
 #include <WiFi.h>
 #include <SPI.h>
 #include "Crypto.h"
+#include "UlpLevelMonitor.h"
+#include "PowerModel.h"
+#include "Persistence.h"
+#include "Metrics.h"
+#include "TraceLog.h"
+#include "Profiler.h"
 #include <ArduinoJson.h>
+#include <esp_sleep.h>
+#include <driver/rtc_io.h>
 
 AquaReservLogic* AquaReservLogic::instance = nullptr;
 
 // --- FreeRTOS Handles ---
 QueueHandle_t commandQueue_ARP;
 SemaphoreHandle_t ackSemaphore_ARP;
+EventGroupHandle_t controlEvents_ARP;
+TimerHandle_t levelDebounceTimer_ARP;
+TimerHandle_t buttonDebounceTimer_ARP;
+
+// --- State kept in RTC slow memory across deep sleep ---
+RTC_DATA_ATTR static bool rtcStateValid = false;
+RTC_DATA_ATTR static bool rtcPumpCommand = false;
+RTC_DATA_ATTR static uint32_t rtcWakeCount = 0;
 
 
 AquaReservLogic::AquaReservLogic() {
@@ -24,8 +40,27 @@ void AquaReservLogic::initialize() {
 
     commandQueue_ARP = xQueueCreate(10, sizeof(char[256]));
     ackSemaphore_ARP = xSemaphoreCreateBinary();
+    controlEvents_ARP = xEventGroupCreate();
+    // One-shot timers: every edge restarts them, so they only fire once the input is quiet.
+    levelDebounceTimer_ARP = xTimerCreate("LevelDebounce", pdMS_TO_TICKS(SENSOR_STABILITY_MS), pdFALSE, this, onLevelDebounceElapsed);
+    buttonDebounceTimer_ARP = xTimerCreate("BtnDebounce", pdMS_TO_TICKS(BUTTON_DEBOUNCE_MS), pdFALSE, this, onButtonDebounceElapsed);
 
     loadOperationalConfig();
+
+    if (lowPowerMode) {
+        setCpuFrequencyMhz(LOW_POWER_CPU_FREQ_MHZ);
+        esp_sleep_wakeup_cause_t wakeCause = esp_sleep_get_wakeup_cause();
+        if (wakeCause != ESP_SLEEP_WAKEUP_UNDEFINED && rtcStateValid && UlpLevelMonitor::hasState()) {
+            restoreFromDeepSleep(wakeCause);
+        } else {
+            PowerProfile profile = PowerModel::defaultProfile();
+            DutyCycleScenario scenario = { LOW_POWER_HEARTBEAT_S, 8, 2, 2 };
+            DutyCycleResult estimate = PowerModel::simulate(profile, scenario, 86400);
+            Serial.printf("Low-power mode: ~%u wake-ups/day, %.3f mA average (%.1f mA always-on).\n",
+                          estimate.wakeUps, estimate.averageCurrentMa, PowerModel::alwaysOnCurrentMa(profile));
+        }
+    }
+
     setupHardware();
     setupLoRa();
     startTasks();
@@ -34,30 +69,48 @@ void AquaReservLogic::initialize() {
 }
 
 void AquaReservLogic::loadOperationalConfig() {
-    Preferences prefs;
-    prefs.begin("hydro_config", true);
-    assignedWellId = prefs.getString("assigned_well", "");
-    isWellShared = prefs.getBool("is_well_shared", false);
-    currentMode = (OperatingMode)prefs.getUChar("op_mode", AUTO);
-    prefs.end();
+    assignedWellId = Persistence::getString("hydro_config", "assigned_well", "");
+    isWellShared = Persistence::getBool("hydro_config", "is_well_shared", false);
+    currentMode = (OperatingMode)Persistence::getUChar("hydro_config", "op_mode", AUTO);
+    lowPowerMode = Persistence::getBool("hydro_config", "low_power", false);
+#if LEVEL_SENSOR_TYPE != LEVEL_SENSOR_FLOATS
+    if (lowPowerMode) {
+        Serial.println("Low-power mode needs the float switches: disabled with this level sensor.");
+        lowPowerMode = false;
+    }
+#endif
 }
 
+// Only updates the write-back cache; the flash write happens later, off the control path.
 void AquaReservLogic::saveOperationalConfig() {
-    Preferences prefs;
-    prefs.begin("hydro_config", false);
-    prefs.putString("assigned_well", assignedWellId);
-    prefs.putBool("is_well_shared", isWellShared);
-    prefs.putUChar("op_mode", (unsigned char)currentMode);
-    prefs.end();
-    Serial.println("Operational config saved.");
+    Persistence::putString("hydro_config", "assigned_well", assignedWellId);
+    Persistence::putBool("hydro_config", "is_well_shared", isWellShared);
+    Persistence::putUChar("hydro_config", "op_mode", (unsigned char)currentMode);
 }
 
 
 void AquaReservLogic::setupHardware() {
+    pinMode(AQUA_RESERV_BUTTON_PIN, INPUT_PULLUP);
+    attachInterrupt(digitalPinToInterrupt(AQUA_RESERV_BUTTON_PIN), onButtonPinFall, FALLING);
+
+#if LEVEL_SENSOR_TYPE == LEVEL_SENSOR_FLOATS
     // Initialisation des broches pour les capteurs de niveau
     pinMode(AQUA_RESERV_LEVEL_HIGH_PIN, INPUT_PULLUP);
     pinMode(AQUA_RESERV_LEVEL_LOW_PIN, INPUT_PULLUP);
-    pinMode(AQUA_RESERV_BUTTON_PIN, INPUT_PULLUP);
+
+    // Les changements d'état sont signalés par interruption, l'anti-rebond est fait par timer.
+    attachInterrupt(digitalPinToInterrupt(AQUA_RESERV_LEVEL_HIGH_PIN), onLevelPinChange, CHANGE);
+    attachInterrupt(digitalPinToInterrupt(AQUA_RESERV_LEVEL_LOW_PIN), onLevelPinChange, CHANGE);
+
+    // Le niveau initial doit lui aussi être stable pendant SENSOR_STABILITY_MS avant d'être pris en compte.
+    // Au réveil de veille profonde, l'ULP a déjà fait cet anti-rebond.
+    if (!wokeFromSleep) {
+        xTimerStart(levelDebounceTimer_ARP, 0);
+    }
+#else
+    // Capteur continu : le filtrage remplace l'anti-rebond, la première classification lance le contrôle.
+    levelSensor.begin(onLevelSensorChange, this);
+#endif
 }
 
 void AquaReservLogic::setupLoRa() {
@@ -84,15 +137,21 @@ void AquaReservLogic::setupLoRa() {
     LoRa.receive();
     Serial.println("LoRa receiver started.");
 
-    String discoveryPacket = LoRaMessage::serializeDiscovery(deviceId.c_str(), ROLE_AQUA_RESERV_PRO);
-    sendLoRaMessage(discoveryPacket);
+    // After a deep-sleep wake-up the Centrale already knows us: the sleep manager sends a status update instead.
+    if (!wokeFromSleep) {
+        String discoveryPacket = LoRaMessage::serializeDiscovery(deviceId.c_str(), ROLE_AQUA_RESERV_PRO, lowPowerMode ? LOW_POWER_RX_WINDOW_MS : 0);
+        sendLoRaMessage(discoveryPacket);
+    }
 }
 
 void AquaReservLogic::startTasks() {
-    xTaskCreate(Task_Sensor_Handler, "SensorHandler", 2048, this, 2, NULL);
-    xTaskCreate(Task_Control_Logic, "ControlLogic", 4096, this, 1, NULL);
-    xTaskCreate(Task_GPIO_Handler, "GPIOHandler", 2048, this, 2, NULL);
-    xTaskCreate(Task_Status_Reporter, "StatusReporter", 4096, this, 1, NULL);
+    xTaskCreate(Task_Control_Logic, "ControlLogic", Profiler::stackSize("ControlLogic", 4096), this, 2, NULL);
+    if (lowPowerMode) {
+        xTaskCreate(Task_Sleep_Manager, "SleepManager", Profiler::stackSize("SleepManager", 3072), this, 1, NULL);
+    } else {
+        xTaskCreate(Task_Status_Reporter, "StatusReporter", Profiler::stackSize("StatusReporter", 4096), this, 1, NULL);
+        rxSlots.begin(deviceId, onRxSyncChanged);
+    }
 }
 
 
@@ -100,146 +159,311 @@ void AquaReservLogic::triggerPumpCommand(bool command) {
     currentPumpCommand = command;
     if (assignedWellId.isEmpty()) return;
 
-    String packet;
+    uint16_t traceId = (uint16_t)(esp_random() % 0xFFFF) + 1;
     if (isWellShared) {
         MessageType requestType = command ? REQUEST_PUMP_ON : REQUEST_PUMP_OFF;
-        packet = LoRaMessage::serializePumpRequest(deviceId.c_str(), requestType);
+        String packet = LoRaMessage::serializePumpRequest(deviceId.c_str(), requestType, traceId, traceDebounceMs, millis() - traceStableMs);
+        Metrics::inc(MC_PUMP_REQUESTS);
         Serial.println("Well is shared. Sending request to Centrale.");
         sendLoRaMessage(packet);
     } else {
         CommandType cmdType = command ? CMD_PUMP_ON : CMD_PUMP_OFF;
-        packet = LoRaMessage::serializeCommand(deviceId.c_str(), assignedWellId.c_str(), cmdType);
         Serial.println("Well is not shared. Sending direct command.");
-        if (!sendReliableCommand(packet)) {
+        if (!sendReliableCommand(cmdType, traceId)) {
             Serial.println("Command failed after all retries.");
         }
     }
 }
 
 
-// --- FreeRTOS Tasks ---
+// --- Sensors and button ---
 
-void AquaReservLogic::Task_Sensor_Handler(void *pvParameters) {
-    AquaReservLogic* self = (AquaReservLogic*)pvParameters;
-    LevelState lastUnstableLevel = self->currentLevel;
-    unsigned long levelChangeTimestamp = 0;
+LevelState AquaReservLogic::readLevelSensors() {
+    uint8_t bits = (digitalRead(AQUA_RESERV_LEVEL_HIGH_PIN) << 1) | digitalRead(AQUA_RESERV_LEVEL_LOW_PIN);
+    return sensorBitsToLevel(bits);
+}
 
-    for (;;) {
-        // Lecture des capteurs. Rappel : INPUT_PULLUP, donc LOW = activé.
-        bool highSensorActive = (digitalRead(AQUA_RESERV_LEVEL_HIGH_PIN) == LOW);
-        bool lowSensorActive = (digitalRead(AQUA_RESERV_LEVEL_LOW_PIN) == LOW);
-
-        LevelState detectedLevel;
-
-        if (highSensorActive && lowSensorActive) {
-            detectedLevel = LEVEL_FULL;
-        } else if (!highSensorActive && !lowSensorActive) {
-            detectedLevel = LEVEL_EMPTY;
-        } else if (!highSensorActive && lowSensorActive) {
-            detectedLevel = LEVEL_OK;
-        } else { // highSensorActive && !lowSensorActive
-            // État incohérent : le capteur haut est actif mais pas le bas.
-            detectedLevel = LEVEL_ERROR;
-        }
+// bits = (niveau brut broche haute << 1) | niveau brut broche basse, même format que l'ULP.
+LevelState AquaReservLogic::sensorBitsToLevel(uint8_t bits) {
+    // Rappel : INPUT_PULLUP, donc LOW = activé.
+    bool highSensorActive = (bits & 0x2) == 0;
+    bool lowSensorActive = (bits & 0x1) == 0;
+
+    if (highSensorActive && lowSensorActive) {
+        return LEVEL_FULL;
+    } else if (!highSensorActive && !lowSensorActive) {
+        return LEVEL_EMPTY;
+    } else if (!highSensorActive && lowSensorActive) {
+        return LEVEL_OK;
+    }
+    // État incohérent : le capteur haut est actif mais pas le bas.
+    return LEVEL_ERROR;
+}
 
-        if (detectedLevel != lastUnstableLevel) {
-            lastUnstableLevel = detectedLevel;
-            levelChangeTimestamp = millis();
-        }
+uint8_t AquaReservLogic::levelToSensorBits(LevelState level) {
+    switch (level) {
+        case LEVEL_FULL: return 0x0;
+        case LEVEL_OK: return 0x2;
+        case LEVEL_ERROR: return 0x1;
+        default: return 0x3; // LEVEL_EMPTY
+    }
+}
 
-        if (millis() - levelChangeTimestamp > SENSOR_STABILITY_MS) {
-            if (self->currentLevel != detectedLevel) {
-                self->currentLevel = detectedLevel;
-                const char* levelStr = "UNKNOWN";
-                if(self->currentLevel == LEVEL_FULL) levelStr = "FULL";
-                else if(self->currentLevel == LEVEL_OK) levelStr = "OK";
-                else if(self->currentLevel == LEVEL_EMPTY) levelStr = "EMPTY";
-                else if(self->currentLevel == LEVEL_ERROR) levelStr = "ERROR";
-                Serial.printf("New stable level: %s\n", levelStr);
-            }
-        }
-        vTaskDelay(pdMS_TO_TICKS(250));
+const char* AquaReservLogic::levelToString(LevelState level) {
+    switch (level) {
+        case LEVEL_FULL: return "FULL";
+        case LEVEL_OK: return "OK";
+        case LEVEL_EMPTY: return "EMPTY";
+        case LEVEL_ERROR: return "ERROR";
+        default: return "UNKNOWN";
     }
 }
 
-void AquaReservLogic::Task_Control_Logic(void *pvParameters) {
-    AquaReservLogic* self = (AquaReservLogic*)pvParameters;
+void IRAM_ATTR AquaReservLogic::onLevelPinChange() {
+    if (instance->traceEdgeMs == 0) instance->traceEdgeMs = millis() | 1;
+    BaseType_t higherPriorityTaskWoken = pdFALSE;
+    xTimerResetFromISR(levelDebounceTimer_ARP, &higherPriorityTaskWoken);
+    if (higherPriorityTaskWoken) portYIELD_FROM_ISR();
+}
 
-    for (;;) {
-        if (self->currentMode == AUTO) {
-            bool desiredCommand = self->currentPumpCommand;
-
-            // Logique de contrôle basée sur les niveaux
-            if (self->currentLevel == LEVEL_EMPTY) {
-                desiredCommand = true; // Demander le démarrage
-            } else if (self->currentLevel == LEVEL_FULL) {
-                desiredCommand = false; // Demander l'arrêt
-            }
-            // Si le niveau est OK, on ne change rien à la commande en cours.
+void IRAM_ATTR AquaReservLogic::onButtonPinFall() {
+    if (instance->traceEdgeMs == 0) instance->traceEdgeMs = millis() | 1;
+    BaseType_t higherPriorityTaskWoken = pdFALSE;
+    xTimerResetFromISR(buttonDebounceTimer_ARP, &higherPriorityTaskWoken);
+    if (higherPriorityTaskWoken) portYIELD_FROM_ISR();
+}
 
-            // On envoie la commande seulement si elle change
-            if (desiredCommand != self->currentPumpCommand) {
-                self->triggerPumpCommand(desiredCommand);
-            }
-        }
-        vTaskDelay(pdMS_TO_TICKS(1000));
+// Runs in the timer service task once the float switches have been quiet for SENSOR_STABILITY_MS.
+void AquaReservLogic::onLevelDebounceElapsed(TimerHandle_t timer) {
+    AquaReservLogic* self = (AquaReservLogic*)pvTimerGetTimerID(timer);
+    LevelState detectedLevel = readLevelSensors();
+    self->markInputStable();
+
+    if (self->currentLevel != detectedLevel) {
+        self->currentLevel = detectedLevel;
+        Serial.printf("New stable level: %s\n", levelToString(detectedLevel));
+    }
+    // Notify even when unchanged so the boot-time evaluation also goes through the control task.
+    xEventGroupSetBits(controlEvents_ARP, CTRL_EVT_LEVEL_CHANGED);
+}
+
+#if LEVEL_SENSOR_TYPE != LEVEL_SENSOR_FLOATS
+// Runs in the level sampler task when the filtered level changes class.
+void AquaReservLogic::onLevelSensorChange(SensorLevel level, void* context) {
+    AquaReservLogic* self = (AquaReservLogic*)context;
+    static const LevelState LEVELS[] = { LEVEL_EMPTY, LEVEL_OK, LEVEL_FULL, LEVEL_ERROR };
+    self->markInputStable();
+    self->currentLevel = level < SENSOR_LEVEL_NONE ? LEVELS[level] : LEVEL_ERROR;
+    Serial.printf("New stable level: %s (%d permille)\n", levelToString(self->currentLevel), self->levelSensor.permille());
+    xEventGroupSetBits(controlEvents_ARP, CTRL_EVT_LEVEL_CHANGED);
+}
+#endif
+
+void AquaReservLogic::onButtonDebounceElapsed(TimerHandle_t timer) {
+    // Only a press that is still held after the debounce window counts; release bounces read HIGH.
+    if (digitalRead(AQUA_RESERV_BUTTON_PIN) == LOW) {
+        instance->markInputStable();
+        xEventGroupSetBits(controlEvents_ARP, CTRL_EVT_BUTTON_PRESSED);
     }
 }
 
-void AquaReservLogic::Task_GPIO_Handler(void *pvParameters) {
+// Closes the debounce stage of the next traced command.
+void AquaReservLogic::markInputStable() {
+    uint32_t edgeMs = traceEdgeMs;
+    traceStableMs = millis();
+    traceDebounceMs = edgeMs != 0 ? traceStableMs - edgeMs : 0;
+    traceEdgeMs = 0;
+}
+
+
+// --- FreeRTOS Tasks ---
+
+void AquaReservLogic::Task_Control_Logic(void *pvParameters) {
     AquaReservLogic* self = (AquaReservLogic*)pvParameters;
-    int lastButtonState = HIGH;
-    unsigned long lastDebounceTime = 0;
-    const int debounceDelay = 50;
 
     for (;;) {
-        int buttonState = digitalRead(AQUA_RESERV_BUTTON_PIN);
-        if (buttonState != lastButtonState) {
-            lastDebounceTime = millis();
+        // Blocks until a debounced event arrives: the CPU stays idle between level or button changes.
+        EventBits_t events = xEventGroupWaitBits(controlEvents_ARP,
+                                                 CTRL_EVT_ALL,
+                                                 pdFALSE, pdFALSE, portMAX_DELAY);
+        // Flag busy before clearing the bits so the sleep manager never sees an idle gap.
+        self->controlBusy = true;
+        xEventGroupClearBits(controlEvents_ARP, events);
+
+        if (events & CTRL_EVT_BUTTON_PRESSED) {
+            self->handleButtonPress();
+        }
+        if (events & CTRL_EVT_LEVEL_CHANGED) {
+            self->applyAutoControl();
         }
+        if (events & CTRL_EVT_CONFIG_CHANGED) {
+            self->saveOperationalConfig();
+        }
+        self->controlBusy = false;
+    }
+}
 
-        if ((millis() - lastDebounceTime) > debounceDelay) {
-            if (buttonState == LOW && lastButtonState == HIGH) {
-                self->currentMode = (self->currentMode == AUTO) ? MANUAL : AUTO;
-                Serial.printf("Mode switched to %s\n", self->currentMode == AUTO ? "AUTO" : "MANUAL");
-
-                if (self->currentMode == MANUAL) {
-                    bool newCommand = !self->currentPumpCommand;
-                    if (newCommand && self->currentLevel == LEVEL_FULL) {
-                        Serial.println("Manual start inhibited: reservoir is full.");
-                    } else {
-                        self->triggerPumpCommand(newCommand);
-                    }
-                }
-                self->saveOperationalConfig();
-            }
+void AquaReservLogic::applyAutoControl() {
+    if (currentMode != AUTO) return;
+
+    bool desiredCommand = currentPumpCommand;
+
+    // Logique de contrôle basée sur les niveaux
+    if (currentLevel == LEVEL_EMPTY) {
+        desiredCommand = true; // Demander le démarrage
+    } else if (currentLevel == LEVEL_FULL) {
+        desiredCommand = false; // Demander l'arrêt
+    }
+    // Si le niveau est OK, on ne change rien à la commande en cours.
+
+    // On envoie la commande seulement si elle change
+    if (desiredCommand != currentPumpCommand) {
+        triggerPumpCommand(desiredCommand);
+    }
+}
+
+void AquaReservLogic::handleButtonPress() {
+    currentMode = (currentMode == AUTO) ? MANUAL : AUTO;
+    Serial.printf("Mode switched to %s\n", currentMode == AUTO ? "AUTO" : "MANUAL");
+
+    if (currentMode == MANUAL) {
+        bool newCommand = !currentPumpCommand;
+        if (newCommand && currentLevel == LEVEL_FULL) {
+            Serial.println("Manual start inhibited: reservoir is full.");
+        } else {
+            triggerPumpCommand(newCommand);
         }
-        lastButtonState = buttonState;
-        vTaskDelay(pdMS_TO_TICKS(20));
+    } else {
+        // De retour en AUTO : réévaluer immédiatement le niveau courant.
+        applyAutoControl();
     }
+    saveOperationalConfig();
 }
 
 void AquaReservLogic::Task_Status_Reporter(void *pvParameters) {
     AquaReservLogic* self = (AquaReservLogic*)pvParameters;
     const int HEARTBEAT_INTERVAL_MS = 120000;
+    uint32_t lastDigestMs = 0;
     for (;;) {
         vTaskDelay(pdMS_TO_TICKS(HEARTBEAT_INTERVAL_MS));
 
+        if (millis() - lastDigestMs >= METRICS_DIGEST_PERIOD_MS) {
+            lastDigestMs = millis();
+            self->sendMetricsDigest();
+        }
+
         if (millis() - self->lastLoRaTransmissionTimestamp < HEARTBEAT_INTERVAL_MS) {
             continue;
         }
 
-        const char* levelStr = "UNKNOWN";
-        if(self->currentLevel == LEVEL_FULL) levelStr = "FULL";
-        else if(self->currentLevel == LEVEL_OK) levelStr = "OK";
-        else if(self->currentLevel == LEVEL_EMPTY) levelStr = "EMPTY";
-        else if(self->currentLevel == LEVEL_ERROR) levelStr = "ERROR";
+        self->sendStatusUpdate();
+    }
+}
+
+void AquaReservLogic::Task_Sleep_Manager(void *pvParameters) {
+    AquaReservLogic* self = (AquaReservLogic*)pvParameters;
 
-        String statusPacket = LoRaMessage::serializeStatusUpdate(self->deviceId.c_str(), levelStr, LoRa.packetRssi());
-        sendLoRaMessage(statusPacket);
+    for (;;) {
+        vTaskDelay(pdMS_TO_TICKS(100));
+
+        // Check pending events before the busy flag (see Task_Control_Logic).
+        if (xEventGroupGetBits(controlEvents_ARP) & CTRL_EVT_ALL) continue;
+        if (self->controlBusy) continue;
+        if (xTimerIsTimerActive(levelDebounceTimer_ARP) || xTimerIsTimerActive(buttonDebounceTimer_ARP)) continue;
+
+        // Every wake-up carries at least one uplink: it is the heartbeat, and the Centrale
+        // uses it to deliver any downlink held for us during our receive window.
+        if (self->lastLoRaTransmissionTimestamp == 0) {
+            self->sendStatusUpdate();
+            if (rtcWakeCount % METRICS_DIGEST_EVERY_WAKES == 0) self->sendMetricsDigest();
+            continue;
+        }
+        if (millis() - self->lastLoRaTransmissionTimestamp < LOW_POWER_RX_WINDOW_MS) continue;
+
+        self->enterDeepSleep();
     }
 }
 
+void AquaReservLogic::sendStatusUpdate() {
+#if LEVEL_SENSOR_TYPE != LEVEL_SENSOR_FLOATS
+    int16_t levelPermille = levelSensor.permille();
+#else
+    int16_t levelPermille = LEVEL_UNKNOWN;
+#endif
+    String statusPacket = LoRaMessage::serializeStatusUpdate(deviceId.c_str(), levelToString(currentLevel), LoRa.packetRssi(),
+                                                             lowPowerMode ? LOW_POWER_RX_WINDOW_MS : 0, rxSlots.isSynchronized(),
+                                                             levelPermille);
+    sendLoRaMessage(statusPacket);
+}
+
+void AquaReservLogic::sendMetricsDigest() {
+    MetricsDigest digest;
+    Metrics::fillDigest(digest);
+    sendLoRaMessage(LoRaMessage::serializeMetricsDigest(deviceId.c_str(), digest));
+
+    NodeDiagnostics diag;
+    Profiler::fillDiagnostics(diag);
+    sendLoRaMessage(LoRaMessage::serializeDiagnostics(deviceId.c_str(), diag));
+}
+
+// Tell the Centrale whether it must hold our downlinks for our receive slots.
+void AquaReservLogic::onRxSyncChanged(bool synchronized) {
+    instance->sendStatusUpdate();
+}
+
+
+// --- Deep sleep ---
+
+void AquaReservLogic::restoreFromDeepSleep(int wakeCause) {
+    wokeFromSleep = true;
+    rtcWakeCount++;
+    Metrics::restoreFromRtc();
+
+    // Reprendre la main sur les broches et l'état retenu pendant la veille.
+    UlpLevelMonitor::stop(AQUA_RESERV_LEVEL_HIGH_PIN, AQUA_RESERV_LEVEL_LOW_PIN);
+    rtc_gpio_deinit((gpio_num_t)AQUA_RESERV_BUTTON_PIN);
+    currentLevel = sensorBitsToLevel(UlpLevelMonitor::stableBits());
+    currentPumpCommand = rtcPumpCommand;
+
+    EventBits_t events = 0;
+    // The ULP only wakes us once the level has held for SENSOR_STABILITY_MS; the
+    // control stage then includes the boot.
+    traceDebounceMs = wakeCause == ESP_SLEEP_WAKEUP_ULP ? SENSOR_STABILITY_MS : 0;
+    traceStableMs = 0;
+    if (wakeCause == ESP_SLEEP_WAKEUP_ULP) events |= CTRL_EVT_LEVEL_CHANGED;
+    if (wakeCause == ESP_SLEEP_WAKEUP_EXT0) events |= CTRL_EVT_BUTTON_PRESSED;
+    if (events) xEventGroupSetBits(controlEvents_ARP, events);
+
+    Serial.printf("Wake-up #%u (cause %d), level %s\n", rtcWakeCount, wakeCause, levelToString(currentLevel));
+}
+
+void AquaReservLogic::enterDeepSleep() {
+    rtcPumpCommand = currentPumpCommand;
+    rtcStateValid = true;
+
+    detachInterrupt(digitalPinToInterrupt(AQUA_RESERV_LEVEL_HIGH_PIN));
+    detachInterrupt(digitalPinToInterrupt(AQUA_RESERV_LEVEL_LOW_PIN));
+    detachInterrupt(digitalPinToInterrupt(AQUA_RESERV_BUTTON_PIN));
+    LoRa.sleep();
+
+    // The ULP starts from the level we last acted on, so any difference wakes us up.
+    UlpLevelMonitor::start(AQUA_RESERV_LEVEL_HIGH_PIN, AQUA_RESERV_LEVEL_LOW_PIN, ULP_SAMPLE_PERIOD_MS,
+                           SENSOR_STABILITY_MS / ULP_SAMPLE_PERIOD_MS, levelToSensorBits(currentLevel));
+
+    rtc_gpio_pullup_en((gpio_num_t)AQUA_RESERV_BUTTON_PIN);
+    rtc_gpio_pulldown_dis((gpio_num_t)AQUA_RESERV_BUTTON_PIN);
+    esp_sleep_pd_config(ESP_PD_DOMAIN_RTC_PERIPH, ESP_PD_OPTION_ON);
+    esp_sleep_enable_ulp_wakeup();
+    esp_sleep_enable_ext0_wakeup((gpio_num_t)AQUA_RESERV_BUTTON_PIN, 0);
+    esp_sleep_enable_timer_wakeup((uint64_t)LOW_POWER_HEARTBEAT_S * 1000000ULL);
+
+    Persistence::flush();
+    Metrics::saveToRtc();
+    Serial.printf("Entering deep sleep after %lu ms awake.\n", millis());
+    Serial.flush();
+    esp_deep_sleep_start();
+}
+
 
 // --- LoRa Communication ---
 
@@ -256,18 +480,31 @@ void AquaReservLogic::onReceive(int packetSize) {
     if (decryptedPacket.length() > 0) {
         handleLoRaPacket(decryptedPacket);
     } else {
-        Serial.println("Decryption failed.");
+        Metrics::inc(MC_LORA_DECRYPT_FAILURES);
+        TRACE(TR_LORA_DECRYPT_FAILED, encryptedPacket.length());
     }
 }
 
 void AquaReservLogic::handleLoRaPacket(const String& packet) {
     StaticJsonDocument<256> doc;
-    deserializeJson(doc, packet);
+    if (deserializeJson(doc, packet)) {
+        Metrics::inc(MC_LORA_PARSE_FAILURES);
+        TRACE(TR_LORA_PARSE_FAILED, packet.length());
+        return;
+    }
 
     int type = doc["type"];
+    Metrics::countRx(type);
     const char* src = doc["src"];
+    TRACE(TR_LORA_RX, type, LoRa.packetRssi(), TRACE_ID(src));
+
+    if (type == MessageType::BEACON) {
+        instance->rxSlots.onBeacon(doc["seq"].as<uint32_t>());
+        return;
+    }
 
     if (type == MessageType::COMMAND_ACK && src != nullptr && instance->assignedWellId.equals(src)) {
+        instance->wellHoldS = (doc["pg"] | 0) != 0 ? doc["eta"] | 0UL : 0;
         xSemaphoreGive(ackSemaphore_ARP);
     }
 
@@ -278,34 +515,54 @@ void AquaReservLogic::handleLoRaPacket(const String& packet) {
             if (cmd != nullptr && strcmp(cmd, "ASSIGN_WELL") == 0) {
                 instance->assignedWellId = doc["well_id"].as<String>();
                 instance->isWellShared = doc["is_shared"].as<bool>();
-                Serial.printf("Received new well assignment: %s (Shared: %s)\n", instance->assignedWellId.c_str(), instance->isWellShared ? "Yes" : "No");
-                instance->saveOperationalConfig();
+                TRACE(TR_WELL_ASSIGNED, TRACE_ID(instance->assignedWellId), instance->isWellShared);
+                xEventGroupSetBitsFromISR(controlEvents_ARP, CTRL_EVT_CONFIG_CHANGED, NULL);
             }
         }
     }
 }
 
-bool AquaReservLogic::sendReliableCommand(const String& packet) {
+bool AquaReservLogic::sendReliableCommand(CommandType cmd, uint16_t traceId) {
     const int MAX_RETRIES = 3;
     const TickType_t ACK_TIMEOUT = pdMS_TO_TICKS(2000);
 
+    uint32_t startMs = millis();
+    String packet;
     for (int i = 0; i < MAX_RETRIES; i++) {
+        if (i > 0) Metrics::inc(MC_ACK_RETRIES);
+        // The well may only be listening during its receive slots.
+        uint32_t waitMs = rxSlots.msUntilSlotOf(assignedWellId);
+        if (waitMs > 0) vTaskDelay(pdMS_TO_TICKS(waitMs));
+        // Built after the first slot wait, so that the control stage includes it. Retries resend it as is.
+        if (packet.isEmpty()) {
+            packet = LoRaMessage::serializeCommand(deviceId.c_str(), assignedWellId.c_str(), cmd, traceId, traceDebounceMs, millis() - traceStableMs);
+        }
         sendLoRaMessage(packet);
         if (xSemaphoreTake(ackSemaphore_ARP, ACK_TIMEOUT) == pdTRUE) {
             lastLoRaTransmissionTimestamp = millis();
+            Metrics::observe(MH_ACK_LATENCY_MS, millis() - startMs);
+            if (wellHoldS > 0) {
+                Serial.printf("Well protects its pump: command applied in %lu s.\n", (unsigned long)wellHoldS);
+            }
             return true;
         }
-        Serial.printf("ACK timeout. Retry %d/%d\n", i + 1, MAX_RETRIES);
+        Metrics::inc(MC_ACK_TIMEOUTS);
+        TRACE(TR_ACK_TIMEOUT, i + 1, MAX_RETRIES);
     }
+    Metrics::inc(MC_COMMAND_FAILURES);
     return false;
 }
 
 void AquaReservLogic::sendLoRaMessage(const String& message) {
     String encrypted = CryptoManager::encrypt(message);
+    int type = Metrics::messageTypeOf(message);
+    Metrics::countTx(type);
+    instance->rxSlots.beginTransmit();
     LoRa.beginPacket();
     LoRa.print(encrypted);
     LoRa.endPacket();
+    instance->rxSlots.endTransmit();
 
     instance->lastLoRaTransmissionTimestamp = millis();
-    Serial.printf("Sent LoRa Packet: %s\n", message.c_str());
+    TRACE(TR_LORA_TX, type, message.length());
 }
@@ -2,13 +2,24 @@
 #define AQUA_RESERV_LOGIC_H
 
 #include <Arduino.h>
+#include <freertos/event_groups.h>
+#include <freertos/timers.h>
 #include <LoRa.h>
 #include <Preferences.h>
 #include "Message.h"
+#include "PingSlotReceiver.h"
+#include "LevelSensor.h"
 #include "config.h" // Utilisation de la configuration centralisée
 
 // Logic configuration
 #define SENSOR_STABILITY_MS 2000 // Temps en ms avant de considérer un état de capteur comme stable
+#define BUTTON_DEBOUNCE_MS 50     // Fenêtre anti-rebond du bouton manuel
+
+// Control task event bits
+#define CTRL_EVT_LEVEL_CHANGED   (1 << 0)
+#define CTRL_EVT_BUTTON_PRESSED  (1 << 1)
+#define CTRL_EVT_CONFIG_CHANGED  (1 << 2) // Set from the LoRa callback, saved from the control task
+#define CTRL_EVT_ALL             (CTRL_EVT_LEVEL_CHANGED | CTRL_EVT_BUTTON_PRESSED | CTRL_EVT_CONFIG_CHANGED)
 
 // State enumerations
 enum OperatingMode { AUTO, MANUAL };
@@ -24,29 +35,64 @@ private:
     String assignedWellId = "";
     bool isWellShared = false;
     OperatingMode currentMode = AUTO;
-    LevelState currentLevel = LEVEL_OK; // Initialiser à OK
+    volatile LevelState currentLevel = LEVEL_OK; // Initialiser à OK
     bool currentPumpCommand = false;
+    volatile uint32_t wellHoldS = 0; // Last ACK of the well: command held this long by its pump protection
     volatile unsigned long lastLoRaTransmissionTimestamp = 0;
 
+    // Latency tracing of the next pump command (assembled by the Centrale)
+    volatile uint32_t traceEdgeMs = 0; // First sensor or button edge since the last stable state, 0 = none
+    uint32_t traceStableMs = 0;
+    uint32_t traceDebounceMs = 0;
+
+    // Low-power operation (deep sleep between events, ULP watching the float switches)
+    bool lowPowerMode = false;
+    bool wokeFromSleep = false;
+    volatile bool controlBusy = false;
+
+    PingSlotReceiver rxSlots;
+#if LEVEL_SENSOR_TYPE != LEVEL_SENSOR_FLOATS
+    LevelSensor levelSensor;
+    static void onLevelSensorChange(SensorLevel level, void* context);
+#endif
+
     void setupHardware();
     void setupLoRa();
     void startTasks();
     void loadOperationalConfig();
     void saveOperationalConfig();
     void triggerPumpCommand(bool command);
+    void markInputStable();
+    void applyAutoControl();
+    void handleButtonPress();
+    void sendStatusUpdate();
+    void sendMetricsDigest();
+    static void onRxSyncChanged(bool synchronized);
+    void restoreFromDeepSleep(int wakeCause);
+    void enterDeepSleep();
+
+    static LevelState readLevelSensors();
+    static LevelState sensorBitsToLevel(uint8_t bits);
+    static uint8_t levelToSensorBits(LevelState level);
+    static const char* levelToString(LevelState level);
 
     static void onReceive(int packetSize);
     static void handleLoRaPacket(const String& packet);
     static void sendLoRaMessage(const String& message);
-    bool sendReliableCommand(const String& packet);
+    bool sendReliableCommand(CommandType cmd, uint16_t traceId);
 
     static AquaReservLogic* instance;
 
+    // GPIO interrupts and debounce timer callbacks
+    static void IRAM_ATTR onLevelPinChange();
+    static void IRAM_ATTR onButtonPinFall();
+    static void onLevelDebounceElapsed(TimerHandle_t timer);
+    static void onButtonDebounceElapsed(TimerHandle_t timer);
+
     // FreeRTOS task prototypes
     static void Task_Control_Logic(void *pvParameters);
-    static void Task_Sensor_Handler(void *pvParameters);
-    static void Task_GPIO_Handler(void *pvParameters);
     static void Task_Status_Reporter(void *pvParameters);
+    static void Task_Sleep_Manager(void *pvParameters);
 };
 
 #endif // AQUA_RESERV_LOGIC_H
@@ -0,0 +1,322 @@
+#include "ArbitrationEngine.h"
+#include <string.h>
+
+#define BIT(slot) (1UL << (slot))
+
+ArbitrationEngine::ArbitrationEngine() {
+    memset(wells, 0, sizeof(wells));
+    memset(reservoirs, 0, sizeof(reservoirs));
+    for (uint8_t i = 0; i < ARB_MAX_NODES; i++) {
+        wells[i].rule = defaultRule();
+        reservoirs[i].served = ARB_NONE;
+    }
+}
+
+ArbWellRule ArbitrationEngine::defaultRule() {
+    ArbWellRule rule;
+    rule.minRunMs = 0;
+    rule.minRestMs = 0;
+    rule.startScore = 1;
+    rule.fullIsLimit = true;
+    return rule;
+}
+
+// --- Topology ---
+
+void ArbitrationEngine::clearLinks() {
+    linkTotal = 0;
+    for (uint8_t i = 0; i < ARB_MAX_NODES; i++) reservoirs[i].served = ARB_NONE;
+    dirtyReservoirs = BIT(ARB_MAX_NODES) - 1;
+    dirtyWells = BIT(ARB_MAX_NODES) - 1;
+}
+
+// A second link between the same reservoir and well updates its weight.
+bool ArbitrationEngine::link(uint8_t reservoir, uint8_t well, uint8_t weight) {
+    if (reservoir >= ARB_MAX_NODES || well >= ARB_MAX_NODES || reservoir == well || weight == 0) return false;
+    for (uint8_t i = 0; i < linkTotal; i++) {
+        if (links[i].reservoir == reservoir && links[i].well == well) {
+            links[i].weight = weight;
+            dirtyReservoirs |= BIT(reservoir);
+            return true;
+        }
+    }
+    if (linkTotal == ARB_MAX_LINKS) return false;
+    links[linkTotal++] = { reservoir, well, weight };
+    dirtyReservoirs |= BIT(reservoir);
+    dirtyWells |= BIT(well);
+    return true;
+}
+
+void ArbitrationEngine::setRule(uint8_t well, const ArbWellRule& rule) {
+    if (well >= ARB_MAX_NODES) return;
+    wells[well].rule = rule;
+    if (wells[well].rule.startScore == 0) wells[well].rule.startScore = 1;
+    dirtyWells |= BIT(well);
+}
+
+bool ArbitrationEngine::linkAt(uint8_t index, uint8_t& reservoir, uint8_t& well, uint8_t& weight) const {
+    if (index >= linkTotal) return false;
+    reservoir = links[index].reservoir;
+    well = links[index].well;
+    weight = links[index].weight;
+    return true;
+}
+
+bool ArbitrationEngine::hasWell(uint8_t reservoir) const {
+    for (uint8_t i = 0; i < linkTotal; i++) {
+        if (links[i].reservoir == reservoir) return true;
+    }
+    return false;
+}
+
+bool ArbitrationEngine::needsArbitration(uint8_t well) const {
+    const ArbWellRule& rule = wells[well].rule;
+    if (rule.minRunMs != 0 || rule.minRestMs != 0 || rule.startScore > 1) return true;
+    uint8_t reservoirCount = 0;
+    for (uint8_t i = 0; i < linkTotal; i++) {
+        if (links[i].well != well) continue;
+        if (++reservoirCount > 1) return true;
+        for (uint8_t j = 0; j < linkTotal; j++) {
+            if (links[j].reservoir == links[i].reservoir && links[j].well != well) return true;
+        }
+    }
+    return false;
+}
+
+// --- State inputs ---
+
+void ArbitrationEngine::setLevel(uint8_t reservoir, ArbLevel level) {
+    if (reservoir >= ARB_MAX_NODES || reservoirs[reservoir].level == level) return;
+    reservoirs[reservoir].level = level;
+    dirtyReservoirs |= BIT(reservoir);
+}
+
+void ArbitrationEngine::setDemand(uint8_t reservoir, bool demand) {
+    if (reservoir >= ARB_MAX_NODES || reservoirs[reservoir].demand == demand) return;
+    reservoirs[reservoir].demand = demand;
+    dirtyReservoirs |= BIT(reservoir);
+}
+
+void ArbitrationEngine::setWellOnline(uint8_t well, bool online, uint32_t nowMs) {
+    if (well >= ARB_MAX_NODES || wells[well].online == online) return;
+    Well& w = wells[well];
+    w.online = online;
+    if (!online && w.running) {
+        w.running = false;
+        w.pending = false;
+        w.switched = true;
+        w.changedAtMs = nowMs;
+    }
+    dirtyWells |= BIT(well);
+    markReservoirsOf(well);
+}
+
+void ArbitrationEngine::wellReported(uint8_t well, bool running, uint32_t nowMs) {
+    if (well >= ARB_MAX_NODES) return;
+    Well& w = wells[well];
+    if (w.pending) {
+        if (running == w.running) {
+            w.pending = false;
+            w.heldUntilMs = 0;
+            return;
+        }
+        bool held = w.heldUntilMs != 0 && (int32_t)(nowMs - w.heldUntilMs) < (int32_t)ARB_COMMAND_GRACE_MS;
+        if (nowMs - w.changedAtMs < ARB_COMMAND_GRACE_MS || held) return;
+        w.pending = false; // Never took effect: the next evaluation decides again
+        w.heldUntilMs = 0;
+    }
+    if (running == w.running) return;
+    w.running = running;
+    w.switched = true;
+    w.changedAtMs = nowMs;
+    dirtyWells |= BIT(well);
+    markReservoirsOf(well);
+}
+
+void ArbitrationEngine::wellHeld(uint8_t well, uint32_t untilMs) {
+    if (well >= ARB_MAX_NODES || !wells[well].pending) return;
+    wells[well].heldUntilMs = untilMs != 0 ? untilMs : 1;
+}
+
+// --- Evaluation ---
+
+bool ArbitrationEngine::due(uint32_t nowMs) const {
+    if (dirtyWells != 0 || dirtyReservoirs != 0) return true;
+    for (uint8_t i = 0; i < ARB_MAX_NODES; i++) {
+        if (wells[i].wakeAtMs != 0 && (int32_t)(nowMs - wells[i].wakeAtMs) >= 0) return true;
+    }
+    return false;
+}
+
+uint8_t ArbitrationEngine::evaluate(uint32_t nowMs, ArbDecision* out, uint8_t max) {
+    for (uint8_t i = 0; i < ARB_MAX_NODES; i++) {
+        if (wells[i].wakeAtMs != 0 && (int32_t)(nowMs - wells[i].wakeAtMs) >= 0) {
+            wells[i].wakeAtMs = 0;
+            dirtyWells |= BIT(i);
+        }
+    }
+
+    uint8_t count = 0;
+    for (uint8_t pass = 0; pass < ARB_MAX_PASSES && (dirtyReservoirs != 0 || dirtyWells != 0); pass++) {
+        // Where each changed reservoir's demand goes; the wells on both ends are re-evaluated.
+        uint32_t changed = dirtyReservoirs;
+        dirtyReservoirs = 0;
+        for (uint8_t r = 0; r < ARB_MAX_NODES; r++) {
+            if (!(changed & BIT(r))) continue;
+            Reservoir& res = reservoirs[r];
+            uint8_t served = chooseWell(r, nowMs);
+            if (res.served != ARB_NONE) dirtyWells |= BIT(res.served);
+            if (served != ARB_NONE) dirtyWells |= BIT(served);
+            res.served = served;
+            for (uint8_t i = 0; i < linkTotal; i++) {
+                if (links[i].reservoir == r) dirtyWells |= BIT(links[i].well); // Level matters to all its wells
+            }
+        }
+
+        uint32_t pending = dirtyWells;
+        dirtyWells = 0;
+        for (uint8_t w = 0; w < ARB_MAX_NODES; w++) {
+            if (!(pending & BIT(w))) continue;
+            if (count == max) {
+                dirtyWells |= BIT(w); // No room for a decision: next call
+                continue;
+            }
+            if (evaluateWell(w, nowMs, out[count])) count++;
+        }
+    }
+    return count;
+}
+
+uint8_t ArbitrationEngine::chooseWell(uint8_t reservoir, uint32_t nowMs) const {
+    uint8_t current = reservoirs[reservoir].served;
+    uint8_t best = ARB_NONE;
+    uint16_t bestRank = 0;
+    for (uint8_t i = 0; i < linkTotal; i++) {
+        const Link& l = links[i];
+        if (l.reservoir != reservoir) continue;
+        const Well& w = wells[l.well];
+        if (!w.online) continue;
+        if (l.well == current && w.running) return current; // Stay on the running well
+        uint16_t rank = l.weight + (resting(w, nowMs) ? 0 : 256);
+        if (rank > bestRank) {
+            bestRank = rank;
+            best = l.well;
+        }
+    }
+    return best;
+}
+
+bool ArbitrationEngine::resting(const Well& w, uint32_t nowMs) const {
+    return !w.running && w.switched && nowMs - w.changedAtMs < w.rule.minRestMs;
+}
+
+void ArbitrationEngine::markReservoirsOf(uint8_t well) {
+    for (uint8_t i = 0; i < linkTotal; i++) {
+        if (links[i].well == well) dirtyReservoirs |= BIT(links[i].reservoir);
+    }
+}
+
+// Returns true if the well has a decision to report.
+bool ArbitrationEngine::evaluateWell(uint8_t well, uint32_t nowMs, ArbDecision& decision) {
+    Well& w = wells[well];
+    uint16_t score = 0;
+    uint8_t heaviest = ARB_NONE, heaviestWeight = 0;
+    uint8_t full = ARB_NONE;
+    for (uint8_t i = 0; i < linkTotal; i++) {
+        const Link& l = links[i];
+        if (l.well != well) continue;
+        const Reservoir& res = reservoirs[l.reservoir];
+        if (res.level == ARB_LEVEL_FULL) full = l.reservoir;
+        if (res.demand && res.served == well) {
+            score += l.weight;
+            if (l.weight > heaviestWeight) {
+                heaviestWeight = l.weight;
+                heaviest = l.reservoir;
+            }
+        }
+    }
+    w.score = score;
+
+    bool want;
+    ArbReason reason;
+    uint8_t cause = heaviest;
+    bool fullLimit = full != ARB_NONE && w.rule.fullIsLimit;
+    if (!needsArbitration(well)) {
+        w.reason = ARB_DIRECT;
+        w.wakeAtMs = 0;
+        return false;
+    }
+    if (!w.online) {
+        want = false;
+        reason = ARB_WELL_OFFLINE;
+    } else if (w.running) {
+        want = score > 0;
+        reason = want ? ARB_STILL_NEEDED : ARB_NO_DEMAND;
+    } else if (score == 0) {
+        want = false;
+        reason = ARB_IDLE;
+    } else if (fullLimit) {
+        want = false;
+        reason = ARB_RESERVOIR_FULL;
+        cause = full;
+    } else if (score < w.rule.startScore) {
+        want = false;
+        reason = ARB_BELOW_THRESHOLD;
+    } else {
+        want = true;
+        reason = ARB_DEMAND;
+    }
+
+    w.wakeAtMs = 0;
+    if (want != w.running && w.switched) {
+        uint32_t minimum = want ? w.rule.minRestMs : w.rule.minRunMs;
+        bool overflow = !want && fullLimit;
+        if (nowMs - w.changedAtMs < minimum && !overflow) {
+            w.wakeAtMs = w.changedAtMs + minimum;
+            if (w.wakeAtMs == 0) w.wakeAtMs = 1; // 0 means nothing deferred
+            reason = want ? ARB_MIN_REST : ARB_MIN_RUN;
+            want = w.running;
+        } else if (overflow && nowMs - w.changedAtMs < minimum) {
+            reason = ARB_RESERVOIR_FULL;
+            cause = full;
+        }
+    }
+
+    ArbReason previous = w.reason;
+    w.reason = reason;
+    decision.well = well;
+    decision.on = want;
+    decision.reason = reason;
+    decision.reservoir = cause;
+    if (want != w.running) {
+        w.running = want;
+        w.pending = true;
+        w.heldUntilMs = 0;
+        w.switched = true;
+        w.changedAtMs = nowMs;
+        markReservoirsOf(well);
+        decision.command = true;
+        return true;
+    }
+    // Refusals and deferrals are reported once, not at every evaluation.
+    decision.command = false;
+    bool notable = reason == ARB_RESERVOIR_FULL || reason == ARB_BELOW_THRESHOLD ||
+                   reason == ARB_MIN_RUN || reason == ARB_MIN_REST;
+    return notable && reason != previous;
+}
+
+const char* ArbitrationEngine::reasonName(ArbReason reason) {
+    switch (reason) {
+        case ARB_IDLE: return "IDLE";
+        case ARB_DEMAND: return "DEMAND";
+        case ARB_NO_DEMAND: return "NO_DEMAND";
+        case ARB_STILL_NEEDED: return "STILL_NEEDED";
+        case ARB_RESERVOIR_FULL: return "RESERVOIR_FULL";
+        case ARB_BELOW_THRESHOLD: return "BELOW_THRESHOLD";
+        case ARB_MIN_RUN: return "MIN_RUN";
+        case ARB_MIN_REST: return "MIN_REST";
+        case ARB_WELL_OFFLINE: return "WELL_OFFLINE";
+        case ARB_DIRECT: return "DIRECT";
+        default: return "UNKNOWN";
+    }
+}
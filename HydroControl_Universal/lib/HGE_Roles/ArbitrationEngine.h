@@ -0,0 +1,159 @@
+#ifndef ARBITRATION_ENGINE_H
+#define ARBITRATION_ENGINE_H
+
+#include <stdint.h>
+
+#define ARB_MAX_NODES        16  // MAX_NODES: reservoirs and wells are node slots
+#define ARB_MAX_LINKS        32  // Reservoir -> well links
+#define ARB_MAX_PASSES       4   // Re-evaluation rounds per evaluate(), see evaluate()
+#define ARB_NONE             0xFF
+#define ARB_DEFAULT_WEIGHT   10
+#define ARB_COMMAND_GRACE_MS 30000 // A well report contradicting our command is ignored this long
+
+static_assert(ARB_MAX_NODES < 32, "node slots are bits of a uint32_t");
+
+enum ArbLevel : uint8_t {
+    ARB_LEVEL_UNKNOWN,
+    ARB_LEVEL_EMPTY,
+    ARB_LEVEL_OK,
+    ARB_LEVEL_FULL
+};
+
+enum ArbReason : uint8_t {
+    ARB_IDLE,            // No demand, pump off
+    ARB_DEMAND,          // Started: the weighted demand reached the well's threshold
+    ARB_NO_DEMAND,       // Stopped: no reservoir needs the well any more
+    ARB_STILL_NEEDED,    // Running, and still needed by a reservoir
+    ARB_RESERVOIR_FULL,  // Not started, or minimum run cut short: a reservoir on the well is full
+    ARB_BELOW_THRESHOLD, // Not started: weighted demand below the threshold
+    ARB_MIN_RUN,         // Stop deferred to the end of the minimum run time
+    ARB_MIN_REST,        // Start deferred to the end of the minimum rest time
+    ARB_WELL_OFFLINE,    // The well stopped answering
+    ARB_DIRECT           // Not arbitrated: its only reservoir commands it directly
+};
+
+struct ArbWellRule {
+    uint32_t minRunMs;
+    uint32_t minRestMs;
+    uint16_t startScore;  // Weighted demand needed to start; any demand keeps it running
+    bool fullIsLimit;     // A full reservoir on the well blocks starts and ends the minimum run
+};
+
+struct ArbDecision {
+    uint8_t well;
+    bool on;              // State the well should be in
+    bool command;         // true: switch the well; false: refusal or deferral, for the log only
+    ArbReason reason;
+    uint8_t reservoir;    // Reservoir behind the decision, ARB_NONE if none
+};
+
+// Shared-well arbitration of the Centrale, as rules over reservoir states rather
+// than code in the request handler. Pure logic: no Arduino, RTOS or radio, time
+// passed in by the caller, so it runs the same on a PC.
+//
+// Reservoirs and wells are Centrale node slots. A reservoir may be linked to
+// several wells, each link with a weight. Its demand (a pump request) goes to one
+// well at a time: the one already serving it while that well runs, otherwise the
+// heaviest link whose well is online and not resting, otherwise the heaviest
+// online one (the start is then deferred). A well runs while the summed weights of
+// the demands it serves are > 0, and starts once they reach its startScore, unless
+// a full reservoir is linked to it (fullIsLimit). Minimum run and rest times defer
+// the change, evaluate() comes back to it once the time is over.
+//
+// With one link per reservoir, the default rule reproduces the historical
+// behaviour: start unless a reservoir on the well is full, stop once no reservoir
+// on the well is asking for water. A well with a single reservoir and no rule is
+// left to that reservoir (ARB_DIRECT): the engine only follows its reports.
+//
+// Inputs only mark what they affect; evaluate() re-examines those reservoirs and
+// wells and, when a well changes state, the reservoirs linked to it (their
+// choice of well may change). Each round is O(links), at most ARB_MAX_PASSES
+// rounds per call; anything left stays marked for the next call.
+//
+// Not thread-safe: the Centrale calls it with the node list locked.
+class ArbitrationEngine {
+public:
+    ArbitrationEngine();
+
+    static ArbWellRule defaultRule();
+
+    // Topology. clearLinks() keeps the wells' states and timers.
+    void clearLinks();
+    bool link(uint8_t reservoir, uint8_t well, uint8_t weight);
+    void setRule(uint8_t well, const ArbWellRule& rule);
+    const ArbWellRule& rule(uint8_t well) const { return wells[well].rule; }
+    uint8_t linkCount() const { return linkTotal; }
+    bool linkAt(uint8_t index, uint8_t& reservoir, uint8_t& well, uint8_t& weight) const;
+    bool hasWell(uint8_t reservoir) const;
+    // True when reservoirs on this well must go through the Centrale rather than
+    // command it directly: the well is shared, backs up another one, or has a rule.
+    bool needsArbitration(uint8_t well) const;
+
+    // State inputs
+    void setLevel(uint8_t reservoir, ArbLevel level);
+    void setDemand(uint8_t reservoir, bool demand);
+    void setWellOnline(uint8_t well, bool online, uint32_t nowMs);
+    // The well's own report of its relay. Taken as the truth unless we switched it
+    // less than ARB_COMMAND_GRACE_MS ago and it has not confirmed yet.
+    void wellReported(uint8_t well, bool running, uint32_t nowMs);
+    // The well acknowledged our command but holds it (its own pump protection)
+    // until untilMs: the grace period then runs from untilMs.
+    void wellHeld(uint8_t well, uint32_t untilMs);
+
+    // Returns the number of decisions written to out.
+    uint8_t evaluate(uint32_t nowMs, ArbDecision* out, uint8_t max);
+    // Something is marked, or a deferred change is due.
+    bool due(uint32_t nowMs) const;
+
+    uint8_t servingWell(uint8_t reservoir) const { return reservoirs[reservoir].served; }
+    bool demand(uint8_t reservoir) const { return reservoirs[reservoir].demand; }
+    bool running(uint8_t well) const { return wells[well].running; }
+    // Switched by us, not confirmed by the well yet
+    bool pending(uint8_t well) const { return wells[well].pending; }
+    ArbReason reason(uint8_t well) const { return wells[well].reason; }
+    uint16_t score(uint8_t well) const { return wells[well].score; }
+    // 0 if nothing is deferred
+    uint32_t wakeAtMs(uint8_t well) const { return wells[well].wakeAtMs; }
+
+    static const char* reasonName(ArbReason reason);
+
+private:
+    struct Link {
+        uint8_t reservoir;
+        uint8_t well;
+        uint8_t weight;
+    };
+
+    struct Well {
+        ArbWellRule rule;
+        bool online;
+        bool running;
+        bool pending;         // Switched by us, not confirmed by the well yet
+        bool switched;        // changedAtMs is valid
+        uint32_t changedAtMs;
+        uint32_t wakeAtMs;    // Deferred change due, 0 = none
+        uint32_t heldUntilMs; // Our command held by the well until then, 0 = not held
+        uint16_t score;
+        ArbReason reason;
+    };
+
+    struct Reservoir {
+        ArbLevel level;
+        bool demand;
+        uint8_t served;       // Well its demand goes to, ARB_NONE = none
+    };
+
+    Link links[ARB_MAX_LINKS];
+    uint8_t linkTotal = 0;
+    Well wells[ARB_MAX_NODES];
+    Reservoir reservoirs[ARB_MAX_NODES];
+    uint32_t dirtyWells = 0;
+    uint32_t dirtyReservoirs = 0;
+
+    uint8_t chooseWell(uint8_t reservoir, uint32_t nowMs) const;
+    bool evaluateWell(uint8_t well, uint32_t nowMs, ArbDecision& decision);
+    void markReservoirsOf(uint8_t well);
+    bool resting(const Well& w, uint32_t nowMs) const;
+};
+
+#endif // ARBITRATION_ENGINE_H
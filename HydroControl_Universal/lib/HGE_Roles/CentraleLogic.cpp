@@ -3,72 +3,139 @@
 #include <SPI.h>
 #include "Crypto.h"
 #include "LittleFS.h"
+#include "WifiConnector.h"
+#include "Persistence.h"
+#include "Clock.h"
+#include "Metrics.h"
+#include "TraceLog.h"
+#include "Profiler.h"
 
 CentraleLogic* CentraleLogic::instance = nullptr;
 
 // --- FreeRTOS Handles ---
 QueueHandle_t loraRxQueue_Centrale;
 SemaphoreHandle_t nodeListMutex_Centrale;
+SemaphoreHandle_t loraTxMutex_Centrale;
 
-CentraleLogic::CentraleLogic() : server(80), events("/events") {
+// Takes the node list mutex and records how long the caller waited for it.
+static BaseType_t lockNodeList(TickType_t timeout) {
+    uint32_t startUs = micros();
+    BaseType_t taken = xSemaphoreTake(nodeListMutex_Centrale, timeout);
+    Metrics::observe(MH_MUTEX_WAIT_US, micros() - startUs);
+    return taken;
+}
+
+CentraleLogic::CentraleLogic() : server(80), events("/events"), assets(LittleFS, "/index_centrale.html"), wsApi("/ws") {
     instance = this;
 }
 
 void CentraleLogic::initialize() {
     Serial.println("Centrale Logic Initializing...");
 
-    // --- Connect to Wi-Fi ---
+    deviceId = WiFi.macAddress();
+    deviceId.replace(":", "");
+
+    loraRxQueue_Centrale = xQueueCreate(10, LORA_RX_PACKET_MAX_LEN);
+    nodeListMutex_Centrale = xSemaphoreCreateMutex();
+    loraTxMutex_Centrale = xSemaphoreCreateMutex();
+    rxSchedule = RxSchedule::defaultConfig();
+    latency.begin();
+
+    // The radio network must not wait for Wi-Fi: every subsystem starts as soon as
+    // what it needs is ready, and Wi-Fi associates in the background.
+    uint32_t loraPhase = boot.addPhase("LoRa", [](void* ctx) {
+        return ((CentraleLogic*)ctx)->setupLoRa();
+    }, this);
+    storagePhase = boot.addPhase("LittleFS", [](void* ctx) {
+        if (!LittleFS.begin()) {
+            Serial.println("An Error has occurred while mounting LittleFS");
+            return false;
+        }
+        if (TRACE_TO_FILE) TraceLog::setSink(TRACE_SINK_FILE);
+        return true;
+    }, this);
+    uint32_t wifiPhase = boot.addPhase("WiFi", [](void* ctx) {
+        return ((CentraleLogic*)ctx)->startWifi();
+    }, this);
+    wifiLinkPhase = boot.addPhase("WiFiLink", [](void* ctx) {
+        return true; // Finished by onWifiResult()
+    }, this, wifiPhase, true);
+    // Restored before the LoRa handler runs, so arbitration works from the first request.
+    uint32_t restorePhase = boot.addPhase("NodeTable", [](void* ctx) {
+        return ((CentraleLogic*)ctx)->restoreNodeSnapshot();
+    }, this);
+    boot.addPhase("History", [](void* ctx) {
+        return ((CentraleLogic*)ctx)->history.begin();
+    }, this, storagePhase);
+    boot.addPhase("Journal", [](void* ctx) {
+        return ((CentraleLogic*)ctx)->journal.begin();
+    }, this, storagePhase);
+    boot.addPhase("LoRaTasks", [](void* ctx) {
+        ((CentraleLogic*)ctx)->startTasks();
+        return true;
+    }, this, loraPhase | restorePhase);
+    boot.addPhase("WebServer", [](void* ctx) {
+        ((CentraleLogic*)ctx)->setupWebServer();
+        return true;
+    }, this, storagePhase | wifiPhase | restorePhase);
+    // Connects in the background like Wi-Fi; events are spooled until then.
+    boot.addPhase("MQTT", [](void* ctx) {
+        return ((CentraleLogic*)ctx)->startMqtt();
+    }, this, storagePhase | wifiPhase | restorePhase);
+    boot.addPhase("Modbus", [](void* ctx) {
+        CentraleLogic* self = (CentraleLogic*)ctx;
+        self->modbus.begin(fillSocketSnapshot, onModbusPump, self);
+        return true;
+    }, this, wifiPhase | restorePhase);
+    boot.start();
+}
+
+bool CentraleLogic::startWifi() {
     Preferences prefs;
     prefs.begin("network_config", true);
     String ssid = prefs.getString("ssid", "");
     String password = prefs.getString("password", "");
     prefs.end();
 
-    if (ssid.length() > 0) {
-        WiFi.begin(ssid.c_str(), password.c_str());
-        Serial.print("Connecting to WiFi...");
-        int retries = 0;
-        while (WiFi.status() != WL_CONNECTED && retries < 20) {
-            delay(500);
-            Serial.print(".");
-            retries++;
-        }
-        if (WiFi.status() == WL_CONNECTED) {
-            Serial.println("\nWiFi connected!");
-            Serial.print("IP Address: ");
-            Serial.println(WiFi.localIP());
-        } else {
-            Serial.println("\nFailed to connect to WiFi. Web server will not be available.");
-        }
-    } else {
+    if (ssid.length() == 0) {
         Serial.println("No WiFi credentials found. Web server will not be available.");
+        return false;
     }
-    // --- End Wi-Fi Connection ---
-
-    deviceId = WiFi.macAddress();
-    deviceId.replace(":", "");
+    WifiConnector::begin(ssid, password, onWifiResult, this);
+    return true;
+}
 
-    loraRxQueue_Centrale = xQueueCreate(10, LORA_RX_PACKET_MAX_LEN);
-    nodeListMutex_Centrale = xSemaphoreCreateMutex();
+bool CentraleLogic::startMqtt() {
+    Preferences prefs;
+    prefs.begin("mqtt_config", true);
+    String host = prefs.getString("host", "");
+    uint16_t port = prefs.getUShort("port", MQTT_DEFAULT_PORT);
+    String user = prefs.getString("user", "");
+    String password = prefs.getString("password", "");
+    prefs.end();
 
-    if(!LittleFS.begin()){
-        Serial.println("An Error has occurred while mounting LittleFS");
-        return;
+    if (host.length() == 0) {
+        Serial.println("No MQTT broker configured. MQTT bridge disabled.");
+        return false;
     }
+    journal.setListener(onJournalEvent, this);
+    return mqtt.begin(host, port, user, password, deviceId, fillSocketSnapshot, onMqttCommand, this);
+}
 
-    setupLoRa();
-    setupWebServer();
-    startTasks();
-
-    Serial.println("Centrale Logic Initialized.");
+void CentraleLogic::onWifiResult(bool connected, void* context) {
+    CentraleLogic* self = (CentraleLogic*)context;
+    if (connected) {
+        Clock::startSync(); // History timestamps; until synced they are boot-relative
+    }
+    self->boot.complete(self->wifiLinkPhase, connected);
 }
 
-void CentraleLogic::setupLoRa() {
+bool CentraleLogic::setupLoRa() {
     SPI.begin(LORA_SCK_PIN, LORA_MISO_PIN, LORA_MOSI_PIN);
     LoRa.setPins(LORA_SS_PIN, LORA_RST_PIN, LORA_DIO0_PIN);
     if (!LoRa.begin(433E6)) {
         Serial.println("Starting LoRa failed!");
-        while (1);
+        return false;
     }
 
     Preferences prefs;
@@ -79,93 +146,194 @@ void CentraleLogic::setupLoRa() {
     if (psk.length() == 16) {
         CryptoManager::setKey((const uint8_t*)psk.c_str());
     } else {
-        Serial.println("FATAL: LoRa PSK is not 16 characters. Halting.");
-        while(1);
+        Serial.println("FATAL: LoRa PSK is not 16 characters. Radio disabled.");
+        return false;
     }
 
     LoRa.onReceive(onReceive);
     LoRa.receive();
     Serial.println("LoRa receiver started.");
+    return true;
 }
 
 void CentraleLogic::startTasks() {
-    xTaskCreate(Task_LoRa_Handler, "LoRaHandler", 4096, this, 3, NULL);
-    xTaskCreate(Task_Node_Janitor, "NodeJanitor", 2048, this, 1, NULL);
-    xTaskCreate(Task_SSE_Publisher, "SSEPublisher", 4096, this, 2, NULL);
+    xTaskCreate(Task_LoRa_Handler, "LoRaHandler", Profiler::stackSize("LoRaHandler", 4096), this, 3, NULL);
+    xTaskCreate(Task_Node_Janitor, "NodeJanitor", Profiler::stackSize("NodeJanitor", 2048), this, 1, NULL);
+    xTaskCreate(Task_SSE_Publisher, "SSEPublisher", Profiler::stackSize("SSEPublisher", 4096), this, 2, NULL);
+    xTaskCreate(Task_Beacon_Scheduler, "BeaconScheduler", Profiler::stackSize("BeaconScheduler", 4096), this, 3, NULL);
+    xTaskCreate(Task_Snapshot_Writer, "SnapshotWriter", Profiler::stackSize("SnapshotWriter", 4096), this, 1, NULL);
+    xTaskCreate(Task_Arbitration, "Arbitration", Profiler::stackSize("Arbitration", 4096), this, 1, NULL);
 }
 
 void CentraleLogic::setupWebServer() {
-    server.on("/", HTTP_GET, [](AsyncWebServerRequest *request){
-        request->send(LittleFS, "/index_centrale.html", "text/html");
-    });
+    // Dashboard files, gzipped and fingerprinted at build time (scripts/compress_assets.py).
+    assets.begin();
+    server.addHandler(&assets);
 
+    // The same commands are available on the WebSocket API (/ws).
     server.on("/api/assign", HTTP_POST, [](AsyncWebServerRequest *request){
+        uint32_t startUs = micros();
         if (request->hasParam("reservoirId", true) && request->hasParam("wellId", true)) {
-            String reservoirId = request->getParam("reservoirId", true)->value();
-            String wellId = request->getParam("wellId", true)->value();
-
-            if (xSemaphoreTake(nodeListMutex_Centrale, portMAX_DELAY) == pdTRUE) {
-                bool isShared = false;
-                for (int i = 0; i < instance->nodeCount; i++) {
-                    if (instance->nodeList[i].id.equals(reservoirId)) {
-                        instance->nodeList[i].assignedTo = wellId;
-                        break;
-                    }
-                }
-
-                int assignments = 0;
-                for (int i = 0; i < instance->nodeCount; i++) {
-                    if (instance->nodeList[i].type == ROLE_AQUA_RESERV_PRO && instance->nodeList[i].assignedTo.equals(wellId)) {
-                        assignments++;
-                    }
-                }
-                isShared = (assignments > 1);
-
-                for (int i = 0; i < instance->nodeCount; i++) {
-                    if (instance->nodeList[i].type == ROLE_AQUA_RESERV_PRO && instance->nodeList[i].assignedTo.equals(wellId)) {
-                        StaticJsonDocument<256> cmdDoc;
-                        cmdDoc["type"] = MessageType::COMMAND;
-                        cmdDoc["tgt"] = instance->nodeList[i].id;
-                        cmdDoc["cmd"] = "ASSIGN_WELL";
-                        cmdDoc["well_id"] = wellId;
-                        cmdDoc["is_shared"] = isShared;
-                        String packet;
-                        serializeJson(cmdDoc, packet);
-                        sendLoRaMessage(packet);
-                    }
-                }
-                xSemaphoreGive(nodeListMutex_Centrale);
-            }
+            instance->assignWell(request->getParam("reservoirId", true)->value(), request->getParam("wellId", true)->value());
             request->send(200, "text/plain", "Assignment updated.");
         } else {
             request->send(400, "text/plain", "Missing parameters.");
         }
+        Metrics::observe(MH_HTTP_COMMAND_US, micros() - startUs);
+    });
+
+    server.on("/api/fill", HTTP_GET, [](AsyncWebServerRequest *request) {
+        AsyncResponseStream *response = request->beginResponseStream("application/json");
+        instance->writeFillJson(*response);
+        request->send(response);
+    });
+
+    server.on("/api/arbitration", HTTP_GET, [](AsyncWebServerRequest *request) {
+        AsyncResponseStream *response = request->beginResponseStream("application/json");
+        instance->writeArbitrationJson(*response);
+        request->send(response);
+    });
+
+    // Rule of a well: id, minRun and minRest (s), score (start threshold), fullIsLimit (0/1)
+    server.on("/api/arbitration/well", HTTP_POST, [](AsyncWebServerRequest *request) {
+        uint32_t startUs = micros();
+        if (!request->hasParam("id", true)) {
+            request->send(400, "text/plain", "Missing parameters.");
+            return;
+        }
+        ArbWellConfig config;
+        memset(&config, 0, sizeof(config));
+        config.minRunS = request->hasParam("minRun", true) ? request->getParam("minRun", true)->value().toInt() : 0;
+        config.minRestS = request->hasParam("minRest", true) ? request->getParam("minRest", true)->value().toInt() : 0;
+        config.startScore = request->hasParam("score", true) ? request->getParam("score", true)->value().toInt() : 1;
+        config.fullIsLimit = request->hasParam("fullIsLimit", true) ? request->getParam("fullIsLimit", true)->value().toInt() != 0 : 1;
+        if (instance->setWellRule(request->getParam("id", true)->value(), config)) {
+            request->send(200, "text/plain", "Rule updated.");
+        } else {
+            request->send(507, "text/plain", "Too many well rules.");
+        }
+        Metrics::observe(MH_HTTP_COMMAND_US, micros() - startUs);
+    });
+
+    // Backup or extra well of a reservoir: reservoir, well, weight (0 removes the link)
+    server.on("/api/arbitration/link", HTTP_POST, [](AsyncWebServerRequest *request) {
+        uint32_t startUs = micros();
+        if (!request->hasParam("reservoir", true) || !request->hasParam("well", true) || !request->hasParam("weight", true)) {
+            request->send(400, "text/plain", "Missing parameters.");
+            return;
+        }
+        long weight = request->getParam("weight", true)->value().toInt();
+        if (weight < 0 || weight > 255) {
+            request->send(400, "text/plain", "Weight out of range (0-255).");
+            return;
+        }
+        if (instance->setWellLink(request->getParam("reservoir", true)->value(), request->getParam("well", true)->value(), (uint8_t)weight)) {
+            request->send(200, "text/plain", "Link updated.");
+        } else {
+            request->send(507, "text/plain", "Too many links.");
+        }
+        Metrics::observe(MH_HTTP_COMMAND_US, micros() - startUs);
     });
 
     server.on("/api/set-name", HTTP_POST, [](AsyncWebServerRequest *request) {}, NULL,
         [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total){
-        StaticJsonDocument<128> doc;
+        uint32_t startUs = micros();
+        StaticJsonDocument<256> doc;
         deserializeJson(doc, (const char*) data, len);
         String nodeId = doc["id"];
         String nodeName = doc["name"];
+        bool hasNotes = doc.containsKey("notes");
+        String nodeNotes = doc["notes"] | "";
 
         if (nodeId.length() > 0) {
-            if (xSemaphoreTake(nodeListMutex_Centrale, portMAX_DELAY) == pdTRUE) {
-                for (int i = 0; i < instance->nodeCount; i++) {
-                    if (instance->nodeList[i].id.equals(nodeId)) {
-                        instance->nodeList[i].name = nodeName;
-                        instance->saveNodeName(nodeId, nodeName);
-                        break;
-                    }
-                }
-                xSemaphoreGive(nodeListMutex_Centrale);
-            }
+            instance->renameNode(nodeId, nodeName, hasNotes, nodeNotes);
             request->send(200, "text/plain", "Name updated.");
         } else {
             request->send(400, "text/plain", "Invalid request.");
         }
+        Metrics::observe(MH_HTTP_COMMAND_US, micros() - startUs);
+    });
+
+    // /api/history?node=<id>[&from=<unix s>][&to=<unix s>][&step=<s>]
+    server.on("/api/history", HTTP_GET, [](AsyncWebServerRequest *request) {
+        if (!request->hasParam("node")) {
+            request->send(400, "text/plain", "Missing node.");
+            return;
+        }
+        String nodeId = request->getParam("node")->value();
+        uint32_t from = request->hasParam("from") ? strtoul(request->getParam("from")->value().c_str(), NULL, 10) : 0;
+        uint32_t to = request->hasParam("to") ? strtoul(request->getParam("to")->value().c_str(), NULL, 10) : UINT32_MAX;
+        uint32_t step = request->hasParam("step") ? strtoul(request->getParam("step")->value().c_str(), NULL, 10) : 0;
+
+        std::shared_ptr<TimeSeriesQuery> query = instance->history.query(nodeId, from, to, step);
+        if (!query) {
+            request->send(404, "text/plain", "No history for this node.");
+            return;
+        }
+        // Streamed block by block: the response never holds more than one chunk in RAM.
+        request->send(request->beginChunkedResponse("application/json", [query](uint8_t *buffer, size_t maxLen, size_t index) {
+            return query->read(buffer, maxLen);
+        }));
     });
 
+    // /api/journal?format=csv|ndjson[&from=<unix s>][&to=<unix s>][&well=<id>]
+    server.on("/api/journal", HTTP_GET, [](AsyncWebServerRequest *request) {
+        bool csv = !request->hasParam("format") || request->getParam("format")->value() != "ndjson";
+        uint32_t from = request->hasParam("from") ? strtoul(request->getParam("from")->value().c_str(), NULL, 10) : 0;
+        uint32_t to = request->hasParam("to") ? strtoul(request->getParam("to")->value().c_str(), NULL, 10) : UINT32_MAX;
+        String wellId = request->hasParam("well") ? request->getParam("well")->value() : "";
+
+        std::shared_ptr<JournalExport> exp = instance->journal.exportEvents(csv ? JOURNAL_CSV : JOURNAL_NDJSON, from, to, wellId);
+        if (!exp) {
+            request->send(404, "text/plain", "No journal for this well.");
+            return;
+        }
+        // Each chunk is filled straight from flash blocks; the export is never held in RAM.
+        AsyncWebServerResponse *response = request->beginChunkedResponse(csv ? "text/csv" : "application/x-ndjson",
+            [exp](uint8_t *buffer, size_t maxLen, size_t index) {
+                return exp->read(buffer, maxLen);
+            });
+        response->addHeader("Content-Disposition", csv ? "attachment; filename=pump-journal.csv" : "attachment; filename=pump-journal.ndjson");
+        request->send(response);
+    });
+
+    // Binary trace, decoded on a PC with scripts/decode_trace.py. ?old=1 for the previous file.
+    server.on("/api/trace", HTTP_GET, [](AsyncWebServerRequest *request) {
+        const char* path = request->hasParam("old") ? TRACE_FILE_OLD : TRACE_FILE_PATH;
+        if (!LittleFS.exists(path)) {
+            request->send(404, "text/plain", "No trace file.");
+            return;
+        }
+        request->send(LittleFS, path, "application/octet-stream", true);
+    });
+
+    server.on("/api/latency", HTTP_GET, [](AsyncWebServerRequest *request) {
+        AsyncResponseStream *response = request->beginResponseStream("application/json");
+        instance->latency.writeJson(*response);
+        request->send(response);
+    });
+
+    // Tasks, stacks and heap of the Centrale, plus the last diagnostics of each node.
+    server.on("/api/profile", HTTP_GET, [](AsyncWebServerRequest *request) {
+        AsyncResponseStream *response = request->beginResponseStream("application/json");
+        response->print("{\"local\":");
+        Profiler::writeJson(*response);
+        response->print(",\"nodes\":");
+        instance->writeNodeDiagnostics(*response);
+        response->print("}");
+        request->send(response);
+    });
+
+    server.on("/metrics", HTTP_GET, [](AsyncWebServerRequest *request) {
+        AsyncResponseStream *response = request->beginResponseStream("text/plain; version=0.0.4");
+        Metrics::writePrometheus(*response);
+        instance->writeNodeMetrics(*response);
+        request->send(response);
+    });
+
+    wsApi.begin(onSocketCommand, fillSocketSnapshot, this);
+    server.addHandler(&wsApi.handler());
+    events.begin();
     server.addHandler(&events);
     server.begin();
 }
@@ -185,6 +353,9 @@ void CentraleLogic::Task_LoRa_Handler(void *pvParameters) {
             String decryptedPacket = CryptoManager::decrypt(encryptedPacket);
             if (decryptedPacket.length() > 0) {
                 handleLoRaPacket(decryptedPacket, rssi);
+            } else {
+                Metrics::inc(MC_LORA_DECRYPT_FAILURES);
+                TRACE(TR_LORA_DECRYPT_FAILED, encryptedPacket.length());
             }
         }
     }
@@ -194,31 +365,427 @@ void CentraleLogic::Task_Node_Janitor(void *pvParameters) {
     const long NODE_TIMEOUT_MS = 300000; // 5 minutes
     for (;;) {
         vTaskDelay(pdMS_TO_TICKS(30000)); // Run every 30 seconds
-        if (xSemaphoreTake(nodeListMutex_Centrale, portMAX_DELAY) == pdTRUE) {
+        if (lockNodeList(portMAX_DELAY) == pdTRUE) {
             unsigned long currentTime = millis();
             for (int i = 0; i < instance->nodeCount; i++) {
+                Node& node = instance->nodeList[i];
+                if (node.cmdSentAtMs != 0 && currentTime - node.cmdSentAtMs > PUMP_ACK_TIMEOUT_MS) {
+                    Metrics::inc(MC_ACK_TIMEOUTS);
+                    instance->journal.pumpAck(node.id, node.cmdFrom, node.cmdOn, JOURNAL_ACK_TIMEOUT, currentTime - node.cmdSentAtMs, node.cmdAttempts);
+                    node.cmdSentAtMs = 0;
+                    node.trace.id = 0;
+                }
                 if (instance->nodeList[i].status != "DISCONNECTED" && (currentTime - instance->nodeList[i].lastSeen > NODE_TIMEOUT_MS)) {
+                    instance->trackPumpRun(node, "DISCONNECTED");
                     instance->nodeList[i].status = "DISCONNECTED";
-                    Serial.printf("Node %s timed out.\n", instance->nodeList[i].id.c_str());
+                    instance->markSnapshotDirty();
+                    instance->history.record(instance->nodeList[i].id, TS_KIND_STATUS, TS_VALUE_DISCONNECTED, 0);
+                    instance->updateArbitrationInputs(i);
+                    TRACE(TR_NODE_TIMEOUT, TRACE_ID(instance->nodeList[i].id));
                 }
             }
+            // A well gone silent hands its reservoirs over to their backup wells
+            if (instance->arbitration.due(currentTime)) instance->runArbitration();
             xSemaphoreGive(nodeListMutex_Centrale);
         }
     }
 }
 
+// Ends the deferrals (minimum run and rest times) when nothing else comes in.
+void CentraleLogic::Task_Arbitration(void* pvParameters) {
+    CentraleLogic* self = (CentraleLogic*)pvParameters;
+    for (;;) {
+        vTaskDelay(pdMS_TO_TICKS(ARBITRATION_TICK_MS));
+        if (lockNodeList(portMAX_DELAY) != pdTRUE) continue;
+        if (self->arbitration.due(millis())) self->runArbitration();
+#if FILL_TOP_UP
+        if (millis() - self->topUpPlannedMs >= FILL_PLAN_PERIOD_S * 1000UL) {
+            self->topUpPlannedMs = millis();
+            self->planTopUps();
+        }
+#endif
+        xSemaphoreGive(nodeListMutex_Centrale);
+    }
+}
+
 void CentraleLogic::Task_SSE_Publisher(void* pvParameters) {
     for(;;) {
         vTaskDelay(pdMS_TO_TICKS(2000)); // Push updates every 2 seconds
-        instance->events.send(instance->getSystemStatusJson().c_str(), "update", millis());
+        if (instance->events.count() == 0) continue;
+        instance->events.publish("update", instance->getSystemStatusJson());
     }
 }
 
+// Sends the beacons and releases each slotted node's queued downlinks at the start of its receive slots.
+void CentraleLogic::Task_Beacon_Scheduler(void* pvParameters) {
+    CentraleLogic* self = (CentraleLogic*)pvParameters;
+    const RxScheduleConfig& cfg = self->rxSchedule;
+
+    for (;;) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+
+        if (self->beaconAtMs == 0 || millis() - self->beaconAtMs >= cfg.beaconPeriodMs) {
+            self->beaconSeq++;
+            sendLoRaMessage(LoRaMessage::serializeBeacon(self->beaconSeq));
+            // Nodes time-stamp the beacon when it has been fully received.
+            self->beaconAtMs = millis();
+            continue;
+        }
+
+        uint32_t since = millis() - self->beaconAtMs;
+        uint32_t lookFrom = since > PING_SLOT_TX_TOLERANCE_MS ? since - PING_SLOT_TX_TOLERANCE_MS : 0;
+        String packet;
+        bool found = false;
+        if (lockNodeList(portMAX_DELAY) == pdTRUE) {
+            for (int i = 0; i < self->nodeCount && !found; i++) {
+                Node& node = self->nodeList[i];
+                if (!node.pingSlots || node.downlinkCount == 0) continue;
+                uint32_t offset = RxSchedule::slotOffsetMs(cfg, node.id.c_str(), self->beaconSeq);
+                uint32_t slotStart = RxSchedule::nextSlotStartMs(cfg, offset, lookFrom);
+                // Give the node one scheduler tick to open its receiver
+                if (slotStart != RxSchedule::NO_SLOT && since >= slotStart + 10) {
+                    found = self->popDownlink(i, packet);
+                }
+            }
+            xSemaphoreGive(nodeListMutex_Centrale);
+        }
+        if (found) {
+            sendLoRaMessage(packet);
+        }
+    }
+}
+
+
+// --- Arbitration ---
+
+static JournalOutcome outcomeOf(ArbReason reason) {
+    switch (reason) {
+        case ARB_RESERVOIR_FULL: return JOURNAL_DENIED_RESERVOIR_FULL;
+        case ARB_STILL_NEEDED: return JOURNAL_DENIED_OTHER_EMPTY;
+        case ARB_BELOW_THRESHOLD: return JOURNAL_BELOW_THRESHOLD;
+        case ARB_MIN_RUN: return JOURNAL_DEFERRED_MIN_RUN;
+        case ARB_MIN_REST: return JOURNAL_DEFERRED_MIN_REST;
+        case ARB_WELL_OFFLINE: return JOURNAL_WELL_OFFLINE;
+        default: return JOURNAL_OK;
+    }
+}
+
+// Must be called with nodeListMutex_Centrale held.
+int CentraleLogic::findNode(const String& id) {
+    for (int i = 0; i < nodeCount; i++) {
+        if (nodeList[i].id.equals(id)) return i;
+    }
+    return -1;
+}
+
+void CentraleLogic::loadArbitrationConfig() {
+    Preferences prefs;
+    prefs.begin("arbitration", true);
+    size_t wellsLen = prefs.getBytesLength("wells");
+    size_t linksLen = prefs.getBytesLength("links");
+    arbWellCount = wellsLen / sizeof(ArbWellConfig) > MAX_NODES ? MAX_NODES : wellsLen / sizeof(ArbWellConfig);
+    arbLinkCount = linksLen / sizeof(ArbLinkConfig) > ARB_MAX_LINKS ? ARB_MAX_LINKS : linksLen / sizeof(ArbLinkConfig);
+    if (arbWellCount > 0) prefs.getBytes("wells", arbWells, arbWellCount * sizeof(ArbWellConfig));
+    if (arbLinkCount > 0) prefs.getBytes("links", arbLinks, arbLinkCount * sizeof(ArbLinkConfig));
+    prefs.end();
+    if (arbWellCount > 0 || arbLinkCount > 0) {
+        Serial.printf("Arbitration: %u well rules, %u links.\n", arbWellCount, arbLinkCount);
+    }
+}
+
+// Web server task only, like every change of the settings.
+void CentraleLogic::saveArbitrationConfig() {
+    Preferences prefs;
+    prefs.begin("arbitration", false);
+    if (arbWellCount > 0) prefs.putBytes("wells", arbWells, arbWellCount * sizeof(ArbWellConfig));
+    else prefs.remove("wells");
+    if (arbLinkCount > 0) prefs.putBytes("links", arbLinks, arbLinkCount * sizeof(ArbLinkConfig));
+    else prefs.remove("links");
+    prefs.end();
+}
+
+// Must be called with nodeListMutex_Centrale held. The settings are by node ID and
+// the engine works on slots: rebuilt whenever either changes.
+void CentraleLogic::rebuildArbitration() {
+    arbitration.clearLinks();
+    for (int i = 0; i < nodeCount; i++) {
+        if (nodeList[i].type != ROLE_WELLGUARD_PRO) continue;
+        ArbWellRule rule = ArbitrationEngine::defaultRule();
+        for (uint8_t c = 0; c < arbWellCount; c++) {
+            if (!nodeList[i].id.equals(arbWells[c].id)) continue;
+            rule.minRunMs = arbWells[c].minRunS * 1000;
+            rule.minRestMs = arbWells[c].minRestS * 1000;
+            rule.startScore = arbWells[c].startScore;
+            rule.fullIsLimit = arbWells[c].fullIsLimit != 0;
+        }
+        arbitration.setRule(i, rule);
+    }
+    // The assignment first, then the backup wells and weights
+    for (int i = 0; i < nodeCount; i++) {
+        if (nodeList[i].type != ROLE_AQUA_RESERV_PRO || nodeList[i].assignedTo.isEmpty()) continue;
+        int well = findNode(nodeList[i].assignedTo);
+        if (well >= 0) arbitration.link(i, well, ARB_DEFAULT_WEIGHT);
+    }
+    for (uint8_t c = 0; c < arbLinkCount; c++) {
+        int reservoir = findNode(arbLinks[c].reservoir);
+        int well = findNode(arbLinks[c].well);
+        if (reservoir >= 0 && well >= 0) arbitration.link(reservoir, well, arbLinks[c].weight);
+    }
+    for (int i = 0; i < nodeCount; i++) updateArbitrationInputs(i);
+}
+
+// Must be called with nodeListMutex_Centrale held.
+void CentraleLogic::updateArbitrationInputs(int nodeIndex) {
+    const Node& node = nodeList[nodeIndex];
+    uint32_t now = millis();
+    if (node.type == ROLE_WELLGUARD_PRO) {
+        arbitration.setWellOnline(nodeIndex, !node.status.equals("DISCONNECTED"), now);
+        if (node.status.equalsIgnoreCase("ON") || node.status.equalsIgnoreCase("OFF")) {
+            arbitration.wellReported(nodeIndex, node.status.equalsIgnoreCase("ON"), now);
+        }
+    } else if (node.type == ROLE_AQUA_RESERV_PRO) {
+        ArbLevel level = ARB_LEVEL_UNKNOWN;
+        if (node.status.equalsIgnoreCase("EMPTY")) level = ARB_LEVEL_EMPTY;
+        else if (node.status.equalsIgnoreCase("OK")) level = ARB_LEVEL_OK;
+        else if (node.status.equalsIgnoreCase("FULL")) level = ARB_LEVEL_FULL;
+        arbitration.setLevel(nodeIndex, level);
+        uint8_t served = arbitration.servingWell(nodeIndex);
+        fill.pumpChanged(nodeIndex, served != ARB_NONE && arbitration.running(served), now);
+        fill.levelChanged(nodeIndex, level, now);
+        // A reservoir going through us asks for water from EMPTY until FULL: the level
+        // stands in for requests sent before a restart of the Centrale.
+        int well = findNode(node.assignedTo);
+        if (well >= 0 && arbitration.needsArbitration(well) && level != ARB_LEVEL_OK && level != ARB_LEVEL_UNKNOWN) {
+            arbitration.setDemand(nodeIndex, level == ARB_LEVEL_EMPTY);
+        }
+    }
+}
+
+// Must be called with nodeListMutex_Centrale held.
+void CentraleLogic::runArbitration() {
+    ArbDecision decisions[ARB_MAX_NODES];
+    uint8_t count = arbitration.evaluate(millis(), decisions, ARB_MAX_NODES);
+    CommandTrace untraced;
+    memset(&untraced, 0, sizeof(untraced));
+    untraced.rxMs = millis();
+    applyDecisions(decisions, count, -1, untraced);
+    refreshFillPumps();
+}
+
+// --- Fill prediction ---
+
+// Must be called with nodeListMutex_Centrale held. The pump of a reservoir is the
+// well serving it, as the arbitration sees it (commanded or reported).
+void CentraleLogic::refreshFillPumps() {
+    uint32_t now = millis();
+    for (int i = 0; i < nodeCount; i++) {
+        if (nodeList[i].type != ROLE_AQUA_RESERV_PRO) continue;
+        uint8_t served = arbitration.servingWell(i);
+        fill.pumpChanged(i, served != ARB_NONE && arbitration.running(served), now);
+    }
+}
+
+// Must be called with nodeListMutex_Centrale held. Starts at most one top-up per
+// call: the reservoir predicted empty first, among those whose well is idle, has
+// not started a top-up for FILL_STAGGER_S and goes through us (a well left to its
+// reservoir is not ours to start). Off-peak, the horizon is longer so the
+// reservoirs are topped up then rather than at peak time; and no more than
+// FILL_MAX_RUNNING_WELLS wells run at once because of a top-up.
+void CentraleLogic::planTopUps() {
+    uint32_t now = millis();
+    bool synced;
+    uint32_t unixS = Clock::now(synced);
+    uint16_t minuteOfDay = ((unixS + FILL_UTC_OFFSET_MIN * 60L) / 60) % 1440;
+    bool offPeak = synced && FillEstimator::inWindow(minuteOfDay, FILL_OFFPEAK_START_MIN, FILL_OFFPEAK_END_MIN);
+    uint32_t horizonMs = (offPeak ? FILL_OFFPEAK_LEAD_MIN : FILL_PEAK_LEAD_MIN) * 60000UL;
+
+    int runningWells = 0;
+    for (int i = 0; i < nodeCount; i++) {
+        if (nodeList[i].type == ROLE_WELLGUARD_PRO && arbitration.running(i)) runningWells++;
+    }
+    if (runningWells >= FILL_MAX_RUNNING_WELLS) return;
+
+    int best = -1;
+    uint32_t bestMs = horizonMs;
+    for (int i = 0; i < nodeCount; i++) {
+        if (nodeList[i].type != ROLE_AQUA_RESERV_PRO || arbitration.demand(i)) continue;
+        uint8_t well = arbitration.servingWell(i);
+        if (well == ARB_NONE || arbitration.running(well) || !arbitration.needsArbitration(well)) continue;
+        if (topUpStartedMs[well] != 0 && now - topUpStartedMs[well] < FILL_STAGGER_S * 1000UL) continue;
+        uint32_t emptyInMs = fill.msToEmpty(i, now);
+        if (emptyInMs == 0 || emptyInMs > bestMs) continue; // Empty: its own request is on the way
+        best = i;
+        bestMs = emptyInMs;
+    }
+    if (best < 0) return;
+
+    uint8_t well = arbitration.servingWell(best);
+    topUpStartedMs[well] = now | 1;
+    journal.pumpRequest(nodeList[best].id, nodeList[well].id, true, JOURNAL_TOP_UP);
+    Serial.printf("Top-up of %s on %s, predicted empty in %lu min.\n", nodeList[best].id.c_str(),
+                  nodeList[well].id.c_str(), (unsigned long)(bestMs / 60000));
+    // Held until FULL, like a request (updateArbitrationInputs)
+    arbitration.setDemand(best, true);
+    runArbitration();
+}
+
+// GET /api/fill: learned rates and predictions of each reservoir.
+void CentraleLogic::writeFillJson(Print& out) {
+    if (lockNodeList(pdMS_TO_TICKS(1000)) != pdTRUE) {
+        out.print("[]");
+        return;
+    }
+    uint32_t now = millis();
+    out.print("[");
+    bool first = true;
+    for (int i = 0; i < nodeCount; i++) {
+        if (nodeList[i].type != ROLE_AQUA_RESERV_PRO) continue;
+        uint32_t emptyIn = fill.msToEmpty(i, now);
+        uint32_t fullIn = fill.msToFull(i, now);
+        out.printf("%s{\"id\":\"%s\",\"fillMin\":%lu,\"drainMin\":%lu,\"samples\":%u,\"emptyInMin\":%ld,\"fullInMin\":%ld}",
+                   first ? "" : ",", nodeList[i].id.c_str(), (unsigned long)(fill.fillMs(i) / 60000),
+                   (unsigned long)(fill.drainMs(i) / 60000), fill.samples(i),
+                   emptyIn == FILL_UNKNOWN ? -1L : (long)(emptyIn / 60000), fullIn == FILL_UNKNOWN ? -1L : (long)(fullIn / 60000));
+        first = false;
+    }
+    out.print("]");
+    xSemaphoreGive(nodeListMutex_Centrale);
+}
+
+// Must be called with nodeListMutex_Centrale held. The commands for the requester's
+// well carry its trace, the others are untraced.
+void CentraleLogic::applyDecisions(const ArbDecision* decisions, uint8_t count, int requesterIndex, CommandTrace trace) {
+    uint8_t tracedWell = requesterIndex >= 0 ? arbitration.servingWell(requesterIndex) : ARB_NONE;
+    for (uint8_t i = 0; i < count; i++) {
+        const ArbDecision& d = decisions[i];
+        String reservoirId = d.reservoir != ARB_NONE ? nodeList[d.reservoir].id : "";
+        if (d.well == tracedWell && reservoirId.isEmpty()) reservoirId = nodeList[requesterIndex].id;
+        journal.pumpDecision(nodeList[d.well].id, reservoirId, d.on, d.command ? JOURNAL_OK : outcomeOf(d.reason));
+        if (!d.command) continue;
+        CommandTrace commandTrace = trace;
+        if (d.well != tracedWell) {
+            memset(&commandTrace, 0, sizeof(commandTrace));
+            commandTrace.rxMs = millis();
+        }
+        sendPumpCommand(d.well, reservoirId, d.on, commandTrace);
+    }
+}
+
+// Must be called with nodeListMutex_Centrale held. Tells the reservoirs assigned to
+// the well whether to go through the Centrale or command it directly.
+void CentraleLogic::sendAssignments(const String& wellId) {
+    if (wellId.isEmpty()) return;
+    int well = findNode(wellId);
+    int assignments = 0;
+    for (int i = 0; i < nodeCount; i++) {
+        if (nodeList[i].type == ROLE_AQUA_RESERV_PRO && nodeList[i].assignedTo.equals(wellId)) {
+            assignments++;
+        }
+    }
+    bool isShared = well >= 0 ? arbitration.needsArbitration(well) : assignments > 1;
+
+    for (int i = 0; i < nodeCount; i++) {
+        if (nodeList[i].type == ROLE_AQUA_RESERV_PRO && nodeList[i].assignedTo.equals(wellId)) {
+            StaticJsonDocument<256> cmdDoc;
+            cmdDoc["type"] = MessageType::COMMAND;
+            cmdDoc["tgt"] = nodeList[i].id;
+            cmdDoc["cmd"] = "ASSIGN_WELL";
+            cmdDoc["well_id"] = wellId;
+            cmdDoc["is_shared"] = isShared;
+            String packet;
+            serializeJson(cmdDoc, packet);
+            sendToNode(i, packet);
+        }
+    }
+}
+
+// Returns false if the table of well rules is full.
+bool CentraleLogic::setWellRule(const String& wellId, const ArbWellConfig& config) {
+    int slot = -1;
+    for (uint8_t c = 0; c < arbWellCount; c++) {
+        if (wellId.equals(arbWells[c].id)) slot = c;
+    }
+    if (slot < 0 && arbWellCount == MAX_NODES) return false;
+
+    if (lockNodeList(portMAX_DELAY) != pdTRUE) return false;
+    if (slot < 0) slot = arbWellCount++;
+    arbWells[slot] = config;
+    NodeSnapshot::copyField(arbWells[slot].id, sizeof(arbWells[slot].id), wellId);
+    rebuildArbitration();
+    sendAssignments(wellId);
+    runArbitration();
+    xSemaphoreGive(nodeListMutex_Centrale);
+    saveArbitrationConfig();
+    return true;
+}
+
+// weight 0 removes the link (an assignment stays, with the default weight).
+// Returns false if the table of links is full.
+bool CentraleLogic::setWellLink(const String& reservoirId, const String& wellId, uint8_t weight) {
+    int slot = -1;
+    for (uint8_t c = 0; c < arbLinkCount; c++) {
+        if (reservoirId.equals(arbLinks[c].reservoir) && wellId.equals(arbLinks[c].well)) slot = c;
+    }
+    if (slot < 0 && weight == 0) return true;
+    if (slot < 0 && arbLinkCount == ARB_MAX_LINKS) return false;
+
+    if (lockNodeList(portMAX_DELAY) != pdTRUE) return false;
+    if (weight == 0) {
+        arbLinks[slot] = arbLinks[--arbLinkCount];
+    } else {
+        if (slot < 0) slot = arbLinkCount++;
+        NodeSnapshot::copyField(arbLinks[slot].reservoir, sizeof(arbLinks[slot].reservoir), reservoirId);
+        NodeSnapshot::copyField(arbLinks[slot].well, sizeof(arbLinks[slot].well), wellId);
+        arbLinks[slot].weight = weight;
+    }
+    rebuildArbitration();
+    int reservoir = findNode(reservoirId);
+    if (reservoir >= 0) sendAssignments(nodeList[reservoir].assignedTo);
+    sendAssignments(wellId);
+    runArbitration();
+    xSemaphoreGive(nodeListMutex_Centrale);
+    saveArbitrationConfig();
+    return true;
+}
+
+// GET /api/arbitration: rules and state of each well, and the links in effect.
+void CentraleLogic::writeArbitrationJson(Print& out) {
+    if (lockNodeList(pdMS_TO_TICKS(1000)) != pdTRUE) {
+        out.print("{}");
+        return;
+    }
+    uint32_t now = millis();
+    out.print("{\"wells\":[");
+    bool first = true;
+    for (int i = 0; i < nodeCount; i++) {
+        if (nodeList[i].type != ROLE_WELLGUARD_PRO) continue;
+        const ArbWellRule& rule = arbitration.rule(i);
+        uint32_t wakeAt = arbitration.wakeAtMs(i);
+        out.printf("%s{\"id\":\"%s\",\"minRun\":%lu,\"minRest\":%lu,\"score\":%u,\"fullIsLimit\":%s,"
+                   "\"running\":%s,\"reason\":\"%s\",\"demand\":%u,\"wakeIn\":%ld}",
+                   first ? "" : ",", nodeList[i].id.c_str(), (unsigned long)(rule.minRunMs / 1000),
+                   (unsigned long)(rule.minRestMs / 1000), rule.startScore, rule.fullIsLimit ? "true" : "false",
+                   arbitration.running(i) ? "true" : "false", ArbitrationEngine::reasonName(arbitration.reason(i)),
+                   arbitration.score(i), wakeAt != 0 ? (long)(int32_t)(wakeAt - now) / 1000 : 0L);
+        first = false;
+    }
+    out.print("],\"links\":[");
+    uint8_t reservoir, well, weight;
+    for (uint8_t l = 0; arbitration.linkAt(l, reservoir, well, weight); l++) {
+        out.printf("%s{\"reservoir\":\"%s\",\"well\":\"%s\",\"weight\":%u,\"assigned\":%s,\"serving\":%s}",
+                   l == 0 ? "" : ",", nodeList[reservoir].id.c_str(), nodeList[well].id.c_str(), weight,
+                   nodeList[reservoir].assignedTo.equals(nodeList[well].id) ? "true" : "false",
+                   arbitration.servingWell(reservoir) == well ? "true" : "false");
+    }
+    out.print("]}");
+    xSemaphoreGive(nodeListMutex_Centrale);
+}
 
 // --- Logic Methods ---
 
-void CentraleLogic::registerOrUpdateNode(const String& id, NodeRole role, const String& status, int rssi) {
-    if (xSemaphoreTake(nodeListMutex_Centrale, portMAX_DELAY) == pdTRUE) {
+void CentraleLogic::registerOrUpdateNode(const String& id, NodeRole role, const String& status, int rssi, uint16_t rxWindowMs, bool pingSlots,
+                                         int16_t levelPermille) {
+    if (lockNodeList(portMAX_DELAY) == pdTRUE) {
         int existingNodeIndex = -1;
         for (int i = 0; i < nodeCount; i++) {
             if (nodeList[i].id.equals(id)) {
@@ -228,73 +795,455 @@ void CentraleLogic::registerOrUpdateNode(const String& id, NodeRole role, const
         }
 
         if (existingNodeIndex != -1) { // Update existing node
+            Node& node = nodeList[existingNodeIndex];
+            if (!node.status.equals(status) || node.rxWindowMs != rxWindowMs || node.pingSlots != pingSlots
+                || (role != ROLE_UNKNOWN && node.type != role)) {
+                markSnapshotDirty();
+            }
+            trackPumpRun(node, status);
             nodeList[existingNodeIndex].lastSeen = millis();
             nodeList[existingNodeIndex].rssi = rssi;
             nodeList[existingNodeIndex].status = status;
+            nodeList[existingNodeIndex].rxWindowMs = rxWindowMs;
+            nodeList[existingNodeIndex].pingSlots = pingSlots;
+            nodeList[existingNodeIndex].levelPermille = levelPermille;
+            bool roleChanged = role != ROLE_UNKNOWN && node.type != role;
             if (role != ROLE_UNKNOWN) nodeList[existingNodeIndex].type = role;
+            if (roleChanged) rebuildArbitration();
+            else updateArbitrationInputs(existingNodeIndex);
         } else if (nodeCount < MAX_NODES) { // Add new node
             nodeList[nodeCount].id = id;
-            nodeList[nodeCount].name = loadNodeName(id);
+            nodeList[nodeCount].name = loadNodeName(id); // RAM lookup, see NodeMetadataCache
             nodeList[nodeCount].type = role;
             nodeList[nodeCount].lastSeen = millis();
             nodeList[nodeCount].rssi = rssi;
             nodeList[nodeCount].status = status;
             nodeList[nodeCount].assignedTo = "";
+            nodeList[nodeCount].rxWindowMs = rxWindowMs;
+            nodeList[nodeCount].pingSlots = pingSlots;
+            nodeList[nodeCount].levelPermille = levelPermille;
+            nodeList[nodeCount].downlinkHead = 0;
+            nodeList[nodeCount].downlinkCount = 0;
+            resetPumpTracking(nodeList[nodeCount]);
+            nodeList[nodeCount].digestAtMs = 0;
+            nodeList[nodeCount].diagAtMs = 0;
             nodeCount++;
+            markSnapshotDirty();
+            rebuildArbitration(); // Its links may have been waiting for it
         }
+        if (arbitration.due(millis())) runArbitration();
+        xSemaphoreGive(nodeListMutex_Centrale);
+    }
+}
+
+// The request only sets the reservoir's demand: which well runs, and when, is up to
+// the arbitration rules (ArbitrationEngine.h).
+void CentraleLogic::handlePumpRequest(const String& requesterId, MessageType requestType, CommandTrace trace) {
+    if (lockNodeList(portMAX_DELAY) != pdTRUE) return;
+    Metrics::inc(MC_PUMP_REQUESTS);
+    bool on = requestType == REQUEST_PUMP_ON;
+
+    int requester = findNode(requesterId);
+    if (requester < 0 || !arbitration.hasWell(requester)) {
+        journal.pumpRequest(requesterId, "", on, JOURNAL_NO_WELL);
+        TRACE(TR_PUMP_REQUEST, on, TRACE_ID(requesterId), 0, 0, JOURNAL_NO_WELL);
         xSemaphoreGive(nodeListMutex_Centrale);
+        return;
+    }
+
+    arbitration.setDemand(requester, on);
+    ArbDecision decisions[ARB_MAX_NODES];
+    uint8_t count = arbitration.evaluate(millis(), decisions, ARB_MAX_NODES);
+
+    uint8_t well = arbitration.servingWell(requester);
+    bool direct = false;
+    JournalOutcome outcome = JOURNAL_WELL_OFFLINE;
+    String wellId = nodeList[requester].assignedTo;
+    if (well != ARB_NONE) {
+        wellId = nodeList[well].id;
+        direct = arbitration.reason(well) == ARB_DIRECT;
+        outcome = direct || arbitration.running(well) == on ? JOURNAL_OK : outcomeOf(arbitration.reason(well));
     }
+    journal.pumpRequest(requesterId, wellId, on, outcome);
+    TRACE(TR_PUMP_REQUEST, on, TRACE_ID(requesterId), TRACE_ID(wellId), outcome);
+
+    applyDecisions(decisions, count, requester, trace);
+    // A well left to its reservoir still obeys it through us. A command given but
+    // not confirmed yet may have been lost: sent again, as an attempt of the first.
+    bool switched = false;
+    for (uint8_t i = 0; i < count; i++) switched |= decisions[i].command && decisions[i].well == well;
+    if (outcome == JOURNAL_OK && !switched && (direct || arbitration.pending(well))) {
+        sendPumpCommand(well, requesterId, on, trace);
+    }
+
+    xSemaphoreGive(nodeListMutex_Centrale);
 }
 
-void CentraleLogic::handlePumpRequest(const String& requesterId, MessageType requestType) {
-    if (xSemaphoreTake(nodeListMutex_Centrale, portMAX_DELAY) != pdTRUE) return;
+// --- Pump journal ---
 
-    String wellId = "";
+// Must be called with nodeListMutex_Centrale held.
+void CentraleLogic::sendPumpCommand(int wellIndex, const String& fromId, bool on, CommandTrace trace) {
+    const String& wellId = nodeList[wellIndex].id;
+    String cmdPkt = LoRaMessage::serializeCommand("", wellId.c_str(), on ? CMD_PUMP_ON : CMD_PUMP_OFF, trace.id);
+    trace.issuedMs = millis();
+    sendToNode(wellIndex, cmdPkt);
+    notePumpCommand(wellIndex, fromId, on, trace);
+    history.record(wellId, TS_KIND_PUMP_CMD, on ? TS_VALUE_ON : TS_VALUE_OFF, 0);
+}
+
+// Must be called with nodeListMutex_Centrale held. Repeats of the pending command
+// (reservoir retries) count as attempts; latency and trace run from the first one.
+void CentraleLogic::notePumpCommand(int wellIndex, const String& fromId, bool on, const CommandTrace& trace) {
+    Node& well = nodeList[wellIndex];
+    if (well.cmdSentAtMs != 0 && well.cmdOn == on && well.cmdFrom.equals(fromId)) {
+        if (well.cmdAttempts < 255) well.cmdAttempts++;
+        return;
+    }
+    well.cmdSentAtMs = millis() | 1;
+    well.cmdAttempts = 1;
+    well.cmdOn = on;
+    well.cmdFrom = fromId;
+    well.trace = trace;
+}
+
+void CentraleLogic::onCommandAck(const String& wellId, const JsonDocument& ack) {
+    if (lockNodeList(portMAX_DELAY) != pdTRUE) return;
+    uint32_t nowMs = millis();
     for (int i = 0; i < nodeCount; i++) {
-        if (nodeList[i].id.equals(requesterId)) {
-            wellId = nodeList[i].assignedTo;
+        Node& well = nodeList[i];
+        if (well.id.equals(wellId)) {
+            // "pg": the well holds the command for "eta" s (anti-short-cycling, PumpProtection.h)
+            uint8_t hold = ack["pg"] | 0;
+            if (well.cmdSentAtMs != 0) {
+                Metrics::observe(MH_ACK_LATENCY_MS, nowMs - well.cmdSentAtMs);
+                journal.pumpAck(well.id, well.cmdFrom, well.cmdOn, hold != 0 ? JOURNAL_HELD_BY_WELL : JOURNAL_OK,
+                                nowMs - well.cmdSentAtMs, well.cmdAttempts);
+                well.cmdSentAtMs = 0;
+            }
+            if (hold != 0) arbitration.wellHeld(i, nowMs + (ack["eta"] | 0UL) * 1000);
+            if (ack.containsKey("fl")) well.flowLph = ack["fl"];
+            // d = [received -> relay switched, received -> ACK sent] on the well.
+            if (well.trace.id != 0 && (ack["tr"] | 0) == well.trace.id && ack["d"].size() >= 2) {
+                uint32_t relayMs = ack["d"][0];
+                uint32_t wellMs = max(relayMs, ack["d"][1].as<uint32_t>());
+                uint32_t roundTripMs = nowMs - well.trace.issuedMs;
+
+                LatencySample sample;
+                bool synced;
+                sample.timestamp = Clock::now(synced);
+                sample.traceId = well.trace.id;
+                sample.on = well.cmdOn;
+                snprintf(sample.wellId, sizeof(sample.wellId), "%s", well.id.c_str());
+                sample.stagesMs[LAT_DEBOUNCE] = well.trace.debounceMs;
+                sample.stagesMs[LAT_CONTROL] = well.trace.controlMs;
+                sample.stagesMs[LAT_ARBITRATION] = well.trace.issuedMs - well.trace.rxMs;
+                sample.stagesMs[LAT_DELIVERY] = roundTripMs > wellMs ? roundTripMs - wellMs : 0;
+                sample.stagesMs[LAT_ACTUATION] = relayMs;
+                sample.stagesMs[LAT_ACK] = wellMs - relayMs;
+                latency.add(sample);
+            }
+            well.trace.id = 0;
             break;
         }
     }
+    xSemaphoreGive(nodeListMutex_Centrale);
+}
 
-    if (wellId.isEmpty()) {
-        xSemaphoreGive(nodeListMutex_Centrale);
+// Must be called with nodeListMutex_Centrale held, before the status is updated.
+void CentraleLogic::trackPumpRun(Node& node, const String& newStatus) {
+    bool wasOn = node.status.equalsIgnoreCase("ON");
+    bool isOn = newStatus.equalsIgnoreCase("ON");
+    if (!wasOn && isOn) {
+        node.runStartedAtMs = millis() | 1;
+        journal.pumpStart(node.id, node.cmdFrom);
+    } else if (wasOn && !isOn) {
+        uint32_t runSeconds = node.runStartedAtMs != 0 ? (millis() - node.runStartedAtMs) / 1000 : 0;
+        JournalOutcome outcome = JOURNAL_OK;
+        if (newStatus.equals("DISCONNECTED")) outcome = JOURNAL_LINK_LOST;
+        else if (node.pumpFault == PUMP_FAULT_NO_FLOW) outcome = JOURNAL_NO_FLOW;
+        else if (node.pumpFault == PUMP_FAULT_DRY_RUN) outcome = JOURNAL_DRY_RUN;
+        else if (node.pumpFault == PUMP_FAULT_OVERLOAD) outcome = JOURNAL_OVERLOAD;
+        else if (node.pumpFault == PUMP_FAULT_LOCKED_ROTOR) outcome = JOURNAL_LOCKED_ROTOR;
+        journal.pumpStop(node.id, runSeconds, outcome);
+        node.runStartedAtMs = 0;
+    }
+}
+
+// Before registerOrUpdateNode(), so that a run stopped by the well is journaled with its fault.
+void CentraleLogic::storePumpReport(const String& wellId, const JsonDocument& status) {
+    if (!status.containsKey("fl") && !status.containsKey("ia")) return;
+    if (lockNodeList(portMAX_DELAY) != pdTRUE) return;
+    for (int i = 0; i < nodeCount; i++) {
+        if (nodeList[i].id.equals(wellId)) {
+            nodeList[i].flowLph = status["fl"] | -1;
+            nodeList[i].volumeL = status["vol"] | nodeList[i].volumeL;
+            nodeList[i].currentMa = status["ia"] | -1;
+            nodeList[i].pumpFault = status["ft"] | 0;
+            break;
+        }
+    }
+    xSemaphoreGive(nodeListMutex_Centrale);
+}
+
+void CentraleLogic::storeMetricsDigest(const String& nodeId, const MetricsDigest& digest) {
+    if (lockNodeList(portMAX_DELAY) != pdTRUE) return;
+    for (int i = 0; i < nodeCount; i++) {
+        if (nodeList[i].id.equals(nodeId)) {
+            nodeList[i].digest = digest;
+            nodeList[i].digestAtMs = millis();
+            break;
+        }
+    }
+    xSemaphoreGive(nodeListMutex_Centrale);
+}
+
+void CentraleLogic::storeDiagnostics(const String& nodeId, const NodeDiagnostics& diag) {
+    if (lockNodeList(portMAX_DELAY) != pdTRUE) return;
+    for (int i = 0; i < nodeCount; i++) {
+        if (nodeList[i].id.equals(nodeId)) {
+            nodeList[i].diag = diag;
+            nodeList[i].diagAtMs = millis();
+            break;
+        }
+    }
+    xSemaphoreGive(nodeListMutex_Centrale);
+}
+
+// JSON array of the last diagnostics of each edge node.
+void CentraleLogic::writeNodeDiagnostics(Print& out) {
+    struct Entry { char id[NODE_SNAPSHOT_ID_LEN]; NodeDiagnostics diag; uint32_t ageS; };
+    Entry* entries = (Entry*)malloc(MAX_NODES * sizeof(Entry));
+    if (entries == nullptr) {
+        out.print("[]");
         return;
     }
+    int count = 0;
+    if (lockNodeList(pdMS_TO_TICKS(1000)) == pdTRUE) {
+        for (int i = 0; i < nodeCount; i++) {
+            if (nodeList[i].diagAtMs == 0) continue;
+            NodeSnapshot::copyField(entries[count].id, sizeof(entries[count].id), nodeList[i].id);
+            entries[count].diag = nodeList[i].diag;
+            entries[count].ageS = (millis() - nodeList[i].diagAtMs) / 1000;
+            count++;
+        }
+        xSemaphoreGive(nodeListMutex_Centrale);
+    }
 
-    if (requestType == REQUEST_PUMP_ON) {
-        bool isAnyReservoirFull = false;
+    out.print("[");
+    for (int i = 0; i < count; i++) {
+        const NodeDiagnostics& diag = entries[i].diag;
+        out.printf("%s{\"id\":\"%s\",\"age\":%u,\"heap\":{\"free\":%u,\"min\":%u,\"largest\":%u},\"worstTask\":\"%s\",\"worstStackFree\":%u,\"cpuBusy\":%u}",
+                   i > 0 ? "," : "", entries[i].id, entries[i].ageS, diag.heapFree, diag.heapMin, diag.heapLargest,
+                   diag.worstTask, diag.worstStackFree, diag.cpuBusyPct);
+    }
+    out.print("]");
+    free(entries);
+}
+
+// Edge node digests, one series per node.
+void CentraleLogic::writeNodeMetrics(Print& out) {
+    struct Entry { char id[NODE_SNAPSHOT_ID_LEN]; MetricsDigest digest; uint32_t ageS; };
+    Entry* entries = (Entry*)malloc(MAX_NODES * sizeof(Entry));
+    if (entries == nullptr) return;
+    int count = 0;
+    if (lockNodeList(pdMS_TO_TICKS(1000)) == pdTRUE) {
         for (int i = 0; i < nodeCount; i++) {
-            if (nodeList[i].type == ROLE_AQUA_RESERV_PRO && nodeList[i].assignedTo.equals(wellId) && nodeList[i].status.equalsIgnoreCase("FULL")) {
-                isAnyReservoirFull = true;
-                break;
-            }
+            if (nodeList[i].digestAtMs == 0) continue;
+            NodeSnapshot::copyField(entries[count].id, sizeof(entries[count].id), nodeList[i].id);
+            entries[count].digest = nodeList[i].digest;
+            entries[count].ageS = (millis() - nodeList[i].digestAtMs) / 1000;
+            count++;
+        }
+        xSemaphoreGive(nodeListMutex_Centrale);
+    }
+
+    struct Field { const char* name; const char* type; size_t offset; };
+    static const Field fields[] = {
+        { "hge_node_uptime_seconds", "gauge", offsetof(MetricsDigest, uptimeS) },
+        { "hge_node_lora_rx_frames_total", "counter", offsetof(MetricsDigest, rxFrames) },
+        { "hge_node_lora_tx_frames_total", "counter", offsetof(MetricsDigest, txFrames) },
+        { "hge_node_lora_decrypt_failures_total", "counter", offsetof(MetricsDigest, decryptFailures) },
+        { "hge_node_lora_parse_failures_total", "counter", offsetof(MetricsDigest, parseFailures) },
+        { "hge_node_ack_timeouts_total", "counter", offsetof(MetricsDigest, ackTimeouts) },
+        { "hge_node_ack_retries_total", "counter", offsetof(MetricsDigest, ackRetries) },
+        { "hge_node_command_failures_total", "counter", offsetof(MetricsDigest, commandFailures) },
+        { "hge_node_heap_min_free_bytes", "gauge", offsetof(MetricsDigest, heapMin) },
+        { "hge_node_ack_latency_avg_ms", "gauge", offsetof(MetricsDigest, ackLatencyAvgMs) },
+    };
+    for (const Field& field : fields) {
+        out.printf("# TYPE %s %s\n", field.name, field.type);
+        for (int i = 0; i < count; i++) {
+            uint32_t value = *(const uint32_t*)((const uint8_t*)&entries[i].digest + field.offset);
+            out.printf("%s{node=\"%s\"} %u\n", field.name, entries[i].id, value);
+        }
+    }
+    out.print("# TYPE hge_node_digest_age_seconds gauge\n");
+    for (int i = 0; i < count; i++) {
+        out.printf("hge_node_digest_age_seconds{node=\"%s\"} %u\n", entries[i].id, entries[i].ageS);
+    }
+    free(entries);
+}
+
+void CentraleLogic::resetPumpTracking(Node& node) {
+    node.cmdSentAtMs = 0;
+    node.cmdAttempts = 0;
+    node.cmdOn = false;
+    node.cmdFrom = "";
+    node.trace.id = 0;
+    // A pump restored as running is timed from now: the boot gap is not counted.
+    node.runStartedAtMs = node.status.equalsIgnoreCase("ON") ? (millis() | 1) : 0;
+    node.flowLph = -1; // Until its next status update
+    node.volumeL = 0;
+    node.currentMa = -1;
+    node.pumpFault = PUMP_FAULT_NONE;
+}
+
+// --- Registry snapshot ---
+
+// Must be called with nodeListMutex_Centrale held.
+void CentraleLogic::markSnapshotDirty() {
+    if (!snapshotDirty) {
+        snapshotDirty = true;
+        snapshotDirtySinceMs = millis();
+    }
+}
+
+bool CentraleLogic::restoreNodeSnapshot() {
+    // Names and notes first: one NVS pass, independent of LittleFS.
+    uint32_t startMs = millis();
+    int loaded = metadata.load("node-names", "node-notes");
+    Serial.printf("Loaded %d node names/notes in %lu ms.\n", loaded, millis() - startMs);
+    loadArbitrationConfig();
+
+    if (!boot.waitFor(storagePhase, portMAX_DELAY) || !boot.succeeded(storagePhase)) {
+        return true; // Nothing to restore from, the fleet will re-announce itself
+    }
+
+    int count = NodeSnapshot::load(snapshotRecords, MAX_NODES);
+    if (count < 0) {
+        Serial.println("No valid node snapshot, starting with an empty registry.");
+        return true;
+    }
+
+    if (lockNodeList(portMAX_DELAY) == pdTRUE) {
+        for (int i = 0; i < count; i++) {
+            const NodeRecord& rec = snapshotRecords[i];
+            Node& node = nodeList[i];
+            node.id = rec.id;
+            node.name = loadNodeName(node.id);
+            node.type = (NodeRole)rec.role;
+            node.assignedTo = rec.assignedTo;
+            node.status = rec.status;
+            node.rssi = rec.rssi;
+            node.rxWindowMs = rec.rxWindowMs;
+            node.pingSlots = (rec.flags & NODE_FLAG_PING_SLOTS) != 0;
+            node.levelPermille = -1; // Until its next status update
+            // A full timeout to re-announce before the janitor flags it
+            node.lastSeen = millis();
+            node.downlinkHead = 0;
+            node.downlinkCount = 0;
+            resetPumpTracking(node);
+            node.digestAtMs = 0;
+            node.diagAtMs = 0;
         }
-        if (!isAnyReservoirFull) {
-            String cmdPkt = LoRaMessage::serializeCommand("", wellId.c_str(), CMD_PUMP_ON);
-            sendLoRaMessage(cmdPkt);
+        nodeCount = count;
+        rebuildArbitration();
+        xSemaphoreGive(nodeListMutex_Centrale);
+    }
+    Serial.printf("Restored %d nodes from snapshot.\n", count);
+    return true;
+}
+
+void CentraleLogic::writeNodeSnapshot() {
+    uint16_t count = 0;
+    if (lockNodeList(portMAX_DELAY) != pdTRUE) return;
+    for (int i = 0; i < nodeCount; i++) {
+        NodeRecord& rec = snapshotRecords[count++];
+        NodeSnapshot::copyField(rec.id, sizeof(rec.id), nodeList[i].id);
+        NodeSnapshot::copyField(rec.assignedTo, sizeof(rec.assignedTo), nodeList[i].assignedTo);
+        NodeSnapshot::copyField(rec.status, sizeof(rec.status), nodeList[i].status);
+        rec.role = (uint8_t)nodeList[i].type;
+        rec.flags = nodeList[i].pingSlots ? NODE_FLAG_PING_SLOTS : 0;
+        rec.rxWindowMs = nodeList[i].rxWindowMs;
+        rec.rssi = (int16_t)nodeList[i].rssi;
+    }
+    snapshotDirty = false;
+    xSemaphoreGive(nodeListMutex_Centrale);
+
+    // Only this task touches snapshotRecords once the boot restore is over.
+    if (!NodeSnapshot::save(snapshotRecords, count)) {
+        Serial.println("Failed to write node snapshot.");
+        if (lockNodeList(portMAX_DELAY) == pdTRUE) {
+            markSnapshotDirty(); // Retry after the next coalescing delay
+            xSemaphoreGive(nodeListMutex_Centrale);
+        }
+    }
+}
+
+void CentraleLogic::Task_Snapshot_Writer(void* pvParameters) {
+    CentraleLogic* self = (CentraleLogic*)pvParameters;
+    for (;;) {
+        vTaskDelay(pdMS_TO_TICKS(1000));
+        if (!self->boot.succeeded(self->storagePhase)) continue;
+        // Unlocked peek: a stale read only delays the write by one tick.
+        if (self->snapshotDirty && millis() - self->snapshotDirtySinceMs >= NODE_SNAPSHOT_COALESCE_MS) {
+            self->writeNodeSnapshot();
         }
-    } else if (requestType == REQUEST_PUMP_OFF) {
-        bool isAnotherReservoirEmpty = false;
+    }
+}
+
+// Must be called with nodeListMutex_Centrale held.
+void CentraleLogic::sendToNode(int nodeIndex, const String& packet) {
+    Node& node = nodeList[nodeIndex];
+    if (node.rxWindowMs == 0 && !node.pingSlots) {
+        sendLoRaMessage(packet);
+        return;
+    }
+
+    if (node.downlinkCount == NODE_DOWNLINK_QUEUE_LEN) {
+        // Drop the oldest: the latest command is the one that reflects the current state.
+        node.downlinkHead = (node.downlinkHead + 1) % NODE_DOWNLINK_QUEUE_LEN;
+        node.downlinkCount--;
+        Metrics::inc(MC_DOWNLINKS_DROPPED);
+        TRACE(TR_DOWNLINK_DROPPED, TRACE_ID(node.id));
+    }
+    Metrics::inc(MC_DOWNLINKS_QUEUED);
+    node.downlinkQueue[(node.downlinkHead + node.downlinkCount) % NODE_DOWNLINK_QUEUE_LEN] = packet;
+    node.downlinkCount++;
+}
+
+// Must be called with nodeListMutex_Centrale held.
+bool CentraleLogic::popDownlink(int nodeIndex, String& packet) {
+    Node& node = nodeList[nodeIndex];
+    if (node.downlinkCount == 0) return false;
+    packet = node.downlinkQueue[node.downlinkHead];
+    node.downlinkQueue[node.downlinkHead] = "";
+    node.downlinkHead = (node.downlinkHead + 1) % NODE_DOWNLINK_QUEUE_LEN;
+    node.downlinkCount--;
+    return true;
+}
+
+void CentraleLogic::flushPendingDownlink(const String& nodeId) {
+    String packet;
+    bool found = false;
+    if (lockNodeList(portMAX_DELAY) == pdTRUE) {
         for (int i = 0; i < nodeCount; i++) {
-            if (nodeList[i].type == ROLE_AQUA_RESERV_PRO && nodeList[i].assignedTo.equals(wellId) && !nodeList[i].id.equals(requesterId) && nodeList[i].status.equalsIgnoreCase("EMPTY")) {
-                isAnotherReservoirEmpty = true;
+            if (nodeList[i].id.equals(nodeId)) {
+                found = popDownlink(i, packet);
                 break;
             }
         }
-        if (!isAnotherReservoirEmpty) {
-            String cmdPkt = LoRaMessage::serializeCommand("", wellId.c_str(), CMD_PUMP_OFF);
-            sendLoRaMessage(cmdPkt);
-        }
+        xSemaphoreGive(nodeListMutex_Centrale);
+    }
+    if (found) {
+        sendLoRaMessage(packet);
     }
-
-    xSemaphoreGive(nodeListMutex_Centrale);
 }
 
 
 String CentraleLogic::getSystemStatusJson() {
     String output = "{}";
-    if (xSemaphoreTake(nodeListMutex_Centrale, pdMS_TO_TICKS(1000)) == pdTRUE) {
+    if (lockNodeList(pdMS_TO_TICKS(1000)) == pdTRUE) {
         StaticJsonDocument<2048> doc;
         JsonArray nodes = doc.createNestedArray("nodes");
         for (int i = 0; i < nodeCount; i++) {
@@ -304,8 +1253,17 @@ String CentraleLogic::getSystemStatusJson() {
             node["type"] = (int)nodeList[i].type;
             node["rssi"] = nodeList[i].rssi;
             node["status"] = nodeList[i].status;
+            if (nodeList[i].levelPermille >= 0) node["level"] = nodeList[i].levelPermille;
+            if (nodeList[i].flowLph >= 0) {
+                node["flow"] = nodeList[i].flowLph;
+                node["volume"] = nodeList[i].volumeL;
+            }
+            if (nodeList[i].currentMa >= 0) node["current"] = nodeList[i].currentMa;
+            if (nodeList[i].pumpFault != PUMP_FAULT_NONE) node["fault"] = nodeList[i].pumpFault;
             node["lastSeen"] = nodeList[i].lastSeen;
             node["assignedTo"] = nodeList[i].assignedTo;
+            String notes = metadata.notes(nodeList[i].id);
+            if (notes.length() > 0) node["notes"] = notes;
         }
         serializeJson(doc, output);
         xSemaphoreGive(nodeListMutex_Centrale);
@@ -313,19 +1271,130 @@ String CentraleLogic::getSystemStatusJson() {
     return output;
 }
 
+// Returns false if the reservoir is unknown.
+bool CentraleLogic::assignWell(const String& reservoirId, const String& wellId) {
+    if (lockNodeList(portMAX_DELAY) != pdTRUE) return false;
+    int reservoir = findNode(reservoirId);
+    if (reservoir < 0) {
+        xSemaphoreGive(nodeListMutex_Centrale);
+        return false;
+    }
+    String previousWell = nodeList[reservoir].assignedTo;
+    nodeList[reservoir].assignedTo = wellId;
+    markSnapshotDirty();
+
+    rebuildArbitration();
+    sendAssignments(wellId);
+    // The reservoirs left on the previous well may no longer share it
+    if (!previousWell.equals(wellId)) sendAssignments(previousWell);
+    runArbitration();
+    xSemaphoreGive(nodeListMutex_Centrale);
+    return true;
+}
+
+// Returns false if the node is unknown.
+bool CentraleLogic::renameNode(const String& nodeId, const String& nodeName, bool hasNotes, const String& notes) {
+    bool known = false;
+    if (lockNodeList(portMAX_DELAY) == pdTRUE) {
+        for (int i = 0; i < nodeCount; i++) {
+            if (nodeList[i].id.equals(nodeId)) {
+                nodeList[i].name = nodeName;
+                known = true;
+                break;
+            }
+        }
+        xSemaphoreGive(nodeListMutex_Centrale);
+    }
+    if (known) {
+        saveNodeName(nodeId, nodeName);
+        if (hasNotes) saveNodeNotes(nodeId, notes);
+    }
+    return known;
+}
+
+WsStatus CentraleLogic::onSocketCommand(const WsCommand& command, void* context) {
+    CentraleLogic* self = (CentraleLogic*)context;
+    switch (command.type) {
+        case WSM_ASSIGN:
+            return self->assignWell(command.id, command.target) ? WS_STATUS_OK : WS_STATUS_UNKNOWN_NODE;
+        case WSM_SET_NAME:
+            return self->renameNode(command.id, command.name, command.hasNotes, command.notes) ? WS_STATUS_OK : WS_STATUS_UNKNOWN_NODE;
+        default:
+            return WS_STATUS_BAD_REQUEST;
+    }
+}
+
+// cmd/assign {"reservoir","well"}: same as POST /api/assign.
+// cmd/pump {"reservoir","on"}: arbitrated like a request from that reservoir;
+// the outcome is published on event/PUMP_REQUEST.
+const char* CentraleLogic::onMqttCommand(const char* command, JsonObjectConst args, void* context) {
+    CentraleLogic* self = (CentraleLogic*)context;
+    const char* reservoirId = args["reservoir"] | "";
+    if (reservoirId[0] == '\0') return "missing reservoir";
+
+    if (strcmp(command, "assign") == 0) {
+        const char* wellId = args["well"] | "";
+        if (wellId[0] == '\0') return "missing well";
+        return self->assignWell(reservoirId, wellId) ? nullptr : "unknown reservoir";
+    }
+    if (strcmp(command, "pump") == 0) {
+        if (!args["on"].is<bool>()) return "missing on";
+        CommandTrace trace;
+        memset(&trace, 0, sizeof(trace));
+        trace.rxMs = millis();
+        self->handlePumpRequest(reservoirId, args["on"].as<bool>() ? REQUEST_PUMP_ON : REQUEST_PUMP_OFF, trace);
+        return nullptr;
+    }
+    return "unknown command";
+}
+
+void CentraleLogic::onJournalEvent(const char* wellId, const char* peerId, const JournalRecord& rec, void* context) {
+    CentraleLogic* self = (CentraleLogic*)context;
+    char json[MQTT_PAYLOAD_LEN];
+    EventJournal::formatJson(json, sizeof(json), rec, wellId, peerId);
+    self->mqtt.postEvent(EventJournal::eventName(rec.event), rec.timestamp, json);
+}
+
+// Coil write from a PLC: arbitrated like a request from that reservoir.
+void CentraleLogic::onModbusPump(const char* reservoirId, bool on, void* context) {
+    CommandTrace trace;
+    memset(&trace, 0, sizeof(trace));
+    trace.rxMs = millis();
+    ((CentraleLogic*)context)->handlePumpRequest(reservoirId, on ? REQUEST_PUMP_ON : REQUEST_PUMP_OFF, trace);
+}
+
+uint8_t CentraleLogic::fillSocketSnapshot(WsNodeRecord* records, uint8_t max, void* context) {
+    CentraleLogic* self = (CentraleLogic*)context;
+    uint8_t count = 0;
+    if (lockNodeList(pdMS_TO_TICKS(1000)) != pdTRUE) return 0;
+    for (int i = 0; i < self->nodeCount && count < max; i++) {
+        const Node& node = self->nodeList[i];
+        WsNodeRecord& record = records[count++];
+        snprintf(record.id, sizeof(record.id), "%s", node.id.c_str());
+        snprintf(record.name, sizeof(record.name), "%s", node.name.c_str());
+        record.role = (uint8_t)node.type;
+        record.rssi = (int16_t)node.rssi;
+        snprintf(record.status, sizeof(record.status), "%s", node.status.c_str());
+        record.lastSeen = node.lastSeen;
+        snprintf(record.assignedTo, sizeof(record.assignedTo), "%s", node.assignedTo.c_str());
+    }
+    xSemaphoreGive(nodeListMutex_Centrale);
+    return count;
+}
+
+// Lookups are served from RAM; writes also go to NVS through the write-back cache.
 void CentraleLogic::saveNodeName(const String& nodeId, const String& nodeName) {
-    Preferences prefs;
-    prefs.begin("node-names", false);
-    prefs.putString(nodeId.c_str(), nodeName);
-    prefs.end();
+    metadata.setName(nodeId, nodeName);
+    Persistence::putString("node-names", nodeId.c_str(), nodeName);
 }
 
 String CentraleLogic::loadNodeName(const String& nodeId) {
-    Preferences prefs;
-    prefs.begin("node-names", true);
-    String name = prefs.getString(nodeId.c_str(), "");
-    prefs.end();
-    return name;
+    return metadata.name(nodeId);
+}
+
+void CentraleLogic::saveNodeNotes(const String& nodeId, const String& notes) {
+    metadata.setNotes(nodeId, notes);
+    Persistence::putString("node-notes", nodeId.c_str(), notes);
 }
 
 // --- LoRa Static Methods ---
@@ -337,35 +1406,102 @@ void CentraleLogic::onReceive(int packetSize) {
     while (LoRa.available()) packetBuffer[len++] = (char)LoRa.read();
     packetBuffer[len] = '\0';
     snprintf(packetBuffer + len, sizeof(packetBuffer) - len, "\1%d", LoRa.packetRssi());
-    xQueueSendFromISR(loraRxQueue_Centrale, &packetBuffer, NULL);
+    if (xQueueSendFromISR(loraRxQueue_Centrale, &packetBuffer, NULL) != pdPASS) {
+        Metrics::inc(MC_LORA_RX_QUEUE_DROPS);
+        TRACE(TR_LORA_RX_QUEUE_FULL);
+    }
+    Metrics::gaugeMax(MG_LORA_RX_QUEUE_HWM, uxQueueMessagesWaitingFromISR(loraRxQueue_Centrale));
+}
+
+// Trace fields of a reservoir's request or command: "tr" and d = [debounce, control].
+static CommandTrace readTrace(const JsonDocument& doc) {
+    CommandTrace trace;
+    trace.id = doc["tr"] | 0;
+    trace.rxMs = millis();
+    trace.issuedMs = 0;
+    trace.debounceMs = doc["d"][0] | 0;
+    trace.controlMs = doc["d"][1] | 0;
+    return trace;
 }
 
 void CentraleLogic::handleLoRaPacket(const String& packet, int rssi) {
     StaticJsonDocument<256> doc;
-    deserializeJson(doc, packet);
+    if (deserializeJson(doc, packet)) {
+        Metrics::inc(MC_LORA_PARSE_FAILURES);
+        TRACE(TR_LORA_PARSE_FAILED, packet.length());
+        return;
+    }
     MessageType type = (MessageType)doc["type"].as<int>();
     String id = doc.containsKey("id") ? doc["id"].as<String>() : doc["src"].as<String>();
+    Metrics::countRx(type);
+    TRACE(TR_LORA_RX, type, rssi, TRACE_ID(id));
 
     switch (type) {
         case DISCOVERY:
-            instance->registerOrUpdateNode(id, (NodeRole)doc["role"].as<int>(), "Discovered", rssi);
+            instance->registerOrUpdateNode(id, (NodeRole)doc["role"].as<int>(), "Discovered", rssi, doc["rxw"] | 0, doc["ps"] | 0);
             break;
         case STATUS_UPDATE:
-            instance->registerOrUpdateNode(id, ROLE_UNKNOWN, doc["status"].as<String>(), rssi);
+            instance->storePumpReport(id, doc);
+            instance->registerOrUpdateNode(id, ROLE_UNKNOWN, doc["status"].as<String>(), rssi, doc["rxw"] | 0, doc["ps"] | 0, doc["lv"] | -1);
+            instance->history.record(id, TS_KIND_STATUS, TimeSeriesStore::valueFromStatus(doc["status"].as<String>()), rssi);
+            if ((doc["lv"] | -1) >= 0) instance->history.record(id, TS_KIND_LEVEL, (doc["lv"].as<int>() + 5) / 10, rssi);
             break;
         case REQUEST_PUMP_ON:
         case REQUEST_PUMP_OFF:
-            instance->handlePumpRequest(id, type);
+            instance->handlePumpRequest(id, type, readTrace(doc));
             break;
+        case COMMAND:
+            // Direct reservoir -> well commands (non-shared wells) are overheard for the journal.
+            if (doc["cmd"].is<int>() && doc["tgt"].is<const char*>()) {
+                String wellId = doc["tgt"].as<String>();
+                if (lockNodeList(portMAX_DELAY) == pdTRUE) {
+                    for (int i = 0; i < instance->nodeCount; i++) {
+                        if (instance->nodeList[i].id.equals(wellId)) {
+                            CommandTrace trace = readTrace(doc);
+                            trace.issuedMs = trace.rxMs; // The well hears it at the same time
+                            instance->notePumpCommand(i, id, doc["cmd"].as<int>() == CMD_PUMP_ON, trace);
+                            break;
+                        }
+                    }
+                    xSemaphoreGive(nodeListMutex_Centrale);
+                }
+            }
+            break;
+        case COMMAND_ACK:
+            instance->onCommandAck(id, doc);
+            break;
+        case DIAGNOSTICS: {
+            NodeDiagnostics diag;
+            if (LoRaMessage::deserializeDiagnostics(doc, diag)) {
+                instance->storeDiagnostics(id, diag);
+            }
+            break;
+        }
+        case METRICS_DIGEST: {
+            MetricsDigest digest;
+            if (LoRaMessage::deserializeMetricsDigest(doc["m"], digest)) {
+                instance->storeMetricsDigest(id, digest);
+            }
+            break;
+        }
         default:
             break;
     }
+
+    // The sender is listening right now: hand over anything held for it.
+    instance->flushPendingDownlink(id);
 }
 
 void CentraleLogic::sendLoRaMessage(const String& message) {
     String encrypted = CryptoManager::encrypt(message);
+    int type = Metrics::messageTypeOf(message);
+    Metrics::countTx(type);
+    // Web handlers, the LoRa handler and the beacon scheduler all transmit.
+    xSemaphoreTake(loraTxMutex_Centrale, portMAX_DELAY);
     LoRa.beginPacket();
     LoRa.print(encrypted);
     LoRa.endPacket();
-    Serial.printf("Sent LoRa Packet: %s\n", message.c_str());
+    LoRa.receive(); // endPacket() leaves the radio in standby
+    xSemaphoreGive(loraTxMutex_Centrale);
+    TRACE(TR_LORA_TX, type, message.length());
 }
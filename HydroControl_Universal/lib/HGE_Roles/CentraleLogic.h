@@ -7,10 +7,52 @@
 #include <ArduinoJson.h>
 #include <Preferences.h>
 #include "Message.h"
+#include "RxSchedule.h"
+#include "BootSequencer.h"
+#include "NodeSnapshot.h"
+#include "NodeMetadataCache.h"
+#include "TimeSeriesStore.h"
+#include "EventJournal.h"
+#include "LatencyTracker.h"
+#include "StaticAssets.h"
+#include "DashboardSocket.h"
+#include "EventStream.h"
+#include "MqttBridge.h"
+#include "ModbusServer.h"
+#include "ArbitrationEngine.h"
+#include "FillEstimator.h"
 #include "config.h" // Utilisation de la configuration centralisée
 
 #define MAX_NODES 16
 #define LORA_RX_PACKET_MAX_LEN 256
+#define NODE_DOWNLINK_QUEUE_LEN 4
+#define ARB_ID_LEN 16 // MAC-based IDs are 12 chars
+
+// Latency trace of a pump command, from the "tr"/"d" fields of the request or
+// overheard command. Times are on the Centrale's clock.
+struct CommandTrace {
+    uint16_t id;         // 0 = untraced
+    uint32_t rxMs;       // Request (or overheard command) received
+    uint32_t issuedMs;   // Command handed to the radio or the downlink queue
+    uint32_t debounceMs; // Reported by the reservoir
+    uint32_t controlMs;
+};
+
+// Arbitration settings, by node ID, as stored in NVS ("arbitration").
+struct ArbWellConfig {
+    char id[ARB_ID_LEN];
+    uint32_t minRunS;
+    uint32_t minRestS;
+    uint16_t startScore;
+    uint8_t fullIsLimit;
+} __attribute__((packed));
+
+// Extra link (backup well) or the weight of an assignment
+struct ArbLinkConfig {
+    char reservoir[ARB_ID_LEN];
+    char well[ARB_ID_LEN];
+    uint8_t weight;
+} __attribute__((packed));
 
 struct Node {
     String id;
@@ -20,6 +62,31 @@ struct Node {
     String status;
     unsigned long lastSeen;
     String assignedTo; // For AquaReserv, stores the Wellguard ID it's assigned to
+    uint16_t rxWindowMs;   // > 0 for battery nodes that only listen right after they transmit
+    bool pingSlots;        // Node follows the beacons and only listens during its receive slots
+    int16_t levelPermille; // Reservoirs with a continuous level sensor, -1 otherwise
+    // Downlinks held until the node listens again (next uplink or next slot)
+    String downlinkQueue[NODE_DOWNLINK_QUEUE_LEN];
+    uint8_t downlinkHead;
+    uint8_t downlinkCount;
+    // Pump journal (wells): command awaiting the ACK, and the current run
+    uint32_t cmdSentAtMs;    // 0 = nothing pending
+    uint8_t cmdAttempts;
+    bool cmdOn;
+    String cmdFrom;          // Reservoir behind the last command
+    uint32_t runStartedAtMs; // 0 = pump not running
+    // Flow meter and motor current of the well, from its status updates and ACKs
+    int32_t flowLph;         // -1 = no flow meter
+    uint32_t volumeL;
+    int32_t currentMa;       // -1 = no current sensor
+    uint8_t pumpFault;       // PumpFaultCode of the last status
+    CommandTrace trace;      // Of the pending command
+    // Last metrics digest sent by the node
+    MetricsDigest digest;
+    uint32_t digestAtMs;     // 0 = none received
+    // Last profiler diagnostics sent by the node
+    NodeDiagnostics diag;
+    uint32_t diagAtMs;       // 0 = none received
 };
 
 class CentraleLogic {
@@ -31,29 +98,101 @@ private:
     Node nodeList[MAX_NODES];
     int nodeCount = 0;
     AsyncWebServer server;
-    AsyncEventSource events;
+    EventStream events;
+    StaticAssetHandler assets;
+    DashboardSocket wsApi;
+    MqttBridge mqtt;
+    ModbusServer modbus;
     String deviceId;
+    RxScheduleConfig rxSchedule;
+    uint32_t beaconSeq = 0;
+    uint32_t beaconAtMs = 0;
+    BootSequencer boot;
+    NodeMetadataCache metadata;
+    TimeSeriesStore history;
+    EventJournal journal;
+    LatencyTracker latency;
+    ArbitrationEngine arbitration;       // Node list mutex held
+    ArbWellConfig arbWells[MAX_NODES];
+    uint8_t arbWellCount = 0;
+    ArbLinkConfig arbLinks[ARB_MAX_LINKS];
+    uint8_t arbLinkCount = 0;
+    FillEstimator fill;                  // Node list mutex held
+    uint32_t topUpStartedMs[MAX_NODES] = {}; // Per well: last top-up started, 0 = none
+    uint32_t topUpPlannedMs = 0;
+    uint32_t wifiLinkPhase = 0;
+    uint32_t storagePhase = 0;
+
+    // Registry snapshot, written at most every NODE_SNAPSHOT_COALESCE_MS
+    NodeRecord snapshotRecords[MAX_NODES];
+    bool snapshotDirty = false;
+    uint32_t snapshotDirtySinceMs = 0;
 
-    void setupLoRa();
+    bool setupLoRa();
+    bool startWifi();
+    bool startMqtt();
     void setupWebServer();
     void startTasks();
 
-    void registerOrUpdateNode(const String& id, NodeRole role, const String& status, int rssi);
-    void handlePumpRequest(const String& requesterId, MessageType requestType);
+    void registerOrUpdateNode(const String& id, NodeRole role, const String& status, int rssi, uint16_t rxWindowMs, bool pingSlots,
+                              int16_t levelPermille = -1);
+    void sendToNode(int nodeIndex, const String& packet);
+    bool popDownlink(int nodeIndex, String& packet);
+    void flushPendingDownlink(const String& nodeId);
+    void markSnapshotDirty();
+    bool restoreNodeSnapshot();
+    void writeNodeSnapshot();
+    void handlePumpRequest(const String& requesterId, MessageType requestType, CommandTrace trace);
+    void loadArbitrationConfig();
+    void saveArbitrationConfig();
+    void rebuildArbitration();
+    void runArbitration();
+    void applyDecisions(const ArbDecision* decisions, uint8_t count, int requesterIndex, CommandTrace trace);
+    void sendAssignments(const String& wellId);
+    void updateArbitrationInputs(int nodeIndex);
+    bool setWellRule(const String& wellId, const ArbWellConfig& config);
+    bool setWellLink(const String& reservoirId, const String& wellId, uint8_t weight);
+    void writeArbitrationJson(Print& out);
+    void refreshFillPumps();
+    void planTopUps();
+    void writeFillJson(Print& out);
+    int findNode(const String& id);
+    void sendPumpCommand(int wellIndex, const String& fromId, bool on, CommandTrace trace);
+    void notePumpCommand(int wellIndex, const String& fromId, bool on, const CommandTrace& trace);
+    void onCommandAck(const String& wellId, const JsonDocument& ack);
+    void trackPumpRun(Node& node, const String& newStatus);
+    void storePumpReport(const String& wellId, const JsonDocument& status);
+    void resetPumpTracking(Node& node);
+    void storeMetricsDigest(const String& nodeId, const MetricsDigest& digest);
+    void writeNodeMetrics(Print& out);
+    void storeDiagnostics(const String& nodeId, const NodeDiagnostics& diag);
+    void writeNodeDiagnostics(Print& out);
     String getSystemStatusJson();
+    bool assignWell(const String& reservoirId, const String& wellId);
+    bool renameNode(const String& nodeId, const String& nodeName, bool hasNotes, const String& notes);
     void saveNodeName(const String& nodeId, const String& nodeName);
     String loadNodeName(const String& nodeId);
+    void saveNodeNotes(const String& nodeId, const String& notes);
 
     // Static members to be accessed by ISR/callbacks
     static CentraleLogic* instance;
     static void onReceive(int packetSize);
     static void handleLoRaPacket(const String& packet, int rssi);
     static void sendLoRaMessage(const String& message);
+    static void onWifiResult(bool connected, void* context);
+    static WsStatus onSocketCommand(const WsCommand& command, void* context);
+    static uint8_t fillSocketSnapshot(WsNodeRecord* records, uint8_t max, void* context);
+    static const char* onMqttCommand(const char* command, JsonObjectConst args, void* context);
+    static void onJournalEvent(const char* wellId, const char* peerId, const JournalRecord& rec, void* context);
+    static void onModbusPump(const char* reservoirId, bool on, void* context);
 
     // FreeRTOS tasks and synchronization
     static void Task_LoRa_Handler(void *pvParameters);
     static void Task_Node_Janitor(void *pvParameters);
     static void Task_SSE_Publisher(void* pvParameters);
+    static void Task_Beacon_Scheduler(void* pvParameters);
+    static void Task_Snapshot_Writer(void* pvParameters);
+    static void Task_Arbitration(void* pvParameters);
 };
 
 #endif // CENTRALE_LOGIC_H
@@ -0,0 +1,88 @@
+#include "FillEstimator.h"
+#include <string.h>
+
+FillEstimator::FillEstimator() {
+    memset(reservoirs, 0, sizeof(reservoirs));
+}
+
+bool FillEstimator::levelChanged(uint8_t reservoir, ArbLevel level, uint32_t nowMs) {
+    if (reservoir >= FILL_MAX_RESERVOIRS) return false;
+    Reservoir& res = reservoirs[reservoir];
+    if (res.level == level) return false;
+
+    bool learned = false;
+    if (res.level == ARB_LEVEL_OK && res.clean && nowMs - res.bandSinceMs >= FILL_MIN_SAMPLE_MS) {
+        if (res.enteredFrom == ARB_LEVEL_EMPTY && level == ARB_LEVEL_FULL && res.pumpOn) {
+            learn(res.fillMs, nowMs - res.bandSinceMs);
+            learned = true;
+        } else if (res.enteredFrom == ARB_LEVEL_FULL && level == ARB_LEVEL_EMPTY && !res.pumpOn) {
+            learn(res.drainMs, nowMs - res.bandSinceMs);
+            learned = true;
+        }
+        if (learned && res.samples < UINT8_MAX) res.samples++;
+    }
+
+    switch (level) {
+        case ARB_LEVEL_EMPTY: res.position = 0; break;
+        case ARB_LEVEL_FULL: res.position = FILL_BAND_FULL; break;
+        case ARB_LEVEL_OK:
+            if (res.level == ARB_LEVEL_EMPTY) res.position = 0;
+            else if (res.level == ARB_LEVEL_FULL) res.position = FILL_BAND_FULL;
+            else res.position = FILL_BAND_FULL / 2; // Unknown: mid-band
+            res.enteredFrom = res.level;
+            res.bandSinceMs = nowMs;
+            res.clean = true;
+            break;
+        default: break;
+    }
+    res.positionAtMs = nowMs;
+    res.level = level;
+    return learned;
+}
+
+void FillEstimator::pumpChanged(uint8_t reservoir, bool on, uint32_t nowMs) {
+    if (reservoir >= FILL_MAX_RESERVOIRS) return;
+    Reservoir& res = reservoirs[reservoir];
+    if (res.pumpOn == on) return;
+    res.position = positionAt(res, nowMs);
+    res.positionAtMs = nowMs;
+    res.pumpOn = on;
+    res.clean = false;
+}
+
+uint32_t FillEstimator::msToEmpty(uint8_t reservoir, uint32_t nowMs) const {
+    const Reservoir& res = reservoirs[reservoir];
+    if (res.level == ARB_LEVEL_EMPTY) return 0;
+    if (res.level == ARB_LEVEL_UNKNOWN || res.drainMs == 0 || res.pumpOn) return FILL_UNKNOWN;
+    return (uint64_t)positionAt(res, nowMs) * res.drainMs / FILL_BAND_FULL;
+}
+
+uint32_t FillEstimator::msToFull(uint8_t reservoir, uint32_t nowMs) const {
+    const Reservoir& res = reservoirs[reservoir];
+    if (res.level == ARB_LEVEL_FULL) return 0;
+    if (res.level == ARB_LEVEL_UNKNOWN || res.fillMs == 0 || !res.pumpOn) return FILL_UNKNOWN;
+    return (uint64_t)(FILL_BAND_FULL - positionAt(res, nowMs)) * res.fillMs / FILL_BAND_FULL;
+}
+
+bool FillEstimator::inWindow(uint16_t minuteOfDay, uint16_t startMin, uint16_t endMin) {
+    if (startMin <= endMin) return minuteOfDay >= startMin && minuteOfDay < endMin;
+    return minuteOfDay >= startMin || minuteOfDay < endMin;
+}
+
+// Extrapolated within the band; the floats bound it, so it never crosses them.
+uint16_t FillEstimator::positionAt(const Reservoir& res, uint32_t nowMs) const {
+    if (res.level != ARB_LEVEL_OK) return res.position;
+    uint32_t rateMs = res.pumpOn ? res.fillMs : res.drainMs;
+    if (rateMs == 0) return res.position;
+    uint64_t moved = (uint64_t)(nowMs - res.positionAtMs) * FILL_BAND_FULL / rateMs;
+    if (res.pumpOn) return moved >= (uint32_t)(FILL_BAND_FULL - res.position) ? FILL_BAND_FULL : res.position + moved;
+    return moved >= res.position ? 0 : res.position - moved;
+}
+
+void FillEstimator::learn(uint32_t& average, uint32_t sampleMs) {
+    if (average == 0) {
+        average = sampleMs;
+        return;
+    }
+    average = (uint32_t)((int64_t)average + ((int64_t)sampleMs - (int64_t)average) / 4);
+}
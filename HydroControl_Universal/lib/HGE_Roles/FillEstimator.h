@@ -0,0 +1,72 @@
+#ifndef FILL_ESTIMATOR_H
+#define FILL_ESTIMATOR_H
+
+#include <stdint.h>
+#include "ArbitrationEngine.h"
+
+#ifndef FILL_MAX_RESERVOIRS
+#define FILL_MAX_RESERVOIRS  ARB_MAX_NODES // Node slots, as for the arbitration
+#endif
+#define FILL_UNKNOWN         UINT32_MAX
+#define FILL_BAND_FULL       65535         // Position at the high float, Q16
+#define FILL_MIN_SAMPLE_MS   60000         // Shorter band crossings are float bounce, not a rate
+
+// Fill and drain rates of each reservoir, learned from its level transitions.
+// Pure logic: no Arduino, RTOS or radio, time passed in by the caller, so it runs
+// the same on a PC.
+//
+// With two floats the only rate a reservoir shows is how long it takes to cross
+// the band between them (OK): from the low float to the high one with the pump
+// on (fill), from the high float to the low one with the pump off (drain). A
+// crossing with the pump switched midway tells nothing and is not learned. The
+// learned durations are exponential averages (1/4 per crossing).
+//
+// In between, the position in the band is extrapolated from the last known one
+// at the learned rate, and snapped to the float on each transition. It gives the
+// time to empty (drain from the current position) and time to full.
+//
+// Each input is O(1) and touches only its reservoir. Not thread-safe: the
+// Centrale calls it with the node list locked.
+class FillEstimator {
+public:
+    FillEstimator();
+
+    // Returns true if the transition completed a crossing that was learned.
+    bool levelChanged(uint8_t reservoir, ArbLevel level, uint32_t nowMs);
+    // The pump feeding the reservoir started or stopped.
+    void pumpChanged(uint8_t reservoir, bool on, uint32_t nowMs);
+
+    // FILL_UNKNOWN until a drain was learned, or while the pump runs. A full
+    // reservoir reports at least one band crossing.
+    uint32_t msToEmpty(uint8_t reservoir, uint32_t nowMs) const;
+    // FILL_UNKNOWN until a fill was learned, or while the pump is off.
+    uint32_t msToFull(uint8_t reservoir, uint32_t nowMs) const;
+    // Learned band crossing times, 0 = not learned yet.
+    uint32_t fillMs(uint8_t reservoir) const { return reservoirs[reservoir].fillMs; }
+    uint32_t drainMs(uint8_t reservoir) const { return reservoirs[reservoir].drainMs; }
+    uint8_t samples(uint8_t reservoir) const { return reservoirs[reservoir].samples; }
+
+    // Whether minuteOfDay falls in [startMin, endMin), the window may wrap midnight.
+    static bool inWindow(uint16_t minuteOfDay, uint16_t startMin, uint16_t endMin);
+
+private:
+    struct Reservoir {
+        ArbLevel level;
+        ArbLevel enteredFrom;  // Level before the current band crossing
+        bool pumpOn;
+        bool clean;            // Pump unchanged since entering the band
+        uint8_t samples;       // Crossings learned, saturates
+        uint16_t position;     // In the band, 0 = low float, FILL_BAND_FULL = high float
+        uint32_t positionAtMs;
+        uint32_t bandSinceMs;
+        uint32_t fillMs;
+        uint32_t drainMs;
+    };
+
+    Reservoir reservoirs[FILL_MAX_RESERVOIRS];
+
+    uint16_t positionAt(const Reservoir& res, uint32_t nowMs) const;
+    static void learn(uint32_t& average, uint32_t sampleMs);
+};
+
+#endif // FILL_ESTIMATOR_H
@@ -0,0 +1,126 @@
+#include "PumpProtection.h"
+
+PumpProtection::PumpProtection(const PumpProtectionConfig& config) : config(config) {
+    if (this->config.maxStartsPerHour > PUMP_MAX_STARTS_TRACKED) {
+        this->config.maxStartsPerHour = PUMP_MAX_STARTS_TRACKED;
+    }
+}
+
+void PumpProtection::begin(uint32_t nowMs) {
+    relayOn = false;
+    changedAtMs = nowMs;
+    held = false;
+    lockoutMs = 0;
+    startHead = 0;
+    startCount = 0;
+}
+
+PumpHold PumpProtection::request(bool on, uint32_t nowMs, uint32_t& waitMs) {
+    expireLockout(nowMs);
+    PumpHold hold = blockedBy(on, nowMs, waitMs);
+    if (hold == PUMP_APPLIED) {
+        held = false; // The latest command wins
+        apply(on, nowMs);
+        return PUMP_APPLIED;
+    }
+    held = true;
+    heldState = on;
+    return hold;
+}
+
+bool PumpProtection::poll(uint32_t nowMs, bool& on) {
+    uint32_t waitMs;
+    expireLockout(nowMs);
+    if (!held || blockedBy(heldState, nowMs, waitMs) != PUMP_APPLIED) return false;
+    held = false;
+    apply(heldState, nowMs);
+    on = heldState;
+    return true;
+}
+
+void PumpProtection::trip(uint32_t nowMs, uint32_t lockoutMs) {
+    bool wasOn = relayOn;
+    apply(false, nowMs);
+    trippedAtMs = nowMs;
+    this->lockoutMs = lockoutMs;
+    // A held command can only be an OFF while the relay was on: it is kept, never
+    // turned into a restart.
+    if (wasOn && !held) {
+        held = true;
+        heldState = true;
+    }
+}
+
+PumpHold PumpProtection::hold(uint32_t nowMs, uint32_t& waitMs) const {
+    waitMs = 0;
+    if (!held) return PUMP_APPLIED;
+    return blockedBy(heldState, nowMs, waitMs);
+}
+
+uint8_t PumpProtection::startsLastHour(uint32_t nowMs) const {
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < startCount; i++) {
+        if (nowMs - starts[i] < PUMP_START_WINDOW_MS) count++;
+    }
+    return count;
+}
+
+// The longest of the waits that apply.
+PumpHold PumpProtection::blockedBy(bool on, uint32_t nowMs, uint32_t& waitMs) const {
+    waitMs = 0;
+    if (on == relayOn) return PUMP_APPLIED;
+    uint32_t sinceChange = nowMs - changedAtMs;
+    if (!on) {
+        if (sinceChange >= config.minOnMs) return PUMP_APPLIED;
+        waitMs = config.minOnMs - sinceChange;
+        return PUMP_HELD_MIN_ON;
+    }
+
+    PumpHold hold = PUMP_APPLIED;
+    if (sinceChange < config.minOffMs) {
+        waitMs = config.minOffMs - sinceChange;
+        hold = PUMP_HELD_MIN_OFF;
+    }
+    if (config.maxStartsPerHour > 0 && startCount == config.maxStartsPerHour) {
+        uint32_t sinceOldest = nowMs - starts[startHead];
+        if (sinceOldest < PUMP_START_WINDOW_MS && PUMP_START_WINDOW_MS - sinceOldest > waitMs) {
+            waitMs = PUMP_START_WINDOW_MS - sinceOldest;
+            hold = PUMP_HELD_START_LIMIT;
+        }
+    }
+    uint32_t sinceTrip = nowMs - trippedAtMs;
+    if (lockoutMs > 0 && sinceTrip < lockoutMs && lockoutMs - sinceTrip > waitMs) {
+        waitMs = lockoutMs - sinceTrip;
+        hold = PUMP_HELD_FAULT;
+    }
+    return hold;
+}
+
+// Once over, forgotten: the elapsed time would otherwise wrap around after 49 days.
+void PumpProtection::expireLockout(uint32_t nowMs) {
+    if (lockoutMs > 0 && nowMs - trippedAtMs >= lockoutMs) lockoutMs = 0;
+}
+
+void PumpProtection::apply(bool on, uint32_t nowMs) {
+    if (on == relayOn) return;
+    relayOn = on;
+    changedAtMs = nowMs;
+    if (!on || config.maxStartsPerHour == 0) return;
+    if (startCount < config.maxStartsPerHour) {
+        starts[(startHead + startCount++) % config.maxStartsPerHour] = nowMs;
+    } else {
+        starts[startHead] = nowMs; // Replaces the oldest
+        startHead = (startHead + 1) % config.maxStartsPerHour;
+    }
+}
+
+const char* PumpProtection::holdName(PumpHold hold) {
+    switch (hold) {
+        case PUMP_APPLIED: return "APPLIED";
+        case PUMP_HELD_MIN_ON: return "MIN_ON";
+        case PUMP_HELD_MIN_OFF: return "MIN_OFF";
+        case PUMP_HELD_START_LIMIT: return "START_LIMIT";
+        case PUMP_HELD_FAULT: return "FAULT";
+        default: return "UNKNOWN";
+    }
+}
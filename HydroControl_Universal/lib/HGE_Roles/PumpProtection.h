@@ -0,0 +1,84 @@
+#ifndef PUMP_PROTECTION_H
+#define PUMP_PROTECTION_H
+
+#include <stdint.h>
+
+#define PUMP_MAX_STARTS_TRACKED 30       // Upper bound of maxStartsPerHour
+#define PUMP_START_WINDOW_MS    3600000UL
+
+enum PumpHold : uint8_t {
+    PUMP_APPLIED,          // The relay follows the command now
+    PUMP_HELD_MIN_ON,      // Stop held until the minimum on time is over
+    PUMP_HELD_MIN_OFF,     // Start held until the minimum off time is over
+    PUMP_HELD_START_LIMIT, // Start held: maxStartsPerHour starts within the last hour
+    PUMP_HELD_FAULT        // Start held: the pump was stopped by a fault and is locked out
+};
+
+struct PumpProtectionConfig {
+    uint32_t minOnMs;
+    uint32_t minOffMs;
+    uint8_t maxStartsPerHour; // 0 = no limit
+};
+
+// Anti-short-cycling of the Wellguard relay. Pure logic: no Arduino, RTOS or
+// radio, time passed in by the caller, so it runs the same on a PC.
+//
+// A command that would switch the relay too soon after the previous switch, or
+// start the pump once too often within an hour, is held instead of applied. Only
+// the latest command is kept: a new one replaces the held one, and one matching
+// the relay's current state cancels it, so a flapping float switch or duplicate
+// commands end up as at most one switch once the timers allow it. poll() tells
+// the caller when the held command may be applied.
+//
+// The relay is off at power-up, and counted as switched off at begin(): a reset
+// or brownout right after a stop does not skip the minimum off time.
+//
+// trip() is the safety stop for a fault seen on the well itself (no flow...): the
+// relay goes off at once whatever the timers, and starts are held for the lockout.
+// The run that was cut is kept as a held start, so the pump retries on its own
+// once the lockout is over unless an OFF command cancels it. A stop that was
+// already held (minimum on time) stays held: the pump is not restarted.
+//
+// Not thread-safe: the caller serializes request(), poll() and trip(), and sets
+// the relay under the same lock so a decision is never applied after a later one.
+class PumpProtection {
+public:
+    explicit PumpProtection(const PumpProtectionConfig& config);
+
+    void begin(uint32_t nowMs);
+    // Returns PUMP_APPLIED if the caller must set the relay to on now (it may
+    // already be in that state), otherwise why it is held, and waitMs until then.
+    PumpHold request(bool on, uint32_t nowMs, uint32_t& waitMs);
+    // A held command that may now be applied: returns true and the relay state to set.
+    bool poll(uint32_t nowMs, bool& on);
+    // Safety stop: the caller switches the relay off now.
+    void trip(uint32_t nowMs, uint32_t lockoutMs);
+
+    bool isOn() const { return relayOn; }
+    bool hasHeld() const { return held; }
+    bool heldOn() const { return heldState; }
+    // Of the held command, PUMP_APPLIED if none.
+    PumpHold hold(uint32_t nowMs, uint32_t& waitMs) const;
+    uint8_t startsLastHour(uint32_t nowMs) const;
+
+    static const char* holdName(PumpHold hold);
+
+private:
+    PumpProtectionConfig config;
+    bool relayOn = false;
+    uint32_t changedAtMs = 0;
+    bool held = false;
+    bool heldState = false;
+    uint32_t trippedAtMs = 0;
+    uint32_t lockoutMs = 0;   // 0 = not tripped
+    // Ring of the last maxStartsPerHour start times, oldest at startHead once full
+    uint32_t starts[PUMP_MAX_STARTS_TRACKED];
+    uint8_t startHead = 0;
+    uint8_t startCount = 0;
+
+    PumpHold blockedBy(bool on, uint32_t nowMs, uint32_t& waitMs) const;
+    void apply(bool on, uint32_t nowMs);
+    void expireLockout(uint32_t nowMs);
+};
+
+#endif // PUMP_PROTECTION_H
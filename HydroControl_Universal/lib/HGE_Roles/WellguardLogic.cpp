@@ -2,11 +2,30 @@
 #include <WiFi.h>
 #include <SPI.h>
 #include "Crypto.h"
+#include "Metrics.h"
+#include "TraceLog.h"
+#include "Profiler.h"
+#include "Persistence.h"
 
 WellguardLogic* WellguardLogic::instance = nullptr;
 
+#if WELLGUARD_CURRENT_SENSOR
+// A late drain returns up to the two blocks the ADC driver keeps.
+static_assert(2ULL * WELLGUARD_CURRENT_SAMPLE_HZ * WELLGUARD_CURRENT_BLOCK_MS / 1000 <= SAMPLE_BLOCK_MAX_SAMPLES,
+              "current sample block too long for SampleBlock::acRmsQ4()");
+#endif
+
 // Constructor
-WellguardLogic::WellguardLogic() {
+WellguardLogic::WellguardLogic()
+    : protection({ WELLGUARD_MIN_ON_S * 1000UL, WELLGUARD_MIN_OFF_S * 1000UL, WELLGUARD_MAX_STARTS_PER_HOUR })
+#if WELLGUARD_FLOW_METER
+    , flow({ WELLGUARD_FLOW_UL_PER_PULSE, WELLGUARD_FLOW_PRIMING_S * 1000UL, WELLGUARD_FLOW_MIN_LPH, WELLGUARD_NO_FLOW_S * 1000UL })
+#endif
+#if WELLGUARD_CURRENT_SENSOR
+    , motor({ WELLGUARD_CURRENT_UA_PER_COUNT, WELLGUARD_MOTOR_RATED_MA, WELLGUARD_DRY_RUN_PCT, WELLGUARD_OVERLOAD_PCT,
+              WELLGUARD_LOCKED_ROTOR_PCT, WELLGUARD_MOTOR_STARTUP_MS, WELLGUARD_DRY_RUN_MS, WELLGUARD_OVERLOAD_MS })
+#endif
+{
     instance = this;
 }
 
@@ -28,6 +47,16 @@ void WellguardLogic::initialize() {
 void WellguardLogic::setupHardware() {
     pinMode(WELLGUARD_RELAY_PIN, OUTPUT);
     digitalWrite(WELLGUARD_RELAY_PIN, LOW);
+    protection.begin(millis());
+#if WELLGUARD_FLOW_METER
+    if (!flowPulses.begin(WELLGUARD_FLOW_PIN, 0)) Serial.println("Flow meter: pulse counter setup failed.");
+    flow.begin(millis(), Persistence::getUInt("flow", "volume_l", 0));
+#endif
+#if WELLGUARD_CURRENT_SENSOR
+    if (!currentAdc.begin(WELLGUARD_CURRENT_ADC_CHANNEL, WELLGUARD_CURRENT_SAMPLE_HZ, WELLGUARD_CURRENT_BLOCK_MS)) {
+        Serial.println("Current sensor: ADC sampling setup failed.");
+    }
+#endif
 }
 
 void WellguardLogic::setupLoRa() {
@@ -57,14 +86,23 @@ void WellguardLogic::setupLoRa() {
 }
 
 void WellguardLogic::startTasks() {
+    txQueue = xQueueCreate(WELLGUARD_TX_QUEUE_LEN, sizeof(WellguardReport));
+    xTaskCreate(Task_LoRa_Tx, "LoRaTx", Profiler::stackSize("LoRaTx", 4096), this, 2, NULL);
+    rxSlots.begin(deviceId, onRxSyncChanged);
+
     xTaskCreate(
         Task_Status_Reporter,
         "StatusReporter",
-        4096,
+        Profiler::stackSize("StatusReporter", 4096),
         this,
         1,
         NULL
     );
+    xTaskCreate(Task_Pump_Guard, "PumpGuard", Profiler::stackSize("PumpGuard", 3072), this, 2, NULL);
+#if WELLGUARD_CURRENT_SENSOR
+    // Above the LoRa tasks: a trip must not wait for a transmission
+    xTaskCreate(Task_Motor_Guard, "MotorGuard", Profiler::stackSize("MotorGuard", 3072), this, 3, NULL);
+#endif
 }
 
 // --- FreeRTOS Tasks ---
@@ -72,18 +110,144 @@ void WellguardLogic::startTasks() {
 void WellguardLogic::Task_Status_Reporter(void *pvParameters) {
     WellguardLogic* self = (WellguardLogic*)pvParameters;
     const int HEARTBEAT_INTERVAL_MS = 120000;
+    uint32_t lastDigestMs = 0;
 
     for (;;) {
         vTaskDelay(pdMS_TO_TICKS(HEARTBEAT_INTERVAL_MS));
 
+        if (millis() - lastDigestMs >= METRICS_DIGEST_PERIOD_MS) {
+            lastDigestMs = millis();
+            self->queueReport(WG_REPORT_METRICS);
+        }
+
         if (millis() - self->lastLoRaTransmissionTimestamp < HEARTBEAT_INTERVAL_MS) {
             continue;
         }
 
-        String status = self->relayState ? "ON" : "OFF";
-        String statusPacket = LoRaMessage::serializeStatusUpdate(self->deviceId.c_str(), status.c_str(), self->lastCommandRssi);
-        sendLoRaMessage(statusPacket);
+        self->queueReport(WG_REPORT_STATUS);
+    }
+}
+
+// Applies a command held by the pump protection once its timer is over, and
+// watches the flow meter. The pumped volume is saved here at the end of each
+// run, whoever stopped the pump: never from the LoRa callback, NVS writes block.
+void WellguardLogic::Task_Pump_Guard(void *pvParameters) {
+    WellguardLogic* self = (WellguardLogic*)pvParameters;
+    const int POLL_INTERVAL_MS = 1000; // The holds last tens of seconds or more
+#if WELLGUARD_FLOW_METER
+    bool pumpWasOn = self->relayState;
+#endif
+
+    for (;;) {
+        vTaskDelay(pdMS_TO_TICKS(POLL_INTERVAL_MS));
+#if WELLGUARD_FLOW_METER
+        bool pumpOn = self->relayState;
+        if (pumpWasOn && !pumpOn) Persistence::putUInt("flow", "volume_l", self->flow.volumeLitres());
+        pumpWasOn = pumpOn;
+        if (self->flow.update(self->flowPulses.takePulses(), pumpOn, millis())) {
+            TRACE(TR_PUMP_TRIPPED, self->flow.fault(), self->flow.flowLph());
+            self->tripPump(PUMP_FAULT_NO_FLOW, FlowMeter::faultName(self->flow.fault()));
+            continue;
+        }
+#endif
+        bool on;
+        portENTER_CRITICAL(&self->protectionMux);
+        bool due = self->protection.poll(millis(), on);
+        if (due) self->switchRelay(on);
+        portEXIT_CRITICAL(&self->protectionMux);
+        if (due) {
+            TRACE(TR_RELAY_SET, on);
+            self->queueReport(WG_REPORT_STATUS); // Tells the Centrale
+        }
+    }
+}
+
+#if WELLGUARD_CURRENT_SENSOR
+static PumpFaultCode pumpFaultOf(MotorFault fault) {
+    switch (fault) {
+        case MOTOR_FAULT_DRY_RUN: return PUMP_FAULT_DRY_RUN;
+        case MOTOR_FAULT_OVERLOAD: return PUMP_FAULT_OVERLOAD;
+        case MOTOR_FAULT_LOCKED_ROTOR: return PUMP_FAULT_LOCKED_ROTOR;
+        default: return PUMP_FAULT_NONE;
+    }
+}
+
+// Measures the motor current once per block of WELLGUARD_CURRENT_BLOCK_MS, a whole
+// number of mains periods, and stops the pump on a motor fault.
+void WellguardLogic::Task_Motor_Guard(void *pvParameters) {
+    WellguardLogic* self = (WellguardLogic*)pvParameters;
+    TickType_t lastWake = xTaskGetTickCount();
+
+    for (;;) {
+        vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(WELLGUARD_CURRENT_BLOCK_MS));
+        SampleBlock block;
+        if (self->currentAdc.drain(block) == 0) continue;
+        uint32_t milliamps = self->motor.toMilliamps(block);
+        if (!self->motor.update(milliamps, self->relayState, millis())) continue;
+        MotorFault fault = self->motor.fault();
+        TRACE(TR_MOTOR_TRIPPED, fault, milliamps);
+        self->tripPump(pumpFaultOf(fault), CurrentMonitor::faultName(fault));
+    }
+}
+#endif
+
+// Sends the reports of the other tasks one at a time, fault reports first.
+void WellguardLogic::Task_LoRa_Tx(void *pvParameters) {
+    WellguardLogic* self = (WellguardLogic*)pvParameters;
+    WellguardReport report;
+
+    for (;;) {
+        if (xQueueReceive(self->txQueue, &report, portMAX_DELAY) != pdPASS) continue;
+        if (report == WG_REPORT_METRICS) {
+            self->sendMetricsDigest();
+        } else {
+            self->sendStatusUpdate(self->lastCommandRssi);
+        }
+    }
+}
+
+// A fault report goes to the front of the queue and, when it is full, takes the
+// place of the next report due. Other reports are dropped when it is full: the
+// next heartbeat repeats them.
+void WellguardLogic::queueReport(WellguardReport report) {
+    if (report != WG_REPORT_FAULT) {
+        xQueueSend(txQueue, &report, 0);
+        return;
     }
+    if (xQueueSendToFront(txQueue, &report, 0) == pdPASS) return;
+    WellguardReport dropped;
+    xQueueReceive(txQueue, &dropped, 0);
+    xQueueSendToFront(txQueue, &report, 0);
+}
+
+void WellguardLogic::sendStatusUpdate(long rssi) {
+    String status = relayState ? "ON" : "OFF";
+    PumpReport report = { -1, 0, -1, pumpFault };
+#if WELLGUARD_FLOW_METER
+    report.flowLph = flow.flowLph();
+    report.volumeL = flow.volumeLitres();
+#endif
+#if WELLGUARD_CURRENT_SENSOR
+    report.currentMa = motor.currentMa();
+#endif
+    String statusPacket = LoRaMessage::serializeStatusUpdate(deviceId.c_str(), status.c_str(), rssi, 0, rxSlots.isSynchronized(),
+                                                             -1, &report);
+    sendLoRaMessage(statusPacket);
+}
+
+void WellguardLogic::sendMetricsDigest() {
+    MetricsDigest digest;
+    Metrics::fillDigest(digest);
+    sendLoRaMessage(LoRaMessage::serializeMetricsDigest(deviceId.c_str(), digest));
+
+    NodeDiagnostics diag;
+    Profiler::fillDiagnostics(diag);
+    sendLoRaMessage(LoRaMessage::serializeDiagnostics(deviceId.c_str(), diag));
+}
+
+// Tell the Centrale whether it must hold our downlinks for our receive slots.
+void WellguardLogic::onRxSyncChanged(bool synchronized) {
+    instance->queueReport(WG_REPORT_STATUS);
 }
 
 
@@ -91,6 +255,7 @@ void WellguardLogic::Task_Status_Reporter(void *pvParameters) {
 
 void WellguardLogic::onReceive(int packetSize) {
     if (packetSize == 0) return;
+    instance->lastRxMs = millis();
 
     String encryptedPacket = "";
     while (LoRa.available()) {
@@ -104,7 +269,8 @@ void WellguardLogic::onReceive(int packetSize) {
     if (decryptedPacket.length() > 0) {
         handleLoRaPacket(decryptedPacket);
     } else {
-        Serial.println("Decryption failed.");
+        Metrics::inc(MC_LORA_DECRYPT_FAILURES);
+        TRACE(TR_LORA_DECRYPT_FAILED, encryptedPacket.length());
     }
 }
 
@@ -113,46 +279,92 @@ void WellguardLogic::handleLoRaPacket(const String& packet) {
     DeserializationError error = deserializeJson(doc, packet);
 
     if (error) {
-        Serial.print(F("deserializeJson() failed: "));
-        Serial.println(error.c_str());
+        Metrics::inc(MC_LORA_PARSE_FAILURES);
+        TRACE(TR_LORA_PARSE_FAILED, packet.length());
+        return;
+    }
+
+    int type = doc["type"];
+    Metrics::countRx(type);
+    TRACE(TR_LORA_RX, type, instance->lastCommandRssi, TRACE_ID(doc["src"].as<const char*>()));
+    if (type == MessageType::BEACON) {
+        instance->rxSlots.onBeacon(doc["seq"].as<uint32_t>());
         return;
     }
 
     const char* targetId = doc["tgt"];
     if (targetId != nullptr && instance->deviceId.equals(targetId)) {
 
-        int type = doc["type"];
         if (type == MessageType::COMMAND) {
             int cmd = doc["cmd"];
             bool newRelayState = (cmd == CMD_PUMP_ON);
-            instance->setRelayState(newRelayState);
+            uint32_t waitMs;
+            portENTER_CRITICAL(&instance->protectionMux);
+            PumpHold hold = instance->protection.request(newRelayState, millis(), waitMs);
+            if (hold == PUMP_APPLIED) instance->switchRelay(newRelayState);
+            portEXIT_CRITICAL(&instance->protectionMux);
+            if (hold == PUMP_APPLIED) {
+                TRACE(TR_RELAY_SET, newRelayState);
+                instance->sendStatusUpdate(LoRa.packetRssi()); // Right away, ahead of the ACK
+            } else {
+                TRACE(TR_PUMP_HELD, newRelayState, hold, waitMs);
+            }
 
             const char* sourceId = doc["src"];
             if(sourceId){
-                String ackPacket = LoRaMessage::serializeCommandAck(instance->deviceId.c_str(), sourceId, true);
+                // The status update goes out before the ACK: its airtime shows up in the ACK stage.
+                // A held command has not switched the relay: no latency stages, the ACK says when instead.
+                uint32_t rxMs = instance->lastRxMs;
+#if WELLGUARD_FLOW_METER
+                int32_t flowLph = instance->flow.flowLph();
+#else
+                int32_t flowLph = -1;
+#endif
+                String ackPacket = hold == PUMP_APPLIED
+                    ? LoRaMessage::serializeCommandAck(instance->deviceId.c_str(), sourceId, true,
+                                                       doc["tr"] | 0, instance->relaySwitchedMs - rxMs, millis() - rxMs, 0, 0, flowLph)
+                    : LoRaMessage::serializeCommandAck(instance->deviceId.c_str(), sourceId, true,
+                                                       doc["tr"] | 0, -1, -1, hold, (waitMs + 999) / 1000, flowLph);
                 sendLoRaMessage(ackPacket);
             }
         }
     }
 }
 
-void WellguardLogic::setRelayState(bool newState) {
+// Relay output only, called with protectionMux held together with the protection
+// decision that allowed it: a trip from another task cannot land between the two
+// and be undone by a stale write. The caller traces and reports the new state.
+void WellguardLogic::switchRelay(bool newState) {
+    if (newState) pumpFault = PUMP_FAULT_NONE;
     relayState = newState;
     digitalWrite(WELLGUARD_RELAY_PIN, relayState ? HIGH : LOW);
-    Serial.printf("Relay state set to: %s\n", relayState ? "ON" : "OFF");
+    relaySwitchedMs = millis();
+}
 
-    String status = relayState ? "ON" : "OFF";
-    String statusPacket = LoRaMessage::serializeStatusUpdate(deviceId.c_str(), status.c_str(), LoRa.packetRssi());
-    sendLoRaMessage(statusPacket);
+// Safety stop on a fault seen by the well itself: bypasses the protection timers,
+// then locks starts out for WELLGUARD_FAULT_LOCKOUT_S. The status update carries the fault.
+void WellguardLogic::tripPump(PumpFaultCode fault, const char* reason) {
+    portENTER_CRITICAL(&protectionMux);
+    protection.trip(millis(), WELLGUARD_FAULT_LOCKOUT_S * 1000UL);
+    switchRelay(false);
+    pumpFault = fault;
+    portEXIT_CRITICAL(&protectionMux);
+    TRACE(TR_RELAY_SET, false);
+    Serial.printf("Pump stopped: %s, locked out for %u s.\n", reason, (unsigned)WELLGUARD_FAULT_LOCKOUT_S);
+    queueReport(WG_REPORT_FAULT);
 }
 
 void WellguardLogic::sendLoRaMessage(const String& message) {
     String encrypted = CryptoManager::encrypt(message);
+    int type = Metrics::messageTypeOf(message);
+    Metrics::countTx(type);
 
+    instance->rxSlots.beginTransmit();
     LoRa.beginPacket();
     LoRa.print(encrypted);
     LoRa.endPacket();
+    instance->rxSlots.endTransmit();
 
     instance->lastLoRaTransmissionTimestamp = millis();
-    Serial.printf("Sent LoRa Packet: %s\n", message.c_str());
+    TRACE(TR_LORA_TX, type, message.length());
 }
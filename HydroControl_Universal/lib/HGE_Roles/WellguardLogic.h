@@ -5,8 +5,24 @@
 #include <LoRa.h>
 #include <Preferences.h>
 #include "Message.h"
+#include "PingSlotReceiver.h"
+#include "PumpProtection.h"
+#include "FlowMeter.h"
+#include "PulseCounter.h"
+#include "AdcDmaSampler.h"
+#include "CurrentMonitor.h"
 #include "config.h" // Utilisation de la configuration centralisée
 
+#define WELLGUARD_TX_QUEUE_LEN 4
+
+// Reports sent by the LoRaTx task. They are built when they go out, so a report
+// that overtakes another never carries an older state.
+enum WellguardReport : uint8_t {
+    WG_REPORT_STATUS,
+    WG_REPORT_METRICS, // Metrics digest and diagnostics
+    WG_REPORT_FAULT    // Status after a trip: sent ahead of the others
+};
+
 class WellguardLogic {
 public:
     WellguardLogic();
@@ -17,6 +33,21 @@ private:
     volatile bool relayState = false;
     volatile long lastCommandRssi = 0;
     volatile unsigned long lastLoRaTransmissionTimestamp = 0;
+    volatile uint32_t lastRxMs = 0;        // Latency tracing: frame received
+    volatile uint32_t relaySwitchedMs = 0; // Latency tracing: relay output written
+    PingSlotReceiver rxSlots;
+    PumpProtection protection;
+    portMUX_TYPE protectionMux = portMUX_INITIALIZER_UNLOCKED; // protection, relay and pumpFault: LoRa callback, guard tasks
+#if WELLGUARD_FLOW_METER
+    FlowMeter flow;          // Updated by the PumpGuard task only
+    PulseCounter flowPulses;
+#endif
+#if WELLGUARD_CURRENT_SENSOR
+    CurrentMonitor motor;    // Updated by the MotorGuard task only
+    AdcDmaSampler currentAdc;
+#endif
+    volatile uint8_t pumpFault = PUMP_FAULT_NONE; // PumpFaultCode of the last trip, cleared by the next start
+    QueueHandle_t txQueue = NULL;
 
     void setupHardware();
     void setupLoRa();
@@ -25,13 +56,21 @@ private:
     static void onReceive(int packetSize);
     static void handleLoRaPacket(const String& packet);
     static void sendLoRaMessage(const String& message);
-    void setRelayState(bool newState);
+    void switchRelay(bool newState);
+    void tripPump(PumpFaultCode fault, const char* reason);
+    void queueReport(WellguardReport report);
+    void sendStatusUpdate(long rssi);
+    void sendMetricsDigest();
+    static void onRxSyncChanged(bool synchronized);
 
     // Static members to be accessed by ISR
     static WellguardLogic* instance;
 
     // FreeRTOS tasks
     static void Task_Status_Reporter(void *pvParameters);
+    static void Task_Pump_Guard(void *pvParameters);
+    static void Task_Motor_Guard(void *pvParameters);
+    static void Task_LoRa_Tx(void *pvParameters);
 };
 
 #endif // WELLGUARD_LOGIC_H
@@ -0,0 +1,44 @@
+#include "AdcDmaSampler.h"
+
+bool AdcDmaSampler::begin(adc1_channel_t channel, uint32_t sampleHz, uint32_t periodMs) {
+    this->channel = channel;
+    // Bytes kept by the driver between two drains: a period of samples plus margin.
+    uint32_t storeBytes = (sampleHz / 1000 * periodMs * 2 + 1023) & ~1023u;
+
+    adc_digi_init_config_t init = {};
+    init.max_store_buf_size = storeBytes * 2;
+    init.conv_num_each_intr = sizeof(frame);
+    init.adc1_chan_mask = 1 << channel;
+    if (adc_digi_initialize(&init) != ESP_OK) return false;
+
+    static adc_digi_pattern_config_t pattern = {};
+    pattern.atten = ADC_ATTEN_DB_11;
+    pattern.channel = channel;
+    pattern.unit = 0; // ADC1
+    pattern.bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+
+    adc_digi_configuration_t config = {};
+    config.conv_limit_en = true; // Required by the ESP32 (I2S-driven) controller
+    config.conv_limit_num = 250;
+    config.pattern_num = 1;
+    config.adc_pattern = &pattern;
+    config.sample_freq_hz = sampleHz;
+    config.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+    config.format = ADC_DIGI_OUTPUT_FORMAT_TYPE1;
+    if (adc_digi_controller_configure(&config) != ESP_OK) return false;
+    return adc_digi_start() == ESP_OK;
+}
+
+uint32_t AdcDmaSampler::drain(SampleBlock& block) {
+    uint32_t added = 0;
+    uint32_t length = 0;
+    while (adc_digi_read_bytes(frame, sizeof(frame), &length, 0) == ESP_OK && length > 0) {
+        const adc_digi_output_data_t* samples = (const adc_digi_output_data_t*)frame;
+        for (uint32_t i = 0; i < length / sizeof(adc_digi_output_data_t); i++) {
+            if (samples[i].type1.channel != channel) continue;
+            block.add(samples[i].type1.data);
+            added++;
+        }
+    }
+    return added;
+}
@@ -0,0 +1,25 @@
+#ifndef ADC_DMA_SAMPLER_H
+#define ADC_DMA_SAMPLER_H
+
+#include <Arduino.h>
+#include <driver/adc.h>
+#include "SampleBlock.h"
+
+#define ADC_DMA_FRAME_SAMPLES 256 // Samples per DMA interrupt, and per driver read
+
+// Continuous conversion of one ADC1 channel into DMA (IDF 4.4 adc_digi driver):
+// the CPU only touches the samples when the owner drains them, once per period.
+// The ESP32 has a single digital ADC controller, so one instance per firmware.
+class AdcDmaSampler {
+public:
+    // periodMs: longest expected time between two drains, sizes the driver buffer.
+    bool begin(adc1_channel_t channel, uint32_t sampleHz, uint32_t periodMs);
+    // Adds everything converted since the last drain to block, returns the count.
+    uint32_t drain(SampleBlock& block);
+
+private:
+    adc1_channel_t channel = ADC1_CHANNEL_0;
+    uint8_t frame[ADC_DMA_FRAME_SAMPLES * 2];
+};
+
+#endif // ADC_DMA_SAMPLER_H
@@ -0,0 +1,63 @@
+#include "CurrentMonitor.h"
+
+CurrentMonitor::CurrentMonitor(const CurrentMonitorConfig& config) : config(config) {
+    dryRunBelowMa = (uint32_t)((uint64_t)config.ratedMa * config.dryRunPct / 100);
+    overloadAboveMa = (uint32_t)((uint64_t)config.ratedMa * config.overloadPct / 100);
+    lockedRotorAboveMa = (uint32_t)((uint64_t)config.ratedMa * config.lockedRotorPct / 100);
+}
+
+// RMS in 1/16 count * uA per count / 16 / 1000, rounded.
+uint32_t CurrentMonitor::toMilliamps(const SampleBlock& block) const {
+    return (uint32_t)(((uint64_t)block.acRmsQ4() * config.microampsPerCount + 8000) / 16000);
+}
+
+bool CurrentMonitor::update(uint32_t milliamps, bool motorOn, uint32_t nowMs) {
+    lastMa = milliamps;
+    if (motorOn && !motorWasOn) {
+        startedMs = nowMs;
+        currentFault = MOTOR_OK;
+    }
+    motorWasOn = motorOn;
+    if (!motorOn || currentFault != MOTOR_OK || nowMs - startedMs < config.startupMs) {
+        condition = MOTOR_OK;
+        return false;
+    }
+
+    MotorFault seen = classify(milliamps);
+    if (seen != condition) {
+        condition = seen;
+        conditionSinceMs = nowMs;
+    }
+    switch (seen) {
+        case MOTOR_FAULT_DRY_RUN:
+            if (nowMs - conditionSinceMs < config.dryRunMs) return false;
+            break;
+        case MOTOR_FAULT_OVERLOAD:
+            if (nowMs - conditionSinceMs < config.overloadMs) return false;
+            break;
+        case MOTOR_FAULT_LOCKED_ROTOR:
+            break;
+        default:
+            return false;
+    }
+    currentFault = seen;
+    condition = MOTOR_OK;
+    return true;
+}
+
+MotorFault CurrentMonitor::classify(uint32_t milliamps) const {
+    if (milliamps > lockedRotorAboveMa) return MOTOR_FAULT_LOCKED_ROTOR;
+    if (milliamps > overloadAboveMa) return MOTOR_FAULT_OVERLOAD;
+    if (milliamps < dryRunBelowMa) return MOTOR_FAULT_DRY_RUN;
+    return MOTOR_OK;
+}
+
+const char* CurrentMonitor::faultName(MotorFault fault) {
+    switch (fault) {
+        case MOTOR_OK: return "OK";
+        case MOTOR_FAULT_DRY_RUN: return "DRY_RUN";
+        case MOTOR_FAULT_OVERLOAD: return "OVERLOAD";
+        case MOTOR_FAULT_LOCKED_ROTOR: return "LOCKED_ROTOR";
+        default: return "UNKNOWN";
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef CURRENT_MONITOR_H
+#define CURRENT_MONITOR_H
+
+#include <stdint.h>
+#include "SampleBlock.h"
+
+enum MotorFault : uint8_t {
+    MOTOR_OK,
+    MOTOR_FAULT_DRY_RUN,      // Current well under rated: the pump turns but moves no water
+    MOTOR_FAULT_OVERLOAD,     // Current over rated: worn bearings, clogged impeller, low voltage
+    MOTOR_FAULT_LOCKED_ROTOR  // Still drawing starting current once started: seized motor or pump
+};
+
+struct CurrentMonitorConfig {
+    uint32_t microampsPerCount;  // Clamp and burden scaling: RMS of one ADC count, in uA
+    uint32_t ratedMa;            // Motor full-load current
+    uint8_t dryRunPct;           // Below this % of rated while running: dry run
+    uint8_t overloadPct;         // Above this %: overload
+    uint16_t lockedRotorPct;     // Above this % once started: locked rotor, trips at once
+    uint32_t startupMs;          // Inrush after a start, not watched
+    uint32_t dryRunMs;           // Dry run for this long before the trip
+    uint32_t overloadMs;         // Overload for this long before the trip
+};
+
+// Motor current of a pump from a current transformer clamp, and detection of dry
+// run, overload and locked rotor. Pure logic: no Arduino, RTOS or radio, time
+// passed in by the caller, so it runs the same on a PC.
+//
+// The caller converts a block of ADC samples (a whole number of mains periods)
+// with toMilliamps() and passes it to update(). A fault stays reported until the
+// motor is started again.
+class CurrentMonitor {
+public:
+    explicit CurrentMonitor(const CurrentMonitorConfig& config);
+
+    uint32_t toMilliamps(const SampleBlock& block) const;
+    // Returns true when a fault starts: the caller must stop the motor.
+    bool update(uint32_t milliamps, bool motorOn, uint32_t nowMs);
+
+    uint32_t currentMa() const { return lastMa; }
+    MotorFault fault() const { return currentFault; }
+
+    static const char* faultName(MotorFault fault);
+
+private:
+    CurrentMonitorConfig config;
+    uint32_t dryRunBelowMa;
+    uint32_t overloadAboveMa;
+    uint32_t lockedRotorAboveMa;
+
+    uint32_t lastMa = 0;
+    bool motorWasOn = false;
+    uint32_t startedMs = 0;
+    MotorFault condition = MOTOR_OK; // Seen in every block since conditionSinceMs
+    uint32_t conditionSinceMs = 0;
+    MotorFault currentFault = MOTOR_OK;
+
+    MotorFault classify(uint32_t milliamps) const;
+};
+
+#endif // CURRENT_MONITOR_H
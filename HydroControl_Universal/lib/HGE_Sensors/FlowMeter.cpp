@@ -0,0 +1,63 @@
+#include "FlowMeter.h"
+#include <string.h>
+
+FlowMeter::FlowMeter(const FlowMeterConfig& config) : config(config) {
+    memset(slotPulses, 0, sizeof(slotPulses));
+    memset(slotMs, 0, sizeof(slotMs));
+}
+
+void FlowMeter::begin(uint32_t nowMs, uint32_t totalLitres) {
+    totalMicrolitres = (uint64_t)totalLitres * 1000000ULL;
+    lastUpdateMs = nowMs;
+}
+
+bool FlowMeter::update(uint32_t pulses, bool pumpOn, uint32_t nowMs) {
+    totalMicrolitres += (uint64_t)pulses * config.microlitresPerPulse;
+    slotPulses[slotHead] = pulses;
+    slotMs[slotHead] = nowMs - lastUpdateMs;
+    slotHead = (slotHead + 1) % FLOW_RATE_SLOTS;
+    lastUpdateMs = nowMs;
+
+    if (pumpOn && !pumpWasOn) {
+        runStartedMs = nowMs;
+        currentFault = FLOW_OK;
+    }
+    pumpWasOn = pumpOn;
+    if (!pumpOn || currentFault != FLOW_OK || nowMs - runStartedMs < config.primingMs) {
+        low = false;
+        return false;
+    }
+
+    if (flowLph() >= config.minFlowLph) {
+        low = false;
+        return false;
+    }
+    if (!low) {
+        low = true;
+        lowSinceMs = nowMs;
+    }
+    if (nowMs - lowSinceMs < config.noFlowMs) return false;
+    currentFault = FLOW_FAULT_NO_FLOW;
+    low = false;
+    return true;
+}
+
+// uL/ms * 3600000 ms/h / 1000000 uL/L = L/h * 3.6
+uint32_t FlowMeter::flowLph() const {
+    uint64_t pulses = 0;
+    uint64_t ms = 0;
+    for (uint8_t i = 0; i < FLOW_RATE_SLOTS; i++) {
+        pulses += slotPulses[i];
+        ms += slotMs[i];
+    }
+    if (ms == 0) return 0;
+    return (uint32_t)(pulses * config.microlitresPerPulse * 36 / (ms * 10));
+}
+
+const char* FlowMeter::faultName(FlowFault fault) {
+    switch (fault) {
+        case FLOW_OK: return "OK";
+        case FLOW_FAULT_NO_FLOW: return "NO_FLOW";
+        default: return "UNKNOWN";
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef FLOW_METER_H
+#define FLOW_METER_H
+
+#include <stdint.h>
+
+#define FLOW_RATE_SLOTS 8 // Updates the flow rate is averaged over
+
+enum FlowFault : uint8_t {
+    FLOW_OK,
+    FLOW_FAULT_NO_FLOW // Pump running but (almost) no water through the meter: dry well, broken or closed pipe
+};
+
+struct FlowMeterConfig {
+    uint32_t microlitresPerPulse;
+    uint32_t primingMs;  // After a start, time for the water to reach the meter before it is watched
+    uint32_t minFlowLph; // Below this while running counts as no flow
+    uint32_t noFlowMs;   // Continuously below minFlowLph for this long: FLOW_FAULT_NO_FLOW
+};
+
+// Flow rate and total volume from the pulse count of a flow meter, and detection
+// of a pump running dry. Pure logic: no Arduino, RTOS or radio, time passed in
+// by the caller, so it runs the same on a PC.
+//
+// The caller reads the pulse counter periodically and passes the pulses counted
+// since the previous call; the rate is averaged over the last FLOW_RATE_SLOTS
+// calls. A fault stays reported until the pump is started again.
+class FlowMeter {
+public:
+    explicit FlowMeter(const FlowMeterConfig& config);
+
+    // totalLitres: volume restored from flash.
+    void begin(uint32_t nowMs, uint32_t totalLitres);
+    // Returns true when a fault starts: the caller must stop the pump.
+    bool update(uint32_t pulses, bool pumpOn, uint32_t nowMs);
+
+    uint32_t flowLph() const;
+    uint32_t volumeLitres() const { return (uint32_t)(totalMicrolitres / 1000000ULL); }
+    FlowFault fault() const { return currentFault; }
+
+    static const char* faultName(FlowFault fault);
+
+private:
+    FlowMeterConfig config;
+    uint64_t totalMicrolitres = 0;
+    uint32_t lastUpdateMs = 0;
+    // Ring of the last updates: pulses and the time they were counted over
+    uint32_t slotPulses[FLOW_RATE_SLOTS];
+    uint32_t slotMs[FLOW_RATE_SLOTS];
+    uint8_t slotHead = 0;
+    bool pumpWasOn = false;
+    uint32_t runStartedMs = 0;
+    bool low = false;        // Flow below minFlowLph since lowSinceMs
+    uint32_t lowSinceMs = 0;
+    FlowFault currentFault = FLOW_OK;
+};
+
+#endif // FLOW_METER_H
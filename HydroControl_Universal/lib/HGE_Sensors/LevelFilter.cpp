@@ -0,0 +1,131 @@
+#include "LevelFilter.h"
+
+// --- MedianFilter ---
+
+MedianFilter::MedianFilter(uint8_t window) {
+    if (window == 0) window = 1;
+    if (window > LEVEL_MEDIAN_MAX) window = LEVEL_MEDIAN_MAX;
+    this->window = window;
+}
+
+void MedianFilter::reset() {
+    head = 0;
+    count = 0;
+}
+
+// The sorted copy is kept up to date by one removal and one insertion.
+uint16_t MedianFilter::push(uint16_t value) {
+    uint8_t n = count;
+    if (count == window) {
+        uint16_t outgoing = ring[head];
+        uint8_t i = 0;
+        while (sorted[i] != outgoing) i++;
+        for (; i + 1 < n; i++) sorted[i] = sorted[i + 1];
+        n--;
+    } else {
+        count++;
+    }
+    ring[head] = value;
+    head = (head + 1) % window;
+
+    uint8_t i = n;
+    while (i > 0 && sorted[i - 1] > value) {
+        sorted[i] = sorted[i - 1];
+        i--;
+    }
+    sorted[i] = value;
+    return sorted[count / 2];
+}
+
+// --- EmaFilter ---
+
+EmaFilter::EmaFilter(uint8_t shift) : shift(shift > 8 ? 8 : shift) {}
+
+uint16_t EmaFilter::push(uint16_t value) {
+    int32_t sample = (int32_t)value << 8;
+    if (!primed) {
+        state = sample;
+        primed = true;
+    } else {
+        state += (sample - state) >> shift;
+    }
+    return (uint16_t)((state + 128) >> 8);
+}
+
+// --- LevelCalibration ---
+
+LevelCalibration::LevelCalibration(const CalibrationPoint* points, uint8_t count, uint16_t faultMargin)
+    : count(count > LEVEL_CAL_MAX_POINTS ? LEVEL_CAL_MAX_POINTS : count), faultMargin(faultMargin) {
+    for (uint8_t i = 0; i < this->count; i++) this->points[i] = points[i];
+}
+
+bool LevelCalibration::inRange(uint16_t raw) const {
+    if (count == 0) return false;
+    int32_t low = (int32_t)points[0].raw - faultMargin;
+    int32_t high = (int32_t)points[count - 1].raw + faultMargin;
+    return raw >= low && raw <= high;
+}
+
+int16_t LevelCalibration::toPermille(uint16_t raw) const {
+    if (count == 0) return LEVEL_UNKNOWN;
+    if (raw <= points[0].raw) return points[0].permille;
+    for (uint8_t i = 1; i < count; i++) {
+        if (raw > points[i].raw) continue;
+        const CalibrationPoint& a = points[i - 1];
+        const CalibrationPoint& b = points[i];
+        int32_t span = b.raw - a.raw;
+        if (span == 0) return b.permille;
+        int32_t scaled = (int32_t)(raw - a.raw) * (b.permille - a.permille);
+        int32_t offset = (scaled + (scaled < 0 ? -span / 2 : span / 2)) / span; // Rounded both ways
+        return (int16_t)(a.permille + offset);
+    }
+    return points[count - 1].permille;
+}
+
+// --- Classification ---
+
+SensorLevel classifyLevel(int16_t permille, SensorLevel previous, const LevelThresholds& t) {
+    if (permille == LEVEL_UNKNOWN) return SENSOR_LEVEL_FAULT;
+    int16_t h = t.hysteresis;
+    switch (previous) {
+        case SENSOR_LEVEL_EMPTY:
+            if (permille < t.emptyBelow + h) return SENSOR_LEVEL_EMPTY;
+            break;
+        case SENSOR_LEVEL_FULL:
+            if (permille > (int16_t)t.fullAbove - h) return SENSOR_LEVEL_FULL;
+            break;
+        default:
+            break;
+    }
+    if (permille < t.emptyBelow) return SENSOR_LEVEL_EMPTY;
+    if (permille > t.fullAbove) return SENSOR_LEVEL_FULL;
+    return SENSOR_LEVEL_OK;
+}
+
+// --- LevelFilterChain ---
+
+LevelFilterChain::LevelFilterChain(uint8_t medianWindow, uint8_t emaShift, const LevelCalibration& calibration,
+                                   const LevelThresholds& thresholds, uint8_t faultSamples)
+    : median(medianWindow), ema(emaShift), calibration(calibration), thresholds(thresholds),
+      faultSamples(faultSamples == 0 ? 1 : faultSamples) {}
+
+bool LevelFilterChain::push(uint16_t raw) {
+    if (!calibration.inRange(raw)) return missed();
+    if (badInRow >= faultSamples) {
+        median.reset(); // Back from a fault: what was filtered before is stale
+        ema.reset();
+    }
+    badInRow = 0;
+
+    lastPermille = calibration.toPermille(ema.push(median.push(raw)));
+    SensorLevel previous = level;
+    level = classifyLevel(lastPermille, level == SENSOR_LEVEL_FAULT ? SENSOR_LEVEL_NONE : level, thresholds);
+    return level != previous;
+}
+
+bool LevelFilterChain::missed() {
+    if (badInRow < faultSamples) badInRow++;
+    if (badInRow < faultSamples || level == SENSOR_LEVEL_FAULT) return false;
+    level = SENSOR_LEVEL_FAULT;
+    return true;
+}
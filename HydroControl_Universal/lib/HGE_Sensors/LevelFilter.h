@@ -0,0 +1,111 @@
+#ifndef LEVEL_FILTER_H
+#define LEVEL_FILTER_H
+
+#include <stdint.h>
+
+#define LEVEL_MEDIAN_MAX      9    // Largest median window
+#define LEVEL_CAL_MAX_POINTS  8
+#define LEVEL_PERMILLE_MAX    1000
+#define LEVEL_UNKNOWN         -1
+
+// Integer arithmetic only, no Arduino: the whole chain runs the same on a PC.
+// Each push() is O(window) with window <= LEVEL_MEDIAN_MAX, whatever the input.
+
+enum SensorLevel : uint8_t {
+    SENSOR_LEVEL_EMPTY,
+    SENSOR_LEVEL_OK,
+    SENSOR_LEVEL_FULL,
+    SENSOR_LEVEL_FAULT,   // No valid reading for a while: broken loop, sensor missing
+    SENSOR_LEVEL_NONE     // Nothing classified yet
+};
+
+// Median of the last `window` values: removes isolated spikes (ultrasonic echoes,
+// pump start transients) without the lag of a long average.
+class MedianFilter {
+public:
+    explicit MedianFilter(uint8_t window);
+    // Median of the values so far while fewer than window were pushed.
+    uint16_t push(uint16_t value);
+    void reset();
+
+private:
+    uint16_t ring[LEVEL_MEDIAN_MAX];
+    uint16_t sorted[LEVEL_MEDIAN_MAX];
+    uint8_t window;
+    uint8_t head = 0;
+    uint8_t count = 0;
+};
+
+// Exponential average, weight 1/2^shift per new value, state in Q8.
+class EmaFilter {
+public:
+    explicit EmaFilter(uint8_t shift);
+    uint16_t push(uint16_t value);
+    void reset() { primed = false; }
+
+private:
+    uint8_t shift;
+    bool primed = false;
+    int32_t state = 0;
+};
+
+struct CalibrationPoint {
+    uint16_t raw;       // Sensor units: ADC counts, distance in mm...
+    uint16_t permille;  // Level, 0 = empty, 1000 = full height
+};
+
+// Piecewise-linear raw -> level table. Points by increasing raw; the level may
+// go either way (an ultrasonic distance falls as the level rises).
+class LevelCalibration {
+public:
+    LevelCalibration(const CalibrationPoint* points, uint8_t count, uint16_t faultMargin);
+    // Beyond the table by more than faultMargin: not a level (loop open or shorted).
+    bool inRange(uint16_t raw) const;
+    // Clamped to the table ends.
+    int16_t toPermille(uint16_t raw) const;
+
+private:
+    CalibrationPoint points[LEVEL_CAL_MAX_POINTS];
+    uint8_t count;
+    uint16_t faultMargin;
+};
+
+// EMPTY below emptyBelow, FULL above fullAbove, OK in between. A level only
+// leaves its class once past the threshold by `hysteresis`, so a surface
+// rippling around a threshold does not flap the pump command.
+struct LevelThresholds {
+    uint16_t emptyBelow;
+    uint16_t fullAbove;
+    uint16_t hysteresis;
+};
+
+SensorLevel classifyLevel(int16_t permille, SensorLevel previous, const LevelThresholds& thresholds);
+
+// raw sample -> range check -> median -> exponential average -> calibration -> class.
+// Out-of-range samples are not filtered; faultSamples of them in a row make the
+// level SENSOR_LEVEL_FAULT, and the filters start over once readings are back.
+class LevelFilterChain {
+public:
+    LevelFilterChain(uint8_t medianWindow, uint8_t emaShift, const LevelCalibration& calibration,
+                     const LevelThresholds& thresholds, uint8_t faultSamples);
+
+    // Returns true if the level class changed.
+    bool push(uint16_t raw);
+    // No reading at all this period (timeout, bad frame): counts towards a fault.
+    bool missed();
+
+    int16_t permille() const { return level == SENSOR_LEVEL_FAULT ? LEVEL_UNKNOWN : lastPermille; }
+    SensorLevel currentLevel() const { return level; }
+
+private:
+    MedianFilter median;
+    EmaFilter ema;
+    LevelCalibration calibration;
+    LevelThresholds thresholds;
+    uint8_t faultSamples;
+    uint8_t badInRow = 0;
+    int16_t lastPermille = LEVEL_UNKNOWN;
+    SensorLevel level = SENSOR_LEVEL_NONE;
+};
+
+#endif // LEVEL_FILTER_H
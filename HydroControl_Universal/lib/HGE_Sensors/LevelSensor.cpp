@@ -0,0 +1,87 @@
+#include "LevelSensor.h"
+#include "Profiler.h"
+#include "TraceLog.h"
+#include "config.h"
+
+static const CalibrationPoint LEVEL_CALIBRATION_POINTS[] = LEVEL_CALIBRATION;
+
+LevelSensor::LevelSensor()
+    : chain(LEVEL_MEDIAN_WINDOW, LEVEL_EMA_SHIFT,
+            LevelCalibration(LEVEL_CALIBRATION_POINTS, sizeof(LEVEL_CALIBRATION_POINTS) / sizeof(LEVEL_CALIBRATION_POINTS[0]), LEVEL_FAULT_MARGIN),
+            LevelThresholds{ LEVEL_EMPTY_BELOW, LEVEL_FULL_ABOVE, LEVEL_HYSTERESIS }, LEVEL_FAULT_SAMPLES) {}
+
+void LevelSensor::begin(ChangeHandler onChange, void* context) {
+    this->onChange = onChange;
+    this->context = context;
+    if (!startSampling()) {
+        Serial.println("Level sensor: sampling could not start.");
+        return;
+    }
+    xTaskCreate(Task_Level_Sampler, "LevelSampler", Profiler::stackSize("LevelSampler", 3072), this, 2, NULL);
+}
+
+#if LEVEL_SENSOR_TYPE == LEVEL_SENSOR_ANALOG
+
+bool LevelSensor::startSampling() {
+    return adc.begin(LEVEL_ADC_CHANNEL, LEVEL_ADC_SAMPLE_HZ, LEVEL_SAMPLE_PERIOD_MS);
+}
+
+// Averages what the DMA converted since the last period.
+bool LevelSensor::readPoint(uint16_t& raw) {
+    SampleBlock block;
+    if (adc.drain(block) == 0) return false;
+    raw = block.mean();
+    return true;
+}
+
+#elif LEVEL_SENSOR_TYPE == LEVEL_SENSOR_ULTRASONIC
+
+bool LevelSensor::startSampling() {
+    Serial2.begin(LEVEL_UART_BAUD, SERIAL_8N1, LEVEL_UART_RX_PIN, -1);
+    return true;
+}
+
+// The sensor sends about one frame per 100 ms: keep the last one of the period.
+bool LevelSensor::readPoint(uint16_t& raw) {
+    bool found = false;
+    uint16_t mm;
+    while (Serial2.available()) {
+        if (parser.feed((uint8_t)Serial2.read(), mm)) {
+            raw = mm;
+            found = true;
+        }
+    }
+    return found;
+}
+
+#else
+
+bool LevelSensor::startSampling() {
+    return false; // Float switches are read by AquaReservLogic
+}
+
+bool LevelSensor::readPoint(uint16_t& raw) {
+    return false;
+}
+
+#endif
+
+void LevelSensor::sample() {
+    uint16_t raw;
+    bool changed = readPoint(raw) ? chain.push(raw) : chain.missed();
+    currentPermille = chain.permille();
+    currentLevel = chain.currentLevel();
+    if (!changed) return;
+
+    TRACE(TR_LEVEL_CHANGED, currentLevel, currentPermille);
+    if (onChange != nullptr) onChange(currentLevel, context);
+}
+
+void LevelSensor::Task_Level_Sampler(void *pvParameters) {
+    LevelSensor* self = (LevelSensor*)pvParameters;
+    TickType_t lastWake = xTaskGetTickCount();
+    for (;;) {
+        vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(LEVEL_SAMPLE_PERIOD_MS));
+        self->sample();
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef LEVEL_SENSOR_H
+#define LEVEL_SENSOR_H
+
+#include <Arduino.h>
+#include "AdcDmaSampler.h"
+#include "LevelFilter.h"
+#include "UltrasonicParser.h"
+
+// Continuous level sensor of the AquaReserv, type chosen by LEVEL_SENSOR_TYPE:
+// - LEVEL_SENSOR_ANALOG: the ADC runs continuously into DMA at LEVEL_ADC_SAMPLE_HZ
+//   and each period averages everything converted since the last one, so the CPU
+//   only touches the samples once per LEVEL_SAMPLE_PERIOD_MS.
+// - LEVEL_SENSOR_ULTRASONIC: distance frames read from Serial2.
+// A sampler task feeds one point per period through the LevelFilterChain and calls
+// the handler whenever the level class changes, the first classification included.
+class LevelSensor {
+public:
+    typedef void (*ChangeHandler)(SensorLevel level, void* context);
+
+    LevelSensor();
+    void begin(ChangeHandler onChange, void* context);
+
+    // Filtered level in permille, LEVEL_UNKNOWN before the first reading or on a fault.
+    int16_t permille() const { return currentPermille; }
+    SensorLevel level() const { return currentLevel; }
+
+private:
+    LevelFilterChain chain;
+    AdcDmaSampler adc;
+    UltrasonicParser parser;
+    ChangeHandler onChange = nullptr;
+    void* context = nullptr;
+
+    volatile int16_t currentPermille = LEVEL_UNKNOWN;
+    volatile SensorLevel currentLevel = SENSOR_LEVEL_NONE;
+
+    bool startSampling();
+    // One raw point for this period, false if there was none.
+    bool readPoint(uint16_t& raw);
+    void sample();
+    static void Task_Level_Sampler(void *pvParameters);
+};
+
+#endif // LEVEL_SENSOR_H
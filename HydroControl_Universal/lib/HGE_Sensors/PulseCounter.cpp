@@ -0,0 +1,37 @@
+#include "PulseCounter.h"
+#include <Arduino.h>
+#include <driver/pcnt.h>
+
+bool PulseCounter::begin(uint8_t pin, uint8_t unit) {
+    this->unit = unit;
+    pinMode(pin, INPUT_PULLUP); // Open-collector Hall sensors
+
+    pcnt_config_t config = {};
+    config.pulse_gpio_num = pin;
+    config.ctrl_gpio_num = PCNT_PIN_NOT_USED;
+    config.channel = PCNT_CHANNEL_0;
+    config.unit = (pcnt_unit_t)unit;
+    config.pos_mode = PCNT_COUNT_INC;
+    config.neg_mode = PCNT_COUNT_DIS;
+    config.lctrl_mode = PCNT_MODE_KEEP;
+    config.hctrl_mode = PCNT_MODE_KEEP;
+    config.counter_h_lim = PULSE_COUNTER_LIMIT;
+    config.counter_l_lim = 0;
+    if (pcnt_unit_config(&config) != ESP_OK) return false;
+
+    pcnt_set_filter_value((pcnt_unit_t)unit, PULSE_GLITCH_FILTER_CYCLES);
+    pcnt_filter_enable((pcnt_unit_t)unit);
+    pcnt_counter_pause((pcnt_unit_t)unit);
+    pcnt_counter_clear((pcnt_unit_t)unit);
+    pcnt_counter_resume((pcnt_unit_t)unit);
+    lastCount = 0;
+    return true;
+}
+
+uint32_t PulseCounter::takePulses() {
+    int16_t count = 0;
+    if (pcnt_get_counter_value((pcnt_unit_t)unit, &count) != ESP_OK) return 0;
+    uint32_t pulses = pulsesBetween(lastCount, count);
+    lastCount = count;
+    return pulses;
+}
@@ -0,0 +1,32 @@
+#ifndef PULSE_COUNTER_H
+#define PULSE_COUNTER_H
+
+#include <stdint.h>
+
+// Counts rising edges on a pin with the PCNT peripheral: no interrupt per pulse,
+// the CPU only reads the counter. The hardware glitch filter drops pulses shorter
+// than PULSE_GLITCH_FILTER_CYCLES APB cycles (12.8 us). The 16-bit counter wraps
+// at PULSE_COUNTER_LIMIT, so it must be read at least that often in pulses.
+#define PULSE_COUNTER_LIMIT        32767
+#define PULSE_GLITCH_FILTER_CYCLES 1023
+
+class PulseCounter {
+public:
+    bool begin(uint8_t pin, uint8_t unit);
+    // Pulses counted since the previous call (or begin()).
+    uint32_t takePulses();
+
+    // Pulses between two counter readings, across one wrap at PULSE_COUNTER_LIMIT
+    // (the counter goes back to 0 when it reaches it).
+    static uint32_t pulsesBetween(int16_t previous, int16_t count) {
+        int32_t delta = count - previous;
+        if (delta < 0) delta += PULSE_COUNTER_LIMIT;
+        return (uint32_t)delta;
+    }
+
+private:
+    uint8_t unit = 0;
+    int16_t lastCount = 0;
+};
+
+#endif // PULSE_COUNTER_H
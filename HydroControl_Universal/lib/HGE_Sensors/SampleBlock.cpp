@@ -0,0 +1,38 @@
+#include "SampleBlock.h"
+
+void SampleBlock::reset() {
+    sum = 0;
+    sumSquares = 0;
+    count = 0;
+}
+
+uint16_t SampleBlock::mean() const {
+    if (count == 0) return 0;
+    return (uint16_t)((sum + count / 2) / count);
+}
+
+// variance = (n * sum(x^2) - sum(x)^2) / n^2, scaled by 256 before the root for the Q4 result.
+uint32_t SampleBlock::acRmsQ4() const {
+    if (count == 0) return 0;
+    // spread = n^2 * variance: the shift below bounds the block, see SAMPLE_BLOCK_MAX_SAMPLES.
+    uint64_t spread = (uint64_t)count * sumSquares - sum * sum;
+    uint64_t n2 = (uint64_t)count * count;
+    return isqrt((spread << 8) / n2);
+}
+
+// Bit-by-bit integer square root, floor.
+uint32_t SampleBlock::isqrt(uint64_t value) {
+    uint64_t root = 0;
+    uint64_t bit = 1ULL << 62;
+    while (bit > value) bit >>= 2;
+    while (bit != 0) {
+        if (value >= root + bit) {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)root;
+}
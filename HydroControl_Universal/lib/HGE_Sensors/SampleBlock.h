@@ -0,0 +1,37 @@
+#ifndef SAMPLE_BLOCK_H
+#define SAMPLE_BLOCK_H
+
+#include <stdint.h>
+
+// Largest block acRmsQ4() handles: 12-bit samples vary by less than 2^22 counts^2,
+// and n^2 * variance * 256 must fit 64 bits.
+#define SAMPLE_BLOCK_MAX_SAMPLES 131072
+
+// Running sums over a block of ADC samples: mean, and RMS of the AC part (the
+// deviation from the block mean), in fixed point. Over a whole number of mains
+// periods the block mean is the DC bias of the input, so no separate offset
+// tracking is needed. No Arduino: runs the same on a PC.
+class SampleBlock {
+public:
+    void add(uint16_t sample) {
+        sum += sample;
+        sumSquares += (uint32_t)sample * sample;
+        count++;
+    }
+    void reset();
+
+    uint32_t samples() const { return count; }
+    // Rounded, 0 when empty.
+    uint16_t mean() const;
+    // RMS in 1/16 of an ADC count. Wrong beyond SAMPLE_BLOCK_MAX_SAMPLES samples.
+    uint32_t acRmsQ4() const;
+
+    static uint32_t isqrt(uint64_t value);
+
+private:
+    uint64_t sum = 0;
+    uint64_t sumSquares = 0;
+    uint32_t count = 0;
+};
+
+#endif // SAMPLE_BLOCK_H
@@ -0,0 +1,21 @@
+#include "UltrasonicParser.h"
+
+bool UltrasonicParser::feed(uint8_t b, uint16_t& mm) {
+    if (length == 0 && b != 0xFF) return false;
+    frame[length++] = b;
+    if (length < 4) return false;
+    length = 0;
+
+    if ((uint8_t)(frame[0] + frame[1] + frame[2]) != frame[3]) {
+        bad++;
+        // The header may have been a data byte: look for another one in the frame
+        for (uint8_t i = 1; i < 4; i++) {
+            if (frame[i] != 0xFF) continue;
+            for (uint8_t j = i; j < 4; j++) frame[length++] = frame[j];
+            break;
+        }
+        return false;
+    }
+    mm = ((uint16_t)frame[1] << 8) | frame[2];
+    return true;
+}
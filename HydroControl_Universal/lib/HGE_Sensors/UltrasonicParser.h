@@ -0,0 +1,22 @@
+#ifndef ULTRASONIC_PARSER_H
+#define ULTRASONIC_PARSER_H
+
+#include <stdint.h>
+
+// Frames of the UART ultrasonic distance sensors (A02YYUW, JSN-SR04T mode 1...):
+// 0xFF, distance high byte, distance low byte, checksum = low byte of the sum of
+// the first three. Distance in mm. Fed byte by byte, resynchronizes on 0xFF after
+// a bad checksum. No Arduino: runs the same on a PC.
+class UltrasonicParser {
+public:
+    // Returns true when b completes a valid frame; the distance is then in mm.
+    bool feed(uint8_t b, uint16_t& mm);
+    uint32_t badFrames() const { return bad; }
+
+private:
+    uint8_t frame[4];
+    uint8_t length = 0;
+    uint32_t bad = 0;
+};
+
+#endif // ULTRASONIC_PARSER_H
@@ -0,0 +1,188 @@
+#include "Benchmarks.h"
+
+#ifdef HGE_BENCHMARKS
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include "NodeMetadataCache.h"
+#include "LevelFilter.h"
+#include "SampleBlock.h"
+#include "CurrentMonitor.h"
+#include "config.h"
+
+#define BENCH_NAMES_NS "bench-names"
+#define BENCH_NOTES_NS "bench-notes"
+
+static void printResult(const char* label, uint32_t totalUs, uint32_t worstUs, int nodeCount) {
+    Serial.printf("  %-28s total %7lu us  mean %5lu us  worst %5lu us\n", label,
+                  (unsigned long)totalUs, (unsigned long)(totalUs / nodeCount), (unsigned long)worstUs);
+}
+
+void runNodeMetadataBenchmark(int nodeCount) {
+    Serial.printf("--- Benchmark: re-discovery of %d nodes ---\n", nodeCount);
+
+    // Seed a scratch namespace with one name per node (not timed).
+    Preferences prefs;
+    prefs.begin(BENCH_NAMES_NS, false);
+    for (int i = 0; i < nodeCount; i++) {
+        char id[16];
+        snprintf(id, sizeof(id), "BENCH%07d", i);
+        prefs.putString(id, String("Reservoir ") + i);
+    }
+    prefs.end();
+
+    SemaphoreHandle_t nodeMutex = xSemaphoreCreateMutex();
+    uint32_t totalUs = 0, worstUs = 0;
+
+    // Before: Preferences begin/getString/end for each new node, with the node mutex held.
+    for (int i = 0; i < nodeCount; i++) {
+        char id[16];
+        snprintf(id, sizeof(id), "BENCH%07d", i);
+        uint32_t start = micros();
+        xSemaphoreTake(nodeMutex, portMAX_DELAY);
+        Preferences p;
+        p.begin(BENCH_NAMES_NS, true);
+        String name = p.getString(id, "");
+        p.end();
+        xSemaphoreGive(nodeMutex);
+        uint32_t elapsed = micros() - start;
+        totalUs += elapsed;
+        if (elapsed > worstUs) worstUs = elapsed;
+    }
+    printResult("NVS read per node", totalUs, worstUs, nodeCount);
+
+    // After: one NVS pass at boot, then RAM lookups.
+    NodeMetadataCache* cache = new NodeMetadataCache();
+    uint32_t loadStart = micros();
+    int loaded = cache->load(BENCH_NAMES_NS, BENCH_NOTES_NS);
+    uint32_t loadUs = micros() - loadStart;
+
+    totalUs = 0;
+    worstUs = 0;
+    for (int i = 0; i < nodeCount; i++) {
+        char id[16];
+        snprintf(id, sizeof(id), "BENCH%07d", i);
+        uint32_t start = micros();
+        xSemaphoreTake(nodeMutex, portMAX_DELAY);
+        String name = cache->name(String(id));
+        xSemaphoreGive(nodeMutex);
+        uint32_t elapsed = micros() - start;
+        totalUs += elapsed;
+        if (elapsed > worstUs) worstUs = elapsed;
+    }
+    printResult("Metadata cache lookup", totalUs, worstUs, nodeCount);
+    Serial.printf("  Boot load: %d values in %lu us, arena %u bytes\n", loaded, (unsigned long)loadUs,
+                  (unsigned)cache->arenaUsed());
+
+    delete cache;
+    vSemaphoreDelete(nodeMutex);
+    prefs.begin(BENCH_NAMES_NS, false);
+    prefs.clear();
+    prefs.end();
+}
+
+void runLevelFilterBenchmark(int sampleCount) {
+    Serial.printf("--- Benchmark: level filtering, %d periods ---\n", sampleCount);
+
+    // One period of DMA samples, as the sampler drains it (not timed).
+    const int frameSamples = LEVEL_ADC_SAMPLE_HZ / 1000 * LEVEL_SAMPLE_PERIOD_MS;
+    uint16_t* frame = new uint16_t[frameSamples];
+    for (int i = 0; i < frameSamples; i++) frame[i] = 2000 + (esp_random() % 64);
+
+    uint32_t totalUs = 0, worstUs = 0;
+    for (int n = 0; n < sampleCount; n++) {
+        uint32_t start = micros();
+        SampleBlock block;
+        for (int i = 0; i < frameSamples; i++) block.add(frame[i]);
+        volatile uint16_t mean = block.mean();
+        (void)mean;
+        uint32_t elapsed = micros() - start;
+        totalUs += elapsed;
+        if (elapsed > worstUs) worstUs = elapsed;
+    }
+    printResult("Frame average", totalUs, worstUs, sampleCount);
+    delete[] frame;
+
+    static const CalibrationPoint points[] = LEVEL_CALIBRATION;
+    const int last = sizeof(points) / sizeof(points[0]) - 1;
+    LevelFilterChain chain(LEVEL_MEDIAN_WINDOW, LEVEL_EMA_SHIFT, LevelCalibration(points, last + 1, LEVEL_FAULT_MARGIN),
+                           LevelThresholds{ LEVEL_EMPTY_BELOW, LEVEL_FULL_ABOVE, LEVEL_HYSTERESIS }, LEVEL_FAULT_SAMPLES);
+    totalUs = 0;
+    worstUs = 0;
+    int changes = 0;
+    for (int n = 0; n < sampleCount; n++) {
+        // Slow ramp over the whole range, with noise and one spike in 16
+        uint16_t raw = points[0].raw + (uint32_t)(points[last].raw - points[0].raw) * n / sampleCount + (esp_random() % 32);
+        if (esp_random() % 16 == 0) raw = points[last].raw;
+        uint32_t start = micros();
+        if (chain.push(raw)) changes++;
+        uint32_t elapsed = micros() - start;
+        totalUs += elapsed;
+        if (elapsed > worstUs) worstUs = elapsed;
+    }
+    printResult("Filter chain push", totalUs, worstUs, sampleCount);
+    Serial.printf("  %d class changes, budget %u ms per period\n", changes, (unsigned)LEVEL_SAMPLE_PERIOD_MS);
+}
+
+void runCurrentMonitorBenchmark(int blockCount) {
+    Serial.printf("--- Benchmark: motor current, %d blocks ---\n", blockCount);
+
+    // One block of a 50 Hz clamp signal at about rated current, biased at mid-scale (not timed).
+    const int blockSamples = WELLGUARD_CURRENT_SAMPLE_HZ / 1000 * WELLGUARD_CURRENT_BLOCK_MS;
+    const float peakCounts = WELLGUARD_MOTOR_RATED_MA * 1000.0f / WELLGUARD_CURRENT_UA_PER_COUNT * 1.41421356f;
+    uint16_t* samples = new uint16_t[blockSamples];
+    for (int i = 0; i < blockSamples; i++) {
+        samples[i] = 2048 + (int)(peakCounts * sinf(2.0f * PI * 50 * i / WELLGUARD_CURRENT_SAMPLE_HZ)) + (esp_random() % 8);
+    }
+
+    uint32_t totalUs = 0, worstUs = 0;
+    volatile float floatRms = 0;
+    for (int n = 0; n < blockCount; n++) {
+        uint32_t start = micros();
+        float sum = 0, sumSquares = 0;
+        for (int i = 0; i < blockSamples; i++) {
+            float x = samples[i] - 2048.0f; // Centred, or the variance drowns in float rounding
+            sum += x;
+            sumSquares += x * x;
+        }
+        float mean = sum / blockSamples;
+        floatRms = sqrtf(sumSquares / blockSamples - mean * mean);
+        uint32_t elapsed = micros() - start;
+        totalUs += elapsed;
+        if (elapsed > worstUs) worstUs = elapsed;
+    }
+    printResult("RMS, float", totalUs, worstUs, blockCount);
+
+    CurrentMonitor monitor({ WELLGUARD_CURRENT_UA_PER_COUNT, WELLGUARD_MOTOR_RATED_MA, WELLGUARD_DRY_RUN_PCT, WELLGUARD_OVERLOAD_PCT,
+                             WELLGUARD_LOCKED_ROTOR_PCT, WELLGUARD_MOTOR_STARTUP_MS, WELLGUARD_DRY_RUN_MS, WELLGUARD_OVERLOAD_MS });
+    totalUs = 0;
+    worstUs = 0;
+    uint32_t milliamps = 0;
+    for (int n = 0; n < blockCount; n++) {
+        uint32_t start = micros();
+        SampleBlock block;
+        for (int i = 0; i < blockSamples; i++) block.add(samples[i]);
+        milliamps = monitor.toMilliamps(block);
+        uint32_t elapsed = micros() - start;
+        totalUs += elapsed;
+        if (elapsed > worstUs) worstUs = elapsed;
+    }
+    printResult("RMS, fixed point", totalUs, worstUs, blockCount);
+    delete[] samples;
+
+    totalUs = 0;
+    worstUs = 0;
+    int trips = 0;
+    for (int n = 0; n < blockCount; n++) {
+        uint32_t start = micros();
+        if (monitor.update(milliamps, true, n * WELLGUARD_CURRENT_BLOCK_MS)) trips++;
+        uint32_t elapsed = micros() - start;
+        totalUs += elapsed;
+        if (elapsed > worstUs) worstUs = elapsed;
+    }
+    printResult("Monitor update", totalUs, worstUs, blockCount);
+    Serial.printf("  %lu mA (float %.0f counts), %d trips, budget %u ms per block\n", (unsigned long)milliamps,
+                  (double)floatRms, trips, (unsigned)WELLGUARD_CURRENT_BLOCK_MS);
+}
+
+#endif // HGE_BENCHMARKS
@@ -0,0 +1,22 @@
+#ifndef BENCHMARKS_H
+#define BENCHMARKS_H
+
+// On-target micro-benchmarks, built only with -D HGE_BENCHMARKS
+// (PlatformIO environment "esp32dev_benchmarks"). Results go to the serial console.
+#ifdef HGE_BENCHMARKS
+
+// Re-discovery of nodeCount nodes by the Centrale: name lookup under the node mutex,
+// one Preferences read per node (previous code) versus NodeMetadataCache.
+void runNodeMetadataBenchmark(int nodeCount);
+
+// Level sampler work per period: averaging one period of DMA samples, then the
+// median/EMA/calibration chain, over sampleCount noisy points with spikes.
+void runLevelFilterBenchmark(int sampleCount);
+
+// Motor guard work per block: RMS of one block of clamp samples in floating point
+// versus the fixed-point SampleBlock, then the CurrentMonitor update.
+void runCurrentMonitorBenchmark(int blockCount);
+
+#endif // HGE_BENCHMARKS
+
+#endif // BENCHMARKS_H
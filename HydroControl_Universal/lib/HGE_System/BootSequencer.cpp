@@ -0,0 +1,103 @@
+#include "BootSequencer.h"
+
+#define PHASE_FAILED_BIT(bit) ((bit) << BOOT_MAX_PHASES)
+
+BootSequencer::BootSequencer() {
+    phaseEvents = xEventGroupCreate();
+}
+
+uint32_t BootSequencer::addPhase(const char* name, PhaseFn run, void* context, uint32_t dependsOn,
+                                 bool completesLater, uint32_t stackSize) {
+    if (phaseCount >= BOOT_MAX_PHASES) {
+        Serial.printf("Boot: too many phases, '%s' ignored.\n", name);
+        return 0;
+    }
+    Phase& phase = phases[phaseCount];
+    phase.owner = this;
+    phase.name = name;
+    phase.run = run;
+    phase.context = context;
+    phase.bit = 1UL << phaseCount;
+    phase.dependsOn = dependsOn;
+    phase.completesLater = completesLater;
+    phase.stackSize = stackSize;
+    phase.readyMs = 0;
+    phase.endMs = 0;
+    phase.skipped = false;
+    phaseCount++;
+    return phase.bit;
+}
+
+void BootSequencer::start() {
+    for (int i = 0; i < phaseCount; i++) {
+        xTaskCreate(Task_Boot_Phase, phases[i].name, phases[i].stackSize, &phases[i], 2, NULL);
+    }
+    xTaskCreate(Task_Boot_Report, "BootReport", 2048, this, 1, NULL);
+}
+
+void BootSequencer::complete(uint32_t phaseBit, bool ok) {
+    for (int i = 0; i < phaseCount; i++) {
+        if (phases[i].bit == phaseBit) {
+            finish(&phases[i], ok);
+            return;
+        }
+    }
+}
+
+bool BootSequencer::waitFor(uint32_t phaseMask, TickType_t timeout) {
+    EventBits_t bits = xEventGroupWaitBits(phaseEvents, phaseMask, pdFALSE, pdTRUE, timeout);
+    return (bits & phaseMask) == phaseMask;
+}
+
+bool BootSequencer::succeeded(uint32_t phaseMask) {
+    EventBits_t bits = xEventGroupGetBits(phaseEvents);
+    return (bits & phaseMask) == phaseMask && (bits & PHASE_FAILED_BIT(phaseMask)) == 0;
+}
+
+void BootSequencer::finish(Phase* phase, bool ok) {
+    if (xEventGroupGetBits(phaseEvents) & phase->bit) return; // Already finished (e.g. timeout then success)
+    phase->endMs = millis();
+    // Failure bit first, so that a dependant woken by the done bit sees it.
+    if (!ok) xEventGroupSetBits(phaseEvents, PHASE_FAILED_BIT(phase->bit));
+    xEventGroupSetBits(phaseEvents, phase->bit);
+}
+
+void BootSequencer::printReport() {
+    EventBits_t bits = xEventGroupGetBits(phaseEvents);
+    Serial.println("--- Boot timing (ms since reset) ---");
+    for (int i = 0; i < phaseCount; i++) {
+        const Phase& p = phases[i];
+        const char* result = p.skipped ? "skipped" : ((bits & PHASE_FAILED_BIT(p.bit)) ? "FAILED" : "ok");
+        Serial.printf("  %-12s ready %6lu  done %6lu  (%lu ms)  %s\n", p.name, (unsigned long)p.readyMs,
+                      (unsigned long)p.endMs, (unsigned long)(p.endMs - p.readyMs), result);
+    }
+}
+
+void BootSequencer::Task_Boot_Phase(void* pvParameters) {
+    Phase* phase = (Phase*)pvParameters;
+    BootSequencer* self = phase->owner;
+
+    if (phase->dependsOn) {
+        xEventGroupWaitBits(self->phaseEvents, phase->dependsOn, pdFALSE, pdTRUE, portMAX_DELAY);
+    }
+    phase->readyMs = millis();
+
+    if (xEventGroupGetBits(self->phaseEvents) & PHASE_FAILED_BIT(phase->dependsOn)) {
+        phase->skipped = true;
+        self->finish(phase, false);
+    } else {
+        bool ok = phase->run(phase->context);
+        if (!ok || !phase->completesLater) {
+            self->finish(phase, ok);
+        }
+    }
+    vTaskDelete(NULL);
+}
+
+void BootSequencer::Task_Boot_Report(void* pvParameters) {
+    BootSequencer* self = (BootSequencer*)pvParameters;
+    uint32_t allPhases = (1UL << self->phaseCount) - 1;
+    xEventGroupWaitBits(self->phaseEvents, allPhases, pdFALSE, pdTRUE, portMAX_DELAY);
+    self->printReport();
+    vTaskDelete(NULL);
+}
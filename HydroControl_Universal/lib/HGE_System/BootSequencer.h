@@ -0,0 +1,55 @@
+#ifndef BOOT_SEQUENCER_H
+#define BOOT_SEQUENCER_H
+
+#include <Arduino.h>
+#include <freertos/event_groups.h>
+
+#define BOOT_MAX_PHASES 12 // Event group: low 12 bits = done, next 12 bits = failed
+
+// Runs the boot phases of a role in parallel, each in its own short-lived task,
+// as soon as the phases it depends on are done. A phase whose dependency failed is
+// skipped. Prints a timing report (ms since reset) once every phase has finished.
+class BootSequencer {
+public:
+    typedef bool (*PhaseFn)(void* context);
+
+    BootSequencer();
+
+    // Returns the phase bit, to be combined into the dependsOn mask of later phases.
+    // A phase registered with completesLater only starts its work in run(); it is
+    // finished by a later call to complete().
+    uint32_t addPhase(const char* name, PhaseFn run, void* context, uint32_t dependsOn = 0,
+                      bool completesLater = false, uint32_t stackSize = 4096);
+    void start();
+    void complete(uint32_t phaseBit, bool ok);
+
+    bool waitFor(uint32_t phaseMask, TickType_t timeout);
+    bool succeeded(uint32_t phaseMask);
+
+private:
+    struct Phase {
+        BootSequencer* owner;
+        const char* name;
+        PhaseFn run;
+        void* context;
+        uint32_t bit;
+        uint32_t dependsOn;
+        bool completesLater;
+        uint32_t stackSize;
+        uint32_t readyMs;
+        uint32_t endMs;
+        bool skipped;
+    };
+
+    Phase phases[BOOT_MAX_PHASES];
+    int phaseCount = 0;
+    EventGroupHandle_t phaseEvents;
+
+    void finish(Phase* phase, bool ok);
+    void printReport();
+
+    static void Task_Boot_Phase(void* pvParameters);
+    static void Task_Boot_Report(void* pvParameters);
+};
+
+#endif // BOOT_SEQUENCER_H
@@ -0,0 +1,15 @@
+#include "Clock.h"
+#include <time.h>
+#include "config.h"
+
+#define CLOCK_VALID_AFTER 1600000000UL // Anything earlier means SNTP has not synced yet
+
+void Clock::startSync() {
+    configTime(0, 0, NTP_SERVER);
+}
+
+uint32_t Clock::now(bool& synced) {
+    time_t t = time(nullptr);
+    synced = (uint32_t)t >= CLOCK_VALID_AFTER;
+    return synced ? (uint32_t)t : millis() / 1000;
+}
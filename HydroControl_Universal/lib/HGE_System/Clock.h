@@ -0,0 +1,15 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <Arduino.h>
+
+// Wall-clock time for logged data. The clock is set by SNTP once Wi-Fi is up;
+// until then timestamps fall back to seconds since boot and are flagged as such.
+class Clock {
+public:
+    static void startSync();
+    // Unix seconds, or seconds since boot with synced = false.
+    static uint32_t now(bool& synced);
+};
+
+#endif // CLOCK_H
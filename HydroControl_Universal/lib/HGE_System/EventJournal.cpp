@@ -0,0 +1,279 @@
+#include "EventJournal.h"
+#include <LittleFS.h>
+#include <rom/crc.h>
+#include <time.h>
+#include "Clock.h"
+#include "Profiler.h"
+
+bool EventJournal::begin() {
+    mutex = xSemaphoreCreateMutex();
+    ring.init(JOURNAL_ROOT, sizeof(JournalRecord), JOURNAL_SEGMENTS, JOURNAL_SEGMENT_RECORDS);
+    ring.scan();
+    loadIds();
+
+    pendingQueue = xQueueCreate(JOURNAL_QUEUE_LEN, sizeof(PendingEvent));
+    xTaskCreate(Task_Journal_Writer, "JournalWriter", Profiler::stackSize("JournalWriter", 4096), this, 1, NULL);
+    return true;
+}
+
+void EventJournal::setListener(Listener listener, void* context) {
+    listenerContext = context;
+    this->listener = listener;
+}
+
+void EventJournal::pumpRequest(const String& reservoirId, const String& wellId, bool on, JournalOutcome outcome) {
+    log(JOURNAL_PUMP_REQUEST, outcome, wellId, reservoirId, on ? JOURNAL_FLAG_ON : 0, 0, 0);
+}
+
+void EventJournal::pumpAck(const String& wellId, const String& fromId, bool on, JournalOutcome outcome, uint32_t latencyMs, uint8_t attempts) {
+    log(JOURNAL_PUMP_ACK, outcome, wellId, fromId, on ? JOURNAL_FLAG_ON : 0, latencyMs, attempts);
+}
+
+void EventJournal::pumpStart(const String& wellId, const String& fromId) {
+    log(JOURNAL_PUMP_START, JOURNAL_OK, wellId, fromId, JOURNAL_FLAG_ON, 0, 0);
+}
+
+void EventJournal::pumpStop(const String& wellId, uint32_t runSeconds, JournalOutcome outcome) {
+    log(JOURNAL_PUMP_STOP, outcome, wellId, "", 0, runSeconds, 0);
+}
+
+void EventJournal::pumpDecision(const String& wellId, const String& reservoirId, bool on, JournalOutcome outcome) {
+    log(JOURNAL_PUMP_DECISION, outcome, wellId, reservoirId, on ? JOURNAL_FLAG_ON : 0, 0, 0);
+}
+
+void EventJournal::log(uint8_t event, uint8_t outcome, const String& wellId, const String& peerId, uint8_t flags, uint32_t arg, uint8_t attempts) {
+    if (pendingQueue == NULL) return;
+
+    PendingEvent pending;
+    strncpy(pending.well, wellId.c_str(), JOURNAL_ID_LEN - 1);
+    pending.well[JOURNAL_ID_LEN - 1] = '\0';
+    strncpy(pending.peer, peerId.c_str(), JOURNAL_ID_LEN - 1);
+    pending.peer[JOURNAL_ID_LEN - 1] = '\0';
+
+    bool synced;
+    JournalRecord& rec = pending.rec;
+    rec.timestamp = Clock::now(synced);
+    rec.arg = arg;
+    rec.event = event;
+    rec.outcome = outcome;
+    rec.flags = flags | (synced ? 0 : JOURNAL_FLAG_UPTIME);
+    rec.attempts = attempts;
+    // well, peer and crc are filled in by the writer once the IDs are resolved
+
+    if (listener != nullptr) listener(pending.well, pending.peer, rec, listenerContext);
+    // Never wait: callers hold the node list mutex.
+    if (xQueueSend(pendingQueue, &pending, 0) != pdPASS) dropped++;
+}
+
+void EventJournal::Task_Journal_Writer(void* pvParameters) {
+    EventJournal* self = (EventJournal*)pvParameters;
+    PendingEvent pending;
+    JournalRecord batch[JOURNAL_QUEUE_LEN];
+    for (;;) {
+        xQueuePeek(self->pendingQueue, &pending, portMAX_DELAY);
+        // A pump cycle logs several events within seconds: write them together.
+        vTaskDelay(pdMS_TO_TICKS(JOURNAL_FLUSH_DELAY_MS));
+
+        size_t count = 0;
+        xSemaphoreTake(self->mutex, portMAX_DELAY);
+        while (count < JOURNAL_QUEUE_LEN && xQueueReceive(self->pendingQueue, &pending, 0) == pdPASS) {
+            JournalRecord& rec = batch[count++];
+            rec = pending.rec;
+            rec.well = self->resolveId(pending.well);
+            rec.peer = self->resolveId(pending.peer);
+            rec.crc = recordCrc(rec);
+        }
+        size_t written = self->ring.append((const uint8_t*)batch, count);
+        xSemaphoreGive(self->mutex);
+
+        if (written < count) {
+            self->dropped += count - written;
+            Serial.printf("Journal: %u events dropped.\n", (unsigned)(count - written));
+        }
+    }
+}
+
+// --- ID table ---
+
+void EventJournal::loadIds() {
+    idCount = 0;
+    File file = LittleFS.open(JOURNAL_IDS_PATH, FILE_READ);
+    if (!file) return;
+    while (idCount < JOURNAL_MAX_IDS && file.read((uint8_t*)ids[idCount], JOURNAL_ID_LEN) == JOURNAL_ID_LEN) {
+        ids[idCount][JOURNAL_ID_LEN - 1] = '\0';
+        idCount++;
+    }
+    file.close();
+}
+
+// Must be called with the mutex held.
+uint8_t EventJournal::findId(const char* id) {
+    for (uint8_t i = 0; i < idCount; i++) {
+        if (strcmp(ids[i], id) == 0) return i;
+    }
+    return JOURNAL_NO_NODE;
+}
+
+// Must be called with the mutex held. Appends unknown IDs to the table.
+uint8_t EventJournal::resolveId(const char* id) {
+    if (id[0] == '\0') return JOURNAL_NO_NODE;
+    uint8_t index = findId(id);
+    if (index != JOURNAL_NO_NODE || idCount >= JOURNAL_MAX_IDS) return index;
+
+    char entry[JOURNAL_ID_LEN] = {0};
+    strncpy(entry, id, JOURNAL_ID_LEN - 1);
+    File file = LittleFS.open(JOURNAL_IDS_PATH, FILE_APPEND);
+    if (!file) return JOURNAL_NO_NODE;
+    bool ok = file.write((const uint8_t*)entry, JOURNAL_ID_LEN) == JOURNAL_ID_LEN;
+    file.close();
+    if (!ok) return JOURNAL_NO_NODE;
+
+    memcpy(ids[idCount], entry, JOURNAL_ID_LEN);
+    return idCount++;
+}
+
+uint16_t EventJournal::recordCrc(const JournalRecord& rec) {
+    return crc16_le(0, (const uint8_t*)&rec, offsetof(JournalRecord, crc));
+}
+
+const char* EventJournal::eventName(uint8_t event) {
+    switch (event) {
+        case JOURNAL_PUMP_REQUEST: return "PUMP_REQUEST";
+        case JOURNAL_PUMP_ACK: return "PUMP_ACK";
+        case JOURNAL_PUMP_START: return "PUMP_START";
+        case JOURNAL_PUMP_STOP: return "PUMP_STOP";
+        case JOURNAL_PUMP_DECISION: return "PUMP_DECISION";
+        default: return "UNKNOWN";
+    }
+}
+
+const char* EventJournal::outcomeName(uint8_t outcome) {
+    switch (outcome) {
+        case JOURNAL_OK: return "OK";
+        case JOURNAL_DENIED_RESERVOIR_FULL: return "DENIED_RESERVOIR_FULL";
+        case JOURNAL_DENIED_OTHER_EMPTY: return "DENIED_OTHER_EMPTY";
+        case JOURNAL_NO_WELL: return "NO_WELL";
+        case JOURNAL_ACK_TIMEOUT: return "ACK_TIMEOUT";
+        case JOURNAL_LINK_LOST: return "LINK_LOST";
+        case JOURNAL_BELOW_THRESHOLD: return "BELOW_THRESHOLD";
+        case JOURNAL_DEFERRED_MIN_RUN: return "DEFERRED_MIN_RUN";
+        case JOURNAL_DEFERRED_MIN_REST: return "DEFERRED_MIN_REST";
+        case JOURNAL_WELL_OFFLINE: return "WELL_OFFLINE";
+        case JOURNAL_HELD_BY_WELL: return "HELD_BY_WELL";
+        case JOURNAL_TOP_UP: return "TOP_UP";
+        case JOURNAL_NO_FLOW: return "NO_FLOW";
+        case JOURNAL_DRY_RUN: return "DRY_RUN";
+        case JOURNAL_OVERLOAD: return "OVERLOAD";
+        case JOURNAL_LOCKED_ROTOR: return "LOCKED_ROTOR";
+        default: return "UNKNOWN";
+    }
+}
+
+// --- Export ---
+
+std::shared_ptr<JournalExport> EventJournal::exportEvents(JournalFormat format, uint32_t from, uint32_t to, const String& wellId) {
+    if (mutex == NULL) return nullptr;
+    uint8_t well = JOURNAL_NO_NODE;
+    if (wellId.length() > 0) {
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        well = findId(wellId.c_str());
+        xSemaphoreGive(mutex);
+        if (well == JOURNAL_NO_NODE) return nullptr;
+    }
+    return std::make_shared<JournalExport>(this, format, from, to, well);
+}
+
+JournalExport::JournalExport(EventJournal* journal, JournalFormat format, uint32_t from, uint32_t to, uint8_t well)
+    : journal(journal), cursor(&journal->ring, journal->mutex, from, to, JOURNAL_EXPORT_BLOCK), format(format), well(well) {}
+
+size_t JournalExport::read(uint8_t* buffer, size_t maxLen) {
+    size_t written = 0;
+    while (written < maxLen) {
+        if (linePos == lineLen && !nextLine()) break;
+        size_t n = min(maxLen - written, lineLen - linePos);
+        memcpy(buffer + written, line + linePos, n);
+        linePos += n;
+        written += n;
+    }
+    return written;
+}
+
+bool JournalExport::nextLine() {
+    linePos = 0;
+    lineLen = 0;
+    if (!headerSent) {
+        headerSent = true;
+        if (format == JOURNAL_CSV) {
+            lineLen = snprintf(line, sizeof(line), "time,event,well,peer,command,outcome,latency_ms,run_s,attempts\n");
+            return true;
+        }
+    }
+
+    const uint8_t* data;
+    while ((data = cursor.next()) != nullptr) {
+        JournalRecord rec;
+        memcpy(&rec, data, sizeof(rec));
+        if (rec.crc != EventJournal::recordCrc(rec)) continue;
+        if (well != JOURNAL_NO_NODE && rec.well != well) continue;
+        formatRecord(rec);
+        return true;
+    }
+    return false;
+}
+
+static void formatTime(char* out, size_t size, const JournalRecord& rec) {
+    if (rec.flags & JOURNAL_FLAG_UPTIME) {
+        snprintf(out, size, "boot+%lus", (unsigned long)rec.timestamp);
+    } else {
+        time_t t = rec.timestamp;
+        struct tm tm;
+        gmtime_r(&t, &tm);
+        strftime(out, size, "%Y-%m-%dT%H:%M:%SZ", &tm);
+    }
+}
+
+int EventJournal::formatJson(char* out, size_t size, const JournalRecord& rec, const char* wellId, const char* peerId) {
+    char time[24];
+    formatTime(time, sizeof(time), rec);
+    int len = snprintf(out, size, "{\"time\":\"%s\",\"event\":\"%s\",\"well\":\"%s\",\"peer\":\"%s\",\"command\":\"%s\",\"outcome\":\"%s\"",
+                       time, eventName(rec.event), wellId, peerId, (rec.flags & JOURNAL_FLAG_ON) ? "ON" : "OFF", outcomeName(rec.outcome));
+    if (rec.event == JOURNAL_PUMP_ACK) {
+        len += snprintf(out + len, size - len, ",\"latency_ms\":%lu,\"attempts\":%u", (unsigned long)rec.arg, rec.attempts);
+    } else if (rec.event == JOURNAL_PUMP_STOP) {
+        len += snprintf(out + len, size - len, ",\"run_s\":%lu", (unsigned long)rec.arg);
+    }
+    len += snprintf(out + len, size - len, "}");
+    return len;
+}
+
+void JournalExport::formatRecord(const JournalRecord& rec) {
+    // IDs are only ever appended to the table, but take the lock for the copy.
+    char wellId[JOURNAL_ID_LEN] = "";
+    char peerId[JOURNAL_ID_LEN] = "";
+    xSemaphoreTake(journal->mutex, portMAX_DELAY);
+    if (rec.well < journal->idCount) memcpy(wellId, journal->ids[rec.well], JOURNAL_ID_LEN);
+    if (rec.peer < journal->idCount) memcpy(peerId, journal->ids[rec.peer], JOURNAL_ID_LEN);
+    xSemaphoreGive(journal->mutex);
+
+    int len;
+    if (format == JOURNAL_CSV) {
+        char time[24];
+        formatTime(time, sizeof(time), rec);
+        const char* event = EventJournal::eventName(rec.event);
+        const char* outcome = EventJournal::outcomeName(rec.outcome);
+        const char* command = (rec.flags & JOURNAL_FLAG_ON) ? "ON" : "OFF";
+        char latency[12] = "", run[12] = "", attempts[6] = "";
+        if (rec.event == JOURNAL_PUMP_ACK) {
+            snprintf(latency, sizeof(latency), "%lu", (unsigned long)rec.arg);
+            snprintf(attempts, sizeof(attempts), "%u", rec.attempts);
+        }
+        if (rec.event == JOURNAL_PUMP_STOP) snprintf(run, sizeof(run), "%lu", (unsigned long)rec.arg);
+        len = snprintf(line, sizeof(line), "%s,%s,%s,%s,%s,%s,%s,%s,%s\n",
+                       time, event, wellId, peerId, command, outcome, latency, run, attempts);
+    } else {
+        len = min(EventJournal::formatJson(line, sizeof(line) - 1, rec, wellId, peerId), (int)sizeof(line) - 2);
+        line[len++] = '\n';
+        line[len] = '\0';
+    }
+    lineLen = min((size_t)len, sizeof(line) - 1);
+}
@@ -0,0 +1,149 @@
+#ifndef EVENT_JOURNAL_H
+#define EVENT_JOURNAL_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <memory>
+#include "SegmentRing.h"
+#include "config.h"
+
+#define JOURNAL_ROOT          "/journal"
+#define JOURNAL_IDS_PATH      "/journal/ids.bin"
+#define JOURNAL_ID_LEN        16   // MAC-based IDs are 12 chars
+#define JOURNAL_MAX_IDS       64
+#define JOURNAL_NO_NODE       0xFF
+#define JOURNAL_EXPORT_BLOCK  64   // Records read from flash per block while exporting
+#define JOURNAL_LINE_MAX      224
+
+enum JournalEvent {
+    JOURNAL_PUMP_REQUEST = 1, // Shared well: a reservoir asked the Centrale to switch the pump
+    JOURNAL_PUMP_ACK,         // A pump command was acknowledged by the well (or never was)
+    JOURNAL_PUMP_START,       // The well reported its relay ON
+    JOURNAL_PUMP_STOP,        // The well reported its relay OFF, or stopped answering while ON
+    JOURNAL_PUMP_DECISION     // The arbitration switched a well, or refused / deferred it
+};
+
+enum JournalOutcome {
+    JOURNAL_OK,
+    JOURNAL_DENIED_RESERVOIR_FULL, // ON refused: another reservoir on the well is full
+    JOURNAL_DENIED_OTHER_EMPTY,    // OFF refused: another reservoir on the well still needs water
+    JOURNAL_NO_WELL,               // The requester has no well assigned
+    JOURNAL_ACK_TIMEOUT,
+    JOURNAL_LINK_LOST,             // Run ended because the well timed out
+    JOURNAL_BELOW_THRESHOLD,       // ON not applied: weighted demand below the well's start score
+    JOURNAL_DEFERRED_MIN_RUN,      // OFF deferred to the end of the well's minimum run time
+    JOURNAL_DEFERRED_MIN_REST,     // ON deferred to the end of the well's minimum rest time
+    JOURNAL_WELL_OFFLINE,          // No well of the reservoir is answering
+    JOURNAL_HELD_BY_WELL,          // ACK: the well's pump protection applies the command later
+    JOURNAL_TOP_UP,                // ON asked by the Centrale itself: the reservoir is predicted empty soon
+    JOURNAL_NO_FLOW,               // Run stopped by the well: no flow through its meter
+    JOURNAL_DRY_RUN,               // Run stopped by the well: motor current too low
+    JOURNAL_OVERLOAD,              // Run stopped by the well: motor current too high
+    JOURNAL_LOCKED_ROTOR           // Run stopped by the well: starting current that did not fall
+};
+
+enum JournalFormat {
+    JOURNAL_CSV,
+    JOURNAL_NDJSON
+};
+
+#define JOURNAL_FLAG_ON       (1 << 0) // Command / request was ON
+#define JOURNAL_FLAG_UPTIME   (1 << 1) // Clock not set yet: timestamp is seconds since boot
+
+// 16-byte record; node IDs are stored as indexes into the journal's ID table.
+struct JournalRecord {
+    uint32_t timestamp;
+    uint32_t arg;       // PUMP_ACK: latency in ms since the first send. PUMP_STOP: run duration in s.
+    uint8_t event;
+    uint8_t outcome;
+    uint8_t well;
+    uint8_t peer;       // Reservoir behind the request / command
+    uint8_t flags;
+    uint8_t attempts;   // PUMP_ACK: transmissions seen before the ACK
+    uint16_t crc;       // crc16 of the preceding bytes
+} __attribute__((packed));
+
+class EventJournal;
+
+// Formats journal records as CSV or NDJSON lines straight into the response
+// buffer, one flash block at a time.
+class JournalExport {
+public:
+    JournalExport(EventJournal* journal, JournalFormat format, uint32_t from, uint32_t to, uint8_t well);
+
+    // AwsResponseFiller-compatible: fills up to maxLen bytes, returns 0 when done.
+    size_t read(uint8_t* buffer, size_t maxLen);
+
+private:
+    EventJournal* journal;
+    SegmentRing::Cursor cursor;
+    JournalFormat format;
+    uint8_t well;
+    bool headerSent = false;
+    char line[JOURNAL_LINE_MAX];
+    size_t lineLen = 0;
+    size_t linePos = 0;
+
+    bool nextLine();
+    void formatRecord(const JournalRecord& rec);
+};
+
+// Structured log of pump arbitration and command delivery, kept on LittleFS for
+// months: JOURNAL_SEGMENTS * JOURNAL_SEGMENT_RECORDS records in a SegmentRing,
+// the oldest segment recycled when full. Logging calls only post to a queue; a
+// low-priority writer task resolves node IDs and appends the batch.
+class EventJournal {
+public:
+    // Called for every event as it is logged, on the caller's task and often with
+    // the node list mutex held: must not block. IDs are empty when not applicable.
+    typedef void (*Listener)(const char* wellId, const char* peerId, const JournalRecord& rec, void* context);
+
+    bool begin();
+    void setListener(Listener listener, void* context);
+
+    void pumpRequest(const String& reservoirId, const String& wellId, bool on, JournalOutcome outcome);
+    void pumpAck(const String& wellId, const String& fromId, bool on, JournalOutcome outcome, uint32_t latencyMs, uint8_t attempts);
+    void pumpStart(const String& wellId, const String& fromId);
+    void pumpStop(const String& wellId, uint32_t runSeconds, JournalOutcome outcome);
+    void pumpDecision(const String& wellId, const String& reservoirId, bool on, JournalOutcome outcome);
+
+    // wellId filters on one well; empty for all. Returns nullptr if that well has no events.
+    std::shared_ptr<JournalExport> exportEvents(JournalFormat format, uint32_t from, uint32_t to, const String& wellId);
+
+    uint32_t droppedEvents() const { return dropped; }
+
+    static const char* eventName(uint8_t event);
+    static const char* outcomeName(uint8_t outcome);
+    // One event as a JSON object (no line break); returns the snprintf length.
+    static int formatJson(char* out, size_t size, const JournalRecord& rec, const char* wellId, const char* peerId);
+
+private:
+    friend class JournalExport;
+
+    struct PendingEvent {
+        char well[JOURNAL_ID_LEN];
+        char peer[JOURNAL_ID_LEN];
+        JournalRecord rec;
+    };
+
+    SegmentRing ring;
+    char ids[JOURNAL_MAX_IDS][JOURNAL_ID_LEN];
+    uint8_t idCount = 0;
+    QueueHandle_t pendingQueue = NULL;
+    SemaphoreHandle_t mutex = NULL;  // Guards the ring and the ID table
+    volatile uint32_t dropped = 0;
+    Listener listener = nullptr;
+    void* listenerContext = nullptr;
+
+    void log(uint8_t event, uint8_t outcome, const String& wellId, const String& peerId, uint8_t flags, uint32_t arg, uint8_t attempts);
+    uint8_t findId(const char* id);
+    uint8_t resolveId(const char* id);
+    void loadIds();
+
+    static uint16_t recordCrc(const JournalRecord& rec);
+    static void Task_Journal_Writer(void* pvParameters);
+};
+
+#endif // EVENT_JOURNAL_H
@@ -0,0 +1,77 @@
+#include "LatencyTracker.h"
+#include <algorithm>
+#include "Metrics.h"
+
+#define LATENCY_RECENT 10 // Samples listed in full by writeJson()
+
+void LatencyTracker::begin() {
+    mutex = xSemaphoreCreateMutex();
+}
+
+void LatencyTracker::add(const LatencySample& sample) {
+    if (mutex == NULL) return;
+    Metrics::observe(MH_ACTUATION_LATENCY_MS, total(sample));
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    samples[head] = sample;
+    head = (head + 1) % LATENCY_SAMPLES;
+    if (count < LATENCY_SAMPLES) count++;
+    xSemaphoreGive(mutex);
+}
+
+uint32_t LatencyTracker::total(const LatencySample& sample) {
+    uint32_t sum = 0;
+    for (uint8_t s = 0; s < LAT_STAGE_COUNT; s++) sum += sample.stagesMs[s];
+    return sum;
+}
+
+const char* LatencyTracker::stageName(uint8_t stage) {
+    switch (stage) {
+        case LAT_DEBOUNCE: return "debounce";
+        case LAT_CONTROL: return "control";
+        case LAT_ARBITRATION: return "arbitration";
+        case LAT_DELIVERY: return "delivery";
+        case LAT_ACTUATION: return "actuation";
+        case LAT_ACK: return "ack";
+        default: return "total";
+    }
+}
+
+// Nearest-rank percentiles; values is sorted in place.
+void LatencyTracker::writeStage(Print& out, const char* name, uint32_t* values, uint8_t n) {
+    std::sort(values, values + n);
+    auto pct = [&](uint8_t p) { return n == 0 ? 0 : values[(n * p + 99) / 100 - 1]; };
+    out.printf("{\"name\":\"%s\",\"p50\":%u,\"p90\":%u,\"p99\":%u,\"max\":%u}",
+               name, pct(50), pct(90), pct(99), n == 0 ? 0 : values[n - 1]);
+}
+
+void LatencyTracker::writeJson(Print& out) {
+    if (mutex == NULL) {
+        out.print("{\"count\":0,\"stages\":[],\"recent\":[]}");
+        return;
+    }
+    uint32_t values[LATENCY_SAMPLES];
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    out.printf("{\"count\":%u,\"stages\":[", count);
+    for (uint8_t s = 0; s <= LAT_STAGE_COUNT; s++) {
+        for (uint8_t i = 0; i < count; i++) {
+            values[i] = s < LAT_STAGE_COUNT ? samples[i].stagesMs[s] : total(samples[i]);
+        }
+        if (s > 0) out.print(",");
+        writeStage(out, stageName(s), values, count);
+    }
+
+    out.print("],\"recent\":[");
+    uint8_t recent = min((uint8_t)LATENCY_RECENT, count);
+    for (uint8_t i = 0; i < recent; i++) {
+        const LatencySample& sample = samples[(head + LATENCY_SAMPLES - 1 - i) % LATENCY_SAMPLES];
+        out.printf("%s{\"time\":%u,\"trace\":%u,\"well\":\"%s\",\"command\":\"%s\",\"total\":%u,\"ms\":[",
+                   i > 0 ? "," : "", sample.timestamp, sample.traceId, sample.wellId, sample.on ? "ON" : "OFF", total(sample));
+        for (uint8_t s = 0; s < LAT_STAGE_COUNT; s++) {
+            out.printf(s > 0 ? ",%u" : "%u", sample.stagesMs[s]);
+        }
+        out.print("]}");
+    }
+    out.print("]}");
+    xSemaphoreGive(mutex);
+}
@@ -0,0 +1,53 @@
+#ifndef LATENCY_TRACKER_H
+#define LATENCY_TRACKER_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "config.h"
+
+#define LATENCY_ID_LEN 16
+
+// Stages of a traced pump command, in path order. Each one is measured on the
+// node that owns it, so no clock synchronization is needed.
+enum LatencyStage {
+    LAT_DEBOUNCE,    // Reservoir: first float switch edge -> stable level
+    LAT_CONTROL,     // Reservoir: stable level -> request / command on air (slot wait included)
+    LAT_ARBITRATION, // Centrale: request received -> command issued (0 for non-shared wells)
+    LAT_DELIVERY,    // Centrale: command issued -> ACK received, minus the time spent on the well
+    LAT_ACTUATION,   // Well: command received -> relay switched
+    LAT_ACK,         // Well: relay switched -> ACK on air
+    LAT_STAGE_COUNT
+};
+
+struct LatencySample {
+    uint32_t timestamp;  // Clock::now()
+    uint16_t traceId;
+    bool on;
+    char wellId[LATENCY_ID_LEN];
+    uint32_t stagesMs[LAT_STAGE_COUNT];
+};
+
+// Last LATENCY_SAMPLES completed command traces, with per-stage percentiles for
+// the dashboard. Samples are assembled by the Centrale from the durations each
+// hop reports in the "tr"/"d" protocol fields.
+class LatencyTracker {
+public:
+    void begin();
+    void add(const LatencySample& sample);
+    // {"count":N,"stages":[{"name","p50","p90","p99","max"}...],"recent":[...]}
+    void writeJson(Print& out);
+
+    static uint32_t total(const LatencySample& sample);
+    static const char* stageName(uint8_t stage);
+
+private:
+    LatencySample samples[LATENCY_SAMPLES];
+    uint8_t head = 0;
+    uint8_t count = 0;
+    SemaphoreHandle_t mutex = NULL;
+
+    void writeStage(Print& out, const char* name, uint32_t* values, uint8_t n);
+};
+
+#endif // LATENCY_TRACKER_H
@@ -0,0 +1,270 @@
+#include "Metrics.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+std::atomic<uint32_t> Metrics::counters[MC_COUNT];
+std::atomic<uint32_t> Metrics::gauges[MG_COUNT];
+std::atomic<uint32_t> Metrics::rxFrames[METRICS_MSG_TYPES];
+std::atomic<uint32_t> Metrics::txFrames[METRICS_MSG_TYPES];
+Metrics::Histogram Metrics::histograms[MH_COUNT];
+
+struct MetricInfo {
+    const char* name;
+    const char* help;
+};
+
+static const MetricInfo counterInfo[MC_COUNT] = {
+    { "hge_lora_decrypt_failures_total", "Received frames that failed to decrypt" },
+    { "hge_lora_parse_failures_total", "Decrypted frames that were not valid JSON" },
+    { "hge_lora_rx_queue_drops_total", "Received frames dropped because the RX queue was full" },
+    { "hge_ack_timeouts_total", "ACK waits that expired" },
+    { "hge_ack_retries_total", "Commands sent again after an ACK timeout" },
+    { "hge_command_failures_total", "Commands given up after the last retry" },
+    { "hge_pump_requests_total", "Pump requests sent or arbitrated" },
+    { "hge_downlinks_queued_total", "Downlinks held until the node listens" },
+    { "hge_downlinks_dropped_total", "Held downlinks dropped because the node queue was full" },
+    { "hge_ws_bad_requests_total", "WebSocket API messages that could not be parsed" },
+    { "hge_ws_rejected_total", "WebSocket connections refused because all client slots were taken" },
+    { "hge_ws_deferred_total", "Node updates held back because a WebSocket client queue was full" },
+    { "hge_ws_evicted_total", "WebSocket clients closed for staying blocked" },
+    { "hge_sse_rejected_total", "Event stream connections refused because all subscriber slots were taken" },
+    { "hge_sse_skipped_total", "Events skipped for slow subscribers, superseded by a newer one" },
+    { "hge_sse_evicted_total", "Event stream subscribers closed for not acknowledging" },
+    { "hge_mqtt_connects_total", "MQTT sessions opened with the broker" },
+    { "hge_mqtt_published_total", "Node states and events published to the broker" },
+    { "hge_mqtt_spooled_total", "Events spooled to flash while the broker was unreachable" },
+    { "hge_mqtt_events_dropped_total", "Events lost because the MQTT queue or spool was full" },
+    { "hge_mqtt_commands_total", "Commands received over MQTT" },
+    { "hge_modbus_requests_total", "Modbus TCP requests answered" },
+    { "hge_modbus_exceptions_total", "Modbus TCP requests answered with an exception" },
+    { "hge_modbus_rejected_total", "Modbus TCP connections refused because all client slots were taken" },
+    { "hge_modbus_image_retries_total", "Register image copies retried because the image was being rewritten" },
+};
+
+static const MetricInfo gaugeInfo[MG_COUNT] = {
+    { "hge_lora_rx_queue_high_water", "Highest LoRa RX queue depth seen" },
+    { "hge_ws_clients", "Connected WebSocket API clients" },
+    { "hge_sse_clients", "Event stream subscribers" },
+    { "hge_mqtt_connected", "1 while connected to the MQTT broker" },
+    { "hge_modbus_clients", "Connected Modbus TCP clients" },
+};
+
+// Upper bounds of each histogram's buckets; the last one is +Inf.
+struct HistogramInfo {
+    const char* name;
+    const char* help;
+    uint8_t bucketCount;
+    uint32_t bounds[METRICS_MAX_BUCKETS - 1];
+};
+
+static const HistogramInfo histogramInfo[MH_COUNT] = {
+    { "hge_ack_latency_ms", "Command to ACK latency", 10,
+      { 100, 250, 500, 1000, 2000, 4000, 8000, 16000, 32000 } },
+    { "hge_node_list_wait_us", "Wait for the node list mutex", 10,
+      { 10, 50, 100, 500, 1000, 5000, 10000, 50000, 100000 } },
+    { "hge_pump_actuation_latency_ms", "Level change to relay switched, traced commands", 10,
+      { 2500, 3000, 4000, 5000, 7500, 10000, 15000, 20000, 30000 } },
+    { "hge_ws_command_us", "WebSocket API request to ACK", 10,
+      { 100, 500, 1000, 5000, 10000, 50000, 100000, 500000, 1000000 } },
+    { "hge_http_command_us", "HTTP API command handling", 10,
+      { 100, 500, 1000, 5000, 10000, 50000, 100000, 500000, 1000000 } },
+};
+
+void Metrics::inc(MetricCounter counter, uint32_t n) {
+    counters[counter].fetch_add(n, std::memory_order_relaxed);
+}
+
+void Metrics::countRx(int messageType) {
+    if (messageType >= 0 && messageType < METRICS_MSG_TYPES) rxFrames[messageType].fetch_add(1, std::memory_order_relaxed);
+}
+
+void Metrics::countTx(int messageType) {
+    if (messageType >= 0 && messageType < METRICS_MSG_TYPES) txFrames[messageType].fetch_add(1, std::memory_order_relaxed);
+}
+
+void Metrics::setGauge(MetricGauge gauge, uint32_t value) {
+    gauges[gauge].store(value, std::memory_order_relaxed);
+}
+
+void Metrics::gaugeMax(MetricGauge gauge, uint32_t value) {
+    uint32_t current = gauges[gauge].load(std::memory_order_relaxed);
+    while (value > current && !gauges[gauge].compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+void Metrics::observe(MetricHistogram histogram, uint32_t value) {
+    const HistogramInfo& info = histogramInfo[histogram];
+    uint8_t bucket = 0;
+    while (bucket < info.bucketCount - 1 && value > info.bounds[bucket]) bucket++;
+    Histogram& h = histograms[histogram];
+    h.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    h.count.fetch_add(1, std::memory_order_relaxed);
+    h.sum.fetch_add(value, std::memory_order_relaxed);
+}
+
+int Metrics::messageTypeOf(const String& json) {
+    const char* prefix = "{\"type\":";
+    if (!json.startsWith(prefix)) return -1;
+    return atoi(json.c_str() + strlen(prefix));
+}
+
+const char* Metrics::messageTypeName(int messageType) {
+    switch (messageType) {
+        case DISCOVERY: return "DISCOVERY";
+        case WELCOME_ACK: return "WELCOME_ACK";
+        case STATUS_UPDATE: return "STATUS_UPDATE";
+        case COMMAND: return "COMMAND";
+        case COMMAND_ACK: return "COMMAND_ACK";
+        case HEARTBEAT: return "HEARTBEAT";
+        case RELAY_REQUEST: return "RELAY_REQUEST";
+        case SYNC_COMMAND: return "SYNC_COMMAND";
+        case REQUEST_PUMP_ON: return "REQUEST_PUMP_ON";
+        case REQUEST_PUMP_OFF: return "REQUEST_PUMP_OFF";
+        case BEACON: return "BEACON";
+        case METRICS_DIGEST: return "METRICS_DIGEST";
+        case DIAGNOSTICS: return "DIAGNOSTICS";
+        default: return nullptr;
+    }
+}
+
+uint32_t Metrics::totalFrames(const std::atomic<uint32_t>* frames) {
+    uint32_t total = 0;
+    for (int i = 0; i < METRICS_MSG_TYPES; i++) total += frames[i].load(std::memory_order_relaxed);
+    return total;
+}
+
+// --- Rendering ---
+
+void Metrics::writePrometheus(Print& out) {
+    const std::atomic<uint32_t>* frames[2] = { rxFrames, txFrames };
+    const char* frameNames[2] = { "hge_lora_rx_frames_total", "hge_lora_tx_frames_total" };
+    for (int dir = 0; dir < 2; dir++) {
+        out.printf("# HELP %s LoRa frames by message type\n# TYPE %s counter\n", frameNames[dir], frameNames[dir]);
+        for (int type = 0; type < METRICS_MSG_TYPES; type++) {
+            const char* name = messageTypeName(type);
+            uint32_t value = frames[dir][type].load(std::memory_order_relaxed);
+            if (name != nullptr) out.printf("%s{type=\"%s\"} %u\n", frameNames[dir], name, value);
+        }
+    }
+
+    for (int i = 0; i < MC_COUNT; i++) {
+        out.printf("# HELP %s %s\n# TYPE %s counter\n%s %u\n", counterInfo[i].name, counterInfo[i].help,
+                   counterInfo[i].name, counterInfo[i].name, counters[i].load(std::memory_order_relaxed));
+    }
+    for (int i = 0; i < MG_COUNT; i++) {
+        out.printf("# HELP %s %s\n# TYPE %s gauge\n%s %u\n", gaugeInfo[i].name, gaugeInfo[i].help,
+                   gaugeInfo[i].name, gaugeInfo[i].name, gauges[i].load(std::memory_order_relaxed));
+    }
+
+    for (int i = 0; i < MH_COUNT; i++) {
+        const HistogramInfo& info = histogramInfo[i];
+        Histogram& h = histograms[i];
+        out.printf("# HELP %s %s\n# TYPE %s histogram\n", info.name, info.help, info.name);
+        uint32_t cumulative = 0;
+        for (uint8_t b = 0; b < info.bucketCount; b++) {
+            cumulative += h.buckets[b].load(std::memory_order_relaxed);
+            if (b < info.bucketCount - 1) {
+                out.printf("%s_bucket{le=\"%u\"} %u\n", info.name, info.bounds[b], cumulative);
+            } else {
+                out.printf("%s_bucket{le=\"+Inf\"} %u\n", info.name, cumulative);
+            }
+        }
+        out.printf("%s_sum %u\n%s_count %u\n", info.name, h.sum.load(std::memory_order_relaxed),
+                   info.name, h.count.load(std::memory_order_relaxed));
+    }
+
+    out.printf("# HELP hge_heap_free_bytes Free heap\n# TYPE hge_heap_free_bytes gauge\nhge_heap_free_bytes %u\n", ESP.getFreeHeap());
+    out.printf("# HELP hge_heap_min_free_bytes Lowest free heap since boot\n# TYPE hge_heap_min_free_bytes gauge\nhge_heap_min_free_bytes %u\n", ESP.getMinFreeHeap());
+    out.printf("# HELP hge_heap_largest_block_bytes Largest allocatable block\n# TYPE hge_heap_largest_block_bytes gauge\nhge_heap_largest_block_bytes %u\n", ESP.getMaxAllocHeap());
+    out.printf("# HELP hge_uptime_seconds Time since boot\n# TYPE hge_uptime_seconds counter\nhge_uptime_seconds %lu\n", millis() / 1000);
+
+    writeTasks(out);
+}
+
+void Metrics::writeTasks(Print& out) {
+#if configUSE_TRACE_FACILITY
+    TaskStatus_t* tasks = (TaskStatus_t*)malloc(METRICS_MAX_TASKS * sizeof(TaskStatus_t));
+    if (tasks == nullptr) return;
+    uint32_t totalRunTime = 0;
+    UBaseType_t count = uxTaskGetSystemState(tasks, METRICS_MAX_TASKS, &totalRunTime);
+
+    out.print("# HELP hge_task_stack_free_bytes Lowest free stack of the task since it started\n# TYPE hge_task_stack_free_bytes gauge\n");
+    for (UBaseType_t i = 0; i < count; i++) {
+        // ESP-IDF reports the high-water mark in bytes
+        out.printf("hge_task_stack_free_bytes{task=\"%s\"} %u\n", tasks[i].pcTaskName, (unsigned)tasks[i].usStackHighWaterMark);
+    }
+#if configGENERATE_RUN_TIME_STATS
+    if (totalRunTime > 0) {
+        // Run time adds up over both cores: a task using one core fully is at 0.5.
+        out.print("# HELP hge_task_cpu_ratio Share of the CPU time used by the task since boot\n# TYPE hge_task_cpu_ratio gauge\n");
+        for (UBaseType_t i = 0; i < count; i++) {
+            double ratio = (double)tasks[i].ulRunTimeCounter / ((double)totalRunTime * portNUM_PROCESSORS);
+            out.printf("hge_task_cpu_ratio{task=\"%s\"} %.4f\n", tasks[i].pcTaskName, ratio);
+        }
+    }
+#endif
+    free(tasks);
+#endif
+}
+
+void Metrics::fillDigest(MetricsDigest& digest) {
+    const Histogram& latency = histograms[MH_ACK_LATENCY_MS];
+    uint32_t latencyCount = latency.count.load(std::memory_order_relaxed);
+
+    digest.uptimeS = millis() / 1000;
+    digest.rxFrames = totalFrames(rxFrames);
+    digest.txFrames = totalFrames(txFrames);
+    digest.decryptFailures = counters[MC_LORA_DECRYPT_FAILURES].load(std::memory_order_relaxed);
+    digest.parseFailures = counters[MC_LORA_PARSE_FAILURES].load(std::memory_order_relaxed);
+    digest.ackTimeouts = counters[MC_ACK_TIMEOUTS].load(std::memory_order_relaxed);
+    digest.ackRetries = counters[MC_ACK_RETRIES].load(std::memory_order_relaxed);
+    digest.commandFailures = counters[MC_COMMAND_FAILURES].load(std::memory_order_relaxed);
+    digest.heapMin = ESP.getMinFreeHeap();
+    digest.ackLatencyAvgMs = latencyCount > 0 ? latency.sum.load(std::memory_order_relaxed) / latencyCount : 0;
+}
+
+// --- Deep sleep carry-over ---
+
+#define METRICS_RTC_MAGIC 0x4D455452 // "METR"
+
+struct MetricsRtcCopy {
+    uint32_t magic;
+    uint32_t counters[MC_COUNT];
+    uint32_t rxFrames[METRICS_MSG_TYPES];
+    uint32_t txFrames[METRICS_MSG_TYPES];
+    uint32_t buckets[MH_COUNT][METRICS_MAX_BUCKETS];
+    uint32_t count[MH_COUNT];
+    uint32_t sum[MH_COUNT];
+};
+
+// Plain integers in RTC memory: the atomics stay in internal RAM.
+RTC_DATA_ATTR static MetricsRtcCopy rtcCopy;
+
+void Metrics::saveToRtc() {
+    for (int i = 0; i < MC_COUNT; i++) rtcCopy.counters[i] = counters[i].load();
+    for (int i = 0; i < METRICS_MSG_TYPES; i++) {
+        rtcCopy.rxFrames[i] = rxFrames[i].load();
+        rtcCopy.txFrames[i] = txFrames[i].load();
+    }
+    for (int h = 0; h < MH_COUNT; h++) {
+        for (int b = 0; b < METRICS_MAX_BUCKETS; b++) rtcCopy.buckets[h][b] = histograms[h].buckets[b].load();
+        rtcCopy.count[h] = histograms[h].count.load();
+        rtcCopy.sum[h] = histograms[h].sum.load();
+    }
+    rtcCopy.magic = METRICS_RTC_MAGIC;
+}
+
+void Metrics::restoreFromRtc() {
+    if (rtcCopy.magic != METRICS_RTC_MAGIC) return;
+    for (int i = 0; i < MC_COUNT; i++) counters[i].fetch_add(rtcCopy.counters[i]);
+    for (int i = 0; i < METRICS_MSG_TYPES; i++) {
+        rxFrames[i].fetch_add(rtcCopy.rxFrames[i]);
+        txFrames[i].fetch_add(rtcCopy.txFrames[i]);
+    }
+    for (int h = 0; h < MH_COUNT; h++) {
+        for (int b = 0; b < METRICS_MAX_BUCKETS; b++) histograms[h].buckets[b].fetch_add(rtcCopy.buckets[h][b]);
+        histograms[h].count.fetch_add(rtcCopy.count[h]);
+        histograms[h].sum.fetch_add(rtcCopy.sum[h]);
+    }
+    rtcCopy.magic = 0;
+}
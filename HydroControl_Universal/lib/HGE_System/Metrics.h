@@ -0,0 +1,103 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "Message.h"
+
+#define METRICS_MSG_TYPES        16 // Per-type frame counters, indexed by MessageType
+#define METRICS_MAX_BUCKETS      10 // Histogram buckets, +Inf included
+#define METRICS_MAX_TASKS        24 // Tasks listed in the per-task section
+
+enum MetricCounter {
+    MC_LORA_DECRYPT_FAILURES,
+    MC_LORA_PARSE_FAILURES,
+    MC_LORA_RX_QUEUE_DROPS,
+    MC_ACK_TIMEOUTS,      // ACK waits that expired, one per attempt
+    MC_ACK_RETRIES,       // Commands sent again after a timeout
+    MC_COMMAND_FAILURES,  // Commands given up after the last retry
+    MC_PUMP_REQUESTS,     // Sent by a reservoir, or arbitrated by the Centrale
+    MC_DOWNLINKS_QUEUED,  // Held for a sleepy or slotted node
+    MC_DOWNLINKS_DROPPED, // Oldest held downlink dropped, queue full
+    MC_WS_BAD_REQUESTS,   // WebSocket API messages that could not be parsed
+    MC_WS_REJECTED,       // WebSocket connections refused, WS_MAX_CLIENTS reached
+    MC_WS_DEFERRED,       // Node updates held back because a client's queue was full
+    MC_WS_EVICTED,        // WebSocket clients closed after WS_STALL_TIMEOUT_MS blocked
+    MC_SSE_REJECTED,      // Event stream connections refused, SSE_MAX_CLIENTS reached
+    MC_SSE_SKIPPED,       // Events a slow subscriber never got, superseded by a newer one
+    MC_SSE_EVICTED,       // Subscribers closed for not acknowledging
+    MC_MQTT_CONNECTS,     // Sessions opened with the broker
+    MC_MQTT_PUBLISHED,    // Node states and events handed to the broker
+    MC_MQTT_SPOOLED,      // Events written to the LittleFS spool while offline
+    MC_MQTT_EVENTS_DROPPED, // Event queue or spool full
+    MC_MQTT_COMMANDS,     // Commands received on cmd/<command>
+    MC_MODBUS_REQUESTS,   // Modbus TCP requests answered, exceptions included
+    MC_MODBUS_EXCEPTIONS, // Answered with an exception code
+    MC_MODBUS_REJECTED,   // Connections refused, MODBUS_MAX_CLIENTS reached
+    MC_MODBUS_IMAGE_RETRIES, // Register image copied again, rewritten during the copy
+    MC_COUNT
+};
+
+enum MetricGauge {
+    MG_LORA_RX_QUEUE_HWM,
+    MG_WS_CLIENTS,
+    MG_SSE_CLIENTS,
+    MG_MQTT_CONNECTED,
+    MG_MODBUS_CLIENTS,
+    MG_COUNT
+};
+
+enum MetricHistogram {
+    MH_ACK_LATENCY_MS,    // Command to ACK
+    MH_MUTEX_WAIT_US,     // Wait for the Centrale node list
+    MH_ACTUATION_LATENCY_MS, // Traced commands: level change to relay switched
+    MH_WS_COMMAND_US,     // WebSocket API: request received -> ACK sent
+    MH_HTTP_COMMAND_US,   // Same commands through the HTTP API
+    MH_COUNT
+};
+
+// Process-wide metrics. Every update is a single relaxed atomic operation (no lock,
+// no allocation), so the LoRa ISRs and all tasks can record freely; readers get
+// values that are individually exact but not a consistent snapshot, which is what
+// a scrape needs. Heap and per-task figures are sampled when rendering.
+class Metrics {
+public:
+    static void inc(MetricCounter counter, uint32_t n = 1);
+    static void countRx(int messageType);
+    static void countTx(int messageType);
+    static void setGauge(MetricGauge gauge, uint32_t value);
+    static void gaugeMax(MetricGauge gauge, uint32_t value);
+    static void observe(MetricHistogram histogram, uint32_t value);
+
+    // Cheap type lookup for outgoing frames: every serializer writes "type" first.
+    static int messageTypeOf(const String& json);
+
+    // Prometheus text exposition format.
+    static void writePrometheus(Print& out);
+    // Compact summary sent over LoRa by the edge nodes.
+    static void fillDigest(MetricsDigest& digest);
+
+    // Deep sleep clears RAM: low-power nodes carry the counters over in RTC memory.
+    static void saveToRtc();
+    static void restoreFromRtc();
+
+    static const char* messageTypeName(int messageType);
+
+private:
+    struct Histogram {
+        std::atomic<uint32_t> buckets[METRICS_MAX_BUCKETS];
+        std::atomic<uint32_t> count;
+        std::atomic<uint32_t> sum;
+    };
+
+    static std::atomic<uint32_t> counters[MC_COUNT];
+    static std::atomic<uint32_t> gauges[MG_COUNT];
+    static std::atomic<uint32_t> rxFrames[METRICS_MSG_TYPES];
+    static std::atomic<uint32_t> txFrames[METRICS_MSG_TYPES];
+    static Histogram histograms[MH_COUNT];
+
+    static uint32_t totalFrames(const std::atomic<uint32_t>* frames);
+    static void writeTasks(Print& out);
+};
+
+#endif // METRICS_H
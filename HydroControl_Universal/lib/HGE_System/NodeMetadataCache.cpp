@@ -0,0 +1,188 @@
+#include "NodeMetadataCache.h"
+#include <nvs.h>
+
+NodeMetadataCache::NodeMetadataCache() {
+    arena[0] = '\0';
+    mutex = xSemaphoreCreateMutex();
+}
+
+int NodeMetadataCache::load(const char* namesNamespace, const char* notesNamespace) {
+    return loadNamespace(namesNamespace, FIELD_NAME) + loadNamespace(notesNamespace, FIELD_NOTES);
+}
+
+int NodeMetadataCache::loadNamespace(const char* ns, Field field) {
+    nvs_handle_t handle;
+    if (nvs_open(ns, NVS_READONLY, &handle) != ESP_OK) return 0; // Never written
+
+    int loaded = 0;
+    nvs_iterator_t it = nvs_entry_find(NVS_DEFAULT_PART_NAME, ns, NVS_TYPE_STR);
+    while (it != NULL) {
+        nvs_entry_info_t info;
+        nvs_entry_info(it, &info);
+        char value[NODE_META_VALUE_MAX];
+        size_t length = sizeof(value);
+        if (nvs_get_str(handle, info.key, value, &length) == ESP_OK) {
+            set(info.key, field, value);
+            loaded++;
+        }
+        it = nvs_entry_next(it);
+    }
+    nvs_release_iterator(it);
+    nvs_close(handle);
+    return loaded;
+}
+
+String NodeMetadataCache::name(const String& nodeId) {
+    return get(nodeId, FIELD_NAME);
+}
+
+String NodeMetadataCache::notes(const String& nodeId) {
+    return get(nodeId, FIELD_NOTES);
+}
+
+void NodeMetadataCache::setName(const String& nodeId, const String& name) {
+    set(nodeId.c_str(), FIELD_NAME, name.c_str());
+}
+
+void NodeMetadataCache::setNotes(const String& nodeId, const String& notes) {
+    set(nodeId.c_str(), FIELD_NOTES, notes.c_str());
+}
+
+String NodeMetadataCache::get(const String& nodeId, Field field) {
+    String value;
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    Entry* entry = find(nodeId.c_str(), hashId(nodeId.c_str()));
+    if (entry != nullptr) {
+        value = &arena[field == FIELD_NAME ? entry->nameOffset : entry->notesOffset];
+    }
+    xSemaphoreGive(mutex);
+    return value;
+}
+
+void NodeMetadataCache::set(const char* nodeId, Field field, const char* value) {
+    uint32_t hash = hashId(nodeId);
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    Entry* entry = find(nodeId, hash);
+    if (entry == nullptr) {
+        if (entryCount >= NODE_META_MAX_ENTRIES) {
+            xSemaphoreGive(mutex);
+            Serial.printf("Node metadata cache full, %s not cached.\n", nodeId);
+            return;
+        }
+        uint16_t idOffset = intern(nodeId);
+        if (idOffset == 0) {
+            xSemaphoreGive(mutex);
+            return;
+        }
+        entry = &entries[entryCount++];
+        entry->idHash = hash;
+        entry->idOffset = idOffset;
+        entry->nameOffset = 0;
+        entry->notesOffset = 0;
+    }
+    // Interning may compact the arena, which rewrites the offsets of every entry.
+    uint16_t offset = intern(value);
+    if (field == FIELD_NAME) {
+        entry->nameOffset = offset;
+    } else {
+        entry->notesOffset = offset;
+    }
+    xSemaphoreGive(mutex);
+}
+
+NodeMetadataCache::Entry* NodeMetadataCache::find(const char* nodeId, uint32_t hash) {
+    for (int i = 0; i < entryCount; i++) {
+        if (entries[i].idHash == hash && strcmp(&arena[entries[i].idOffset], nodeId) == 0) {
+            return &entries[i];
+        }
+    }
+    return nullptr;
+}
+
+// Returns the offset of value in the arena, reusing an identical live string. 0 on failure
+// (or for the empty string).
+uint16_t NodeMetadataCache::intern(const char* value) {
+    if (value[0] == '\0') return 0;
+    for (int i = 0; i < entryCount; i++) {
+        const uint16_t offsets[3] = { entries[i].idOffset, entries[i].nameOffset, entries[i].notesOffset };
+        for (uint16_t offset : offsets) {
+            if (offset != 0 && strcmp(&arena[offset], value) == 0) return offset;
+        }
+    }
+
+    uint16_t offset = append(value);
+    if (offset == 0) {
+        compact();
+        offset = append(value);
+    }
+    return offset;
+}
+
+uint16_t NodeMetadataCache::append(const char* value) {
+    size_t length = strnlen(value, NODE_META_VALUE_MAX - 1);
+    if (arenaLength + length + 1 > NODE_META_ARENA_SIZE) return 0;
+    uint16_t offset = arenaLength;
+    memcpy(&arena[offset], value, length);
+    arena[offset + length] = '\0';
+    arenaLength += length + 1;
+    return offset;
+}
+
+// Rebuilds the arena with live strings only. Runs rarely: only renames leave garbage.
+// A string shared by several fields (see intern()) is copied once. The offsets are
+// rewritten only once every string has been copied, so a failure leaves the cache as is.
+void NodeMetadataCache::compact() {
+    const int slots = entryCount * 3;
+    char* scratch = (char*)malloc(NODE_META_ARENA_SIZE);
+    uint16_t* remap = (uint16_t*)malloc((slots + 1) * 2 * sizeof(uint16_t));
+    if (scratch == nullptr || remap == nullptr) {
+        free(scratch);
+        free(remap);
+        return;
+    }
+    uint16_t* oldOffsets = remap;
+    uint16_t* newOffsets = remap + slots + 1;
+    size_t length = 1;
+    scratch[0] = '\0';
+    bool fits = true;
+    for (int slot = 0; slot < slots && fits; slot++) {
+        const Entry& entry = entries[slot / 3];
+        uint16_t offset = slot % 3 == 0 ? entry.idOffset : slot % 3 == 1 ? entry.nameOffset : entry.notesOffset;
+        oldOffsets[slot] = offset;
+        newOffsets[slot] = 0;
+        if (offset == 0) continue;
+        int seen = 0;
+        while (seen < slot && oldOffsets[seen] != offset) seen++;
+        if (seen < slot) {
+            newOffsets[slot] = newOffsets[seen];
+            continue;
+        }
+        size_t size = strlen(&arena[offset]) + 1;
+        if (length + size > NODE_META_ARENA_SIZE) {
+            fits = false;
+            break;
+        }
+        memcpy(&scratch[length], &arena[offset], size);
+        newOffsets[slot] = length;
+        length += size;
+    }
+    if (fits) {
+        for (int i = 0; i < entryCount; i++) {
+            entries[i].idOffset = newOffsets[i * 3];
+            entries[i].nameOffset = newOffsets[i * 3 + 1];
+            entries[i].notesOffset = newOffsets[i * 3 + 2];
+        }
+        memcpy(arena, scratch, length);
+        arenaLength = length;
+    }
+    free(scratch);
+    free(remap);
+}
+
+uint32_t NodeMetadataCache::hashId(const char* nodeId) {
+    uint32_t hash = 2166136261u;
+    while (*nodeId) {
+        hash = (hash ^ (uint8_t)*nodeId++) * 16777619u;
+    }
+    return hash;
+}
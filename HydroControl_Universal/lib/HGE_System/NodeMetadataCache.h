@@ -0,0 +1,57 @@
+#ifndef NODE_METADATA_CACHE_H
+#define NODE_METADATA_CACHE_H
+
+#include <Arduino.h>
+#include <freertos/semphr.h>
+
+#define NODE_META_MAX_ENTRIES 128
+#define NODE_META_ARENA_SIZE  4096
+#define NODE_META_VALUE_MAX   64  // Longest name or note kept
+
+// User metadata of the nodes (names, notes), read from NVS in one pass at boot and
+// then served from RAM. Strings live in a single arena, identical values are stored
+// once; superseded values are reclaimed by compacting the arena when it fills up.
+// Persisting changes is the caller's job (see Persistence).
+class NodeMetadataCache {
+public:
+    NodeMetadataCache();
+
+    // Iterates the two NVS namespaces once; returns the number of values loaded.
+    int load(const char* namesNamespace, const char* notesNamespace);
+
+    String name(const String& nodeId);
+    String notes(const String& nodeId);
+    void setName(const String& nodeId, const String& name);
+    void setNotes(const String& nodeId, const String& notes);
+
+    int size() const { return entryCount; }
+    size_t arenaUsed() const { return arenaLength; }
+
+private:
+    enum Field { FIELD_NAME, FIELD_NOTES };
+
+    struct Entry {
+        uint32_t idHash;
+        uint16_t idOffset;
+        uint16_t nameOffset;  // 0 = empty string
+        uint16_t notesOffset;
+    };
+
+    Entry entries[NODE_META_MAX_ENTRIES];
+    int entryCount = 0;
+    char arena[NODE_META_ARENA_SIZE];
+    size_t arenaLength = 1; // arena[0] is the shared empty string
+    SemaphoreHandle_t mutex;
+
+    int loadNamespace(const char* ns, Field field);
+    String get(const String& nodeId, Field field);
+    void set(const char* nodeId, Field field, const char* value);
+    Entry* find(const char* nodeId, uint32_t hash);
+    uint16_t intern(const char* value);
+    uint16_t append(const char* value);
+    void compact();
+
+    static uint32_t hashId(const char* nodeId);
+};
+
+#endif // NODE_METADATA_CACHE_H
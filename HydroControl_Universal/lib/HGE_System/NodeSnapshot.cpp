@@ -0,0 +1,46 @@
+#include "NodeSnapshot.h"
+#include <LittleFS.h>
+#include <rom/crc.h>
+
+#define NODE_SNAPSHOT_TMP_PATH "/nodes.tmp"
+
+bool NodeSnapshot::save(const NodeRecord* records, uint16_t count) {
+    Header header;
+    header.magic = MAGIC;
+    header.version = VERSION;
+    header.count = count;
+    header.crc = crc32_le(0, (const uint8_t*)records, count * sizeof(NodeRecord));
+
+    File file = LittleFS.open(NODE_SNAPSHOT_TMP_PATH, FILE_WRITE);
+    if (!file) return false;
+    size_t written = file.write((const uint8_t*)&header, sizeof(header));
+    written += file.write((const uint8_t*)records, count * sizeof(NodeRecord));
+    file.close();
+
+    if (written != sizeof(header) + count * sizeof(NodeRecord)) {
+        LittleFS.remove(NODE_SNAPSHOT_TMP_PATH);
+        return false;
+    }
+    return LittleFS.rename(NODE_SNAPSHOT_TMP_PATH, NODE_SNAPSHOT_PATH);
+}
+
+int NodeSnapshot::load(NodeRecord* records, uint16_t maxCount) {
+    File file = LittleFS.open(NODE_SNAPSHOT_PATH, FILE_READ);
+    if (!file) return -1;
+
+    Header header;
+    bool valid = file.read((uint8_t*)&header, sizeof(header)) == sizeof(header)
+                 && header.magic == MAGIC && header.version == VERSION && header.count <= maxCount
+                 && file.size() == sizeof(header) + header.count * sizeof(NodeRecord);
+    if (valid) {
+        size_t len = header.count * sizeof(NodeRecord);
+        valid = file.read((uint8_t*)records, len) == len && crc32_le(0, (const uint8_t*)records, len) == header.crc;
+    }
+    file.close();
+    return valid ? header.count : -1;
+}
+
+void NodeSnapshot::copyField(char* dest, size_t size, const String& value) {
+    strncpy(dest, value.c_str(), size - 1);
+    dest[size - 1] = '\0';
+}
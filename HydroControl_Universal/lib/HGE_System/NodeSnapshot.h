@@ -0,0 +1,49 @@
+#ifndef NODE_SNAPSHOT_H
+#define NODE_SNAPSHOT_H
+
+#include <Arduino.h>
+
+#define NODE_SNAPSHOT_PATH     "/nodes.bin"
+#define NODE_SNAPSHOT_ID_LEN   16 // MAC-based IDs are 12 chars
+#define NODE_SNAPSHOT_STATUS_LEN 16 // "DISCONNECTED" and its terminator, with margin
+
+#define NODE_FLAG_PING_SLOTS   (1 << 0)
+
+// Fixed-size record: everything the Centrale needs to arbitrate before the node
+// talks again. Names stay in NVS ("node-names").
+struct NodeRecord {
+    char id[NODE_SNAPSHOT_ID_LEN];
+    char assignedTo[NODE_SNAPSHOT_ID_LEN];
+    char status[NODE_SNAPSHOT_STATUS_LEN];
+    uint8_t role;
+    uint8_t flags;
+    uint16_t rxWindowMs;
+    int16_t rssi;
+} __attribute__((packed));
+
+// Binary snapshot of the Centrale node registry on LittleFS.
+// Layout: header { magic, version, count, crc32 of the records } followed by the records.
+// Written to a temporary file then renamed, so a power cut never leaves a half-written
+// snapshot; a bad magic, version, size or CRC makes load() ignore the file.
+class NodeSnapshot {
+public:
+    static bool save(const NodeRecord* records, uint16_t count);
+    // Returns the number of records restored, or -1 if there is no valid snapshot.
+    static int load(NodeRecord* records, uint16_t maxCount);
+
+    // Bounded copy helper for the fixed-size fields.
+    static void copyField(char* dest, size_t size, const String& value);
+
+private:
+    struct Header {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t count;
+        uint32_t crc;
+    } __attribute__((packed));
+
+    static const uint32_t MAGIC = 0x544E4748; // "HGNT"
+    static const uint16_t VERSION = 2; // 2: status field widened from 12 bytes
+};
+
+#endif // NODE_SNAPSHOT_H
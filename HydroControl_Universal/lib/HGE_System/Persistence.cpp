@@ -0,0 +1,257 @@
+#include "Persistence.h"
+#include <Preferences.h>
+#include "config.h"
+
+Persistence::Entry Persistence::entries[PERSIST_MAX_ENTRIES];
+Persistence::Entry Persistence::flushBatch[PERSIST_MAX_ENTRIES];
+SemaphoreHandle_t Persistence::cacheMutex = NULL;
+SemaphoreHandle_t Persistence::flushMutex = NULL;
+TaskHandle_t Persistence::flushTask = NULL;
+
+void Persistence::begin() {
+    if (cacheMutex != NULL) return;
+    cacheMutex = xSemaphoreCreateMutex();
+    flushMutex = xSemaphoreCreateMutex();
+    xTaskCreate(Task_Persistence_Flush, "PersistFlush", 4096, NULL, 1, &flushTask);
+}
+
+// --- Cache ---
+// All helpers below expect cacheMutex to be held.
+
+Persistence::Entry* Persistence::find(const char* ns, const char* key) {
+    for (int i = 0; i < PERSIST_MAX_ENTRIES; i++) {
+        if (entries[i].used && strcmp(entries[i].ns, ns) == 0 && strcmp(entries[i].key, key) == 0) {
+            return &entries[i];
+        }
+    }
+    return nullptr;
+}
+
+Persistence::Entry* Persistence::allocate(const char* ns, const char* key) {
+    Entry* slot = nullptr;
+    for (int i = 0; i < PERSIST_MAX_ENTRIES && slot == nullptr; i++) {
+        if (!entries[i].used) slot = &entries[i];
+    }
+    // Cache full: evict a clean entry, it can be read back from NVS.
+    for (int i = 0; i < PERSIST_MAX_ENTRIES && slot == nullptr; i++) {
+        if (!entries[i].dirty) slot = &entries[i];
+    }
+    if (slot == nullptr) return nullptr;
+
+    strncpy(slot->ns, ns, PERSIST_NS_LEN - 1);
+    slot->ns[PERSIST_NS_LEN - 1] = '\0';
+    strncpy(slot->key, key, PERSIST_KEY_LEN - 1);
+    slot->key[PERSIST_KEY_LEN - 1] = '\0';
+    slot->used = true;
+    slot->dirty = false;
+    slot->number = 0;
+    slot->text = "";
+    return slot;
+}
+
+// Read-through: a miss loads the key from NVS (or keeps the caller's default).
+Persistence::Entry* Persistence::lookup(const char* ns, const char* key, EntryType type) {
+    Entry* entry = find(ns, key);
+    if (entry != nullptr) return entry;
+
+    Preferences prefs;
+    if (!prefs.begin(ns, true)) return nullptr; // Namespace never written
+    if (!prefs.isKey(key)) {
+        prefs.end();
+        return nullptr;
+    }
+    entry = allocate(ns, key);
+    if (entry != nullptr) {
+        entry->type = type;
+        switch (type) {
+            case TYPE_STRING: entry->text = prefs.getString(key, ""); break;
+            case TYPE_UCHAR: entry->number = prefs.getUChar(key, 0); break;
+            case TYPE_BOOL: entry->number = prefs.getBool(key, false) ? 1 : 0; break;
+            case TYPE_UINT: entry->number = prefs.getUInt(key, 0); break;
+        }
+    }
+    prefs.end();
+    return entry;
+}
+
+void Persistence::markDirty(Entry* entry) {
+    entry->dirty = true;
+    if (flushTask != NULL) xTaskNotifyGive(flushTask);
+}
+
+// --- Reads ---
+
+String Persistence::getString(const char* ns, const char* key, const String& defaultValue) {
+    String value = defaultValue;
+    xSemaphoreTake(cacheMutex, portMAX_DELAY);
+    Entry* entry = lookup(ns, key, TYPE_STRING);
+    if (entry != nullptr) value = entry->text;
+    xSemaphoreGive(cacheMutex);
+    return value;
+}
+
+uint8_t Persistence::getUChar(const char* ns, const char* key, uint8_t defaultValue) {
+    uint8_t value = defaultValue;
+    xSemaphoreTake(cacheMutex, portMAX_DELAY);
+    Entry* entry = lookup(ns, key, TYPE_UCHAR);
+    if (entry != nullptr) value = entry->number;
+    xSemaphoreGive(cacheMutex);
+    return value;
+}
+
+bool Persistence::getBool(const char* ns, const char* key, bool defaultValue) {
+    bool value = defaultValue;
+    xSemaphoreTake(cacheMutex, portMAX_DELAY);
+    Entry* entry = lookup(ns, key, TYPE_BOOL);
+    if (entry != nullptr) value = entry->number != 0;
+    xSemaphoreGive(cacheMutex);
+    return value;
+}
+
+uint32_t Persistence::getUInt(const char* ns, const char* key, uint32_t defaultValue) {
+    uint32_t value = defaultValue;
+    xSemaphoreTake(cacheMutex, portMAX_DELAY);
+    Entry* entry = lookup(ns, key, TYPE_UINT);
+    if (entry != nullptr) value = entry->number;
+    xSemaphoreGive(cacheMutex);
+    return value;
+}
+
+// --- Writes ---
+// Unchanged values are not marked dirty, so repeated saves of the same state cost nothing.
+
+void Persistence::putString(const char* ns, const char* key, const String& value) {
+    xSemaphoreTake(cacheMutex, portMAX_DELAY);
+    Entry* entry = find(ns, key);
+    bool isNew = (entry == nullptr);
+    if (isNew && (entry = allocate(ns, key)) == nullptr) {
+        xSemaphoreGive(cacheMutex);
+        // Every entry is dirty: write this one through rather than lose it.
+        Preferences prefs;
+        prefs.begin(ns, false);
+        prefs.putString(key, value);
+        prefs.end();
+        return;
+    }
+    if (isNew || entry->type != TYPE_STRING || !entry->text.equals(value)) {
+        entry->type = TYPE_STRING;
+        entry->text = value;
+        markDirty(entry);
+    }
+    xSemaphoreGive(cacheMutex);
+}
+
+void Persistence::putUChar(const char* ns, const char* key, uint8_t value) {
+    xSemaphoreTake(cacheMutex, portMAX_DELAY);
+    Entry* entry = find(ns, key);
+    bool isNew = (entry == nullptr);
+    if (isNew && (entry = allocate(ns, key)) == nullptr) {
+        xSemaphoreGive(cacheMutex);
+        Preferences prefs;
+        prefs.begin(ns, false);
+        prefs.putUChar(key, value);
+        prefs.end();
+        return;
+    }
+    if (isNew || entry->type != TYPE_UCHAR || entry->number != value) {
+        entry->type = TYPE_UCHAR;
+        entry->number = value;
+        markDirty(entry);
+    }
+    xSemaphoreGive(cacheMutex);
+}
+
+void Persistence::putBool(const char* ns, const char* key, bool value) {
+    xSemaphoreTake(cacheMutex, portMAX_DELAY);
+    Entry* entry = find(ns, key);
+    bool isNew = (entry == nullptr);
+    if (isNew && (entry = allocate(ns, key)) == nullptr) {
+        xSemaphoreGive(cacheMutex);
+        Preferences prefs;
+        prefs.begin(ns, false);
+        prefs.putBool(key, value);
+        prefs.end();
+        return;
+    }
+    if (isNew || entry->type != TYPE_BOOL || (entry->number != 0) != value) {
+        entry->type = TYPE_BOOL;
+        entry->number = value ? 1 : 0;
+        markDirty(entry);
+    }
+    xSemaphoreGive(cacheMutex);
+}
+
+void Persistence::putUInt(const char* ns, const char* key, uint32_t value) {
+    xSemaphoreTake(cacheMutex, portMAX_DELAY);
+    Entry* entry = find(ns, key);
+    bool isNew = (entry == nullptr);
+    if (isNew && (entry = allocate(ns, key)) == nullptr) {
+        xSemaphoreGive(cacheMutex);
+        Preferences prefs;
+        prefs.begin(ns, false);
+        prefs.putUInt(key, value);
+        prefs.end();
+        return;
+    }
+    if (isNew || entry->type != TYPE_UINT || entry->number != value) {
+        entry->type = TYPE_UINT;
+        entry->number = value;
+        markDirty(entry);
+    }
+    xSemaphoreGive(cacheMutex);
+}
+
+// --- Flush ---
+
+void Persistence::flush() {
+    xSemaphoreTake(flushMutex, portMAX_DELAY);
+
+    // Copy the dirty set and mark it clean, then write without blocking the cache:
+    // a key changed during the write is simply dirty again for the next flush.
+    int count = 0;
+    xSemaphoreTake(cacheMutex, portMAX_DELAY);
+    for (int i = 0; i < PERSIST_MAX_ENTRIES; i++) {
+        if (entries[i].used && entries[i].dirty) {
+            flushBatch[count++] = entries[i];
+            entries[i].dirty = false;
+        }
+    }
+    xSemaphoreGive(cacheMutex);
+
+    if (count > 0) {
+        writeEntries(flushBatch, count);
+        for (int i = 0; i < count; i++) flushBatch[i].text = ""; // Release the heap copies
+    }
+    xSemaphoreGive(flushMutex);
+}
+
+// One begin()/end() per namespace, whatever the number of keys.
+void Persistence::writeEntries(Entry* batch, int count) {
+    for (int i = 0; i < count; i++) {
+        if (!batch[i].used) continue;
+        Preferences prefs;
+        prefs.begin(batch[i].ns, false);
+        for (int j = i; j < count; j++) {
+            if (!batch[j].used || strcmp(batch[j].ns, batch[i].ns) != 0) continue;
+            switch (batch[j].type) {
+                case TYPE_STRING: prefs.putString(batch[j].key, batch[j].text); break;
+                case TYPE_UCHAR: prefs.putUChar(batch[j].key, batch[j].number); break;
+                case TYPE_BOOL: prefs.putBool(batch[j].key, batch[j].number != 0); break;
+                case TYPE_UINT: prefs.putUInt(batch[j].key, batch[j].number); break;
+            }
+            if (j != i) batch[j].used = false;
+        }
+        batch[i].used = false;
+        prefs.end();
+    }
+}
+
+void Persistence::Task_Persistence_Flush(void* pvParameters) {
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        // Let the burst of changes settle, then write them in one go.
+        vTaskDelay(pdMS_TO_TICKS(PERSIST_FLUSH_DELAY_MS));
+        ulTaskNotifyTake(pdTRUE, 0);
+        flush();
+    }
+}
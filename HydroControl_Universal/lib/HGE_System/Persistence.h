@@ -0,0 +1,61 @@
+#ifndef PERSISTENCE_H
+#define PERSISTENCE_H
+
+#include <Arduino.h>
+#include <freertos/semphr.h>
+
+#define PERSIST_NS_LEN  16 // NVS limits, terminator included
+#define PERSIST_KEY_LEN 16
+
+// Write-back cache in front of Preferences/NVS.
+// Reads go through the cache (the first read of a key hits NVS once), writes only
+// update RAM and mark the key dirty. A background task writes the dirty keys,
+// grouped by namespace, PERSIST_FLUSH_DELAY_MS after the first change. Callers
+// that are about to restart or sleep call flush().
+// Not usable from an ISR.
+class Persistence {
+public:
+    static void begin();
+
+    static String getString(const char* ns, const char* key, const String& defaultValue = String());
+    static uint8_t getUChar(const char* ns, const char* key, uint8_t defaultValue = 0);
+    static bool getBool(const char* ns, const char* key, bool defaultValue = false);
+    static uint32_t getUInt(const char* ns, const char* key, uint32_t defaultValue = 0);
+
+    static void putString(const char* ns, const char* key, const String& value);
+    static void putUChar(const char* ns, const char* key, uint8_t value);
+    static void putBool(const char* ns, const char* key, bool value);
+    static void putUInt(const char* ns, const char* key, uint32_t value);
+
+    // Writes every dirty key now.
+    static void flush();
+
+private:
+    enum EntryType : uint8_t { TYPE_STRING, TYPE_UCHAR, TYPE_BOOL, TYPE_UINT };
+
+    struct Entry {
+        char ns[PERSIST_NS_LEN];
+        char key[PERSIST_KEY_LEN];
+        EntryType type;
+        bool used;
+        bool dirty;
+        uint32_t number;  // TYPE_UCHAR, TYPE_BOOL and TYPE_UINT
+        String text;      // TYPE_STRING
+    };
+
+    static Entry entries[];
+    static Entry flushBatch[];
+    static SemaphoreHandle_t cacheMutex;
+    static SemaphoreHandle_t flushMutex;
+    static TaskHandle_t flushTask;
+
+    static Entry* find(const char* ns, const char* key);
+    static Entry* allocate(const char* ns, const char* key);
+    static Entry* lookup(const char* ns, const char* key, EntryType type);
+    static void markDirty(Entry* entry);
+    static void writeEntries(Entry* batch, int count);
+
+    static void Task_Persistence_Flush(void* pvParameters);
+};
+
+#endif // PERSISTENCE_H
@@ -0,0 +1,69 @@
+#include "PowerModel.h"
+
+PowerProfile PowerModel::defaultProfile() {
+    PowerProfile p;
+    p.sleepCurrentUa = 25.0f;   // ESP32 deep sleep + ULP at 10 Hz + SX1278 sleep + regulator
+    p.activeCurrentMa = 32.0f;  // 80 MHz, Wi-Fi off
+    p.rxCurrentMa = 44.0f;
+    p.txCurrentMa = 125.0f;     // +17 dBm
+    p.wakeOverheadMs = 320.0f;
+    p.txTimeMs = 330.0f;        // ~170 byte hex frame at SF7/125 kHz
+    p.rxWindowMs = 1500.0f;
+    return p;
+}
+
+DutyCycleResult PowerModel::simulate(const PowerProfile& profile, const DutyCycleScenario& scenario, uint32_t horizonS) {
+    DutyCycleResult result = {0, 0.0f, 0.0f, 0.0f, 0.0f};
+    const float horizonMs = horizonS * 1000.0f;
+
+    // Events are spread evenly over the day; heartbeats restart after every uplink.
+    const uint32_t eventsPerDay = scenario.levelEventsPerDay + scenario.buttonPressesPerDay;
+    const float eventPeriodMs = eventsPerDay > 0 ? (86400000.0f / eventsPerDay) : horizonMs + 1.0f;
+    const float heartbeatMs = scenario.heartbeatS * 1000.0f;
+
+    float nowMs = 0.0f;
+    float nextEventMs = eventPeriodMs / 2.0f;
+    float chargeMaMs = 0.0f;
+
+    while (nowMs < horizonMs) {
+        float nextHeartbeatMs = nowMs + heartbeatMs;
+        bool eventWake = nextEventMs <= nextHeartbeatMs;
+        float wakeMs = eventWake ? nextEventMs : nextHeartbeatMs;
+        if (wakeMs > horizonMs) {
+            chargeMaMs += (horizonMs - nowMs) * profile.sleepCurrentUa / 1000.0f;
+            break;
+        }
+
+        // Sleep until the wake-up
+        chargeMaMs += (wakeMs - nowMs) * profile.sleepCurrentUa / 1000.0f;
+
+        uint8_t frames = eventWake ? scenario.framesPerEvent : 1;
+        float txMs = frames * profile.txTimeMs;
+        float awakeMs = profile.wakeOverheadMs + txMs + profile.rxWindowMs;
+
+        chargeMaMs += profile.wakeOverheadMs * profile.activeCurrentMa;
+        chargeMaMs += txMs * profile.txCurrentMa;
+        chargeMaMs += profile.rxWindowMs * profile.rxCurrentMa;
+
+        result.wakeUps++;
+        result.awakeSeconds += awakeMs / 1000.0f;
+        result.radioOnSeconds += (txMs + profile.rxWindowMs) / 1000.0f;
+        nowMs = wakeMs + awakeMs;
+
+        // Any event that happened while awake is handled by the same wake-up
+        while (nextEventMs <= nowMs) nextEventMs += eventPeriodMs;
+    }
+
+    result.chargeMah = chargeMaMs / 3600000.0f;
+    result.averageCurrentMa = horizonMs > 0 ? chargeMaMs / horizonMs : 0.0f;
+    return result;
+}
+
+float PowerModel::alwaysOnCurrentMa(const PowerProfile& profile) {
+    return profile.rxCurrentMa;
+}
+
+float PowerModel::batteryLifeDays(float capacityMah, float averageCurrentMa) {
+    if (averageCurrentMa <= 0.0f) return 0.0f;
+    return capacityMah / averageCurrentMa / 24.0f;
+}
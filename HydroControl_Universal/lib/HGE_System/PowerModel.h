@@ -0,0 +1,47 @@
+#ifndef POWER_MODEL_H
+#define POWER_MODEL_H
+
+#include <stdint.h>
+
+// Electrical profile of a battery node, all figures measured at the battery.
+struct PowerProfile {
+    float sleepCurrentUa;   // Deep sleep with the ULP sampling the float switches
+    float activeCurrentMa;  // CPU awake, radio in standby
+    float rxCurrentMa;      // CPU awake, radio in continuous receive
+    float txCurrentMa;      // CPU awake, radio transmitting
+    float wakeOverheadMs;   // Boot, LoRa init and key loading after each wake-up
+    float txTimeMs;         // Airtime of one encrypted frame
+    float rxWindowMs;       // Receive window opened after each uplink
+};
+
+// What the site does over a day.
+struct DutyCycleScenario {
+    uint32_t heartbeatS;        // Timer wake-up period
+    uint32_t levelEventsPerDay; // Float switch transitions (each one sends a pump request)
+    uint32_t buttonPressesPerDay;
+    uint8_t framesPerEvent;     // Uplinks per event, retries included
+};
+
+struct DutyCycleResult {
+    uint32_t wakeUps;
+    float awakeSeconds;
+    float radioOnSeconds;
+    float averageCurrentMa;
+    float chargeMah;
+};
+
+class PowerModel {
+public:
+    static PowerProfile defaultProfile();
+
+    // Steps through the horizon one wake-up at a time. Events that fall inside an
+    // ongoing awake period are merged into it, exactly as the firmware does.
+    static DutyCycleResult simulate(const PowerProfile& profile, const DutyCycleScenario& scenario, uint32_t horizonS);
+
+    // Average current if the node never slept (current always-on firmware), for comparison.
+    static float alwaysOnCurrentMa(const PowerProfile& profile);
+
+    static float batteryLifeDays(float capacityMah, float averageCurrentMa);
+};
+
+#endif // POWER_MODEL_H
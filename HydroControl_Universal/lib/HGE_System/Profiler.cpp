@@ -0,0 +1,195 @@
+#include "Profiler.h"
+#include "Persistence.h"
+
+Profiler::TaskProfile Profiler::tasks[PROFILER_MAX_TASKS];
+uint8_t Profiler::taskCount = 0;
+Profiler::StackBudget Profiler::budgets[PROFILER_MAX_TASKS];
+uint8_t Profiler::budgetCount = 0;
+multi_heap_info_t Profiler::heap;
+uint32_t Profiler::lastTotalRunTime = 0;
+uint16_t Profiler::busyPermille = 0;
+uint32_t Profiler::sampledAtMs = 0;
+SemaphoreHandle_t Profiler::mutex = NULL;
+
+void Profiler::begin() {
+    if (mutex != NULL) return;
+    mutex = xSemaphoreCreateMutex();
+    xTaskCreate(Task_Profiler, "Profiler", stackSize("Profiler", 3072), NULL, 1, NULL);
+}
+
+// Call after begin() (and Persistence::begin()).
+uint32_t Profiler::stackSize(const char* taskName, uint32_t defaultSize) {
+#ifdef HGE_STACK_CALIBRATION
+    uint32_t size = defaultSize * 2;
+#else
+    uint32_t size = defaultSize;
+    uint8_t calibrated = Persistence::getUChar(PROFILER_STACK_NS, taskName, 0);
+    if (calibrated != 0) {
+        size = constrain((uint32_t)calibrated * 256, (uint32_t)PROFILER_MIN_STACK, defaultSize * 2);
+    }
+#endif
+    if (mutex == NULL) return size;
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    if (budgetCount < PROFILER_MAX_TASKS) {
+        StackBudget& budget = budgets[budgetCount++];
+        snprintf(budget.name, sizeof(budget.name), "%s", taskName);
+        budget.size = size;
+        budget.saved = 0;
+    }
+    xSemaphoreGive(mutex);
+    return size;
+}
+
+// Must be called with the mutex held.
+uint32_t Profiler::budgetOf(const char* name) {
+    for (uint8_t i = 0; i < budgetCount; i++) {
+        if (strcmp(budgets[i].name, name) == 0) return budgets[i].size;
+    }
+    return 0;
+}
+
+void Profiler::sample() {
+#if configUSE_TRACE_FACILITY
+    TaskStatus_t* status = (TaskStatus_t*)malloc(PROFILER_MAX_TASKS * sizeof(TaskStatus_t));
+    if (status == nullptr) return;
+    uint32_t totalRunTime = 0;
+    UBaseType_t count = uxTaskGetSystemState(status, PROFILER_MAX_TASKS, &totalRunTime);
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    heap_caps_get_info(&heap, MALLOC_CAP_8BIT);
+
+    // Rebuilt every time: tasks come and go (boot phases, provisioning).
+    TaskProfile previous[PROFILER_MAX_TASKS];
+    uint8_t previousCount = taskCount;
+    memcpy(previous, tasks, sizeof(TaskProfile) * previousCount);
+    uint32_t elapsed = (totalRunTime - lastTotalRunTime) * portNUM_PROCESSORS;
+    uint32_t idlePermille = 0;
+
+    taskCount = 0;
+    for (UBaseType_t i = 0; i < count && taskCount < PROFILER_MAX_TASKS; i++) {
+        TaskProfile& task = tasks[taskCount++];
+        snprintf(task.name, sizeof(task.name), "%s", status[i].pcTaskName);
+        task.handle = status[i].xHandle;
+        task.stackSize = budgetOf(task.name);
+        task.stackFree = status[i].usStackHighWaterMark; // Bytes on ESP-IDF
+        task.runTime = status[i].ulRunTimeCounter;
+        task.cpuPermille = 0;
+        for (uint8_t p = 0; p < previousCount; p++) {
+            if (previous[p].handle == task.handle && elapsed > 0) {
+                task.cpuPermille = (uint64_t)(task.runTime - previous[p].runTime) * 1000 / elapsed;
+                break;
+            }
+        }
+        if (strncmp(task.name, "IDLE", 4) == 0) idlePermille += task.cpuPermille;
+    }
+    busyPermille = lastTotalRunTime != 0 && idlePermille <= 1000 ? 1000 - idlePermille : 0;
+    lastTotalRunTime = totalRunTime;
+    sampledAtMs = millis();
+    xSemaphoreGive(mutex);
+    free(status);
+#endif
+}
+
+#ifdef HGE_STACK_CALIBRATION
+// Saves the peak usage of each task plus the margin, rounded up to 256 bytes.
+void Profiler::calibrate() {
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    for (uint8_t i = 0; i < taskCount; i++) {
+        TaskProfile& task = tasks[i];
+        if (task.stackSize == 0 || task.stackFree > task.stackSize) continue;
+        uint32_t used = task.stackSize - task.stackFree;
+        uint32_t wanted = ((used * (100 + PROFILER_STACK_MARGIN_PCT) / 100) + 255) & ~255u;
+        wanted = max(wanted, (uint32_t)PROFILER_MIN_STACK);
+        for (uint8_t b = 0; b < budgetCount; b++) {
+            if (strcmp(budgets[b].name, task.name) != 0 || wanted <= budgets[b].saved) continue;
+            budgets[b].saved = wanted;
+            Persistence::putUChar(PROFILER_STACK_NS, task.name, min(wanted / 256, (uint32_t)255));
+            Serial.printf("Stack calibration: %s uses %u of %u bytes, saving %u.\n", task.name, used, task.stackSize, wanted);
+        }
+    }
+    xSemaphoreGive(mutex);
+}
+#endif
+
+void Profiler::writeJson(Print& out) {
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    out.printf("{\"uptime\":%lu,\"sampledAt\":%u,\"cpuBusy\":%u.%u,", millis() / 1000, sampledAtMs / 1000, busyPermille / 10, busyPermille % 10);
+    out.printf("\"heap\":{\"free\":%u,\"min\":%u,\"largest\":%u,\"freeBlocks\":%u,\"allocatedBlocks\":%u},\"tasks\":[",
+               (unsigned)heap.total_free_bytes, (unsigned)heap.minimum_free_bytes, (unsigned)heap.largest_free_block,
+               (unsigned)heap.free_blocks, (unsigned)heap.allocated_blocks);
+    for (uint8_t i = 0; i < taskCount; i++) {
+        const TaskProfile& task = tasks[i];
+        out.printf("%s{\"name\":\"%s\",\"stack\":%u,\"stackFree\":%u,\"cpu\":%u.%u}", i > 0 ? "," : "",
+                   task.name, task.stackSize, task.stackFree, task.cpuPermille / 10, task.cpuPermille % 10);
+    }
+    out.print("]}");
+    xSemaphoreGive(mutex);
+}
+
+void Profiler::writeText(Print& out) {
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    uint32_t fragPct = heap.total_free_bytes > 0 ? 100 - heap.largest_free_block * 100 / heap.total_free_bytes : 0;
+    out.printf("Heap: %u free, %u min, largest block %u (%u%% fragmented), %u free blocks\n",
+               (unsigned)heap.total_free_bytes, (unsigned)heap.minimum_free_bytes, (unsigned)heap.largest_free_block,
+               fragPct, (unsigned)heap.free_blocks);
+    out.printf("CPU busy: %u.%u%% (last %u s)\n", busyPermille / 10, busyPermille % 10, PROFILER_SAMPLE_MS / 1000);
+    out.printf("%-16s %6s %6s %6s\n", "Task", "Stack", "Free", "CPU%");
+    for (uint8_t i = 0; i < taskCount; i++) {
+        const TaskProfile& task = tasks[i];
+        char size[8] = "?";
+        if (task.stackSize > 0) snprintf(size, sizeof(size), "%u", task.stackSize);
+        out.printf("%-16s %6s %6u %4u.%u\n", task.name, size, task.stackFree, task.cpuPermille / 10, task.cpuPermille % 10);
+    }
+    xSemaphoreGive(mutex);
+}
+
+void Profiler::fillDiagnostics(NodeDiagnostics& diag) {
+    // Low-power nodes may not have lived through a full interval.
+    if (sampledAtMs == 0) sample();
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    diag.heapFree = heap.total_free_bytes;
+    diag.heapMin = heap.minimum_free_bytes;
+    diag.heapLargest = heap.largest_free_block;
+    diag.worstTask[0] = '\0';
+    diag.worstStackFree = 0;
+    for (uint8_t i = 0; i < taskCount; i++) {
+        if (diag.worstTask[0] == '\0' || tasks[i].stackFree < diag.worstStackFree) {
+            snprintf(diag.worstTask, sizeof(diag.worstTask), "%s", tasks[i].name);
+            diag.worstStackFree = tasks[i].stackFree;
+        }
+    }
+    diag.cpuBusyPct = busyPermille / 10;
+    xSemaphoreGive(mutex);
+}
+
+void Profiler::Task_Profiler(void* pvParameters) {
+    char line[16];
+    size_t len = 0;
+    uint32_t lastSampleMs = millis();
+    sample();
+
+    for (;;) {
+        vTaskDelay(pdMS_TO_TICKS(100));
+
+        // Serial console: "profile" prints the last sample.
+        while (Serial.available() > 0) {
+            char c = Serial.read();
+            if (c != '\n' && c != '\r') {
+                if (len < sizeof(line) - 1) line[len++] = c;
+                continue;
+            }
+            line[len] = '\0';
+            if (strcmp(line, "profile") == 0) writeText(Serial);
+            len = 0;
+        }
+
+        if (millis() - lastSampleMs >= PROFILER_SAMPLE_MS) {
+            lastSampleMs = millis();
+            sample();
+#ifdef HGE_STACK_CALIBRATION
+            calibrate();
+#endif
+        }
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include "Message.h"
+#include "config.h"
+
+#define PROFILER_MAX_TASKS    24
+#define PROFILER_NAME_LEN     16 // configMAX_TASK_NAME_LEN, also the NVS key limit
+#define PROFILER_STACK_NS     "stacks"
+
+// Periodic sampler of per-task stack high-water marks, per-task CPU share over the
+// last interval and heap state (free, minimum, largest block, block count), so
+// stack sizes and String-induced fragmentation can be checked on a running node.
+// Reports: "profile" on the serial console, writeJson() for the web, and a
+// NodeDiagnostics summary for LoRa.
+//
+// Task stacks are requested through stackSize(): normal builds use the size saved
+// by a calibration build (HGE_STACK_CALIBRATION), or the default. A calibration
+// build gives every task twice its default and saves, per task, the peak usage
+// plus PROFILER_STACK_MARGIN_PCT.
+class Profiler {
+public:
+    static void begin();
+
+    static uint32_t stackSize(const char* taskName, uint32_t defaultSize);
+
+    static void writeJson(Print& out);
+    static void writeText(Print& out);
+    static void fillDiagnostics(NodeDiagnostics& diag);
+
+private:
+    struct TaskProfile {
+        char name[PROFILER_NAME_LEN];
+        TaskHandle_t handle;
+        uint32_t stackSize;   // 0 = not created through stackSize()
+        uint32_t stackFree;   // Lowest since the task started
+        uint32_t runTime;     // Run-time counter at the last sample
+        uint16_t cpuPermille; // Over the last interval, both cores
+    };
+
+    struct StackBudget {
+        char name[PROFILER_NAME_LEN];
+        uint32_t size;
+        uint32_t saved;       // Calibration builds: last size written to NVS
+    };
+
+    static TaskProfile tasks[PROFILER_MAX_TASKS];
+    static uint8_t taskCount;
+    static StackBudget budgets[PROFILER_MAX_TASKS];
+    static uint8_t budgetCount;
+    static multi_heap_info_t heap;
+    static uint32_t lastTotalRunTime;
+    static uint16_t busyPermille;
+    static uint32_t sampledAtMs;
+    static SemaphoreHandle_t mutex;
+
+    static void sample();
+    static uint32_t budgetOf(const char* name);
+    static void calibrate();
+    static void Task_Profiler(void* pvParameters);
+};
+
+#endif // PROFILER_H
@@ -0,0 +1,203 @@
+#include "SegmentRing.h"
+#include <LittleFS.h>
+
+void SegmentRing::init(const char* dir, uint16_t recordSize, uint8_t segmentCount, uint16_t segmentRecords) {
+    strncpy(this->dir, dir, SEGMENT_RING_DIR_LEN - 1);
+    this->dir[SEGMENT_RING_DIR_LEN - 1] = '\0';
+    this->recordSize = recordSize;
+    this->count = min(segmentCount, (uint8_t)SEGMENT_RING_MAX_SEGMENTS);
+    this->segmentRecords = segmentRecords;
+    headIndex = 0;
+    memset(segments, 0, sizeof(segments));
+    if (!LittleFS.exists(this->dir)) LittleFS.mkdir(this->dir);
+}
+
+void SegmentRing::scan() {
+    for (uint8_t i = 0; i < count; i++) {
+        Segment& seg = segments[i];
+        seg.count = 0;
+        String segPath = path(i);
+        File file = LittleFS.open(segPath, FILE_READ);
+        if (!file) continue;
+
+        size_t size = file.size();
+        if (size % recordSize != 0 || size > (size_t)segmentRecords * recordSize) {
+            // Appending after a partial record would misalign everything that follows.
+            file.close();
+            LittleFS.remove(segPath);
+            Serial.printf("Dropped damaged segment %s\n", segPath.c_str());
+            continue;
+        }
+        seg.count = size / recordSize;
+        if (seg.count > 0) {
+            file.read((uint8_t*)&seg.firstTs, sizeof(uint32_t));
+            file.seek((seg.count - 1) * recordSize);
+            file.read((uint8_t*)&seg.lastTs, sizeof(uint32_t));
+        }
+        file.close();
+    }
+
+    // Segments behind the head are full and the head is the only partial one,
+    // so the layout alone tells where appends resume; timestamps only break ties.
+    int head = -1;
+    for (uint8_t i = 0; i < count && head < 0; i++) {
+        if (segments[i].count > 0 && segments[i].count < segmentRecords) head = i;
+    }
+    for (uint8_t i = 0; i < count && head < 0; i++) {
+        uint8_t prev = (i + count - 1) % count;
+        if (segments[i].count == 0 && segments[prev].count > 0) head = i;
+    }
+    if (head < 0) {
+        head = 0;
+        for (uint8_t i = 1; i < count; i++) {
+            if (segments[i].count > 0 && segments[i].lastTs > segments[head].lastTs) head = i;
+        }
+    }
+    headIndex = head;
+}
+
+size_t SegmentRing::append(const uint8_t* records, size_t n) {
+    size_t total = 0;
+    while (n > 0) {
+        Segment* seg = &segments[headIndex];
+        if (seg->count >= segmentRecords) {
+            // Recycle the oldest segment as the new head.
+            headIndex = (headIndex + 1) % count;
+            seg = &segments[headIndex];
+            LittleFS.remove(path(headIndex));
+            seg->count = 0;
+            seg->generation++;
+        }
+
+        size_t batch = min(n, (size_t)(segmentRecords - seg->count));
+        size_t written = writeHead(records, batch);
+        if (written > 0) {
+            if (seg->count == 0) memcpy(&seg->firstTs, records, sizeof(uint32_t));
+            memcpy(&seg->lastTs, records + (written - 1) * recordSize, sizeof(uint32_t));
+            seg->count += written;
+            total += written;
+            records += written * recordSize;
+            n -= written;
+        }
+        // The partition is shared with the other stores and the assets: when it is full,
+        // give up the oldest records now rather than failing every append from here on.
+        if (written < batch && !dropOldest()) return total;
+    }
+    return total;
+}
+
+size_t SegmentRing::writeHead(const uint8_t* records, size_t n) {
+    File file = LittleFS.open(path(headIndex), FILE_APPEND);
+    if (!file) return 0;
+    size_t written = file.write(records, n * recordSize) / recordSize;
+    file.close();
+    return written;
+}
+
+// Empties the oldest segment that holds records, the head excepted. The emptied
+// segments follow the head, so scan() still finds where appends resume.
+bool SegmentRing::dropOldest() {
+    for (uint8_t step = 1; step < count; step++) {
+        uint8_t i = (headIndex + step) % count;
+        if (segments[i].count == 0) continue;
+        LittleFS.remove(path(i));
+        segments[i].count = 0;
+        segments[i].generation++;
+        Serial.printf("Flash full, dropped segment %s early\n", path(i).c_str());
+        return true;
+    }
+    return false;
+}
+
+bool SegmentRing::read(uint8_t segment, uint16_t generation, uint16_t pos, uint8_t* out, uint16_t n) {
+    const Segment& seg = segments[segment];
+    if (seg.generation != generation || pos + n > seg.count) return false;
+    File file = LittleFS.open(path(segment), FILE_READ);
+    if (!file) return false;
+    size_t len = (size_t)n * recordSize;
+    bool ok = file.seek((size_t)pos * recordSize) && file.read(out, len) == len;
+    file.close();
+    return ok;
+}
+
+void SegmentRing::clear() {
+    for (uint8_t i = 0; i < count; i++) {
+        LittleFS.remove(path(i));
+        segments[i].count = 0;
+        segments[i].generation++;
+    }
+    headIndex = 0;
+}
+
+uint32_t SegmentRing::recordCount() const {
+    uint32_t total = 0;
+    for (uint8_t i = 0; i < count; i++) total += segments[i].count;
+    return total;
+}
+
+String SegmentRing::path(uint8_t segment) const {
+    return String(dir) + "/" + segment + ".bin";
+}
+
+// --- Cursor ---
+
+SegmentRing::Cursor::Cursor(SegmentRing* ring, SemaphoreHandle_t mutex, uint32_t from, uint32_t to, uint16_t blockRecords)
+    : ring(ring), mutex(mutex), from(from), to(to), blockRecords(blockRecords) {
+    block = (uint8_t*)malloc((size_t)blockRecords * ring->recordSize);
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    segment = ring->headIndex; // enterNextSegment() steps to the oldest one first
+    segmentsLeft = ring->count;
+    xSemaphoreGive(mutex);
+}
+
+SegmentRing::Cursor::~Cursor() {
+    free(block);
+}
+
+const uint8_t* SegmentRing::Cursor::next() {
+    if (block == nullptr) return nullptr;
+    for (;;) {
+        while (blockPos < blockLen) {
+            const uint8_t* rec = block + (size_t)(blockPos++) * ring->recordSize;
+            uint32_t ts;
+            memcpy(&ts, rec, sizeof(ts));
+            if (ts >= from && ts <= to) return rec;
+        }
+
+        if (recordPos < recordEnd) {
+            uint16_t n = min((uint16_t)(recordEnd - recordPos), blockRecords);
+            blockPos = 0;
+            blockLen = 0;
+            xSemaphoreTake(mutex, portMAX_DELAY);
+            bool ok = ring->read(segment, generation, recordPos, block, n);
+            xSemaphoreGive(mutex);
+            if (ok) {
+                blockLen = n;
+                recordPos += n;
+            } else {
+                recordEnd = 0; // Recycled under us: its records are gone, move on
+            }
+            continue;
+        }
+
+        if (!enterNextSegment()) return nullptr;
+    }
+}
+
+bool SegmentRing::Cursor::enterNextSegment() {
+    bool entered = false;
+    while (segmentsLeft > 0 && !entered) {
+        segment = (segment + 1) % ring->count;
+        segmentsLeft--;
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        const Segment& seg = ring->segments[segment];
+        if (seg.count > 0 && seg.lastTs >= from && seg.firstTs <= to) {
+            generation = seg.generation;
+            recordPos = 0;
+            recordEnd = seg.count; // Records appended after this point are left for the next read
+            entered = true;
+        }
+        xSemaphoreGive(mutex);
+    }
+    return entered;
+}
@@ -0,0 +1,81 @@
+#ifndef SEGMENT_RING_H
+#define SEGMENT_RING_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#define SEGMENT_RING_MAX_SEGMENTS 10
+#define SEGMENT_RING_DIR_LEN      24
+
+// Bounded, append-only log on LittleFS: a directory of segment files used as a ring.
+// Records have a fixed size and start with a uint32_t timestamp, which the RAM index
+// uses to skip whole segments during range reads. When the head segment is full the
+// oldest one is truncated and becomes the new head; its generation is bumped so a
+// reader that was inside it notices. If the flash fills up first, the oldest segments
+// are dropped early. Not thread-safe: the owner serializes access.
+class SegmentRing {
+public:
+    struct Segment {
+        uint32_t firstTs;
+        uint32_t lastTs;
+        uint16_t count;
+        uint16_t generation;
+    };
+
+    void init(const char* dir, uint16_t recordSize, uint8_t segmentCount, uint16_t segmentRecords);
+    // Rebuilds the index from the files. Segments with a partial record are discarded.
+    void scan();
+    // Returns the number of records written.
+    size_t append(const uint8_t* records, size_t count);
+    // Fails if the segment has been recycled since generation was read.
+    bool read(uint8_t segment, uint16_t generation, uint16_t pos, uint8_t* out, uint16_t count);
+    // Drops every record; cursors still inside a segment stop there.
+    void clear();
+    uint32_t recordCount() const;
+
+    const Segment& segment(uint8_t index) const { return segments[index]; }
+    uint8_t head() const { return headIndex; }
+    uint8_t segmentCount() const { return count; }
+
+    // Reads the records of [from, to] oldest first, a block at a time. Takes the
+    // owner's mutex around each index access and flash read, so writers keep going
+    // while a long export streams out.
+    class Cursor {
+    public:
+        Cursor(SegmentRing* ring, SemaphoreHandle_t mutex, uint32_t from, uint32_t to, uint16_t blockRecords);
+        ~Cursor();
+        // Returns a pointer to the next record (valid until the next call), or nullptr at the end.
+        const uint8_t* next();
+
+    private:
+        SegmentRing* ring;
+        SemaphoreHandle_t mutex;
+        uint32_t from, to;
+        uint8_t* block;
+        uint16_t blockRecords;
+        uint16_t blockLen = 0;
+        uint16_t blockPos = 0;
+        uint8_t segmentsLeft;
+        uint8_t segment;
+        uint16_t generation = 0;
+        uint16_t recordPos = 0;
+        uint16_t recordEnd = 0;
+
+        bool enterNextSegment();
+    };
+
+private:
+    char dir[SEGMENT_RING_DIR_LEN];
+    uint16_t recordSize;
+    uint8_t count;
+    uint16_t segmentRecords;
+    uint8_t headIndex;
+    Segment segments[SEGMENT_RING_MAX_SEGMENTS];
+
+    String path(uint8_t segment) const;
+    size_t writeHead(const uint8_t* records, size_t count);
+    bool dropOldest();
+};
+
+#endif // SEGMENT_RING_H
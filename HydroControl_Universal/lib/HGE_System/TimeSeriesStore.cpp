@@ -0,0 +1,275 @@
+#include "TimeSeriesStore.h"
+#include <LittleFS.h>
+#include <rom/crc.h>
+#include "Clock.h"
+#include "Profiler.h"
+
+TimeSeriesStore::TimeSeriesStore() {
+    memset(series, 0, sizeof(series));
+}
+
+bool TimeSeriesStore::begin() {
+    mutex = xSemaphoreCreateMutex();
+
+    if (!LittleFS.exists(TS_ROOT)) LittleFS.mkdir(TS_ROOT);
+    File root = LittleFS.open(TS_ROOT);
+    if (!root || !root.isDirectory()) {
+        Serial.println("History: cannot open " TS_ROOT);
+        return false;
+    }
+
+    int restored = 0;
+    File entry = root.openNextFile();
+    while (entry) {
+        if (entry.isDirectory()) {
+            const char* name = strrchr(entry.name(), '/');
+            name = name ? name + 1 : entry.name();
+            int index = createSeries(name);
+            if (index >= 0) {
+                series[index].ring.scan();
+                restored++;
+            }
+        }
+        entry.close();
+        entry = root.openNextFile();
+    }
+    root.close();
+    Serial.printf("History: %d series indexed.\n", restored);
+
+    pendingQueue = xQueueCreate(TS_QUEUE_LEN, sizeof(PendingRecord));
+    xTaskCreate(Task_History_Writer, "HistoryWriter", Profiler::stackSize("HistoryWriter", 4096), this, 1, NULL);
+    return true;
+}
+
+bool TimeSeriesStore::record(const String& nodeId, uint8_t kind, uint8_t value, int16_t rssi) {
+    if (pendingQueue == NULL || nodeId.length() == 0) return false;
+
+    PendingRecord pending;
+    strncpy(pending.nodeId, nodeId.c_str(), TS_ID_LEN - 1);
+    pending.nodeId[TS_ID_LEN - 1] = '\0';
+    bool synced;
+    pending.rec.timestamp = Clock::now(synced);
+    pending.rec.flags = synced ? 0 : TS_FLAG_UPTIME;
+    pending.rec.kind = kind;
+    pending.rec.value = value;
+    pending.rec.rssi = rssi;
+    pending.rec.reserved = 0;
+    pending.rec.crc = recordCrc(pending.rec);
+
+    // Never wait: the caller is usually the LoRa handler.
+    if (xQueueSend(pendingQueue, &pending, 0) != pdPASS) {
+        dropped++;
+        return false;
+    }
+    return true;
+}
+
+std::shared_ptr<TimeSeriesQuery> TimeSeriesStore::query(const String& nodeId, uint32_t from, uint32_t to, uint32_t step) {
+    if (mutex == NULL) return nullptr;
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    int index = findSeries(nodeId.c_str());
+    xSemaphoreGive(mutex);
+    if (index < 0) return nullptr;
+    return std::make_shared<TimeSeriesQuery>(this, &series[index].ring, nodeId, from, to, step);
+}
+
+uint8_t TimeSeriesStore::valueFromStatus(const String& status) {
+    if (status.equalsIgnoreCase("EMPTY")) return TS_VALUE_EMPTY;
+    if (status.equalsIgnoreCase("OK")) return TS_VALUE_OK;
+    if (status.equalsIgnoreCase("FULL")) return TS_VALUE_FULL;
+    if (status.equalsIgnoreCase("ERROR")) return TS_VALUE_ERROR;
+    if (status.equalsIgnoreCase("ON")) return TS_VALUE_ON;
+    if (status.equalsIgnoreCase("OFF")) return TS_VALUE_OFF;
+    if (status.equalsIgnoreCase("DISCONNECTED")) return TS_VALUE_DISCONNECTED;
+    return TS_VALUE_UNKNOWN;
+}
+
+const char* TimeSeriesStore::statusFromValue(uint8_t value) {
+    switch (value) {
+        case TS_VALUE_EMPTY: return "EMPTY";
+        case TS_VALUE_OK: return "OK";
+        case TS_VALUE_FULL: return "FULL";
+        case TS_VALUE_ERROR: return "ERROR";
+        case TS_VALUE_ON: return "ON";
+        case TS_VALUE_OFF: return "OFF";
+        case TS_VALUE_DISCONNECTED: return "DISCONNECTED";
+        default: return "UNKNOWN";
+    }
+}
+
+// --- Index ---
+
+// Must be called with the mutex held (or before the writer task exists).
+int TimeSeriesStore::findSeries(const char* nodeId) {
+    for (int i = 0; i < TS_MAX_SERIES; i++) {
+        if (series[i].used && strcmp(series[i].nodeId, nodeId) == 0) return i;
+    }
+    return -1;
+}
+
+// Must be called with the mutex held (or before the writer task exists).
+int TimeSeriesStore::createSeries(const char* nodeId) {
+    if (strlen(nodeId) == 0 || strlen(nodeId) >= TS_ID_LEN) return -1;
+    for (int i = 0; i < TS_MAX_SERIES; i++) {
+        if (series[i].used) continue;
+        memset(&series[i], 0, sizeof(Series));
+        series[i].used = true;
+        strcpy(series[i].nodeId, nodeId);
+        String dir = String(TS_ROOT "/") + nodeId;
+        series[i].ring.init(dir.c_str(), sizeof(TsRecord), TS_SEGMENTS_PER_SERIES, TS_SEGMENT_RECORDS);
+        return i;
+    }
+    return -1;
+}
+
+// --- Writer ---
+
+void TimeSeriesStore::Task_History_Writer(void* pvParameters) {
+    TimeSeriesStore* self = (TimeSeriesStore*)pvParameters;
+    PendingRecord first;
+    for (;;) {
+        xQueuePeek(self->pendingQueue, &first, portMAX_DELAY);
+
+        // Let records accumulate so each segment is opened once per batch.
+        uint32_t startMs = millis();
+        while (millis() - startMs < TS_FLUSH_INTERVAL_MS && uxQueueMessagesWaiting(self->pendingQueue) < TS_QUEUE_LEN / 2) {
+            vTaskDelay(pdMS_TO_TICKS(200));
+        }
+
+        size_t count = 0;
+        while (count < TS_QUEUE_LEN && xQueueReceive(self->pendingQueue, &self->batch[count], 0) == pdPASS) {
+            count++;
+        }
+        self->flushBatch(count);
+    }
+}
+
+void TimeSeriesStore::flushBatch(size_t count) {
+    TsRecord group[TS_QUEUE_LEN];
+    for (size_t i = 0; i < count; i++) {
+        if (batch[i].nodeId[0] == '\0') continue; // Already written with an earlier group
+
+        // Gather this node's records, keeping their arrival order.
+        size_t groupLen = 0;
+        for (size_t j = i; j < count; j++) {
+            if (batch[j].nodeId[0] != '\0' && strcmp(batch[j].nodeId, batch[i].nodeId) == 0) {
+                group[groupLen++] = batch[j].rec;
+                if (j != i) batch[j].nodeId[0] = '\0';
+            }
+        }
+
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        int index = findSeries(batch[i].nodeId);
+        if (index < 0) index = createSeries(batch[i].nodeId);
+        size_t written = index >= 0 ? series[index].ring.append((const uint8_t*)group, groupLen) : 0;
+        xSemaphoreGive(mutex);
+        if (written < groupLen) {
+            dropped += groupLen - written;
+            Serial.printf("History: %u records dropped for %s\n", (unsigned)(groupLen - written), batch[i].nodeId);
+        }
+        batch[i].nodeId[0] = '\0';
+    }
+}
+
+uint16_t TimeSeriesStore::recordCrc(const TsRecord& rec) {
+    return crc16_le(0, (const uint8_t*)&rec, offsetof(TsRecord, crc));
+}
+
+// --- Query ---
+
+TimeSeriesQuery::TimeSeriesQuery(TimeSeriesStore* store, SegmentRing* ring, const String& nodeId, uint32_t from, uint32_t to, uint32_t step)
+    : store(store), cursor(ring, store->mutex, from, to, TS_QUERY_BLOCK), nodeId(nodeId), step(step) {
+    memset(buckets, 0, sizeof(buckets));
+}
+
+size_t TimeSeriesQuery::read(uint8_t* buffer, size_t maxLen) {
+    size_t written = 0;
+    while (written < maxLen) {
+        if (pendingPos < pending.length()) {
+            size_t n = min(maxLen - written, (size_t)(pending.length() - pendingPos));
+            memcpy(buffer + written, pending.c_str() + pendingPos, n);
+            pendingPos += n;
+            written += n;
+            continue;
+        }
+        pending = "";
+        pendingPos = 0;
+
+        switch (state) {
+            case HEADER:
+                pending = "{\"node\":\"" + nodeId + "\",\"step\":" + String(step) + ",\"points\":[";
+                state = ROWS;
+                break;
+            case ROWS:
+                if (!generateRows()) state = FOOTER;
+                break;
+            case FOOTER:
+                pending = "],\"dropped\":" + String(store->droppedRecords()) + "}";
+                state = DONE;
+                break;
+            case DONE:
+                return written;
+        }
+    }
+    return written;
+}
+
+// Generates at least one row unless the records are exhausted; returns false once everything is out.
+bool TimeSeriesQuery::generateRows() {
+    while (pending.length() == 0) {
+        const uint8_t* data = cursor.next();
+        if (data == nullptr) {
+            for (uint8_t kind = 1; kind < TS_KIND_COUNT; kind++) emitBucket(kind);
+            return pending.length() > 0;
+        }
+        TsRecord rec;
+        memcpy(&rec, data, sizeof(rec));
+        if (rec.crc != TimeSeriesStore::recordCrc(rec) || rec.kind == 0 || rec.kind >= TS_KIND_COUNT) continue;
+
+        if (step == 0) {
+            emitRow("[" + String(rec.timestamp) + "," + String(rec.kind) + "," + String(rec.value) + "," + String(rec.rssi) + "]");
+        } else {
+            addToBucket(rec);
+        }
+    }
+    return true;
+}
+
+void TimeSeriesQuery::addToBucket(const TsRecord& rec) {
+    uint32_t start = rec.timestamp - (rec.timestamp % step);
+    // Records are chronological: a new bucket closes every open one, keeping rows in time order.
+    for (uint8_t kind = 1; kind < TS_KIND_COUNT; kind++) {
+        if (buckets[kind].open && buckets[kind].start != start) emitBucket(kind);
+    }
+
+    Bucket& b = buckets[rec.kind];
+    if (!b.open) {
+        memset(&b, 0, sizeof(b));
+        b.open = true;
+        b.start = start;
+        b.minRssi = rec.rssi;
+        b.maxRssi = rec.rssi;
+    } else if (b.lastValue != rec.value) {
+        b.changes++;
+    }
+    int16_t rssi = rec.rssi;
+    b.lastValue = rec.value;
+    b.minRssi = min(b.minRssi, rssi);
+    b.maxRssi = max(b.maxRssi, rssi);
+    b.rssiSum += rssi;
+    b.count++;
+}
+
+void TimeSeriesQuery::emitBucket(uint8_t kind) {
+    Bucket& b = buckets[kind];
+    if (!b.open) return;
+    emitRow("[" + String(b.start) + "," + String(kind) + "," + String(b.lastValue) + "," + String(b.minRssi) + ","
+            + String(b.rssiSum / b.count) + "," + String(b.maxRssi) + "," + String(b.count) + "," + String(b.changes) + "]");
+    b.open = false;
+}
+
+void TimeSeriesQuery::emitRow(const String& row) {
+    if (!firstRow) pending += ",";
+    pending += row;
+    firstRow = false;
+}
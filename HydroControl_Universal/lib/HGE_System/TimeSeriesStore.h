@@ -0,0 +1,147 @@
+#ifndef TIME_SERIES_STORE_H
+#define TIME_SERIES_STORE_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <memory>
+#include "SegmentRing.h"
+#include "config.h"
+
+#define TS_ROOT               "/ts"
+#define TS_ID_LEN             16 // MAC-based IDs are 12 chars
+#define TS_QUERY_BLOCK        32 // Records read from flash per block while streaming a query
+
+// Record kinds
+#define TS_KIND_STATUS        1  // Status reported by the node (value = TS_VALUE_*, rssi of the uplink)
+#define TS_KIND_PUMP_CMD      2  // Pump command sent by the Centrale to a Wellguard (TS_VALUE_ON / TS_VALUE_OFF)
+#define TS_KIND_LEVEL         3  // Measured level of a reservoir with a continuous sensor (value = percent)
+#define TS_KIND_COUNT         4
+
+// Record values
+#define TS_VALUE_UNKNOWN      0
+#define TS_VALUE_EMPTY        1
+#define TS_VALUE_OK           2
+#define TS_VALUE_FULL         3
+#define TS_VALUE_ERROR        4
+#define TS_VALUE_ON           5
+#define TS_VALUE_OFF          6
+#define TS_VALUE_DISCONNECTED 7
+
+// Record flags
+#define TS_FLAG_UPTIME        (1 << 0) // Clock not set yet: timestamp is seconds since boot (see Clock)
+
+// Fixed-size record, CRC-protected so a torn write at the end of a segment is skipped.
+struct TsRecord {
+    uint32_t timestamp; // Unix seconds (see TS_FLAG_UPTIME)
+    uint8_t kind;
+    uint8_t value;
+    int16_t rssi;
+    uint8_t flags;
+    uint8_t reserved;
+    uint16_t crc;       // crc16 of the preceding bytes
+} __attribute__((packed));
+
+class TimeSeriesStore;
+
+// Streams one node's history as JSON, one block of records at a time, so a
+// query over days of data never needs more than a few hundred bytes of RAM.
+// With step > 0, records are grouped per kind into step-second buckets:
+//   [bucketStart, kind, lastValue, minRssi, avgRssi, maxRssi, count, changes]
+// With step == 0, raw records are returned: [timestamp, kind, value, rssi].
+class TimeSeriesQuery {
+public:
+    TimeSeriesQuery(TimeSeriesStore* store, SegmentRing* ring, const String& nodeId, uint32_t from, uint32_t to, uint32_t step);
+
+    // AwsResponseFiller-compatible: fills up to maxLen bytes, returns 0 when done.
+    size_t read(uint8_t* buffer, size_t maxLen);
+
+private:
+    struct Bucket {
+        bool open;
+        uint32_t start;
+        uint8_t lastValue;
+        int16_t minRssi;
+        int16_t maxRssi;
+        int32_t rssiSum;
+        uint16_t count;
+        uint16_t changes;
+    };
+
+    TimeSeriesStore* store;
+    SegmentRing::Cursor cursor;
+    String nodeId;
+    uint32_t step;
+
+    enum { HEADER, ROWS, FOOTER, DONE } state = HEADER;
+    String pending;       // Text generated but not sent yet
+    size_t pendingPos = 0;
+    bool firstRow = true;
+
+    Bucket buckets[TS_KIND_COUNT]; // Indexed by kind
+
+    bool generateRows();
+    void addToBucket(const TsRecord& rec);
+    void emitBucket(uint8_t kind);
+    void emitRow(const String& row);
+};
+
+// Append-only time-series store for node statuses and pump commands on LittleFS.
+//
+// Layout: one SegmentRing per node under /ts/<id>, TS_SEGMENTS_PER_SERIES segments of
+// at most TS_SEGMENT_RECORDS records each, so flash usage is bounded by
+// TS_MAX_SERIES * TS_SEGMENTS_PER_SERIES * TS_SEGMENT_RECORDS records. The rings'
+// RAM index keeps the time range of each segment, so a range query only opens
+// the segments it overlaps.
+//
+// record() only posts to a queue and never touches flash: a low-priority writer task
+// drains the queue every TS_FLUSH_INTERVAL_MS (or when it fills up) and appends each
+// node's records in a single write.
+class TimeSeriesStore {
+public:
+    TimeSeriesStore();
+
+    // Scans /ts to build the index and starts the writer task. LittleFS must be mounted.
+    bool begin();
+    // Non-blocking, callable from any task (not from an ISR). Returns false if the record was dropped.
+    bool record(const String& nodeId, uint8_t kind, uint8_t value, int16_t rssi);
+    // Returns nullptr if the node has no history.
+    std::shared_ptr<TimeSeriesQuery> query(const String& nodeId, uint32_t from, uint32_t to, uint32_t step);
+
+    uint32_t droppedRecords() const { return dropped; }
+
+    static uint8_t valueFromStatus(const String& status);
+    static const char* statusFromValue(uint8_t value);
+
+private:
+    friend class TimeSeriesQuery;
+
+    struct Series {
+        bool used;
+        char nodeId[TS_ID_LEN];
+        SegmentRing ring;
+    };
+
+    struct PendingRecord {
+        char nodeId[TS_ID_LEN];
+        TsRecord rec;
+    };
+
+    Series series[TS_MAX_SERIES];
+    QueueHandle_t pendingQueue = NULL;
+    SemaphoreHandle_t mutex = NULL;     // Guards the series table and the rings
+    volatile uint32_t dropped = 0;
+    PendingRecord batch[TS_QUEUE_LEN];  // Writer task only
+
+    int findSeries(const char* nodeId);
+    int createSeries(const char* nodeId);
+    void flushBatch(size_t count);
+
+    static uint16_t recordCrc(const TsRecord& rec);
+
+    static void Task_History_Writer(void* pvParameters);
+};
+
+#endif // TIME_SERIES_STORE_H
@@ -0,0 +1,28 @@
+#ifndef TRACE_FORMATS_H
+#define TRACE_FORMATS_H
+
+// Trace format table: X(name, level, format). The position in the table is the
+// format ID written to the binary log, so only append new entries (an entry that
+// is no longer used keeps its slot). scripts/decode_trace.py parses this file.
+//
+// Every argument is stored as 32 bits. Conversions: %u %d %x, and %I, which takes
+// two arguments (use TRACE_ID) and prints a 12-digit node ID.
+#define HGE_TRACE_FORMATS(X) \
+    X(TR_TRACE_DROPPED,       TRACE_LEVEL_WARN,  "Trace: %u records dropped") \
+    X(TR_LORA_TX,             TRACE_LEVEL_DEBUG, "LoRa TX type=%u len=%u") \
+    X(TR_LORA_RX,             TRACE_LEVEL_DEBUG, "LoRa RX type=%u rssi=%d from %I") \
+    X(TR_LORA_DECRYPT_FAILED, TRACE_LEVEL_WARN,  "LoRa decrypt failed, %u bytes") \
+    X(TR_LORA_PARSE_FAILED,   TRACE_LEVEL_WARN,  "LoRa JSON parse failed, %u bytes") \
+    X(TR_LORA_RX_QUEUE_FULL,  TRACE_LEVEL_WARN,  "LoRa RX queue full, frame dropped") \
+    X(TR_PUMP_REQUEST,        TRACE_LEVEL_INFO,  "Pump request on=%u from %I for well %I, outcome %u") \
+    X(TR_DOWNLINK_DROPPED,    TRACE_LEVEL_WARN,  "Downlink queue full for %I, oldest dropped") \
+    X(TR_NODE_TIMEOUT,        TRACE_LEVEL_INFO,  "Node %I timed out") \
+    X(TR_ACK_TIMEOUT,         TRACE_LEVEL_WARN,  "ACK timeout, retry %u/%u") \
+    X(TR_WELL_ASSIGNED,       TRACE_LEVEL_INFO,  "Well assignment %I, shared=%u") \
+    X(TR_RELAY_SET,           TRACE_LEVEL_INFO,  "Relay set to %u") \
+    X(TR_PUMP_HELD,           TRACE_LEVEL_INFO,  "Pump on=%u held by protection %u for %u ms") \
+    X(TR_LEVEL_CHANGED,       TRACE_LEVEL_INFO,  "Level sensor class %u at %d permille") \
+    X(TR_PUMP_TRIPPED,        TRACE_LEVEL_WARN,  "Pump tripped: fault %u, flow %u L/h") \
+    X(TR_MOTOR_TRIPPED,       TRACE_LEVEL_WARN,  "Motor tripped: fault %u at %u mA")
+
+#endif // TRACE_FORMATS_H
@@ -0,0 +1,200 @@
+#include "TraceLog.h"
+#include <LittleFS.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+static_assert((TRACE_RING_SIZE & (TRACE_RING_SIZE - 1)) == 0, "TRACE_RING_SIZE must be a power of two");
+static_assert(sizeof(TraceRecord) == 32, "Trace records are 32 bytes on flash");
+
+static const char* const traceFormats[] = {
+#define TRACE_X_STRING(name, level, format) format,
+    HGE_TRACE_FORMATS(TRACE_X_STRING)
+#undef TRACE_X_STRING
+};
+
+TraceLog::Slot TraceLog::ring[TRACE_RING_SIZE];
+std::atomic<uint32_t> TraceLog::writePos(0);
+uint32_t TraceLog::readPos = 0;
+std::atomic<uint32_t> TraceLog::dropped(0);
+volatile TraceSink TraceLog::sink = TRACE_SINK_SERIAL;
+
+void TraceLog::begin() {
+    for (uint32_t i = 0; i < TRACE_RING_SIZE; i++) {
+        ring[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    xTaskCreate(Task_Trace_Drain, "TraceDrain", 3072, NULL, 1, NULL);
+}
+
+void TraceLog::setSink(TraceSink newSink) {
+    sink = newSink;
+}
+
+// Hot path: no lock, no wait. Safe from ISRs.
+void TraceLog::writeRecord(TraceFormat format, const uint32_t* args, uint8_t argCount) {
+    uint32_t pos = writePos.load(std::memory_order_relaxed);
+    Slot* slot;
+    for (;;) {
+        slot = &ring[pos & (TRACE_RING_SIZE - 1)];
+        int32_t diff = (int32_t)(slot->sequence.load(std::memory_order_acquire) - pos);
+        if (diff == 0) {
+            if (writePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        } else if (diff < 0) {
+            // The drain task is a full ring behind.
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        } else {
+            pos = writePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    TraceRecord& rec = slot->record;
+    rec.timestampUs = micros();
+    rec.format = format;
+    rec.argCount = argCount;
+    rec.core = xPortGetCoreID();
+    memcpy(rec.args, args, argCount * sizeof(uint32_t));
+    slot->sequence.store(pos + 1, std::memory_order_release);
+}
+
+// Single consumer: only the drain task calls this.
+bool TraceLog::readRecord(TraceRecord& out) {
+    Slot& slot = ring[readPos & (TRACE_RING_SIZE - 1)];
+    // A producer that was preempted between claiming and filling its slot holds
+    // back the records behind it until it resumes.
+    if (slot.sequence.load(std::memory_order_acquire) != readPos + 1) return false;
+    out = slot.record;
+    slot.sequence.store(readPos + TRACE_RING_SIZE, std::memory_order_release);
+    readPos++;
+    return true;
+}
+
+static uint32_t parseHex(const char* id, size_t from, size_t to) {
+    if (id == nullptr) return 0;
+    uint32_t value = 0;
+    for (size_t i = 0; i < to && id[i] != '\0'; i++) {
+        if (i < from) continue;
+        char c = id[i];
+        value = (value << 4) | (isdigit(c) ? c - '0' : (toupper(c) - 'A' + 10) & 0xF);
+    }
+    return value;
+}
+
+uint32_t TraceLog::idHigh(const char* id) {
+    return parseHex(id, 0, 4);
+}
+
+uint32_t TraceLog::idLow(const char* id) {
+    return parseHex(id, 4, 12);
+}
+
+void TraceLog::printRecord(const TraceRecord& rec) {
+    char line[160];
+    int len = snprintf(line, sizeof(line), "[%lu.%06lu] ",
+                       (unsigned long)(rec.timestampUs / 1000000), (unsigned long)(rec.timestampUs % 1000000));
+    if (rec.format >= TR_FORMAT_COUNT) {
+        len += snprintf(line + len, sizeof(line) - len, "Unknown trace format %u", rec.format);
+    } else {
+        uint8_t arg = 0;
+        for (const char* p = traceFormats[rec.format]; *p && len < (int)sizeof(line) - 1; p++) {
+            if (*p != '%' || p[1] == '\0') {
+                line[len++] = *p;
+                continue;
+            }
+            char conv = *++p;
+            uint32_t a = arg < rec.argCount ? rec.args[arg] : 0;
+            uint32_t b = arg + 1 < rec.argCount ? rec.args[arg + 1] : 0;
+            switch (conv) {
+                case 'u': len += snprintf(line + len, sizeof(line) - len, "%lu", (unsigned long)a); arg++; break;
+                case 'd': len += snprintf(line + len, sizeof(line) - len, "%ld", (long)(int32_t)a); arg++; break;
+                case 'x': len += snprintf(line + len, sizeof(line) - len, "%lx", (unsigned long)a); arg++; break;
+                case 'I': len += snprintf(line + len, sizeof(line) - len, "%04lX%08lX", (unsigned long)a, (unsigned long)b); arg += 2; break;
+                default: line[len++] = conv; break;
+            }
+        }
+    }
+    len = min(len, (int)sizeof(line) - 2);
+    line[len++] = '\n';
+    Serial.write((const uint8_t*)line, len);
+}
+
+static File openTraceFile() {
+    File file = LittleFS.open(TRACE_FILE_PATH, FILE_APPEND);
+    if (file && file.size() == 0) {
+        TraceFileHeader header = { TRACE_FILE_MAGIC, 1, TR_FORMAT_COUNT, sizeof(TraceRecord) };
+        file.write((const uint8_t*)&header, sizeof(header));
+    }
+    return file;
+}
+
+void TraceLog::Task_Trace_Drain(void* pvParameters) {
+    static TraceRecord batch[TRACE_FILE_BATCH];
+    size_t batchLen = 0;
+    uint32_t lastFlushMs = millis();
+    uint32_t reportedDrops = 0;
+    TraceSink current = TRACE_SINK_SERIAL;
+    File file;
+
+    for (;;) {
+        TraceSink wanted = sink;
+        if (wanted != current) {
+            if (current == TRACE_SINK_FILE) {
+                if (batchLen > 0) file.write((const uint8_t*)batch, batchLen * sizeof(TraceRecord));
+                batchLen = 0;
+                file.close();
+            }
+            if (wanted == TRACE_SINK_FILE) {
+                file = openTraceFile();
+                if (!file) {
+                    Serial.println("Trace: cannot open " TRACE_FILE_PATH ", staying on Serial.");
+                    sink = wanted = TRACE_SINK_SERIAL;
+                }
+            }
+            current = wanted;
+        }
+
+        TraceRecord rec;
+        for (;;) {
+            if (!readRecord(rec)) {
+                // Drops happen while the ring is full: report them in-stream, after
+                // the records that filled it.
+                uint32_t drops = dropped.load(std::memory_order_relaxed);
+                if (drops == reportedDrops) break;
+                rec.timestampUs = micros();
+                rec.format = TR_TRACE_DROPPED;
+                rec.argCount = 1;
+                rec.core = xPortGetCoreID();
+                rec.args[0] = drops - reportedDrops;
+                reportedDrops = drops;
+            }
+
+            if (current == TRACE_SINK_SERIAL) {
+                printRecord(rec);
+            } else {
+                batch[batchLen++] = rec;
+                if (batchLen == TRACE_FILE_BATCH) {
+                    file.write((const uint8_t*)batch, sizeof(batch));
+                    batchLen = 0;
+                }
+            }
+        }
+
+        if (current == TRACE_SINK_FILE && millis() - lastFlushMs >= TRACE_FILE_FLUSH_MS) {
+            lastFlushMs = millis();
+            if (batchLen > 0) {
+                file.write((const uint8_t*)batch, batchLen * sizeof(TraceRecord));
+                batchLen = 0;
+            }
+            file.flush();
+            // Two files: the current one and the previous one.
+            if (file.size() >= TRACE_FILE_MAX_BYTES) {
+                file.close();
+                LittleFS.remove(TRACE_FILE_OLD);
+                LittleFS.rename(TRACE_FILE_PATH, TRACE_FILE_OLD);
+                file = openTraceFile();
+                if (!file) sink = TRACE_SINK_SERIAL;
+            }
+        }
+
+        vTaskDelay(pdMS_TO_TICKS(TRACE_DRAIN_PERIOD_MS));
+    }
+}
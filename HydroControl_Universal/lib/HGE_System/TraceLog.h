@@ -0,0 +1,107 @@
+#ifndef TRACE_LOG_H
+#define TRACE_LOG_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "config.h"
+
+#define TRACE_LEVEL_DEBUG 0
+#define TRACE_LEVEL_INFO  1
+#define TRACE_LEVEL_WARN  2
+#define TRACE_LEVEL_OFF   3
+
+#include "TraceFormats.h"
+
+#define TRACE_MAX_ARGS    6
+#define TRACE_FILE_PATH   "/trace.bin"
+#define TRACE_FILE_OLD    "/trace.old.bin"
+#define TRACE_FILE_MAGIC  0x52544748 // "HGTR"
+
+enum TraceFormat {
+#define TRACE_X_ENUM(name, level, format) name,
+    HGE_TRACE_FORMATS(TRACE_X_ENUM)
+#undef TRACE_X_ENUM
+    TR_FORMAT_COUNT
+};
+
+enum TraceFormatLevel {
+#define TRACE_X_LEVEL(name, level, format) name##_LEVEL = level,
+    HGE_TRACE_FORMATS(TRACE_X_LEVEL)
+#undef TRACE_X_LEVEL
+};
+
+// Records below TRACE_LEVEL compile to nothing, arguments included.
+#define TRACE(name, ...) \
+    do { if (name##_LEVEL >= TRACE_LEVEL) TraceLog::write(name, ##__VA_ARGS__); } while (0)
+
+// Expands to the two arguments of a %I conversion.
+#define TRACE_ID(id) TraceLog::idHigh(id), TraceLog::idLow(id)
+
+// 32-byte record, also the on-flash format (after a TraceFileHeader).
+struct TraceRecord {
+    uint32_t timestampUs; // micros(), wraps every ~71 min
+    uint16_t format;
+    uint8_t argCount;
+    uint8_t core;
+    uint32_t args[TRACE_MAX_ARGS];
+};
+
+struct TraceFileHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t formatCount;
+    uint32_t recordSize;
+};
+
+enum TraceSink {
+    TRACE_SINK_SERIAL, // Formatted on the device, one line per record
+    TRACE_SINK_FILE    // Raw records on LittleFS, decoded on a PC
+};
+
+// Deferred logging for hot paths. A call stores the format ID and raw arguments
+// in a lock-free ring (one CAS plus a 32-byte copy, no formatting, no UART) and
+// is safe from the LoRa ISRs and every task. A low-priority task drains the ring
+// to Serial or to a LittleFS file. When the ring is full, records are dropped and
+// counted rather than blocking the caller.
+class TraceLog {
+public:
+    static void begin();
+    // LittleFS must be mounted. Switching back to Serial closes the file.
+    static void setSink(TraceSink sink);
+
+    template <typename... Args>
+    static inline void write(TraceFormat format, Args... args) {
+        static_assert(sizeof...(Args) <= TRACE_MAX_ARGS, "Too many trace arguments");
+        const uint32_t values[] = { (uint32_t)args..., 0 };
+        writeRecord(format, values, sizeof...(Args));
+    }
+
+    // Node IDs are 12 hex digits (a MAC): packed into 48 bits.
+    static uint32_t idHigh(const char* id);
+    static uint32_t idLow(const char* id);
+    static uint32_t idHigh(const String& id) { return idHigh(id.c_str()); }
+    static uint32_t idLow(const String& id) { return idLow(id.c_str()); }
+
+    static uint32_t droppedRecords() { return dropped.load(std::memory_order_relaxed); }
+
+private:
+    // Bounded MPSC queue: a slot is free for the producer at position p when its
+    // sequence equals p, and ready for the consumer when it equals p + 1.
+    struct Slot {
+        std::atomic<uint32_t> sequence;
+        TraceRecord record;
+    };
+
+    static Slot ring[TRACE_RING_SIZE];
+    static std::atomic<uint32_t> writePos;
+    static uint32_t readPos;
+    static std::atomic<uint32_t> dropped;
+    static volatile TraceSink sink;
+
+    static void writeRecord(TraceFormat format, const uint32_t* args, uint8_t argCount);
+    static bool readRecord(TraceRecord& out);
+    static void printRecord(const TraceRecord& rec);
+    static void Task_Trace_Drain(void* pvParameters);
+};
+
+#endif // TRACE_LOG_H
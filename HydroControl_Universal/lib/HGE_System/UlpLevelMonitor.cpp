@@ -0,0 +1,92 @@
+#include "UlpLevelMonitor.h"
+#include <esp32/ulp.h>
+#include <driver/rtc_io.h>
+#include <soc/rtc.h>
+#include <soc/rtc_cntl_reg.h>
+#include <soc/rtc_io_reg.h>
+
+static void configureRtcInput(uint8_t pin) {
+    gpio_num_t gpio = (gpio_num_t)pin;
+    rtc_gpio_init(gpio);
+    rtc_gpio_set_direction(gpio, RTC_GPIO_MODE_INPUT_ONLY);
+    rtc_gpio_pulldown_dis(gpio);
+    rtc_gpio_pullup_en(gpio); // Les flotteurs tirent la broche à la masse
+}
+
+void UlpLevelMonitor::start(uint8_t highPin, uint8_t lowPin, uint32_t samplePeriodMs, uint16_t stableSamples, uint8_t currentBits) {
+    configureRtcInput(highPin);
+    configureRtcInput(lowPin);
+
+    const uint32_t highBit = RTC_GPIO_IN_NEXT_S + rtc_io_number_get((gpio_num_t)highPin);
+    const uint32_t lowBit = RTC_GPIO_IN_NEXT_S + rtc_io_number_get((gpio_num_t)lowPin);
+    const uint32_t threshold = stableSamples;
+
+    enum { LBL_COUNT, LBL_RESET, LBL_HALT };
+
+    const ulp_insn_t program[] = {
+        I_MOVI(R3, 0),                              // R3 = base of the data slots
+        // R0 = (high << 1) | low
+        I_RD_REG(RTC_GPIO_IN_REG, highBit, highBit),
+        I_LSHI(R2, R0, 1),
+        I_RD_REG(RTC_GPIO_IN_REG, lowBit, lowBit),
+        I_ORR(R0, R0, R2),
+        // Same as the last stable value: nothing to report
+        I_LD(R1, R3, SLOT_STABLE),
+        I_SUBR(R2, R0, R1),
+        M_BXZ(LBL_RESET),
+        // Same as the current candidate: keep counting
+        I_LD(R1, R3, SLOT_CANDIDATE),
+        I_SUBR(R2, R0, R1),
+        M_BXZ(LBL_COUNT),
+        // New candidate
+        I_ST(R0, R3, SLOT_CANDIDATE),
+        I_MOVI(R1, 1),
+        I_ST(R1, R3, SLOT_COUNT),
+        I_HALT(),
+
+        M_LABEL(LBL_COUNT),
+        I_LD(R1, R3, SLOT_COUNT),
+        I_ADDI(R1, R1, 1),
+        I_ST(R1, R3, SLOT_COUNT),
+        I_MOVR(R0, R1),
+        M_BL(LBL_HALT, threshold),                  // Not stable for long enough yet
+        I_LD(R0, R3, SLOT_CANDIDATE),
+        I_ST(R0, R3, SLOT_STABLE),
+        I_MOVI(R1, 0),
+        I_ST(R1, R3, SLOT_COUNT),
+        I_WAKE(),
+        M_LABEL(LBL_HALT),
+        I_HALT(),
+
+        M_LABEL(LBL_RESET),
+        I_MOVI(R1, 0),
+        I_ST(R1, R3, SLOT_COUNT),
+        I_ST(R0, R3, SLOT_CANDIDATE),               // A glitch that came back restarts the count
+        I_HALT(),
+    };
+
+    RTC_SLOW_MEM[SLOT_STABLE] = currentBits;
+    RTC_SLOW_MEM[SLOT_CANDIDATE] = currentBits;
+    RTC_SLOW_MEM[SLOT_COUNT] = 0;
+    RTC_SLOW_MEM[SLOT_MAGIC] = STATE_MAGIC;
+
+    size_t size = sizeof(program) / sizeof(ulp_insn_t);
+    ulp_process_macros_and_load(PROGRAM_START, program, &size);
+    ulp_set_wakeup_period(0, samplePeriodMs * 1000);
+    ulp_run(PROGRAM_START);
+}
+
+void UlpLevelMonitor::stop(uint8_t highPin, uint8_t lowPin) {
+    // Disable the ULP wake-up timer; the program halts after its current run.
+    CLEAR_PERI_REG_MASK(RTC_CNTL_STATE0_REG, RTC_CNTL_ULP_CP_SLP_TIMER_EN);
+    rtc_gpio_deinit((gpio_num_t)highPin);
+    rtc_gpio_deinit((gpio_num_t)lowPin);
+}
+
+bool UlpLevelMonitor::hasState() {
+    return (RTC_SLOW_MEM[SLOT_MAGIC] & 0xFFFF) == STATE_MAGIC;
+}
+
+uint8_t UlpLevelMonitor::stableBits() {
+    return RTC_SLOW_MEM[SLOT_STABLE] & 0x3;
+}
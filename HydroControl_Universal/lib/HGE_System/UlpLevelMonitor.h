@@ -0,0 +1,30 @@
+#ifndef ULP_LEVEL_MONITOR_H
+#define ULP_LEVEL_MONITOR_H
+
+#include <Arduino.h>
+
+// Samples two RTC-capable float switch inputs on the ULP co-processor while the
+// main cores are in deep sleep, and wakes them once a new combination has been
+// stable for a number of consecutive samples (debounce done on the ULP).
+//
+// State bits: bit1 = raw level of the high pin, bit0 = raw level of the low pin.
+class UlpLevelMonitor {
+public:
+    // Hands both pins over to the RTC domain and starts the ULP program.
+    // currentBits is the combination the main cores last acted on.
+    static void start(uint8_t highPin, uint8_t lowPin, uint32_t samplePeriodMs, uint16_t stableSamples, uint8_t currentBits);
+
+    // Stops sampling and gives both pins back to the digital GPIO matrix.
+    static void stop(uint8_t highPin, uint8_t lowPin);
+
+    // True if the RTC slow memory holds a state written by start() (i.e. after a deep-sleep wake-up).
+    static bool hasState();
+    static uint8_t stableBits();
+
+private:
+    enum Slot { SLOT_STABLE = 0, SLOT_CANDIDATE = 1, SLOT_COUNT = 2, SLOT_MAGIC = 3 };
+    static const uint32_t PROGRAM_START = 8;
+    static const uint16_t STATE_MAGIC = 0x4C56;
+};
+
+#endif // ULP_LEVEL_MONITOR_H
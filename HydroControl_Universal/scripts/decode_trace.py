@@ -0,0 +1,107 @@
+#!/usr/bin/env python3
+"""Decode a binary trace file written by TraceLog (/trace.bin, /api/trace).
+
+Usage: decode_trace.py trace.bin [trace.bin ...] [--formats lib/HGE_System/TraceFormats.h]
+
+Format strings are read from TraceFormats.h, so decode with the sources of the
+firmware that wrote the file. Files are decoded in the order given: pass
+trace.old.bin before trace.bin.
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+MAGIC = 0x52544748  # "HGTR"
+HEADER = struct.Struct("<IHHI")
+RECORD = struct.Struct("<IHBB6I")
+
+DEFAULT_FORMATS = os.path.join(os.path.dirname(__file__), "..", "lib", "HGE_System", "TraceFormats.h")
+
+
+def load_formats(path):
+    with open(path) as f:
+        text = f.read()
+    entries = re.findall(r'X\(\s*(\w+)\s*,\s*(\w+)\s*,\s*"((?:[^"\\]|\\.)*)"\s*\)', text)
+    return [(name, level.replace("TRACE_LEVEL_", ""), fmt) for name, level, fmt in entries]
+
+
+def render(fmt, args):
+    out = []
+    i = 0
+    arg = 0
+
+    def take():
+        nonlocal arg
+        value = args[arg] if arg < len(args) else 0
+        arg += 1
+        return value
+
+    while i < len(fmt):
+        c = fmt[i]
+        if c != "%" or i + 1 == len(fmt):
+            out.append(c)
+            i += 1
+            continue
+        conv = fmt[i + 1]
+        i += 2
+        if conv == "u":
+            out.append(str(take()))
+        elif conv == "d":
+            value = take()
+            out.append(str(value - (1 << 32) if value & 0x80000000 else value))
+        elif conv == "x":
+            out.append("%x" % take())
+        elif conv == "I":
+            high, low = take(), take()
+            out.append("%04X%08X" % (high, low))
+        else:
+            out.append(conv)
+    return "".join(out)
+
+
+def decode(path, formats, out):
+    with open(path, "rb") as f:
+        data = f.read()
+    if len(data) < HEADER.size:
+        print("%s: empty" % path, file=sys.stderr)
+        return
+    magic, version, format_count, record_size = HEADER.unpack_from(data, 0)
+    if magic != MAGIC or record_size != RECORD.size:
+        print("%s: not a trace file" % path, file=sys.stderr)
+        return
+    if format_count != len(formats):
+        print("%s: written with %d formats, TraceFormats.h has %d" % (path, format_count, len(formats)), file=sys.stderr)
+
+    # micros() wraps every ~71 minutes: unwrap, records are (nearly) in order.
+    base = 0
+    last = None
+    for offset in range(HEADER.size, len(data) - RECORD.size + 1, RECORD.size):
+        ts, fmt_id, argc, core, *args = RECORD.unpack_from(data, offset)
+        if last is not None and last - ts > 1 << 31:
+            base += 1 << 32
+        last = ts
+        t = (base + ts) / 1e6
+        if fmt_id < len(formats):
+            name, level, fmt = formats[fmt_id]
+            text = render(fmt, args[:argc])
+        else:
+            level, text = "?", "unknown format %d %s" % (fmt_id, args[:argc])
+        out.write("%12.6f %d %-5s %s\n" % (t, core, level, text))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("files", nargs="+")
+    parser.add_argument("--formats", default=DEFAULT_FORMATS)
+    args = parser.parse_args()
+
+    formats = load_formats(args.formats)
+    for path in args.files:
+        decode(path, formats, sys.stdout)
+
+
+if __name__ == "__main__":
+    main()
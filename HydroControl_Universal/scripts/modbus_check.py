@@ -0,0 +1,192 @@
+#!/usr/bin/env python3
+"""Poll the Modbus TCP server of a Centrale the way a PLC does.
+
+Usage: modbus_check.py <centrale-ip> [--rate 10] [--duration 30] [--coil SLOT on|off]
+
+- reads the header and the node slots, and prints them decoded;
+- checks the exception codes of a few invalid requests;
+- polls the whole register image at --rate Hz for --duration seconds and
+  reports the response times, busy answers (0x06) and the image sequence;
+- with --coil, writes a pump request for reservoir SLOT and waits for the
+  coil to follow (arbitration may refuse it: the outcome is only printed);
+- prints the hge_modbus_* and hge_node_list_wait_us lines of /metrics, to
+  compare the node list waits with and without polling.
+
+Exits with 1 if a check fails. Standard library only.
+"""
+
+import argparse
+import http.client
+import socket
+import struct
+import sys
+import time
+
+# ModbusServer.h
+MAP_VERSION = 1
+NODE_BASE = 16
+NODE_REGS = 16
+MAX_NODES = 16
+REGISTERS = NODE_BASE + MAX_NODES * NODE_REGS
+ROLES = {0: "-", 1: "CENTRALE", 2: "RESERVOIR", 3: "WELL"}
+STATUSES = {0: "UNKNOWN", 1: "EMPTY", 2: "OK", 3: "FULL", 4: "ERROR", 5: "ON", 6: "OFF", 7: "DISCONNECTED"}
+PUMP = {0: "off", 1: "on", 2: "?"}
+
+
+class ModbusError(Exception):
+    def __init__(self, function, code):
+        super().__init__("function 0x%02x: exception 0x%02x" % (function, code))
+        self.code = code
+
+
+class Client:
+    def __init__(self, host, port=502):
+        self.sock = socket.create_connection((host, port), timeout=5)
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.transaction = 0
+
+    def recv_exact(self, n):
+        data = b""
+        while len(data) < n:
+            chunk = self.sock.recv(n - len(data))
+            if not chunk:
+                raise ConnectionError("closed by the Centrale")
+            data += chunk
+        return data
+
+    def request(self, pdu):
+        self.transaction = (self.transaction + 1) & 0xFFFF
+        self.sock.sendall(struct.pack(">HHHB", self.transaction, 0, len(pdu) + 1, 1) + pdu)
+        transaction, protocol, length, _ = struct.unpack(">HHHB", self.recv_exact(7))
+        reply = self.recv_exact(length - 1)
+        if transaction != self.transaction or protocol != 0:
+            raise ConnectionError("bad MBAP header in reply")
+        if reply[0] & 0x80:
+            raise ModbusError(pdu[0], reply[1])
+        return reply
+
+    def read_registers(self, first, count, function=0x04):
+        reply = self.request(struct.pack(">BHH", function, first, count))
+        return list(struct.unpack(">%dH" % count, reply[2:2 + count * 2]))
+
+    def read_image(self):
+        image = []
+        for first in range(0, REGISTERS, 125):
+            image += self.read_registers(first, min(125, REGISTERS - first))
+        return image
+
+    def read_coils(self, first, count):
+        reply = self.request(struct.pack(">BHH", 0x01, first, count))
+        return [(reply[2 + i // 8] >> (i % 8)) & 1 for i in range(count)]
+
+    def write_coil(self, address, on):
+        self.request(struct.pack(">BHH", 0x05, address, 0xFF00 if on else 0))
+
+
+def print_nodes(image):
+    print("Map version %d, %d node(s), uptime %d s, sequence %d"
+          % (image[0], image[1], (image[2] << 16) | image[3], image[4]))
+    for slot in range(image[1]):
+        regs = image[NODE_BASE + slot * NODE_REGS:NODE_BASE + (slot + 1) * NODE_REGS]
+        node_id = b"".join(struct.pack(">H", r) for r in regs[6:12]).rstrip(b"\0").decode(errors="replace")
+        rssi = regs[3] - 0x10000 if regs[3] & 0x8000 else regs[3]
+        print("  slot %2d  %-12s %-9s %-12s pump %-3s rssi %4d  age %5d s  well slot %s"
+              % (slot, node_id, ROLES.get(regs[0], regs[0]), STATUSES.get(regs[1], regs[1]),
+                 PUMP.get(regs[2], regs[2]), rssi, regs[4], regs[5] - 1 if regs[5] else "-"))
+
+
+def expect_exception(client, pdu, code, what, failures):
+    try:
+        client.request(pdu)
+        failures.append("%s: no exception" % what)
+    except ModbusError as error:
+        if error.code != code:
+            failures.append("%s: exception 0x%02x, expected 0x%02x" % (what, error.code, code))
+
+
+def metrics(host):
+    conn = http.client.HTTPConnection(host, 80, timeout=10)
+    conn.request("GET", "/metrics")
+    body = conn.getresponse().read().decode()
+    conn.close()
+    return [line for line in body.splitlines()
+            if line.startswith("hge_modbus_") or line.startswith("hge_node_list_wait_us")]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("host")
+    parser.add_argument("--port", type=int, default=502)
+    parser.add_argument("--rate", type=float, default=10.0, help="polls per second")
+    parser.add_argument("--duration", type=int, default=30)
+    parser.add_argument("--coil", nargs=2, metavar=("SLOT", "STATE"))
+    args = parser.parse_args()
+    failures = []
+
+    for line in metrics(args.host):
+        print("  before: " + line)
+    client = Client(args.host, args.port)
+    image = client.read_image()
+    print_nodes(image)
+    if image[0] != MAP_VERSION:
+        failures.append("map version %d, expected %d" % (image[0], MAP_VERSION))
+    # Holding registers are the same image (uptime and sequence move meanwhile)
+    if client.read_registers(0, 2, function=0x03) != image[0:2]:
+        failures.append("holding registers differ from input registers")
+
+    expect_exception(client, bytes([0x2B, 0x0E, 0x01, 0x00]), 0x01, "unsupported function", failures)
+    expect_exception(client, struct.pack(">BHH", 0x04, REGISTERS - 1, 2), 0x02, "read past the image", failures)
+    expect_exception(client, struct.pack(">BHH", 0x04, 0, 0), 0x03, "read of 0 registers", failures)
+    expect_exception(client, struct.pack(">BHH", 0x05, 0, 0x1234), 0x03, "coil value other than FF00/0000", failures)
+
+    # PLC polling
+    times, busy = [], 0
+    first_sequence = image[4]
+    end = time.monotonic() + args.duration
+    next_poll = time.monotonic()
+    while time.monotonic() < end:
+        start = time.monotonic()
+        try:
+            image = client.read_image()
+            client.read_coils(0, MAX_NODES)
+        except ModbusError as error:
+            if error.code != 0x06:
+                raise
+            busy += 1
+        times.append(time.monotonic() - start)
+        next_poll += 1.0 / args.rate
+        time.sleep(max(0.0, next_poll - time.monotonic()))
+    times.sort()
+    print("%d polls (%d requests each): median %.1f ms, 99th %.1f ms, max %.1f ms, %d busy"
+          % (len(times), (REGISTERS + 124) // 125 + 1, times[len(times) // 2] * 1000,
+             times[int(len(times) * 0.99)] * 1000, times[-1] * 1000, busy))
+    sequence_steps = (image[4] - first_sequence) & 0xFFFF
+    print("Image sequence advanced by %d in %d s" % (sequence_steps, args.duration))
+    if sequence_steps == 0:
+        failures.append("register image not refreshed while polled")
+    if busy > len(times) // 100:
+        failures.append("more than 1%% of the polls answered busy")
+
+    if args.coil:
+        slot, on = int(args.coil[0]), args.coil[1].lower() in ("on", "1", "true")
+        try:
+            client.write_coil(slot, on)
+            deadline = time.monotonic() + 10
+            while client.read_coils(slot, 1)[0] != on and time.monotonic() < deadline:
+                time.sleep(0.5)
+            state = client.read_coils(slot, 1)[0]
+            print("Coil %d written %s, reads %s%s" % (slot, "on" if on else "off", "on" if state else "off",
+                                                    "" if state == on else " (refused or no answer from the well)"))
+        except ModbusError as error:
+            failures.append("coil %d: %s" % (slot, error))
+
+    client.sock.close()
+    for line in metrics(args.host):
+        print("  after:  " + line)
+    for failure in failures:
+        print("FAIL: " + failure)
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == "__main__":
+    main()
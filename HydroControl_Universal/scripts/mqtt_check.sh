@@ -0,0 +1,55 @@
+#!/bin/sh
+# Checks the MQTT bridge of a Centrale against a local broker.
+#
+# Usage: mqtt_check.sh <broker> <centrale-id> [<reservoir-id> <well-id>]
+#
+# Local broker (Mosquitto 2 only listens on localhost without a config):
+#   printf 'listener 1883\nallow_anonymous true\n' > /tmp/mosquitto.conf
+#   mosquitto -c /tmp/mosquitto.conf -v
+# then provision the Centrale with this machine's address as MQTT broker.
+#
+# 1. Retained topics: status must be "online" and every node must have a state.
+# 2. Commands: an unknown command must be refused; with a reservoir and its
+#    current well, cmd/assign is sent again (changes nothing) and must succeed.
+#
+# Offline queue, by hand: stop mosquitto, let a pump cycle happen (or send
+# requests from a reservoir), start it again with
+#   mosquitto_sub -h <broker> -t 'hge/<centrale-id>/event/#' -v
+# running: the events logged during the outage arrive first, in order.
+set -e
+
+BROKER=$1
+ROOT="hge/$2"
+[ -n "$BROKER" ] && [ -n "$2" ] || { echo "Usage: $0 <broker> <centrale-id> [<reservoir-id> <well-id>]"; exit 2; }
+FAIL=0
+
+echo "== Retained topics under $ROOT"
+RETAINED=$(mosquitto_sub -h "$BROKER" -t "$ROOT/status" -t "$ROOT/node/#" -v --retained-only -W 3 || true)
+echo "$RETAINED"
+echo "$RETAINED" | grep -q "^$ROOT/status online$" || { echo "FAIL: status is not online"; FAIL=1; }
+echo "$RETAINED" | grep -q "^$ROOT/node/" || { echo "FAIL: no node state"; FAIL=1; }
+
+# Sends $2 on cmd/$1 and prints the result.
+send_command() {
+    mosquitto_sub -h "$BROKER" -t "$ROOT/cmd/$1/result" -C 1 -W 5 > /tmp/mqtt_check_result &
+    SUB=$!
+    sleep 0.5
+    mosquitto_pub -h "$BROKER" -t "$ROOT/cmd/$1" -m "$2"
+    wait $SUB || true
+    cat /tmp/mqtt_check_result
+}
+
+echo "== Unknown command"
+RESULT=$(send_command nothing '{"reservoir":"X","ref":1}')
+echo "$RESULT"
+echo "$RESULT" | grep -q '"ok":false' || { echo "FAIL: unknown command not refused"; FAIL=1; }
+
+if [ -n "$3" ] && [ -n "$4" ]; then
+    echo "== cmd/assign $3 -> $4"
+    RESULT=$(send_command assign "{\"reservoir\":\"$3\",\"well\":\"$4\",\"ref\":2}")
+    echo "$RESULT"
+    echo "$RESULT" | grep -q '"ok":true' || { echo "FAIL: assign refused"; FAIL=1; }
+fi
+
+[ $FAIL -eq 0 ] && echo "OK"
+exit $FAIL
@@ -0,0 +1,162 @@
+#!/usr/bin/env python3
+"""Check the event stream (/events) of a Centrale against slow subscribers.
+
+Usage: sse_slow_clients.py <centrale-ip> [--slow 2] [--duration 30] [--max-clients 4]
+
+Opens one normal subscriber and --slow subscribers that never read (tiny
+receive buffer, so their TCP window closes after the first events), then:
+- fills the remaining slots and checks that one more connection gets 503;
+- samples the free heap (GET /api/profile) while the slow subscribers stall;
+- checks that the normal subscriber kept getting an "update" every ~2 s;
+- checks that the Centrale closed the slow subscribers (SSE_STALL_TIMEOUT_MS);
+- prints the hge_sse_* lines of /metrics.
+
+Exits with 1 if a check fails. Standard library only. The delivery logic
+itself (one event in flight, drop to latest, stall timeout) is covered on the
+host by test/test_sse_subscriber.cpp; this script checks it on a real board.
+"""
+
+import argparse
+import http.client
+import json
+import select
+import socket
+import sys
+import time
+
+UPDATE_INTERVAL_S = 2.0  # Task_SSE_Publisher
+
+
+def open_stream(host, rcvbuf=None):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    if rcvbuf:
+        sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, rcvbuf)
+    sock.settimeout(10)
+    sock.connect((host, 80))
+    sock.sendall(("GET /events HTTP/1.1\r\nHost: %s\r\nAccept: text/event-stream\r\n\r\n" % host).encode())
+    return sock
+
+
+def read_status(sock):
+    head = b""
+    while b"\r\n\r\n" not in head:
+        chunk = sock.recv(1)
+        if not chunk:
+            break
+        head += chunk
+    line = head.split(b"\r\n")[0].decode(errors="replace")
+    return int(line.split()[1]) if len(line.split()) > 1 else 0, head.split(b"\r\n\r\n", 1)[1:]
+
+
+class Reader:
+    """Normal subscriber: reads everything, time-stamps each event."""
+
+    def __init__(self, host):
+        self.sock = open_stream(host)
+        status, rest = read_status(self.sock)
+        if status != 200:
+            raise ConnectionError("/events answered %d" % status)
+        self.sock.setblocking(False)
+        self.buffer = rest[0] if rest else b""
+        self.arrivals = []
+
+    def poll(self):
+        try:
+            while True:
+                chunk = self.sock.recv(4096)
+                if not chunk:
+                    raise ConnectionError("normal subscriber closed by the Centrale")
+                self.buffer += chunk
+        except BlockingIOError:
+            pass
+        while b"\n\n" in self.buffer:
+            event, self.buffer = self.buffer.split(b"\n\n", 1)
+            if b"event: update" in event:
+                self.arrivals.append(time.monotonic())
+
+
+def closed_by_peer(sock):
+    """Drains what the slow subscriber left unread; True if the stream ended."""
+    sock.setblocking(False)
+    try:
+        while True:
+            if not select.select([sock], [], [], 0.5)[0]:
+                return False
+            if not sock.recv(65536):
+                return True
+    except (ConnectionResetError, BrokenPipeError):
+        return True
+
+
+def http_get(host, path):
+    conn = http.client.HTTPConnection(host, 80, timeout=10)
+    conn.request("GET", path)
+    body = conn.getresponse().read()
+    conn.close()
+    return body
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("host")
+    parser.add_argument("--slow", type=int, default=2)
+    parser.add_argument("--duration", type=int, default=30, help="seconds, more than SSE_STALL_TIMEOUT_MS")
+    parser.add_argument("--max-clients", type=int, default=4, help="SSE_MAX_CLIENTS")
+    args = parser.parse_args()
+    failures = []
+
+    heap_before = json.loads(http_get(args.host, "/api/profile"))["local"]["heap"]["free"]
+    reader = Reader(args.host)
+    slow = [open_stream(args.host, rcvbuf=1024) for _ in range(args.slow)]
+
+    # The remaining slots, then one connection too many.
+    fillers = []
+    for _ in range(args.max_clients - 1 - args.slow):
+        sock = open_stream(args.host)
+        read_status(sock)
+        fillers.append(sock)
+    extra = open_stream(args.host)
+    status, _ = read_status(extra)
+    extra.close()
+    print("Connection %d: HTTP %d" % (args.max_clients + 1, status))
+    if status != 503:
+        failures.append("connection over SSE_MAX_CLIENTS was not refused")
+    for sock in fillers:
+        sock.close()
+
+    lowest = heap_before
+    end = time.monotonic() + args.duration
+    next_sample = 0
+    while time.monotonic() < end:
+        reader.poll()
+        if time.monotonic() >= next_sample:
+            next_sample = time.monotonic() + UPDATE_INTERVAL_S
+            lowest = min(lowest, json.loads(http_get(args.host, "/api/profile"))["local"]["heap"]["free"])
+        time.sleep(0.1)
+
+    gaps = [b - a for a, b in zip(reader.arrivals, reader.arrivals[1:])]
+    worst = max(gaps) if gaps else float("inf")
+    print("Normal subscriber: %d updates, longest gap %.1f s" % (len(reader.arrivals), worst))
+    if worst > 2.5 * UPDATE_INTERVAL_S:
+        failures.append("normal subscriber stalled behind the slow ones")
+
+    closed = sum(closed_by_peer(sock) for sock in slow)
+    print("Slow subscribers closed by the Centrale: %d/%d" % (closed, len(slow)))
+    if closed != len(slow):
+        failures.append("slow subscribers still open after %d s" % args.duration)
+    print("Free heap: %d before, lowest %d during (%d bytes)" % (heap_before, lowest, heap_before - lowest))
+
+    for line in http_get(args.host, "/metrics").decode().splitlines():
+        if line.startswith("hge_sse_"):
+            print("  " + line)
+    for sock in slow:
+        sock.close()
+    reader.sock.close()
+
+    for failure in failures:
+        print("FAIL: " + failure)
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == "__main__":
+    main()
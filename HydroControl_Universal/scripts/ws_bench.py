@@ -0,0 +1,203 @@
+#!/usr/bin/env python3
+"""Compare the WebSocket API (/ws) of the Centrale with the HTTP API.
+
+Usage: ws_bench.py <centrale-ip> [--count 50] [--clients 2]
+
+Measures, from this machine:
+- round trip of WSM_PING and WSM_SET_NAME over one WebSocket, against
+  POST /api/set-name (one TCP connection per request, like the dashboard did);
+- heap used per subscribed WebSocket client, from GET /api/profile.
+
+The node renamed is the first one of the snapshot, with its current name, so
+the run changes nothing. Standard library only; the message format is
+documented in lib/HGE_Network/DashboardSocket.h.
+"""
+
+import argparse
+import base64
+import http.client
+import json
+import os
+import socket
+import struct
+import time
+
+WSM_SUBSCRIBE, WSM_ASSIGN, WSM_SET_NAME, WSM_PING = 0x01, 0x02, 0x03, 0x04
+WSM_ACK, WSM_NODE, WSM_SYNC = 0x80, 0x81, 0x82
+WS_TOPIC_NODES = 0x01
+STATUS = ["OK", "BAD_REQUEST", "UNKNOWN_NODE", "BUSY"]
+
+
+class Socket:
+    def __init__(self, host, port=80, path="/ws"):
+        self.sock = socket.create_connection((host, port), timeout=10)
+        key = base64.b64encode(os.urandom(16)).decode()
+        self.sock.sendall((
+            "GET %s HTTP/1.1\r\nHost: %s\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+            "Sec-WebSocket-Key: %s\r\nSec-WebSocket-Version: 13\r\n\r\n" % (path, host, key)).encode())
+        head = b""
+        while b"\r\n\r\n" not in head:
+            chunk = self.sock.recv(1)
+            if not chunk:
+                raise ConnectionError("closed during handshake")
+            head += chunk
+        if b" 101 " not in head.split(b"\r\n")[0]:
+            raise ConnectionError(head.split(b"\r\n")[0].decode())
+        self.seq = 0
+
+    def _recv_exact(self, n):
+        data = b""
+        while len(data) < n:
+            chunk = self.sock.recv(n - len(data))
+            if not chunk:
+                raise ConnectionError("closed")
+            data += chunk
+        return data
+
+    def send(self, payload, opcode=2):
+        mask = os.urandom(4)
+        header = bytes([0x80 | opcode])
+        if len(payload) < 126:
+            header += bytes([0x80 | len(payload)])
+        else:
+            header += bytes([0x80 | 126]) + struct.pack(">H", len(payload))
+        masked = bytes(b ^ mask[i % 4] for i, b in enumerate(payload))
+        self.sock.sendall(header + mask + masked)
+
+    def recv(self):
+        while True:
+            b0, b1 = self._recv_exact(2)
+            n = b1 & 0x7F
+            if n == 126:
+                n = struct.unpack(">H", self._recv_exact(2))[0]
+            elif n == 127:
+                n = struct.unpack(">Q", self._recv_exact(8))[0]
+            payload = self._recv_exact(n)
+            opcode = b0 & 0x0F
+            if opcode == 8:
+                code = struct.unpack(">H", payload[:2])[0] if len(payload) >= 2 else 0
+                raise ConnectionError("closed by the Centrale (%d %s)" % (code, payload[2:].decode(errors="replace")))
+            if opcode == 9:
+                self.send(payload, opcode=10)
+                continue
+            if opcode == 2:
+                return payload
+
+    def request(self, msg_type, body=b""):
+        """Sends a request and returns (status, handle_us, round_trip_s, other frames)."""
+        self.seq = (self.seq + 1) & 0xFFFF
+        start = time.perf_counter()
+        self.send(struct.pack("<BH", msg_type, self.seq) + body)
+        others = []
+        while True:
+            frame = self.recv()
+            if frame[0] == WSM_ACK and struct.unpack_from("<H", frame, 1)[0] == self.seq:
+                status, handle_us = struct.unpack_from("<BI", frame, 3)
+                return status, handle_us, time.perf_counter() - start, others
+            others.append(frame)
+
+    def subscribe(self):
+        """Returns the node snapshot as a list of dicts."""
+        status, _, _, frames = self.request(WSM_SUBSCRIBE, bytes([WS_TOPIC_NODES]))
+        nodes = [decode_node(f) for f in frames if f[0] == WSM_NODE]
+        while not frames or frames[-1][0] != WSM_SYNC:
+            frames.append(self.recv())
+            if frames[-1][0] == WSM_NODE:
+                nodes.append(decode_node(frames[-1]))
+        return nodes
+
+    def close(self):
+        self.sock.close()
+
+
+def string(s):
+    data = s.encode()
+    return bytes([len(data)]) + data
+
+
+def decode_node(frame):
+    pos = 7  # type, seq, now
+
+    def take_str():
+        nonlocal pos
+        n = frame[pos]
+        value = frame[pos + 1:pos + 1 + n].decode(errors="replace")
+        pos += 1 + n
+        return value
+
+    node = {"id": take_str(), "name": take_str()}
+    node["role"], node["rssi"] = struct.unpack_from("<Bh", frame, pos)
+    pos += 3
+    node["status"] = take_str()
+    node["lastSeen"] = struct.unpack_from("<I", frame, pos)[0]
+    pos += 4
+    node["assignedTo"] = take_str()
+    return node
+
+
+def http_set_name(host, node_id, name):
+    start = time.perf_counter()
+    conn = http.client.HTTPConnection(host, 80, timeout=10)
+    conn.request("POST", "/api/set-name", json.dumps({"id": node_id, "name": name}),
+                 {"Content-Type": "application/json"})
+    conn.getresponse().read()
+    conn.close()
+    return time.perf_counter() - start
+
+
+def heap_free(host):
+    conn = http.client.HTTPConnection(host, 80, timeout=10)
+    conn.request("GET", "/api/profile")
+    free = json.loads(conn.getresponse().read())["local"]["heap"]["free"]
+    conn.close()
+    return free
+
+
+def summary(label, seconds):
+    ms = sorted(s * 1000 for s in seconds)
+    pick = lambda p: ms[min(len(ms) - 1, int(len(ms) * p / 100))]
+    print("%-22s n=%-4d p50=%7.1f  p90=%7.1f  max=%7.1f ms" % (label, len(ms), pick(50), pick(90), ms[-1]))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("host")
+    parser.add_argument("--count", type=int, default=50)
+    parser.add_argument("--clients", type=int, default=2, help="extra sockets for the heap measurement (WS_MAX_CLIENTS)")
+    args = parser.parse_args()
+
+    ws = Socket(args.host)
+    nodes = ws.subscribe()
+    print("Snapshot: %d nodes" % len(nodes))
+    node_id, name = (nodes[0]["id"], nodes[0]["name"]) if nodes else ("BENCH", "")
+
+    ping, ws_cmd, handle, http_cmd = [], [], [], []
+    for _ in range(args.count):
+        ping.append(ws.request(WSM_PING)[2])
+        status, handle_us, rtt, _ = ws.request(WSM_SET_NAME, string(node_id) + string(name) + b"\0")
+        if status != 0:
+            print("SET_NAME: %s" % (STATUS[status] if status < len(STATUS) else status))
+        ws_cmd.append(rtt)
+        handle.append(handle_us / 1e6)
+        http_cmd.append(http_set_name(args.host, node_id, name))
+    summary("WS ping", ping)
+    summary("WS set-name", ws_cmd)
+    summary("  on the Centrale", handle)
+    summary("HTTP set-name", http_cmd)
+
+    before = heap_free(args.host)
+    extra = []
+    for _ in range(args.clients):
+        client = Socket(args.host)
+        client.subscribe()
+        extra.append(client)
+    time.sleep(2)
+    after = heap_free(args.host)
+    print("Heap per subscribed client: %d bytes (%d clients)" % ((before - after) // max(1, len(extra)), len(extra)))
+    for client in extra:
+        client.close()
+    ws.close()
+
+
+if __name__ == "__main__":
+    main()
@@ -30,9 +30,286 @@
 // Bouton pour le mode manuel (logique INPUT_PULLUP)
 #define AQUA_RESERV_BUTTON_PIN     32
 
+// Type de capteur de niveau. Avec un capteur continu, le niveau (0 à 1000 ‰) est
+// filtré (médiane puis moyenne exponentielle), converti par la table de calibration
+// et classé VIDE / OK / PLEIN avec hystérésis. Le mode basse consommation reste
+// réservé aux flotteurs (l'ULP ne surveille qu'eux).
+#define LEVEL_SENSOR_FLOATS        0 // Deux flotteurs (broches ci-dessus)
+#define LEVEL_SENSOR_ANALOG        1 // Sonde de pression 4-20 mA sur résistance, lue par l'ADC en DMA
+#define LEVEL_SENSOR_ULTRASONIC    2 // Télémètre à ultrasons UART (A02YYUW et compatibles)
+#define LEVEL_SENSOR_TYPE          LEVEL_SENSOR_FLOATS
+
+#define LEVEL_ADC_CHANNEL          ADC1_CHANNEL_6 // GPIO34 (ADC1 seulement : l'ADC2 est pris par le WiFi)
+#define LEVEL_ADC_SAMPLE_HZ        20000 // Échantillonnage DMA ; une trame est moyennée en un point
+#define LEVEL_UART_RX_PIN          16    // Sortie TX du télémètre
+#define LEVEL_UART_BAUD            9600
+
+#define LEVEL_SAMPLE_PERIOD_MS     100   // Un point filtré par période
+#define LEVEL_MEDIAN_WINDOW        7     // Points, 9 au plus : élimine les échos et pics isolés
+#define LEVEL_EMA_SHIFT            3     // Poids 1/8 de chaque nouveau point
+// Paires {valeur brute, niveau en ‰} par valeur brute croissante, 8 au plus. Brut :
+// comptes ADC (ici 4 mA et 20 mA sur 150 Ω) ou distance en mm pour les ultrasons
+// (ex. {{250, 1000}, {1750, 0}}). À relever sur site.
+#define LEVEL_CALIBRATION          { { 745, 0 }, { 3724, 1000 } }
+#define LEVEL_FAULT_MARGIN         150   // Au-delà de la table de plus que cela : lecture invalide (boucle coupée)
+#define LEVEL_EMPTY_BELOW          150   // ‰
+#define LEVEL_FULL_ABOVE           900   // ‰
+#define LEVEL_HYSTERESIS           20    // ‰
+#define LEVEL_FAULT_SAMPLES        10    // Lectures invalides consécutives avant le défaut capteur
+
 // -----------------------------------------------------------------
 // Brochage spécifique au rôle WELLGUARD_PRO
 // -----------------------------------------------------------------
 
 // Commande du relais de la pompe de puits
 #define WELLGUARD_RELAY_PIN        27
+
+// Protection de la pompe contre les cycles courts : une commande arrivée trop tôt
+// est retenue puis appliquée à l'échéance (la dernière reçue l'emporte). L'ACK
+// indique la raison et le délai (détail dans PumpProtection.h).
+#define WELLGUARD_MIN_ON_S         60    // Marche minimum avant un arrêt
+#define WELLGUARD_MIN_OFF_S        120   // Repos minimum avant un démarrage, compté aussi depuis la mise sous tension
+#define WELLGUARD_MAX_STARTS_PER_HOUR 6  // 0 : pas de limite
+
+// Débitmètre à impulsions (effet Hall) sur la sortie de la pompe, compté par le
+// périphérique PCNT. Une marche sans débit (puits à sec, tuyau cassé ou fermé)
+// arrête la pompe sur place ; elle est ensuite verrouillée WELLGUARD_FAULT_LOCKOUT_S
+// puis redémarre d'elle-même si la commande est toujours à la marche.
+#define WELLGUARD_FLOW_METER       0     // 1 : débitmètre installé
+#define WELLGUARD_FLOW_PIN         33
+#define WELLGUARD_FLOW_UL_PER_PULSE 2222 // Microlitres par impulsion (ici 450 impulsions/L), voir la fiche du capteur
+#define WELLGUARD_FLOW_PRIMING_S   30    // Après un démarrage, délai d'arrivée de l'eau avant la surveillance
+#define WELLGUARD_FLOW_MIN_LPH     60    // En dessous, la pompe est considérée sans débit
+#define WELLGUARD_NO_FLOW_S        15    // Durée sans débit avant l'arrêt
+#define WELLGUARD_FAULT_LOCKOUT_S  1800  // Verrouillage après un arrêt sur défaut
+
+// Pince ampèremétrique (transformateur de courant) sur une phase du moteur, lue par
+// l'ADC en DMA. Le courant efficace est calculé par bloc d'un nombre entier de
+// périodes secteur ; marche à sec, surcharge et rotor bloqué arrêtent la pompe en
+// quelques centaines de ms, avec le même verrouillage que le débitmètre.
+#define WELLGUARD_CURRENT_SENSOR   0     // 1 : pince installée
+#define WELLGUARD_CURRENT_ADC_CHANNEL ADC1_CHANNEL_0 // GPIO36 (VP), sortie de la pince polarisée à mi-tension
+#define WELLGUARD_CURRENT_SAMPLE_HZ 20000 // Minimum du DMA de l'ESP32
+#define WELLGUARD_CURRENT_BLOCK_MS 100   // 5 périodes à 50 Hz (6 à 60 Hz) par mesure
+#define WELLGUARD_CURRENT_UA_PER_COUNT 24000 // µA efficaces par compte ADC (ici SCT-013-030 : 30 A pour 1 V, atténuation 11 dB)
+#define WELLGUARD_MOTOR_RATED_MA   8000  // Courant nominal, plaque du moteur
+#define WELLGUARD_DRY_RUN_PCT      60    // En dessous, en % du nominal : marche à sec
+#define WELLGUARD_OVERLOAD_PCT     125   // Au-dessus : surcharge
+#define WELLGUARD_LOCKED_ROTOR_PCT 300   // Au-dessus une fois démarré : rotor bloqué, arrêt immédiat
+#define WELLGUARD_MOTOR_STARTUP_MS 1000  // Appel de courant au démarrage, non surveillé
+#define WELLGUARD_DRY_RUN_MS       500   // Durée de marche à sec avant l'arrêt
+#define WELLGUARD_OVERLOAD_MS      500   // Durée de surcharge avant l'arrêt
+
+// -----------------------------------------------------------------
+// Mode basse consommation (AQUA_RESERV_PRO)
+// -----------------------------------------------------------------
+// Activé au provisionnement. Les coeurs principaux dorment en veille profonde,
+// le co-processeur ULP surveille les flotteurs et réveille le module sur changement.
+
+#define LOW_POWER_HEARTBEAT_S      900  // Réveil périodique pour émettre un heartbeat
+#define LOW_POWER_RX_WINDOW_MS     1500 // Fenêtre de réception ouverte après chaque émission
+#define LOW_POWER_CPU_FREQ_MHZ     80   // Fréquence CPU pendant les phases d'éveil
+#define ULP_SAMPLE_PERIOD_MS       100  // Période d'échantillonnage des flotteurs par l'ULP
+
+// -----------------------------------------------------------------
+// Fenêtres de réception planifiées (balises de la Centrale)
+// -----------------------------------------------------------------
+// La Centrale émet une balise toutes les BEACON_PERIOD_MS. Un noeud synchronisé
+// coupe sa radio hors de la fenêtre de balise et de ses créneaux de réception
+// (un tous les PING_SLOT_PERIOD_MS). La Centrale garde les messages descendants
+// de chaque noeud jusqu'à son prochain créneau : ~4,3 s d'attente en moyenne,
+// ~16 s au pire autour d'une balise, où le décalage du créneau est tiré à nouveau
+// (test/test_rx_schedule.cpp).
+
+#define LORA_SPREADING_FACTOR      7      // Valeurs par défaut de la librairie LoRa
+#define LORA_BANDWIDTH_HZ          125000
+#define LORA_MAX_PAYLOAD_LEN       255    // Trame chiffrée la plus longue attendue
+#define LORA_BEACON_PAYLOAD_LEN    64     // Balise chiffrée
+
+#define BEACON_PERIOD_MS           32000
+#define BEACON_GUARD_MS            100    // Marge de part et d'autre de la balise attendue
+#define BEACON_LOSS_MAX            3      // Balises manquées avant retour en réception continue
+#define PING_SLOT_PERIOD_MS        8000   // Écart entre deux créneaux d'un noeud dans une période de balise
+#define PING_SLOT_TX_TOLERANCE_MS  40     // Retard toléré pour l'émission au début d'un créneau
+#define TX_RX_HOLD_MS              2500   // Réception maintenue après une émission (ACK, réponses)
+
+// -----------------------------------------------------------------
+// Démarrage (CENTRALE)
+// -----------------------------------------------------------------
+// Le Wi-Fi s'associe en arrière-plan pendant que LoRa et LittleFS démarrent.
+
+#define WIFI_CONNECT_TIMEOUT_MS    10000 // Au-delà, le démarrage est déclaré sans Wi-Fi (les tentatives continuent)
+#define NODE_SNAPSHOT_COALESCE_MS  5000  // Regroupe les modifications du registre avant écriture sur LittleFS
+
+// -----------------------------------------------------------------
+// Persistance NVS
+// -----------------------------------------------------------------
+// Les écritures Preferences passent par un cache en RAM et sont regroupées.
+
+#define PERSIST_FLUSH_DELAY_MS     3000 // Délai de regroupement avant écriture en flash
+#define PERSIST_MAX_ENTRIES        48   // Clés gardées en cache (noms de noeuds + configuration)
+
+// -----------------------------------------------------------------
+// Historique (CENTRALE)
+// -----------------------------------------------------------------
+// Statuts des noeuds et commandes de pompe enregistrés sur LittleFS, par noeud,
+// dans un anneau de segments. Occupation maximale :
+// TS_MAX_SERIES * TS_SEGMENTS_PER_SERIES * TS_SEGMENT_RECORDS * 12 octets (~288 Ko).
+// Historique et journal tiennent ensemble dans ~540 Ko de la partition LittleFS
+// (~1,4 Mo avec la table de partitions par défaut de l'esp32dev), à côté du dashboard
+// et des autres fichiers. Si la flash est pleine malgré tout, les plus anciens
+// segments sont abandonnés en avance.
+
+#define TS_MAX_SERIES              16    // Noeuds suivis (MAX_NODES)
+#define TS_SEGMENTS_PER_SERIES     4     // Le plus ancien segment est recyclé quand le dernier est plein
+#define TS_SEGMENT_RECORDS         384   // ~13 h par segment avec un heartbeat toutes les 2 min
+#define TS_QUEUE_LEN               64    // Enregistrements en attente d'écriture
+#define TS_FLUSH_INTERVAL_MS       10000 // Regroupement des écritures en flash
+#define NTP_SERVER                 "pool.ntp.org" // Horodatage de l'historique et du journal
+
+// -----------------------------------------------------------------
+// Journal des pompes (CENTRALE)
+// -----------------------------------------------------------------
+// Demandes arbitrées, acquittements et marches/arrêts de pompe, 16 octets par
+// événement. JOURNAL_SEGMENTS * JOURNAL_SEGMENT_RECORDS * 16 octets (~256 Ko),
+// soit environ trois mois à quelques dizaines de cycles de pompe par jour.
+
+#define JOURNAL_SEGMENTS           8
+#define JOURNAL_SEGMENT_RECORDS    2048
+#define JOURNAL_QUEUE_LEN          32
+#define JOURNAL_FLUSH_DELAY_MS     5000  // Regroupe les événements d'un même cycle de pompe
+#define PUMP_ACK_TIMEOUT_MS        30000 // Au-delà, la commande est journalisée sans ACK (retries et créneaux compris)
+
+// -----------------------------------------------------------------
+// Arbitrage des puits (CENTRALE)
+// -----------------------------------------------------------------
+// Règles par puits (temps de marche et de repos minimum, seuil de démarrage)
+// et puits de secours par réservoir, réglables depuis le tableau de bord et
+// conservés en NVS (règles décrites dans ArbitrationEngine.h).
+
+#define ARBITRATION_TICK_MS        1000  // Fin des reports (marche/repos minimum) vérifiée à ce rythme
+
+// -----------------------------------------------------------------
+// Prévision de remplissage (CENTRALE)
+// -----------------------------------------------------------------
+// La Centrale apprend, pour chaque réservoir, le temps de remplissage et de
+// vidange entre ses deux flotteurs, et en déduit l'heure à laquelle il sera vide.
+// Un réservoir sur un puits arbitré est rempli par anticipation : en heures
+// creuses avec un large horizon, en heures pleines seulement juste avant, un
+// démarrage à la fois pour étaler la charge (détail dans FillEstimator.h).
+
+#define FILL_TOP_UP                1     // 0 : prévision seule, aucun remplissage anticipé
+#define FILL_PLAN_PERIOD_S         10
+#define FILL_PEAK_LEAD_MIN         10    // Heures pleines : remplir si vide dans moins de N min
+#define FILL_OFFPEAK_LEAD_MIN      180   // Heures creuses : horizon élargi
+#define FILL_OFFPEAK_START_MIN     (22 * 60) // Heures creuses, en minutes depuis minuit (heure locale)
+#define FILL_OFFPEAK_END_MIN       (6 * 60)
+#define FILL_UTC_OFFSET_MIN        60    // Heure locale = UTC + N min (pas de changement d'heure automatique)
+#define FILL_STAGGER_S             600   // Délai minimum entre deux remplissages anticipés sur un même puits
+#define FILL_MAX_RUNNING_WELLS     2     // Pas de remplissage anticipé au-delà de N puits en marche
+
+// -----------------------------------------------------------------
+// Métriques
+// -----------------------------------------------------------------
+// La Centrale expose /metrics (format Prometheus). Les noeuds envoient un résumé
+// de leurs compteurs par LoRa, repris dans /metrics avec le label node.
+
+#define METRICS_DIGEST_PERIOD_MS   1800000 // Résumé envoyé toutes les 30 min (modes alimentés)
+#define METRICS_DIGEST_EVERY_WAKES 4       // Mode basse consommation : un réveil sur N (~1 h)
+
+// -----------------------------------------------------------------
+// Trace
+// -----------------------------------------------------------------
+// Traces des chemins critiques (émission/réception LoRa, arbitrage des pompes) :
+// enregistrements binaires différés, formatés par une tâche de faible priorité.
+// Les formats sont dans lib/HGE_System/TraceFormats.h ; les fichiers binaires
+// se décodent avec scripts/decode_trace.py.
+
+#define TRACE_LEVEL                TRACE_LEVEL_DEBUG // Niveaux inférieurs supprimés à la compilation (DEBUG, INFO, WARN, OFF)
+#define TRACE_RING_SIZE            256   // Enregistrements en attente (puissance de 2, 32 octets chacun)
+#define TRACE_DRAIN_PERIOD_MS      50
+#define TRACE_TO_FILE              0     // 1 : la Centrale écrit la trace sur LittleFS au lieu du port série
+#define TRACE_FILE_BATCH           32    // Enregistrements par écriture en flash
+#define TRACE_FILE_FLUSH_MS        5000
+#define TRACE_FILE_MAX_BYTES       65536 // Au-delà, le fichier devient /trace.old.bin
+
+// -----------------------------------------------------------------
+// Latence commande -> relais
+// -----------------------------------------------------------------
+// Chaque commande de pompe déclenchée par un réservoir porte un identifiant de
+// trace ("tr") ; chaque noeud ajoute ses durées locales ("d") et la Centrale
+// assemble la décomposition (GET /api/latency).
+
+#define LATENCY_SAMPLES            64    // Dernières commandes tracées gardées pour les percentiles
+
+// -----------------------------------------------------------------
+// Profileur
+// -----------------------------------------------------------------
+// Piles, CPU par tâche et tas : commande série "profile", GET /api/profile
+// (CENTRALE), message DIAGNOSTICS envoyé avec le résumé des métriques.
+// Un build de calibration (-D HGE_STACK_CALIBRATION) double les piles et
+// enregistre en NVS la taille mesurée de chaque tâche, reprise ensuite par
+// les builds normaux.
+
+#define PROFILER_SAMPLE_MS         10000
+#define PROFILER_MIN_STACK         1536  // Plancher des tailles calibrées (octets)
+#define PROFILER_STACK_MARGIN_PCT  25    // Marge ajoutée au pic mesuré
+
+// -----------------------------------------------------------------
+// API WebSocket (CENTRALE)
+// -----------------------------------------------------------------
+// Messages binaires sur /ws : abonnement, deltas de noeuds, commandes et
+// acquittements sur une seule connexion (format dans DashboardSocket.h).
+// scripts/ws_bench.py compare la latence et le tas par client avec l'API HTTP.
+
+#define WS_MAX_CLIENTS             4     // Connexions au-delà refusées (code 1013)
+#define WS_MAX_NODES               16    // MAX_NODES
+#define WS_PUBLISH_INTERVAL_MS     250   // Regroupement des deltas de noeuds
+#define WS_STALL_TIMEOUT_MS        10000 // Client bloqué plus longtemps : fermé
+#define WS_COMMAND_QUEUE_LEN       8
+
+// -----------------------------------------------------------------
+// Flux d'événements SSE (CENTRALE)
+// -----------------------------------------------------------------
+// /events envoie l'état complet des noeuds : un abonné lent ne reçoit que le
+// plus récent, jamais une file d'anciens états (voir EventStream.h).
+// scripts/sse_slow_clients.py simule des abonnés lents contre une Centrale.
+
+#define SSE_MAX_CLIENTS            4     // Connexions au-delà refusées (503)
+#define SSE_STALL_TIMEOUT_MS       10000 // Abonné sans acquittement plus longtemps : fermé
+
+// -----------------------------------------------------------------
+// Pont MQTT (CENTRALE)
+// -----------------------------------------------------------------
+// États des noeuds (retenus), événements du journal de pompe et commandes
+// sur MQTT_TOPIC_ROOT/<id Centrale>/ (détail dans MqttBridge.h). Le broker est
+// saisi au provisionnement ; sans broker le pont reste arrêté.
+// scripts/mqtt_check.sh vérifie le pont contre un Mosquitto local.
+
+#define MQTT_TOPIC_ROOT            "hge"
+#define MQTT_DEFAULT_PORT          1883
+#define MQTT_LINGER_MS             500   // Regroupement des publications
+#define MQTT_POLL_MS               100
+#define MQTT_RECONNECT_MS          5000
+#define MQTT_KEEPALIVE_S           30
+#define MQTT_BUFFER_SIZE           512   // Plus grand message (sujet compris)
+#define MQTT_EVENT_QUEUE_LEN       16
+// File hors ligne : MQTT_SPOOL_SEGMENTS * MQTT_SPOOL_SEGMENT_RECORDS événements
+// de 240 octets (~60 Ko), les plus anciens abandonnés quand elle est pleine.
+#define MQTT_SPOOL_SEGMENTS        4
+#define MQTT_SPOOL_SEGMENT_RECORDS 64
+
+// -----------------------------------------------------------------
+// Serveur Modbus TCP (CENTRALE)
+// -----------------------------------------------------------------
+// Registres des noeuds (niveau, pompe, RSSI, âge, affectation) pour les
+// automates, et une bobine par réservoir pour demander la pompe
+// (plan d'adressage dans ModbusServer.h).
+// scripts/modbus_check.py interroge une Centrale comme le ferait un automate.
+
+#define MODBUS_PORT                502
+#define MODBUS_MAX_CLIENTS         4     // Connexions au-delà refusées
+#define MODBUS_REFRESH_MS          100   // Mise à jour des registres, tant qu'un client est connecté
+#define MODBUS_IDLE_TIMEOUT_S      60    // Client sans requête plus longtemps : fermé
+#define MODBUS_COMMAND_QUEUE_LEN   8
+#define MODBUS_COILS_WRITABLE      1     // 0 : bobines en lecture seule (aucune commande de pompe)
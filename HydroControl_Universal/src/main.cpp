@@ -1,6 +1,10 @@
 #include <Arduino.h>
 #include "RoleManager.h"
 #include "WifiProvisioning.h"
+#include "Persistence.h"
+#include "TraceLog.h"
+#include "Profiler.h"
+#include "Benchmarks.h"
 #include "CentraleLogic.h"
 #include "AquaReservLogic.h"
 #include "WellguardLogic.h"
@@ -19,7 +23,16 @@ void setup() {
 
   Serial.println("Booting HydroControl-GE Universal Firmware v3.0.0...");
 
+  TraceLog::begin();
   currentRole = roleManager.loadRole();
+  Persistence::begin();
+  Profiler::begin();
+
+#ifdef HGE_BENCHMARKS
+  runNodeMetadataBenchmark(100);
+  runLevelFilterBenchmark(1000);
+  runCurrentMonitorBenchmark(100);
+#endif
 
   switch (currentRole) {
     case UNPROVISIONED:
@@ -0,0 +1,37 @@
+#ifndef TEST_CHECK_H
+#define TEST_CHECK_H
+
+#include <stdio.h>
+
+// Minimal checks for the host tests: a failed check is printed and counted, the
+// test keeps going, and TEST_RESULT() gives main() its exit code.
+static int testFailures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            testFailures++; \
+        } \
+    } while (0)
+
+#define CHECK_EQ(actual, expected) \
+    do { \
+        long long checkActual = (long long)(actual); \
+        long long checkExpected = (long long)(expected); \
+        if (checkActual != checkExpected) { \
+            printf("%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual, checkActual, checkExpected); \
+            testFailures++; \
+        } \
+    } while (0)
+
+#define RUN_TEST(test) \
+    do { \
+        int failuresBefore = testFailures; \
+        test(); \
+        printf("%s %s\n", testFailures == failuresBefore ? "  ok  " : "  FAIL", #test); \
+    } while (0)
+
+#define TEST_RESULT() (testFailures == 0 ? 0 : 1)
+
+#endif // TEST_CHECK_H
@@ -0,0 +1,306 @@
+// Shared-well arbitration of the Centrale: rule priorities, well online/offline
+// gating and the fallback to a backup well.
+#include "ArbitrationEngine.h"
+#include "TestCheck.h"
+
+// Node slots: reservoirs 0 and 1, wells 2 (primary) and 3 (backup)
+static const uint8_t R0 = 0;
+static const uint8_t R1 = 1;
+static const uint8_t PRIMARY = 2;
+static const uint8_t BACKUP = 3;
+
+static ArbDecision decisions[ARB_MAX_NODES];
+
+static uint8_t evaluate(ArbitrationEngine& engine, uint32_t nowMs) {
+    return engine.evaluate(nowMs, decisions, ARB_MAX_NODES);
+}
+
+// Two reservoirs sharing the primary well, both online
+static void shareWell(ArbitrationEngine& engine, uint32_t nowMs) {
+    engine.link(R0, PRIMARY, ARB_DEFAULT_WEIGHT);
+    engine.link(R1, PRIMARY, ARB_DEFAULT_WEIGHT);
+    engine.setWellOnline(PRIMARY, true, nowMs);
+}
+
+static void testSingleReservoirIsDirect() {
+    ArbitrationEngine engine;
+    engine.link(R0, PRIMARY, ARB_DEFAULT_WEIGHT);
+    CHECK(!engine.needsArbitration(PRIMARY));
+
+    engine.setRule(PRIMARY, ArbitrationEngine::defaultRule());
+    CHECK(!engine.needsArbitration(PRIMARY));
+
+    ArbWellRule rule = ArbitrationEngine::defaultRule();
+    rule.minRunMs = 60000;
+    engine.setRule(PRIMARY, rule);
+    CHECK(engine.needsArbitration(PRIMARY));
+}
+
+static void testSharedWellRunsWhileAnyDemand() {
+    ArbitrationEngine engine;
+    shareWell(engine, 0);
+    CHECK(engine.needsArbitration(PRIMARY));
+    CHECK_EQ(evaluate(engine, 0), 0);
+
+    engine.setDemand(R0, true);
+    CHECK_EQ(evaluate(engine, 0), 1);
+    CHECK(decisions[0].command && decisions[0].on);
+    CHECK_EQ(decisions[0].well, PRIMARY);
+    CHECK_EQ(decisions[0].reason, ARB_DEMAND);
+
+    engine.setDemand(R1, true);
+    engine.setDemand(R0, false);
+    CHECK_EQ(evaluate(engine, 0), 0);
+    CHECK_EQ(engine.reason(PRIMARY), ARB_STILL_NEEDED);
+
+    engine.setDemand(R1, false);
+    CHECK_EQ(evaluate(engine, 0), 1);
+    CHECK(decisions[0].command && !decisions[0].on);
+    CHECK_EQ(decisions[0].reason, ARB_NO_DEMAND);
+    CHECK_EQ(engine.reason(PRIMARY), ARB_IDLE);
+}
+
+static void testFullReservoirBlocksStart() {
+    ArbitrationEngine engine;
+    shareWell(engine, 0);
+
+    engine.setLevel(R1, ARB_LEVEL_FULL);
+    engine.setDemand(R0, true);
+    CHECK_EQ(evaluate(engine, 0), 1);
+    CHECK(!decisions[0].command);
+    CHECK_EQ(decisions[0].reason, ARB_RESERVOIR_FULL);
+    CHECK(!engine.running(PRIMARY));
+    // Refusal logged once, not on every call
+    CHECK_EQ(evaluate(engine, 0), 0);
+
+    engine.setLevel(R1, ARB_LEVEL_OK);
+    CHECK_EQ(evaluate(engine, 0), 1);
+    CHECK(decisions[0].command && decisions[0].on);
+
+    // Without fullIsLimit a full reservoir no longer matters
+    ArbitrationEngine unlimited;
+    shareWell(unlimited, 0);
+    ArbWellRule rule = ArbitrationEngine::defaultRule();
+    rule.fullIsLimit = false;
+    unlimited.setRule(PRIMARY, rule);
+    unlimited.setLevel(R1, ARB_LEVEL_FULL);
+    unlimited.setDemand(R0, true);
+    CHECK_EQ(evaluate(unlimited, 0), 1);
+    CHECK(decisions[0].command && decisions[0].on);
+}
+
+static void testStartScoreThreshold() {
+    ArbitrationEngine engine;
+    engine.link(R0, PRIMARY, 1);
+    engine.link(R1, PRIMARY, 1);
+    engine.setWellOnline(PRIMARY, true, 0);
+    ArbWellRule rule = ArbitrationEngine::defaultRule();
+    rule.startScore = 2;
+    engine.setRule(PRIMARY, rule);
+
+    engine.setDemand(R0, true);
+    CHECK_EQ(evaluate(engine, 5), 1);
+    CHECK(!decisions[0].command);
+    CHECK_EQ(decisions[0].reason, ARB_BELOW_THRESHOLD);
+    CHECK_EQ(engine.score(PRIMARY), 1);
+
+    engine.setDemand(R1, true);
+    CHECK_EQ(evaluate(engine, 5), 1);
+    CHECK(decisions[0].command && decisions[0].on);
+    CHECK_EQ(engine.score(PRIMARY), 2);
+
+    // Below the threshold again, but any demand keeps it running
+    engine.setDemand(R1, false);
+    CHECK_EQ(evaluate(engine, 5), 0);
+    CHECK(engine.running(PRIMARY));
+}
+
+static void testMinRestAndMinRunDefer() {
+    ArbitrationEngine engine;
+    shareWell(engine, 0);
+    ArbWellRule rule = ArbitrationEngine::defaultRule();
+    rule.minRunMs = 60000;
+    rule.minRestMs = 120000;
+    engine.setRule(PRIMARY, rule);
+
+    engine.setDemand(R0, true);
+    CHECK_EQ(evaluate(engine, 1000), 1);
+    CHECK(decisions[0].command && decisions[0].on);
+
+    // Stop deferred to the end of the minimum run
+    engine.setDemand(R0, false);
+    CHECK_EQ(evaluate(engine, 2000), 1);
+    CHECK(!decisions[0].command);
+    CHECK_EQ(decisions[0].reason, ARB_MIN_RUN);
+    CHECK_EQ(engine.wakeAtMs(PRIMARY), 61000);
+    CHECK(!engine.due(60999));
+    CHECK(engine.due(61000));
+    CHECK_EQ(evaluate(engine, 61000), 1);
+    CHECK(decisions[0].command && !decisions[0].on);
+
+    // Start deferred to the end of the minimum rest
+    engine.setDemand(R0, true);
+    CHECK_EQ(evaluate(engine, 62000), 1);
+    CHECK(!decisions[0].command);
+    CHECK_EQ(decisions[0].reason, ARB_MIN_REST);
+    CHECK_EQ(engine.wakeAtMs(PRIMARY), 181000);
+    CHECK(!engine.due(180999));
+    CHECK_EQ(evaluate(engine, 181000), 1);
+    CHECK(decisions[0].command && decisions[0].on);
+    CHECK_EQ(engine.wakeAtMs(PRIMARY), 0);
+}
+
+static void testOverflowCutsMinRun() {
+    ArbitrationEngine engine;
+    engine.link(R0, PRIMARY, ARB_DEFAULT_WEIGHT);
+    engine.setWellOnline(PRIMARY, true, 0);
+    ArbWellRule rule = ArbitrationEngine::defaultRule();
+    rule.minRunMs = 600000;
+    engine.setRule(PRIMARY, rule);
+
+    engine.setDemand(R0, true);
+    CHECK_EQ(evaluate(engine, 1), 1);
+    CHECK(decisions[0].on);
+
+    engine.setDemand(R0, false);
+    engine.setLevel(R0, ARB_LEVEL_FULL);
+    CHECK_EQ(evaluate(engine, 2), 1);
+    CHECK(decisions[0].command && !decisions[0].on);
+    CHECK_EQ(decisions[0].reason, ARB_RESERVOIR_FULL);
+}
+
+static void testOfflineWellIsNotStarted() {
+    ArbitrationEngine engine;
+    shareWell(engine, 0);
+    engine.setWellOnline(PRIMARY, false, 0);
+
+    // No online well: the demand is not routed
+    engine.setDemand(R0, true);
+    CHECK_EQ(evaluate(engine, 0), 0);
+    CHECK_EQ(engine.servingWell(R0), ARB_NONE);
+    CHECK(!engine.running(PRIMARY));
+
+    engine.setWellOnline(PRIMARY, true, 1000);
+    CHECK_EQ(evaluate(engine, 1000), 1);
+    CHECK(decisions[0].command && decisions[0].on);
+}
+
+static void testRunningWellGoingOfflineIsStopped() {
+    ArbitrationEngine engine;
+    shareWell(engine, 0);
+    engine.setDemand(R0, true);
+    CHECK_EQ(evaluate(engine, 0), 1);
+    CHECK(engine.running(PRIMARY));
+
+    engine.setWellOnline(PRIMARY, false, 1000);
+    evaluate(engine, 1000);
+    CHECK(!engine.running(PRIMARY));
+    CHECK_EQ(engine.reason(PRIMARY), ARB_WELL_OFFLINE);
+}
+
+static void testFallbackToBackupWell() {
+    ArbitrationEngine engine;
+    engine.link(R0, PRIMARY, 10);
+    engine.link(R0, BACKUP, 5);
+    engine.setWellOnline(PRIMARY, true, 0);
+    engine.setWellOnline(BACKUP, true, 0);
+    CHECK(engine.needsArbitration(PRIMARY));
+    CHECK(engine.needsArbitration(BACKUP));
+
+    // Heaviest online link first
+    engine.setDemand(R0, true);
+    CHECK_EQ(evaluate(engine, 0), 1);
+    CHECK_EQ(decisions[0].well, PRIMARY);
+    CHECK(decisions[0].on);
+    CHECK_EQ(engine.servingWell(R0), PRIMARY);
+
+    // Primary lost: the demand moves to the backup
+    engine.setWellOnline(PRIMARY, false, 1000);
+    evaluate(engine, 1000);
+    CHECK_EQ(engine.servingWell(R0), BACKUP);
+    CHECK(engine.running(BACKUP));
+    CHECK(!engine.running(PRIMARY));
+
+    // Primary back: the running backup keeps the demand
+    engine.setWellOnline(PRIMARY, true, 2000);
+    CHECK_EQ(evaluate(engine, 2000), 0);
+    CHECK_EQ(engine.servingWell(R0), BACKUP);
+
+    // Next demand goes to the primary again
+    engine.setDemand(R0, false);
+    evaluate(engine, 3000);
+    CHECK(!engine.running(BACKUP));
+    engine.setDemand(R0, true);
+    CHECK_EQ(evaluate(engine, 4000), 1);
+    CHECK_EQ(decisions[0].well, PRIMARY);
+    CHECK(decisions[0].on);
+}
+
+static void testRestingPrimaryFallsBackToBackup() {
+    ArbitrationEngine engine;
+    engine.link(R0, PRIMARY, 10);
+    engine.link(R0, BACKUP, 5);
+    engine.setWellOnline(PRIMARY, true, 0);
+    engine.setWellOnline(BACKUP, true, 0);
+    ArbWellRule rule = ArbitrationEngine::defaultRule();
+    rule.minRestMs = 120000;
+    engine.setRule(PRIMARY, rule);
+
+    engine.setDemand(R0, true);
+    evaluate(engine, 1000);
+    engine.setDemand(R0, false);
+    evaluate(engine, 2000);
+    CHECK(!engine.running(PRIMARY));
+
+    // Primary resting: a non-resting backup wins over the heavier link
+    engine.setDemand(R0, true);
+    CHECK_EQ(evaluate(engine, 3000), 1);
+    CHECK_EQ(decisions[0].well, BACKUP);
+    CHECK(decisions[0].command && decisions[0].on);
+    CHECK_EQ(engine.servingWell(R0), BACKUP);
+
+    // End of the rest does not take the demand from the running backup
+    CHECK_EQ(evaluate(engine, 200000), 0);
+    CHECK_EQ(engine.servingWell(R0), BACKUP);
+}
+
+static void testWellReportsAndHold() {
+    ArbitrationEngine engine;
+    shareWell(engine, 0);
+    engine.setDemand(R0, true);
+    evaluate(engine, 10);
+    CHECK(engine.pending(PRIMARY));
+
+    // A contradicting report is ignored during the grace period, then adopted
+    engine.wellReported(PRIMARY, false, 10 + ARB_COMMAND_GRACE_MS - 1);
+    CHECK(engine.running(PRIMARY));
+    engine.wellReported(PRIMARY, false, 10 + ARB_COMMAND_GRACE_MS + 1);
+    CHECK(!engine.running(PRIMARY));
+    // The demand is still there: the command is sent again
+    CHECK_EQ(evaluate(engine, 40000), 1);
+    CHECK(decisions[0].command && decisions[0].on);
+
+    // Held by the well: the grace period runs from the end of the hold
+    engine.wellHeld(PRIMARY, 160000);
+    engine.wellReported(PRIMARY, false, 100000);
+    CHECK(engine.running(PRIMARY));
+    engine.wellReported(PRIMARY, false, 160000 + ARB_COMMAND_GRACE_MS - 1);
+    CHECK(engine.running(PRIMARY));
+    engine.wellReported(PRIMARY, false, 160000 + ARB_COMMAND_GRACE_MS + 1);
+    CHECK(!engine.running(PRIMARY));
+}
+
+int main() {
+    RUN_TEST(testSingleReservoirIsDirect);
+    RUN_TEST(testSharedWellRunsWhileAnyDemand);
+    RUN_TEST(testFullReservoirBlocksStart);
+    RUN_TEST(testStartScoreThreshold);
+    RUN_TEST(testMinRestAndMinRunDefer);
+    RUN_TEST(testOverflowCutsMinRun);
+    RUN_TEST(testOfflineWellIsNotStarted);
+    RUN_TEST(testRunningWellGoingOfflineIsStopped);
+    RUN_TEST(testFallbackToBackupWell);
+    RUN_TEST(testRestingPrimaryFallsBackToBackup);
+    RUN_TEST(testWellReportsAndHold);
+    return TEST_RESULT();
+}
@@ -0,0 +1,139 @@
+// Fixed-point RMS of SampleBlock on synthetic mains waveforms, and the dry-run,
+// overload and locked-rotor classification of CurrentMonitor.
+#include <math.h>
+#include "CurrentMonitor.h"
+#include "SampleBlock.h"
+#include "TestCheck.h"
+
+// WELLGUARD_CURRENT_SAMPLE_HZ and WELLGUARD_CURRENT_BLOCK_MS: 5 periods at 50 Hz
+static const uint32_t SAMPLE_HZ = 20000;
+static const uint32_t BLOCK_SAMPLES = 2000;
+static const uint32_t BLOCK_MS = 100;
+static const double BIAS = 1850; // Mid-supply bias of the clamp input, in counts
+
+// 24 mA per count, 8 A motor, dry below 60 %, overload above 125 %, locked rotor
+// above 300 %, 1 s inrush, 500 ms before a dry-run or overload trip
+static const CurrentMonitorConfig CONFIG = {24000, 8000, 60, 125, 300, 1000, 500, 500};
+
+static SampleBlock sine(double peakCounts, uint32_t samples = BLOCK_SAMPLES) {
+    SampleBlock block;
+    for (uint32_t i = 0; i < samples; i++) {
+        block.add((uint16_t)lround(BIAS + peakCounts * sin(2 * M_PI * 50 * i / SAMPLE_HZ)));
+    }
+    return block;
+}
+
+static void testIsqrt() {
+    const uint64_t values[] = {0, 1, 2, 3, 4, 15, 16, 17, 999999, (1ULL << 40) + 5, ~0ULL >> 1, ~0ULL};
+    for (uint64_t value : values) {
+        uint64_t root = SampleBlock::isqrt(value);
+        CHECK(root * root <= value);
+        CHECK((root + 1) * (root + 1) > value || root == 0xFFFFFFFFULL);
+    }
+}
+
+static void testSineRms() {
+    SampleBlock block = sine(1000);
+    CHECK_EQ(block.samples(), BLOCK_SAMPLES);
+    CHECK_EQ(block.mean(), 1850);
+    // 1000 / sqrt(2) = 707.1 counts, within a count after rounding the samples
+    double rms = block.acRmsQ4() / 16.0;
+    CHECK(fabs(rms - 1000 / sqrt(2)) < 1.0);
+
+    // No AC: the bias is not counted
+    CHECK_EQ(sine(0).acRmsQ4(), 0);
+
+    SampleBlock empty;
+    CHECK_EQ(empty.acRmsQ4(), 0);
+    CHECK_EQ(empty.mean(), 0);
+}
+
+// Worst case at SAMPLE_BLOCK_MAX_SAMPLES: full-scale square wave, 2047.5 counts RMS
+static void testLargestBlock() {
+    SampleBlock block;
+    for (uint32_t i = 0; i < SAMPLE_BLOCK_MAX_SAMPLES; i++) block.add(i % 2 ? 4095 : 0);
+    CHECK_EQ(block.acRmsQ4(), 32760);
+}
+
+static void testToMilliamps() {
+    CurrentMonitor monitor(CONFIG);
+    // 8 A RMS: 333.3 counts RMS, 471.4 counts peak
+    uint32_t milliamps = monitor.toMilliamps(sine(471.4));
+    CHECK(milliamps > 7950 && milliamps < 8050);
+    CHECK_EQ(monitor.toMilliamps(sine(0)), 0);
+}
+
+// Starts the motor at 100 ms with startupMa for the first second, then steadyMa,
+// one block every 100 ms. Returns when it tripped, 0 if it did not.
+static uint32_t runMotor(uint32_t startupMa, uint32_t steadyMa, MotorFault& fault) {
+    CurrentMonitor monitor(CONFIG);
+    monitor.update(0, false, 0);
+    for (uint32_t now = BLOCK_MS; now <= 20000; now += BLOCK_MS) {
+        if (monitor.update(now < 1000 ? startupMa : steadyMa, true, now)) {
+            fault = monitor.fault();
+            return now;
+        }
+    }
+    fault = monitor.fault();
+    return 0;
+}
+
+static void testNormalRunDoesNotTrip() {
+    MotorFault fault;
+    // Inrush at 5x rated is ignored during startupMs
+    CHECK_EQ(runMotor(40000, 8000, fault), 0);
+    CHECK_EQ(fault, MOTOR_OK);
+}
+
+static void testClassification() {
+    MotorFault fault;
+    // Watched from 1100 ms; dry run and overload for 500 ms
+    CHECK_EQ(runMotor(40000, 3000, fault), 1600);
+    CHECK_EQ(fault, MOTOR_FAULT_DRY_RUN);
+    CHECK_EQ(runMotor(40000, 11000, fault), 1600);
+    CHECK_EQ(fault, MOTOR_FAULT_OVERLOAD);
+    // Locked rotor trips on the first watched block
+    CHECK_EQ(runMotor(40000, 30000, fault), 1100);
+    CHECK_EQ(fault, MOTOR_FAULT_LOCKED_ROTOR);
+    // Just inside the limits: 60 % and 125 % of rated
+    CHECK_EQ(runMotor(40000, 4800, fault), 0);
+    CHECK_EQ(runMotor(40000, 10000, fault), 0);
+}
+
+static void testBriefDipDoesNotTrip() {
+    CurrentMonitor monitor(CONFIG);
+    monitor.update(0, false, 0);
+    for (uint32_t now = BLOCK_MS; now < 5000; now += BLOCK_MS) {
+        uint32_t milliamps = now >= 2000 && now < 2400 ? 3000 : 8000;
+        CHECK(!monitor.update(milliamps, true, now));
+    }
+    CHECK_EQ(monitor.fault(), MOTOR_OK);
+}
+
+static void testFaultLatchedUntilRestart() {
+    CurrentMonitor monitor(CONFIG);
+    monitor.update(0, false, 0);
+    uint32_t now = BLOCK_MS;
+    while (!monitor.update(30000, true, now) && now < 5000) now += BLOCK_MS;
+    CHECK_EQ(monitor.fault(), MOTOR_FAULT_LOCKED_ROTOR);
+
+    // Reported once, kept while stopped
+    CHECK(!monitor.update(30000, true, now + BLOCK_MS));
+    monitor.update(0, false, now + 2 * BLOCK_MS);
+    CHECK_EQ(monitor.fault(), MOTOR_FAULT_LOCKED_ROTOR);
+
+    monitor.update(8000, true, now + 3 * BLOCK_MS);
+    CHECK_EQ(monitor.fault(), MOTOR_OK);
+}
+
+int main() {
+    RUN_TEST(testIsqrt);
+    RUN_TEST(testSineRms);
+    RUN_TEST(testLargestBlock);
+    RUN_TEST(testToMilliamps);
+    RUN_TEST(testNormalRunDoesNotTrip);
+    RUN_TEST(testClassification);
+    RUN_TEST(testBriefDipDoesNotTrip);
+    RUN_TEST(testFaultLatchedUntilRestart);
+    return TEST_RESULT();
+}
@@ -0,0 +1,185 @@
+// Fill and drain rates learned from the float crossings of a reservoir, and the
+// time-to-empty prediction the Centrale plans its top-ups on.
+#include "FillEstimator.h"
+#include "TestCheck.h"
+
+static const uint32_t MINUTE = 60000;
+static const uint8_t TANK = 0;
+
+static bool near(uint32_t actual, uint32_t expected, uint32_t tolerance) {
+    return actual + tolerance >= expected && actual <= expected + tolerance;
+}
+
+// Pump on from the low float to the high one.
+static bool fillCrossing(FillEstimator& fill, uint8_t reservoir, uint32_t startMs, uint32_t durationMs) {
+    fill.levelChanged(reservoir, ARB_LEVEL_EMPTY, startMs);
+    fill.pumpChanged(reservoir, true, startMs);
+    fill.levelChanged(reservoir, ARB_LEVEL_OK, startMs + 1000);
+    bool learned = fill.levelChanged(reservoir, ARB_LEVEL_FULL, startMs + 1000 + durationMs);
+    fill.pumpChanged(reservoir, false, startMs + 1000 + durationMs);
+    return learned;
+}
+
+// Pump off from the high float to the low one.
+static bool drainCrossing(FillEstimator& fill, uint8_t reservoir, uint32_t startMs, uint32_t durationMs) {
+    fill.levelChanged(reservoir, ARB_LEVEL_FULL, startMs);
+    fill.levelChanged(reservoir, ARB_LEVEL_OK, startMs + 1000);
+    return fill.levelChanged(reservoir, ARB_LEVEL_EMPTY, startMs + 1000 + durationMs);
+}
+
+static void testLearnsFillFromLowToHigh() {
+    FillEstimator fill;
+    CHECK_EQ(fill.fillMs(TANK), 0);
+    CHECK(fillCrossing(fill, TANK, 0, 40 * MINUTE));
+    CHECK_EQ(fill.fillMs(TANK), 40 * MINUTE);
+    CHECK_EQ(fill.drainMs(TANK), 0);
+    CHECK_EQ(fill.samples(TANK), 1);
+}
+
+static void testLearnsDrainFromHighToLow() {
+    FillEstimator fill;
+    CHECK(drainCrossing(fill, TANK, 0, 120 * MINUTE));
+    CHECK_EQ(fill.drainMs(TANK), 120 * MINUTE);
+    CHECK_EQ(fill.fillMs(TANK), 0);
+
+    // Exponential average, 1/4 per crossing
+    CHECK(drainCrossing(fill, TANK, 200 * MINUTE, 200 * MINUTE));
+    CHECK_EQ(fill.drainMs(TANK), 140 * MINUTE);
+    CHECK_EQ(fill.samples(TANK), 2);
+}
+
+static void testPumpSwitchedMidwayIsIgnored() {
+    FillEstimator fill;
+    // Drain interrupted by a start, then the pump stopped again before the low float
+    fill.levelChanged(TANK, ARB_LEVEL_FULL, 0);
+    fill.levelChanged(TANK, ARB_LEVEL_OK, 1000);
+    fill.pumpChanged(TANK, true, 30 * MINUTE);
+    fill.pumpChanged(TANK, false, 40 * MINUTE);
+    CHECK(!fill.levelChanged(TANK, ARB_LEVEL_EMPTY, 150 * MINUTE));
+    CHECK_EQ(fill.drainMs(TANK), 0);
+
+    // Fill with the pump stopped midway and restarted
+    fill.pumpChanged(TANK, true, 151 * MINUTE);
+    fill.levelChanged(TANK, ARB_LEVEL_OK, 152 * MINUTE);
+    fill.pumpChanged(TANK, false, 160 * MINUTE);
+    fill.pumpChanged(TANK, true, 170 * MINUTE);
+    CHECK(!fill.levelChanged(TANK, ARB_LEVEL_FULL, 200 * MINUTE));
+    CHECK_EQ(fill.fillMs(TANK), 0);
+    CHECK_EQ(fill.samples(TANK), 0);
+}
+
+static void testOtherCrossingsAreIgnored() {
+    FillEstimator fill;
+    // Float bounce: too short to be a rate
+    CHECK(!drainCrossing(fill, TANK, 0, FILL_MIN_SAMPLE_MS - 1));
+    // Back to the float it left
+    fill.levelChanged(TANK, ARB_LEVEL_OK, 10 * MINUTE);
+    CHECK(!fill.levelChanged(TANK, ARB_LEVEL_EMPTY, 30 * MINUTE));
+    // Rising with the pump off (rain, another source)
+    fill.levelChanged(TANK, ARB_LEVEL_OK, 40 * MINUTE);
+    CHECK(!fill.levelChanged(TANK, ARB_LEVEL_FULL, 90 * MINUTE));
+    // Level unknown before the band
+    FillEstimator fresh;
+    fresh.levelChanged(TANK, ARB_LEVEL_OK, 0);
+    CHECK(!fresh.levelChanged(TANK, ARB_LEVEL_EMPTY, 60 * MINUTE));
+
+    CHECK_EQ(fill.drainMs(TANK), 0);
+    CHECK_EQ(fill.fillMs(TANK), 0);
+    CHECK_EQ(fresh.drainMs(TANK), 0);
+}
+
+static void testMsToEmptyUnknownCases() {
+    FillEstimator fill;
+    CHECK_EQ(fill.msToEmpty(TANK, 0), FILL_UNKNOWN);
+    fill.levelChanged(TANK, ARB_LEVEL_FULL, 0);
+    // No drain learned yet
+    CHECK_EQ(fill.msToEmpty(TANK, 0), FILL_UNKNOWN);
+
+    drainCrossing(fill, TANK, 0, 120 * MINUTE);
+    CHECK_EQ(fill.msToEmpty(TANK, 121 * MINUTE), 0);
+    fill.pumpChanged(TANK, true, 122 * MINUTE);
+    fill.levelChanged(TANK, ARB_LEVEL_OK, 123 * MINUTE);
+    // Filling: not draining
+    CHECK_EQ(fill.msToEmpty(TANK, 130 * MINUTE), FILL_UNKNOWN);
+}
+
+static void testMsToEmptyExtrapolates() {
+    FillEstimator fill;
+    drainCrossing(fill, TANK, 0, 120 * MINUTE);
+
+    // Full: one whole band crossing away
+    uint32_t fullAtMs = 200 * MINUTE;
+    fill.levelChanged(TANK, ARB_LEVEL_FULL, fullAtMs);
+    CHECK_EQ(fill.msToEmpty(TANK, fullAtMs + 10 * MINUTE), 120 * MINUTE);
+
+    // Leaves the high float: counts down at the learned rate
+    fill.levelChanged(TANK, ARB_LEVEL_OK, fullAtMs + 10 * MINUTE);
+    CHECK(near(fill.msToEmpty(TANK, fullAtMs + 10 * MINUTE), 120 * MINUTE, 1000));
+    CHECK(near(fill.msToEmpty(TANK, fullAtMs + 40 * MINUTE), 90 * MINUTE, 1000));
+    CHECK(near(fill.msToEmpty(TANK, fullAtMs + 100 * MINUTE), 30 * MINUTE, 1000));
+    // Overdue: bounded by the low float
+    CHECK_EQ(fill.msToEmpty(TANK, fullAtMs + 300 * MINUTE), 0);
+}
+
+// A top-up stopped halfway through the band leaves half a drain to go.
+static void testMsToEmptyAfterPartialFill() {
+    FillEstimator fill;
+    fillCrossing(fill, TANK, 0, 40 * MINUTE);
+    drainCrossing(fill, TANK, 50 * MINUTE, 120 * MINUTE);
+
+    uint32_t startMs = 200 * MINUTE;
+    fill.pumpChanged(TANK, true, startMs);
+    fill.levelChanged(TANK, ARB_LEVEL_OK, startMs);
+    CHECK(near(fill.msToFull(TANK, startMs), 40 * MINUTE, 1000));
+    CHECK(near(fill.msToFull(TANK, startMs + 10 * MINUTE), 30 * MINUTE, 1000));
+    fill.pumpChanged(TANK, false, startMs + 20 * MINUTE);
+    CHECK_EQ(fill.msToFull(TANK, startMs + 20 * MINUTE), FILL_UNKNOWN);
+    CHECK(near(fill.msToEmpty(TANK, startMs + 20 * MINUTE), 60 * MINUTE, 1000));
+    CHECK(near(fill.msToEmpty(TANK, startMs + 50 * MINUTE), 30 * MINUTE, 1000));
+}
+
+// planTopUps() starts the reservoir predicted to empty first within its horizon.
+static void testPredictionsRankReservoirs() {
+    FillEstimator fill;
+    const uint8_t FAST = 1, SLOW = 2;
+    drainCrossing(fill, FAST, 0, 60 * MINUTE);
+    drainCrossing(fill, SLOW, 0, 240 * MINUTE);
+
+    uint32_t now = 300 * MINUTE;
+    fill.levelChanged(FAST, ARB_LEVEL_FULL, now);
+    fill.levelChanged(SLOW, ARB_LEVEL_FULL, now);
+    fill.levelChanged(FAST, ARB_LEVEL_OK, now);
+    fill.levelChanged(SLOW, ARB_LEVEL_OK, now);
+
+    now += 30 * MINUTE;
+    uint32_t horizonMs = 60 * MINUTE;
+    CHECK(near(fill.msToEmpty(FAST, now), 30 * MINUTE, 1000));
+    CHECK(near(fill.msToEmpty(SLOW, now), 210 * MINUTE, 1000));
+    CHECK(fill.msToEmpty(FAST, now) <= horizonMs);
+    CHECK(fill.msToEmpty(SLOW, now) > horizonMs);
+    // Untouched reservoirs stay unknown
+    CHECK_EQ(fill.msToEmpty(TANK, now), FILL_UNKNOWN);
+}
+
+static void testOffPeakWindow() {
+    // 22:00 - 06:00 wraps midnight
+    CHECK(FillEstimator::inWindow(23 * 60, 22 * 60, 6 * 60));
+    CHECK(FillEstimator::inWindow(0, 22 * 60, 6 * 60));
+    CHECK(!FillEstimator::inWindow(6 * 60, 22 * 60, 6 * 60));
+    CHECK(!FillEstimator::inWindow(12 * 60, 22 * 60, 6 * 60));
+    CHECK(FillEstimator::inWindow(13 * 60, 12 * 60, 14 * 60));
+    CHECK(!FillEstimator::inWindow(14 * 60, 12 * 60, 14 * 60));
+}
+
+int main() {
+    RUN_TEST(testLearnsFillFromLowToHigh);
+    RUN_TEST(testLearnsDrainFromHighToLow);
+    RUN_TEST(testPumpSwitchedMidwayIsIgnored);
+    RUN_TEST(testOtherCrossingsAreIgnored);
+    RUN_TEST(testMsToEmptyUnknownCases);
+    RUN_TEST(testMsToEmptyExtrapolates);
+    RUN_TEST(testMsToEmptyAfterPartialFill);
+    RUN_TEST(testPredictionsRankReservoirs);
+    RUN_TEST(testOffPeakWindow);
+    return TEST_RESULT();
+}
@@ -0,0 +1,158 @@
+// Flow rate, volume and dry-run detection of the Wellguard flow meter, fed with
+// synthetic pulse trains, and the pulse counter wrap.
+#include "FlowMeter.h"
+#include "PulseCounter.h"
+#include "TestCheck.h"
+
+// 450 pulses per litre, 30 s priming, dry below 60 L/h for 15 s
+static const FlowMeterConfig CONFIG = {2222, 30000, 60, 15000};
+
+// 150 pulses/s with the meter above: 150 * 2222 uL * 3600 = 1199.88 L/h
+static const uint32_t PULSES_PER_S = 150;
+static const uint32_t STEADY_LPH = 1199;
+
+static void testSteadyFlow() {
+    FlowMeter meter(CONFIG);
+    meter.begin(0, 100);
+    CHECK_EQ(meter.volumeLitres(), 100);
+
+    uint32_t now = 0;
+    for (int second = 0; second < 60; second++) {
+        now += 1000;
+        CHECK(!meter.update(PULSES_PER_S, true, now));
+    }
+    CHECK_EQ(meter.flowLph(), STEADY_LPH);
+    // 60 * 150 * 2222 uL = 19.998 L on top of the restored 100 L
+    CHECK_EQ(meter.volumeLitres(), 119);
+    CHECK_EQ(meter.fault(), FLOW_OK);
+}
+
+static void testRateAveragedOverUnevenPeriods() {
+    FlowMeter meter(CONFIG);
+    meter.begin(0, 0);
+
+    // Pulses proportional to the period: the rate does not depend on the jitter
+    uint32_t now = 0;
+    for (int i = 0; i < 3 * FLOW_RATE_SLOTS; i++) {
+        uint32_t periodMs = 800 + (i % 5) * 100;
+        now += periodMs;
+        meter.update(PULSES_PER_S * periodMs / 1000, true, now);
+    }
+    CHECK_EQ(meter.flowLph(), STEADY_LPH);
+
+    // One pulse every 8 s with a 10 L per pulse meter: 4500 L/h
+    FlowMeter coarse({10000000, 30000, 600, 60000});
+    coarse.begin(0, 0);
+    now = 0;
+    for (int second = 0; second < 80; second++) {
+        now += 1000;
+        CHECK(!coarse.update(second % 8 == 0 ? 1 : 0, true, now));
+    }
+    CHECK_EQ(coarse.flowLph(), 4500);
+    CHECK_EQ(coarse.fault(), FLOW_OK);
+}
+
+static void testZeroFlowTripsAfterPriming() {
+    FlowMeter meter(CONFIG);
+    meter.begin(0, 0);
+
+    // Started at 1 s, watched from 31 s, dry for 15 s: trip at 46 s
+    uint32_t now = 0;
+    uint32_t trippedAtMs = 0;
+    while (now < 120000 && trippedAtMs == 0) {
+        now += 1000;
+        if (meter.update(0, true, now)) trippedAtMs = now;
+    }
+    CHECK_EQ(trippedAtMs, 46000);
+    CHECK_EQ(meter.fault(), FLOW_FAULT_NO_FLOW);
+
+    // Reported once, latched while the pump is off
+    for (int second = 0; second < 10; second++) {
+        now += 1000;
+        CHECK(!meter.update(0, false, now));
+    }
+    CHECK_EQ(meter.fault(), FLOW_FAULT_NO_FLOW);
+
+    // A restart clears it and primes again
+    now += 1000;
+    CHECK(!meter.update(0, true, now));
+    CHECK_EQ(meter.fault(), FLOW_OK);
+}
+
+static void testFlowStoppingWhileRunningTrips() {
+    FlowMeter meter(CONFIG);
+    meter.begin(0, 0);
+
+    uint32_t now = 0;
+    for (int second = 0; second < 60; second++) {
+        now += 1000;
+        meter.update(PULSES_PER_S, true, now);
+    }
+    // The average is below 60 L/h once all FLOW_RATE_SLOTS slots are empty,
+    // then 15 s more
+    uint32_t stoppedAtMs = now;
+    uint32_t trippedAtMs = 0;
+    while (now < stoppedAtMs + 60000 && trippedAtMs == 0) {
+        now += 1000;
+        if (meter.update(0, true, now)) trippedAtMs = now;
+    }
+    CHECK_EQ(trippedAtMs - stoppedAtMs, FLOW_RATE_SLOTS * 1000 + 15000);
+}
+
+static void testLowFlowAboveMinimumDoesNotTrip() {
+    FlowMeter meter(CONFIG);
+    meter.begin(0, 0);
+
+    // 45 pulses every 2 s: 180 L/h
+    uint32_t now = 0;
+    for (int i = 0; i < 300; i++) {
+        now += 2000;
+        CHECK(!meter.update(45, true, now));
+    }
+    CHECK_EQ(meter.fault(), FLOW_OK);
+}
+
+static void testCounterDelta() {
+    CHECK_EQ(PulseCounter::pulsesBetween(0, 0), 0);
+    CHECK_EQ(PulseCounter::pulsesBetween(100, 250), 150);
+    CHECK_EQ(PulseCounter::pulsesBetween(0, PULSE_COUNTER_LIMIT - 1), PULSE_COUNTER_LIMIT - 1);
+    // Wrapped: 67 pulses up to the limit, then 33
+    CHECK_EQ(PulseCounter::pulsesBetween(PULSE_COUNTER_LIMIT - 67, 33), 100);
+    CHECK_EQ(PulseCounter::pulsesBetween(PULSE_COUNTER_LIMIT - 1, 0), 1);
+}
+
+// A counter read every second through several wraps loses no pulse.
+static void testCounterWrapKeepsVolume() {
+    FlowMeter meter(CONFIG);
+    meter.begin(0, 0);
+
+    // Hardware counter: counts up, back to 0 when it reaches the limit
+    int16_t counter = 0;
+    int16_t lastCount = 0;
+    uint32_t total = 0;
+    uint32_t now = 0;
+    for (int second = 0; second < 900; second++) {
+        counter = (int16_t)((counter + PULSES_PER_S) % PULSE_COUNTER_LIMIT);
+        uint32_t pulses = PulseCounter::pulsesBetween(lastCount, counter);
+        lastCount = counter;
+        CHECK_EQ(pulses, PULSES_PER_S);
+        total += pulses;
+        now += 1000;
+        meter.update(pulses, true, now);
+    }
+    // 135000 pulses, four wraps: 299.97 L
+    CHECK_EQ(total, 900 * PULSES_PER_S);
+    CHECK_EQ(meter.volumeLitres(), 299);
+    CHECK_EQ(meter.flowLph(), STEADY_LPH);
+}
+
+int main() {
+    RUN_TEST(testSteadyFlow);
+    RUN_TEST(testRateAveragedOverUnevenPeriods);
+    RUN_TEST(testZeroFlowTripsAfterPriming);
+    RUN_TEST(testFlowStoppingWhileRunningTrips);
+    RUN_TEST(testLowFlowAboveMinimumDoesNotTrip);
+    RUN_TEST(testCounterDelta);
+    RUN_TEST(testCounterWrapKeepsVolume);
+    return TEST_RESULT();
+}
@@ -0,0 +1,178 @@
+// Continuous level sensor chain: median against brute force, exponential
+// average settling, calibration tables, hysteresis and the sensor fault.
+#include <algorithm>
+#include <vector>
+#include "LevelFilter.h"
+#include "TestCheck.h"
+
+// 4-20 mA loop into 150 ohms: 800 counts empty, 4000 full
+static const CalibrationPoint PRESSURE_TABLE[] = {{800, 0}, {4000, 1000}};
+static const LevelThresholds THRESHOLDS = {150, 850, 30};
+
+static void testMedianMatchesBruteForce() {
+    uint32_t rng = 12345;
+    for (uint8_t window = 1; window <= LEVEL_MEDIAN_MAX; window++) {
+        MedianFilter median(window);
+        std::vector<uint16_t> history;
+        int mismatches = 0;
+        for (int i = 0; i < 2000; i++) {
+            rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+            uint16_t value = rng % 50; // Many duplicates
+            history.push_back(value);
+            uint16_t filtered = median.push(value);
+
+            size_t n = std::min<size_t>(history.size(), window);
+            std::vector<uint16_t> last(history.end() - n, history.end());
+            std::sort(last.begin(), last.end());
+            if (filtered != last[n / 2]) mismatches++;
+        }
+        CHECK_EQ(mismatches, 0);
+    }
+}
+
+static void testMedianRemovesSpikes() {
+    MedianFilter median(5);
+    for (int i = 0; i < 5; i++) median.push(2400);
+    CHECK_EQ(median.push(4095), 2400);
+    CHECK_EQ(median.push(0), 2400);
+    median.reset();
+    CHECK_EQ(median.push(100), 100);
+}
+
+static void testEmaSettling() {
+    EmaFilter ema(4);
+    CHECK_EQ(ema.push(0), 0);
+    // 1 - (15/16)^16 of the step after 16 values
+    uint16_t value = 0;
+    for (int i = 0; i < 16; i++) value = ema.push(1000);
+    CHECK(value > 600 && value < 690);
+    // Within a count after 100 more; the truncated shift then creeps the last bit in
+    for (int i = 0; i < 100; i++) value = ema.push(1000);
+    CHECK(value >= 999 && value <= 1000);
+    for (int i = 0; i < 400; i++) value = ema.push(1000);
+    CHECK_EQ(value, 1000);
+    for (int i = 0; i < 200; i++) value = ema.push(0);
+    CHECK_EQ(value, 0);
+
+    // First value after a reset is taken as is
+    ema.reset();
+    CHECK_EQ(ema.push(777), 777);
+    EmaFilter passThrough(0);
+    passThrough.push(10);
+    CHECK_EQ(passThrough.push(500), 500);
+}
+
+static void testCalibrationInterpolates() {
+    LevelCalibration calibration(PRESSURE_TABLE, 2, 200);
+    CHECK_EQ(calibration.toPermille(800), 0);
+    CHECK_EQ(calibration.toPermille(2400), 500);
+    CHECK_EQ(calibration.toPermille(4000), 1000);
+    // Rounded to the nearest: 0.31 and 0.63
+    CHECK_EQ(calibration.toPermille(801), 0);
+    CHECK_EQ(calibration.toPermille(802), 1);
+    // Clamped to the table ends
+    CHECK_EQ(calibration.toPermille(700), 0);
+    CHECK_EQ(calibration.toPermille(4100), 1000);
+
+    CHECK(calibration.inRange(600));
+    CHECK(!calibration.inRange(599));
+    CHECK(calibration.inRange(4200));
+    CHECK(!calibration.inRange(4201));
+
+    // Non-linear tank: narrow at the bottom
+    const CalibrationPoint shaped[] = {{0, 0}, {1000, 100}, {2000, 900}, {3000, 1000}};
+    LevelCalibration tank(shaped, 4, 0);
+    CHECK_EQ(tank.toPermille(500), 50);
+    CHECK_EQ(tank.toPermille(1500), 500);
+    CHECK_EQ(tank.toPermille(2500), 950);
+}
+
+// Ultrasonic distance: the level rises as the distance falls.
+static void testInvertedCalibration() {
+    const CalibrationPoint distance[] = {{300, 1000}, {2000, 0}};
+    LevelCalibration calibration(distance, 2, 100);
+    CHECK_EQ(calibration.toPermille(300), 1000);
+    CHECK_EQ(calibration.toPermille(1150), 500);
+    CHECK_EQ(calibration.toPermille(2000), 0);
+    // Rounded towards the nearest, not towards zero: 1000 - 0.59
+    CHECK_EQ(calibration.toPermille(301), 999);
+    CHECK_EQ(calibration.toPermille(200), 1000);
+    CHECK_EQ(calibration.toPermille(2100), 0);
+    CHECK(!calibration.inRange(199));
+
+    LevelCalibration empty(distance, 0, 100);
+    CHECK_EQ(empty.toPermille(1000), LEVEL_UNKNOWN);
+    CHECK(!empty.inRange(1000));
+}
+
+static void testHysteresis() {
+    // First classification: plain thresholds
+    CHECK_EQ(classifyLevel(149, SENSOR_LEVEL_NONE, THRESHOLDS), SENSOR_LEVEL_EMPTY);
+    CHECK_EQ(classifyLevel(150, SENSOR_LEVEL_NONE, THRESHOLDS), SENSOR_LEVEL_OK);
+    CHECK_EQ(classifyLevel(850, SENSOR_LEVEL_NONE, THRESHOLDS), SENSOR_LEVEL_OK);
+    CHECK_EQ(classifyLevel(851, SENSOR_LEVEL_NONE, THRESHOLDS), SENSOR_LEVEL_FULL);
+
+    // Leaving EMPTY or FULL needs the threshold plus the hysteresis
+    CHECK_EQ(classifyLevel(179, SENSOR_LEVEL_EMPTY, THRESHOLDS), SENSOR_LEVEL_EMPTY);
+    CHECK_EQ(classifyLevel(180, SENSOR_LEVEL_EMPTY, THRESHOLDS), SENSOR_LEVEL_OK);
+    CHECK_EQ(classifyLevel(821, SENSOR_LEVEL_FULL, THRESHOLDS), SENSOR_LEVEL_FULL);
+    CHECK_EQ(classifyLevel(820, SENSOR_LEVEL_FULL, THRESHOLDS), SENSOR_LEVEL_OK);
+    // Entering them does not
+    CHECK_EQ(classifyLevel(149, SENSOR_LEVEL_OK, THRESHOLDS), SENSOR_LEVEL_EMPTY);
+    CHECK_EQ(classifyLevel(851, SENSOR_LEVEL_OK, THRESHOLDS), SENSOR_LEVEL_FULL);
+    CHECK_EQ(classifyLevel(LEVEL_UNKNOWN, SENSOR_LEVEL_OK, THRESHOLDS), SENSOR_LEVEL_FAULT);
+}
+
+// A surface rippling around the high threshold switches once.
+static void testChainDoesNotFlap() {
+    LevelFilterChain chain(1, 0, LevelCalibration(PRESSURE_TABLE, 2, 200), THRESHOLDS, 3);
+    int changes = 0;
+    // 845 to 865 permille: 3504 to 3568 counts
+    for (int i = 0; i < 100; i++) {
+        if (chain.push(i % 2 ? 3504 : 3568)) changes++;
+    }
+    CHECK_EQ(changes, 1);
+    CHECK_EQ(chain.currentLevel(), SENSOR_LEVEL_FULL);
+}
+
+static void testFaultAndRecovery() {
+    LevelFilterChain chain(5, 2, LevelCalibration(PRESSURE_TABLE, 2, 200), THRESHOLDS, 3);
+    CHECK_EQ(chain.currentLevel(), SENSOR_LEVEL_NONE);
+    CHECK(chain.push(2400));
+    for (int i = 0; i < 5; i++) CHECK(!chain.push(2400));
+    CHECK_EQ(chain.currentLevel(), SENSOR_LEVEL_OK);
+    CHECK_EQ(chain.permille(), 500);
+
+    // Open loop: reads 0. Fault on the third bad sample, reported once
+    CHECK(!chain.push(0));
+    CHECK(!chain.missed());
+    CHECK_EQ(chain.currentLevel(), SENSOR_LEVEL_OK);
+    CHECK(chain.push(0));
+    CHECK_EQ(chain.currentLevel(), SENSOR_LEVEL_FAULT);
+    CHECK_EQ(chain.permille(), LEVEL_UNKNOWN);
+    CHECK(!chain.push(0));
+    CHECK(!chain.missed());
+
+    // Back: the filters start over, no averaging with the level before the fault
+    CHECK(chain.push(3900));
+    CHECK_EQ(chain.currentLevel(), SENSOR_LEVEL_FULL);
+    CHECK_EQ(chain.permille(), 969);
+
+    // A good sample resets the count: isolated bad ones never fault
+    for (int i = 0; i < 20; i++) {
+        CHECK(!chain.push(i % 3 == 2 ? 3900 : 0));
+    }
+    CHECK_EQ(chain.currentLevel(), SENSOR_LEVEL_FULL);
+}
+
+int main() {
+    RUN_TEST(testMedianMatchesBruteForce);
+    RUN_TEST(testMedianRemovesSpikes);
+    RUN_TEST(testEmaSettling);
+    RUN_TEST(testCalibrationInterpolates);
+    RUN_TEST(testInvertedCalibration);
+    RUN_TEST(testHysteresis);
+    RUN_TEST(testChainDoesNotFlap);
+    RUN_TEST(testFaultAndRecovery);
+    return TEST_RESULT();
+}
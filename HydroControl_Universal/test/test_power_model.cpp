@@ -0,0 +1,95 @@
+// Duty-cycle model of a battery AquaReserv: daily average current and battery
+// life of the default profile, against the always-on firmware.
+#include <math.h>
+#include "PowerModel.h"
+#include "TestCheck.h"
+
+static const uint32_t DAY_S = 86400;
+static const uint32_t HEARTBEAT_S = 900; // LOW_POWER_HEARTBEAT_S
+static const float BATTERY_MAH = 2600;   // One 18650 cell
+
+// What AquaReservLogic logs at cold boot: 8 level events and 2 button presses a
+// day, 2 frames each
+static const DutyCycleScenario DEFAULT_SCENARIO = {HEARTBEAT_S, 8, 2, 2};
+
+static bool near(float actual, float expected, float tolerance) {
+    return fabsf(actual - expected) <= tolerance;
+}
+
+// Heartbeats only, checked against the same sum done by hand: each wake-up is
+// 320 ms active, 330 ms TX and 1500 ms RX, 117490 mA.ms in all, and heartbeats
+// restart after it, so 95 fit in a day.
+static void testHeartbeatsOnly() {
+    PowerProfile profile = PowerModel::defaultProfile();
+    DutyCycleResult result = PowerModel::simulate(profile, {HEARTBEAT_S, 0, 0, 1}, DAY_S);
+
+    CHECK_EQ(result.wakeUps, 95);
+    CHECK(near(result.awakeSeconds, 95 * 2.15f, 0.01f));
+    CHECK(near(result.radioOnSeconds, 95 * 1.83f, 0.01f));
+    float awakeCharge = 95 * 117490.0f;
+    float sleepCharge = (DAY_S * 1000.0f - 95 * 2150.0f) * 0.025f;
+    CHECK(near(result.averageCurrentMa, (awakeCharge + sleepCharge) / (DAY_S * 1000.0f), 0.0005f));
+    CHECK(near(result.chargeMah, result.averageCurrentMa * 24, 0.01f));
+}
+
+static void testDefaultProfileDailyAverage() {
+    PowerProfile profile = PowerModel::defaultProfile();
+    DutyCycleResult result = PowerModel::simulate(profile, DEFAULT_SCENARIO, DAY_S);
+
+    // Events merge with heartbeats: fewer than 95 + 10 wake-ups
+    CHECK(result.wakeUps > 95 && result.wakeUps < 105);
+    // About 0.16 mA, 3.9 mAh a day
+    CHECK(result.averageCurrentMa > 0.15f && result.averageCurrentMa < 0.18f);
+    CHECK(near(result.chargeMah, 3.9f, 0.2f));
+    // Radio on about 0.2 % of the time
+    CHECK(result.radioOnSeconds / DAY_S < 0.003f);
+
+    // More than a year and a half on one cell
+    float lifeDays = PowerModel::batteryLifeDays(BATTERY_MAH, result.averageCurrentMa);
+    CHECK(lifeDays > 550 && lifeDays < 750);
+}
+
+static void testDutyCycleBeatsAlwaysOn() {
+    PowerProfile profile = PowerModel::defaultProfile();
+    DutyCycleResult result = PowerModel::simulate(profile, DEFAULT_SCENARIO, DAY_S);
+    float alwaysOnMa = PowerModel::alwaysOnCurrentMa(profile);
+
+    CHECK(near(alwaysOnMa, 44.0f, 0.001f));
+    CHECK(result.averageCurrentMa * 100 < alwaysOnMa);
+    float alwaysOnDays = PowerModel::batteryLifeDays(BATTERY_MAH, alwaysOnMa);
+    CHECK(alwaysOnDays < 3);
+    CHECK(PowerModel::batteryLifeDays(BATTERY_MAH, result.averageCurrentMa) > 100 * alwaysOnDays);
+}
+
+static void testHeartbeatPeriodTradeOff() {
+    PowerProfile profile = PowerModel::defaultProfile();
+    float fast = PowerModel::simulate(profile, {300, 8, 2, 2}, DAY_S).averageCurrentMa;
+    float normal = PowerModel::simulate(profile, DEFAULT_SCENARIO, DAY_S).averageCurrentMa;
+    float slow = PowerModel::simulate(profile, {3600, 8, 2, 2}, DAY_S).averageCurrentMa;
+    CHECK(fast > normal && normal > slow);
+    // Floor: deep sleep alone
+    CHECK(slow > profile.sleepCurrentUa / 1000);
+}
+
+static void testLongerHorizonSameAverage() {
+    PowerProfile profile = PowerModel::defaultProfile();
+    DutyCycleResult day = PowerModel::simulate(profile, DEFAULT_SCENARIO, DAY_S);
+    DutyCycleResult week = PowerModel::simulate(profile, DEFAULT_SCENARIO, 7 * DAY_S);
+    CHECK(near(week.averageCurrentMa, day.averageCurrentMa, day.averageCurrentMa * 0.02f));
+    CHECK(near(week.chargeMah, 7 * day.chargeMah, day.chargeMah * 0.2f));
+}
+
+static void testBatteryLife() {
+    CHECK(near(PowerModel::batteryLifeDays(2400, 0.1f), 1000, 0.01f));
+    CHECK_EQ(PowerModel::batteryLifeDays(2400, 0), 0);
+}
+
+int main() {
+    RUN_TEST(testHeartbeatsOnly);
+    RUN_TEST(testDefaultProfileDailyAverage);
+    RUN_TEST(testDutyCycleBeatsAlwaysOn);
+    RUN_TEST(testHeartbeatPeriodTradeOff);
+    RUN_TEST(testLongerHorizonSameAverage);
+    RUN_TEST(testBatteryLife);
+    return TEST_RESULT();
+}
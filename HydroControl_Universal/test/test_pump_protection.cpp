@@ -0,0 +1,190 @@
+// Anti-short-cycling of the Wellguard relay: minimum on/off times, starts per
+// hour, fault lockout, and a trip while a command is held or being applied.
+#include "PumpProtection.h"
+#include "TestCheck.h"
+
+static const uint32_t MINUTE = 60000;
+
+static const PumpProtectionConfig CONFIG = {MINUTE, 2 * MINUTE, 3};
+
+static void testMinOffAtPowerUp() {
+    PumpProtection pump(CONFIG);
+    pump.begin(0);
+    uint32_t waitMs;
+    bool on;
+
+    CHECK_EQ(pump.request(true, 1000, waitMs), PUMP_HELD_MIN_OFF);
+    CHECK_EQ(waitMs, 2 * MINUTE - 1000);
+    CHECK(pump.hasHeld() && pump.heldOn());
+    CHECK(!pump.poll(2 * MINUTE - 1, on));
+    CHECK(pump.poll(2 * MINUTE, on));
+    CHECK(on && pump.isOn());
+    CHECK(!pump.hasHeld());
+}
+
+static void testMinOnHoldsStop() {
+    PumpProtection pump(CONFIG);
+    pump.begin(0);
+    uint32_t waitMs;
+    bool on;
+
+    CHECK_EQ(pump.request(true, 2 * MINUTE, waitMs), PUMP_APPLIED);
+    CHECK_EQ(pump.request(false, 2 * MINUTE + 10000, waitMs), PUMP_HELD_MIN_ON);
+    CHECK_EQ(waitMs, MINUTE - 10000);
+    CHECK_EQ(pump.hold(2 * MINUTE + 20000, waitMs), PUMP_HELD_MIN_ON);
+    CHECK_EQ(waitMs, MINUTE - 20000);
+    CHECK(pump.poll(3 * MINUTE, on));
+    CHECK(!on && !pump.isOn());
+}
+
+static void testLatestCommandWins() {
+    PumpProtection pump(CONFIG);
+    pump.begin(0);
+    uint32_t waitMs;
+    bool on;
+
+    CHECK_EQ(pump.request(true, 2 * MINUTE, waitMs), PUMP_APPLIED);
+    CHECK_EQ(pump.request(false, 2 * MINUTE + 1000, waitMs), PUMP_HELD_MIN_ON);
+    // Matches the relay: cancels the held stop
+    CHECK_EQ(pump.request(true, 2 * MINUTE + 2000, waitMs), PUMP_APPLIED);
+    CHECK(!pump.hasHeld());
+    CHECK(!pump.poll(10 * MINUTE, on));
+    CHECK(pump.isOn());
+}
+
+static void testStartsPerHour() {
+    PumpProtection pump(CONFIG);
+    pump.begin(0);
+    uint32_t waitMs;
+    bool on;
+
+    uint32_t now = 2 * MINUTE;
+    for (int start = 0; start < 3; start++) {
+        CHECK_EQ(pump.request(true, now, waitMs), PUMP_APPLIED);
+        now += MINUTE;
+        CHECK_EQ(pump.request(false, now, waitMs), PUMP_APPLIED);
+        now += 2 * MINUTE;
+    }
+    CHECK_EQ(pump.startsLastHour(now), 3);
+
+    // Fourth start held until the first one leaves the window
+    CHECK_EQ(pump.request(true, now, waitMs), PUMP_HELD_START_LIMIT);
+    CHECK_EQ(waitMs, PUMP_START_WINDOW_MS - (now - 2 * MINUTE));
+    CHECK(!pump.poll(2 * MINUTE + PUMP_START_WINDOW_MS - 1, on));
+    CHECK(pump.poll(2 * MINUTE + PUMP_START_WINDOW_MS, on));
+    CHECK(on);
+    CHECK_EQ(pump.startsLastHour(2 * MINUTE + PUMP_START_WINDOW_MS), 3);
+}
+
+static void testTripLocksOutAndRetries() {
+    PumpProtection pump(CONFIG);
+    pump.begin(0);
+    uint32_t waitMs;
+    bool on;
+
+    CHECK_EQ(pump.request(true, 2 * MINUTE, waitMs), PUMP_APPLIED);
+    // Safety stop ignores the minimum on time
+    pump.trip(2 * MINUTE + 1000, 10 * MINUTE);
+    CHECK(!pump.isOn());
+    CHECK(pump.hasHeld() && pump.heldOn());
+    CHECK_EQ(pump.hold(2 * MINUTE + 1000, waitMs), PUMP_HELD_FAULT);
+    CHECK_EQ(waitMs, 10 * MINUTE);
+
+    CHECK_EQ(pump.request(true, 5 * MINUTE, waitMs), PUMP_HELD_FAULT);
+    CHECK(!pump.poll(12 * MINUTE, on));
+    CHECK(pump.poll(12 * MINUTE + 1000, on));
+    CHECK(on && pump.isOn());
+}
+
+static void testOffCancelsRetryAfterTrip() {
+    PumpProtection pump(CONFIG);
+    pump.begin(0);
+    uint32_t waitMs;
+    bool on;
+
+    CHECK_EQ(pump.request(true, 2 * MINUTE, waitMs), PUMP_APPLIED);
+    pump.trip(3 * MINUTE, 10 * MINUTE);
+    CHECK_EQ(pump.request(false, 4 * MINUTE, waitMs), PUMP_APPLIED);
+    CHECK(!pump.hasHeld());
+    CHECK(!pump.poll(20 * MINUTE, on));
+    CHECK(!pump.isOn());
+}
+
+// ON at 70 s, OFF at 100 s held by the minimum on time, trip at 110 s: the stop
+// must survive the trip, the pump must not restart once the lockout is over.
+static void testTripKeepsHeldStop() {
+    PumpProtection pump({MINUTE, MINUTE, 6});
+    pump.begin(0);
+    uint32_t waitMs;
+    bool on = false;
+
+    CHECK_EQ(pump.request(true, 70000, waitMs), PUMP_APPLIED);
+    CHECK_EQ(pump.request(false, 100000, waitMs), PUMP_HELD_MIN_ON);
+    pump.trip(110000, 5 * MINUTE);
+    CHECK(!pump.isOn());
+    CHECK(!pump.heldOn());
+
+    if (pump.poll(410000, on)) CHECK(!on);
+    CHECK(!pump.isOn());
+    CHECK(!pump.hasHeld());
+    CHECK(!pump.poll(20 * MINUTE, on));
+    CHECK(!pump.isOn());
+}
+
+static void testTripWhileOffKeepsHeldStart() {
+    PumpProtection pump(CONFIG);
+    pump.begin(0);
+    uint32_t waitMs;
+    bool on;
+
+    CHECK_EQ(pump.request(true, 1000, waitMs), PUMP_HELD_MIN_OFF);
+    pump.trip(2000, 10 * MINUTE);
+    CHECK(pump.hasHeld() && pump.heldOn());
+    CHECK(!pump.poll(2 * MINUTE, on));
+    CHECK(pump.poll(2000 + 10 * MINUTE, on));
+    CHECK(on);
+}
+
+// A repeated ON from the LoRa callback racing a trip from the MotorGuard task.
+// The Wellguard writes the relay under the lock it decides under, so the relay
+// follows every decision in order; writing it after the lock would apply the
+// stale ON over the trip.
+static void testTripDuringApply() {
+    PumpProtection pump(CONFIG);
+    pump.begin(0);
+    uint32_t waitMs;
+    bool on;
+    bool relay = false;
+
+    CHECK_EQ(pump.request(true, 2 * MINUTE, waitMs), PUMP_APPLIED);
+    relay = true;
+    CHECK_EQ(pump.request(true, 5 * MINUTE, waitMs), PUMP_APPLIED);
+    relay = true;
+    pump.trip(5 * MINUTE, 10 * MINUTE);
+    relay = false;
+    CHECK_EQ(relay, pump.isOn());
+    // Not a second start, and the ON is kept for after the lockout
+    CHECK_EQ(pump.startsLastHour(5 * MINUTE), 1);
+    CHECK(pump.hasHeld() && pump.heldOn());
+
+    // The other order: the same ON once tripped is held, not applied
+    CHECK_EQ(pump.request(true, 5 * MINUTE, waitMs), PUMP_HELD_FAULT);
+    CHECK_EQ(relay, pump.isOn());
+    CHECK(!pump.poll(15 * MINUTE - 1, on));
+    CHECK(pump.poll(15 * MINUTE, on));
+    relay = on;
+    CHECK(relay && pump.isOn());
+}
+
+int main() {
+    RUN_TEST(testMinOffAtPowerUp);
+    RUN_TEST(testMinOnHoldsStop);
+    RUN_TEST(testLatestCommandWins);
+    RUN_TEST(testStartsPerHour);
+    RUN_TEST(testTripLocksOutAndRetries);
+    RUN_TEST(testOffCancelsRetryAfterTrip);
+    RUN_TEST(testTripKeepsHeldStop);
+    RUN_TEST(testTripWhileOffKeepsHeldStart);
+    RUN_TEST(testTripDuringApply);
+    return TEST_RESULT();
+}
@@ -0,0 +1,96 @@
+// Beacon-synchronised receive slots with the shipped config.h timings: airtime,
+// slot placement, the worst wait for a slot, and a day of simulated downlinks.
+#include "RxSchedule.h"
+#include "TestCheck.h"
+
+static const uint32_t DAY_MS = 86400000;
+
+static void testAirtime() {
+    // SF7, 125 kHz, CR 4/5: as given by the Semtech calculator
+    CHECK_EQ(RxSchedule::airtimeMs(255, 7, 125000), 400);
+    CHECK_EQ(RxSchedule::airtimeMs(64, 7, 125000), 119);
+    // Low data rate optimisation from SF11 at 125 kHz
+    CHECK_EQ(RxSchedule::airtimeMs(20, 12, 125000), 1319);
+}
+
+static void testSlotsStayInsideTheBeaconPeriod() {
+    RxScheduleConfig config = RxSchedule::defaultConfig();
+    const uint32_t lastSlotEnd = config.beaconPeriodMs - (config.beaconWindowMs - config.beaconGuardMs);
+
+    for (uint32_t seq = 0; seq < 1000; seq++) {
+        uint32_t offset = RxSchedule::slotOffsetMs(config, "NODE42", seq);
+        CHECK(offset % 10 == 0);
+        CHECK(offset + config.slotLenMs <= config.pingPeriodMs);
+
+        uint32_t start = RxSchedule::nextSlotStartMs(config, offset, 0);
+        CHECK_EQ(start, config.beaconGuardMs + offset);
+        while (start != RxSchedule::NO_SLOT) {
+            CHECK(start + config.slotLenMs <= lastSlotEnd);
+            CHECK(RxSchedule::isListening(config, offset, start));
+            CHECK(RxSchedule::isListening(config, offset, start + config.slotLenMs - 1));
+            CHECK(!RxSchedule::isListening(config, offset, start + config.slotLenMs));
+            start = RxSchedule::nextSlotStartMs(config, offset, start + 1);
+        }
+    }
+}
+
+static void testOffsetsSpreadNodes() {
+    RxScheduleConfig config = RxSchedule::defaultConfig();
+    // Same node, consecutive beacons: re-hashed, so rarely the same offset twice
+    int repeats = 0;
+    for (uint32_t seq = 0; seq < 1000; seq++) {
+        if (RxSchedule::slotOffsetMs(config, "NODE42", seq) == RxSchedule::slotOffsetMs(config, "NODE42", seq + 1)) {
+            repeats++;
+        }
+    }
+    CHECK(repeats < 10);
+    CHECK(RxSchedule::slotOffsetMs(config, "NODE42", 7) != RxSchedule::slotOffsetMs(config, "NODE43", 7));
+}
+
+// Longest wait for a slot over every pair of offsets around a beacon: from just
+// after the last slot of one period to the first slot of the next.
+static uint32_t worstWaitMs(const RxScheduleConfig& config) {
+    const uint32_t maxOffset = config.pingPeriodMs - config.slotLenMs;
+    uint32_t worstMs = 0;
+    for (uint32_t offset = 0; offset <= maxOffset; offset += 10) {
+        uint32_t last = RxSchedule::nextSlotStartMs(config, offset, 0);
+        uint32_t next;
+        while ((next = RxSchedule::nextSlotStartMs(config, offset, last + 1)) != RxSchedule::NO_SLOT) last = next;
+        // The worst offset after the beacon is the largest one
+        uint32_t waitMs = config.beaconPeriodMs - last + config.beaconGuardMs + maxOffset;
+        if (waitMs > worstMs) worstMs = waitMs;
+    }
+    return worstMs;
+}
+
+// About two ping periods, not one: a late offset loses the last slot of its
+// beacon period, and the next offset may be late too.
+static void testWorstWaitAcrossBeacon() {
+    RxScheduleConfig config = RxSchedule::defaultConfig();
+    uint32_t worstMs = worstWaitMs(config);
+    CHECK(worstMs > 2 * config.pingPeriodMs - config.slotLenMs);
+    CHECK(worstMs < 2 * config.pingPeriodMs + config.slotLenMs);
+}
+
+// One command a minute over a day.
+static void testSimulatedDay() {
+    RxScheduleConfig config = RxSchedule::defaultConfig();
+    RxSimulationResult result = RxSchedule::simulate(config, DAY_MS, 60000, 1);
+
+    CHECK(result.commands > 1300 && result.commands < 1500);
+    // Receiver on about 7 % of the time: the slots (480 / 8000) and beacon windows
+    CHECK(result.radioOnRatio > 0.06f && result.radioOnRatio < 0.075f);
+    // Half a ping period on average, plus the longer waits around beacons
+    CHECK(result.meanLatencyMs > 0.45f * config.pingPeriodMs && result.meanLatencyMs < 0.6f * config.pingPeriodMs);
+    CHECK(result.maxLatencyMs > config.pingPeriodMs);
+    CHECK(result.maxLatencyMs <= worstWaitMs(config));
+}
+
+int main() {
+    RUN_TEST(testAirtime);
+    RUN_TEST(testSlotsStayInsideTheBeaconPeriod);
+    RUN_TEST(testOffsetsSpreadNodes);
+    RUN_TEST(testWorstWaitAcrossBeacon);
+    RUN_TEST(testSimulatedDay);
+    return TEST_RESULT();
+}
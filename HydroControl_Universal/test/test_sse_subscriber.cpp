@@ -0,0 +1,134 @@
+// Per-subscriber bound and drop-to-latest delivery of EventStream, with slow
+// consumers simulated by acknowledging late or never.
+#include "SseSubscriber.h"
+#include "TestCheck.h"
+
+static const size_t EVENT_LEN = 300;
+static const size_t SEND_BUFFER = 5744; // TCP_SND_BUF
+
+// What EventStream::trySend() does with the TCP client.
+struct SimulatedClient {
+    SseSubscriber delivery = {};
+    size_t space = SEND_BUFFER;
+    uint32_t received[64];
+    int receivedCount = 0;
+    size_t maxBuffered = 0;
+
+    void offer(uint32_t version, uint32_t nowMs) {
+        if (delivery.upToDate(version)) {
+            delivery.keepingUp();
+            return;
+        }
+        if (!delivery.canWrite(space, EVENT_LEN)) {
+            delivery.blocked(nowMs);
+            return;
+        }
+        delivery.sent(version, EVENT_LEN);
+        space -= EVENT_LEN;
+        received[receivedCount++] = version;
+        if (SEND_BUFFER - space > maxBuffered) maxBuffered = SEND_BUFFER - space;
+    }
+    void ack(uint32_t version, uint32_t nowMs) {
+        delivery.acked(EVENT_LEN);
+        space = SEND_BUFFER;
+        offer(version, nowMs);
+    }
+};
+
+static void testFastSubscriberGetsEveryEvent() {
+    SimulatedClient client;
+    for (uint32_t version = 1; version <= 10; version++) {
+        client.offer(version, version * 2000);
+        client.ack(version, version * 2000 + 50);
+    }
+    CHECK_EQ(client.receivedCount, 10);
+    CHECK_EQ(client.received[9], 10);
+    CHECK(!client.delivery.stalled(30000, 10000));
+}
+
+// Never more than one event in the send buffer, however many are published.
+static void testSlowSubscriberHoldsOneEvent() {
+    SimulatedClient client;
+    for (uint32_t version = 1; version <= 50; version++) client.offer(version, version * 100);
+    CHECK_EQ(client.receivedCount, 1);
+    CHECK_EQ(client.maxBuffered, EVENT_LEN);
+    CHECK_EQ(client.delivery.inFlight, EVENT_LEN);
+}
+
+// Once drained, a late subscriber gets the newest event, and the skipped ones are counted.
+static void testDrainedSubscriberJumpsToLatest() {
+    SimulatedClient client;
+    client.offer(1, 0);
+    for (uint32_t version = 2; version <= 7; version++) client.offer(version, version * 100);
+    CHECK_EQ(client.receivedCount, 1);
+
+    client.delivery.acked(EVENT_LEN);
+    client.space = SEND_BUFFER;
+    CHECK(client.delivery.canWrite(client.space, EVENT_LEN));
+    CHECK_EQ(client.delivery.sent(7, EVENT_LEN), 5);
+    CHECK_EQ(client.delivery.sentVersion, 7);
+}
+
+// Acknowledgements can come in pieces: no write until the whole event is acknowledged.
+static void testPartialAckKeepsWaiting() {
+    SseSubscriber delivery = {};
+    delivery.sent(1, EVENT_LEN);
+    delivery.acked(100);
+    CHECK_EQ(delivery.inFlight, EVENT_LEN - 100);
+    CHECK(!delivery.canWrite(SEND_BUFFER, EVENT_LEN));
+    delivery.acked(EVENT_LEN); // More than left: clamps at 0
+    CHECK_EQ(delivery.inFlight, 0);
+    CHECK(delivery.canWrite(SEND_BUFFER, EVENT_LEN));
+}
+
+// An event that does not fit the free send buffer waits, even with nothing in flight.
+static void testNoRoomWaits() {
+    SseSubscriber delivery = {};
+    CHECK(!delivery.canWrite(EVENT_LEN - 1, EVENT_LEN));
+    CHECK(delivery.canWrite(EVENT_LEN, EVENT_LEN));
+}
+
+// The stall timer starts at the first blocked event and is not pushed back by later ones.
+static void testStallTimeout() {
+    SimulatedClient client;
+    client.offer(1, 1000);
+    for (uint32_t version = 2; version <= 20; version++) client.offer(version, 1000 + version * 1000);
+    CHECK(client.delivery.waiting);
+    CHECK_EQ(client.delivery.waitingSinceMs, 3000); // Version 2 was the first one held back
+    CHECK(!client.delivery.stalled(12999, 10000));
+    CHECK(client.delivery.stalled(13000, 10000));
+
+    client.ack(20, 13500);
+    CHECK(!client.delivery.waiting);
+    CHECK(!client.delivery.stalled(30000, 10000));
+}
+
+// The stall check holds across the millis() wrap-around.
+static void testStallAcrossWrap() {
+    SseSubscriber delivery = {};
+    delivery.sent(1, EVENT_LEN);
+    delivery.blocked(0xFFFFF000u);
+    CHECK(!delivery.stalled(0x00000100u, 10000));
+    CHECK(delivery.stalled(0xFFFFF000u + 10000, 10000));
+}
+
+// A subscriber that is up to date is not waiting, whatever is in flight.
+static void testUpToDateIsNotBlocked() {
+    SimulatedClient client;
+    client.offer(1, 0);
+    client.delivery.blocked(100);
+    client.offer(1, 200);
+    CHECK(!client.delivery.waiting);
+}
+
+int main() {
+    RUN_TEST(testFastSubscriberGetsEveryEvent);
+    RUN_TEST(testSlowSubscriberHoldsOneEvent);
+    RUN_TEST(testDrainedSubscriberJumpsToLatest);
+    RUN_TEST(testPartialAckKeepsWaiting);
+    RUN_TEST(testNoRoomWaits);
+    RUN_TEST(testStallTimeout);
+    RUN_TEST(testStallAcrossWrap);
+    RUN_TEST(testUpToDateIsNotBlocked);
+    return TEST_RESULT();
+}
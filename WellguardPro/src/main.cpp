@@ -40,6 +40,7 @@ volatile unsigned long lastLoRaTransmissionTimestamp = 0;
 // Prototypes
 void startApMode();
 void startStaMode();
+void onWifiEvent(WiFiEvent_t event);
 bool loadConfiguration();
 void onReceive(int packetSize);
 void handleLoRaPacket(const String& packet);
@@ -144,19 +145,23 @@ void startApMode() {
     Serial.println("AP Mode Started. Connect to " + String(AP_SSID));
 }
 
+void onWifiEvent(WiFiEvent_t event) {
+    if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP) {
+        Serial.println("WiFi Connected. IP: " + WiFi.localIP().toString());
+        LED_State opState = OPERATIONAL;
+        xQueueSend(ledStateQueue, &opState, 0);
+    } else if (event == ARDUINO_EVENT_WIFI_STA_DISCONNECTED) {
+        LED_State errorState = CONNECTIVITY_ERROR;
+        xQueueSend(ledStateQueue, &errorState, 0);
+    }
+}
+
 void startStaMode() {
     WiFi.mode(WIFI_STA);
+    WiFi.setAutoReconnect(true);
+    WiFi.onEvent(onWifiEvent);
+    // L'association Wi-Fi se poursuit en arrière-plan : LittleFS, LoRa et les tâches démarrent sans l'attendre.
     WiFi.begin(currentConfig.wifi_ssid.c_str(), currentConfig.wifi_pass.c_str());
-    int retries = 0;
-    while (WiFi.status() != WL_CONNECTED) {
-        delay(500);
-        Serial.print(".");
-        if (++retries > 20) {
-            LED_State errorState = CONNECTIVITY_ERROR;
-            xQueueSend(ledStateQueue, &errorState, 0);
-        }
-    }
-    Serial.println("\nWiFi Connected. IP: " + WiFi.localIP().toString());
 
     if(!LittleFS.begin(true)) {
         Serial.println("LittleFS Mount Failed");
@@ -179,9 +184,6 @@ void startStaMode() {
     LoRa.onReceive(onReceive);
     LoRa.receive();
 
-    LED_State opState = OPERATIONAL;
-    xQueueSend(ledStateQueue, &opState, 0);
-
     xTaskCreate(Task_LED_Manager, "LED Manager", 2048, NULL, 0, NULL);
     xTaskCreate(Task_Status_Reporter, "Status Reporter", 2048, NULL, 1, NULL);
 
@@ -0,0 +1,101 @@
+#include "StaticAssets.h"
+#include <rom/crc.h>
+
+#define CACHE_IMMUTABLE   "public, max-age=31536000, immutable"
+#define CACHE_REVALIDATE  "no-cache"
+
+StaticAssetHandler::StaticAssetHandler(fs::FS& fs, const char* indexFile) : fs(fs), indexFile(indexFile) {}
+
+void StaticAssetHandler::begin() {
+    count = 0;
+    File root = fs.open("/");
+    if (!root || !root.isDirectory()) return;
+
+    uint8_t buffer[512];
+    for (File file = root.openNextFile(); file; file = root.openNextFile()) {
+        if (file.isDirectory()) continue;
+        String path = String("/") + file.name();
+        String url = path;
+        bool gzip = url.endsWith(".gz");
+        if (gzip) url = url.substring(0, url.length() - 3);
+        if (contentType(url.c_str()) == nullptr || url.length() >= STATIC_ASSET_PATH_LEN || path.length() >= STATIC_ASSET_PATH_LEN) continue;
+        if (count >= STATIC_ASSETS_MAX) {
+            Serial.printf("Static assets: table full, %s not served.\n", path.c_str());
+            continue;
+        }
+
+        // Lu une seule fois au démarrage : quelques Ko par fichier, les 304 ne coûtent plus rien ensuite.
+        uint32_t crc = 0;
+        size_t len;
+        while ((len = file.read(buffer, sizeof(buffer))) > 0) {
+            crc = crc32_le(crc, buffer, len);
+        }
+
+        Asset& asset = assets[count++];
+        snprintf(asset.url, sizeof(asset.url), "%s", url.c_str());
+        snprintf(asset.path, sizeof(asset.path), "%s", path.c_str());
+        snprintf(asset.etag, sizeof(asset.etag), "\"%08x\"", crc);
+        asset.gzip = gzip;
+        asset.immutable = isFingerprinted(asset.url);
+    }
+    root.close();
+    Serial.printf("Static assets: %u files indexed.\n", count);
+}
+
+const StaticAssetHandler::Asset* StaticAssetHandler::find(const String& url) const {
+    const char* wanted = url == "/" ? indexFile : url.c_str();
+    for (uint8_t i = 0; i < count; i++) {
+        if (strcmp(assets[i].url, wanted) == 0) return &assets[i];
+    }
+    return nullptr;
+}
+
+bool StaticAssetHandler::canHandle(AsyncWebServerRequest* request) {
+    if (request->method() != HTTP_GET || find(request->url()) == nullptr) return false;
+    // Les en-têtes de la requête ne sont conservés que sur demande.
+    request->addInterestingHeader("If-None-Match");
+    return true;
+}
+
+void StaticAssetHandler::handleRequest(AsyncWebServerRequest* request) {
+    const Asset* asset = find(request->url());
+    if (asset == nullptr) {
+        request->send(404);
+        return;
+    }
+
+    AsyncWebServerResponse* response;
+    AsyncWebHeader* ifNoneMatch = request->getHeader("If-None-Match");
+    if (ifNoneMatch != nullptr && ifNoneMatch->value() == asset->etag) {
+        response = request->beginResponse(304);
+    } else {
+        // Le chemin stocké est passé tel quel : le type de contenu vient de l'URL.
+        response = request->beginResponse(fs, asset->path, contentType(asset->url));
+        if (asset->gzip) response->addHeader("Content-Encoding", "gzip");
+    }
+    response->addHeader("ETag", asset->etag);
+    response->addHeader("Cache-Control", asset->immutable ? CACHE_IMMUTABLE : CACHE_REVALIDATE);
+    request->send(response);
+}
+
+const char* StaticAssetHandler::contentType(const char* url) {
+    const char* ext = strrchr(url, '.');
+    if (ext == nullptr) return nullptr;
+    if (strcmp(ext, ".html") == 0) return "text/html";
+    if (strcmp(ext, ".css") == 0) return "text/css";
+    if (strcmp(ext, ".js") == 0) return "application/javascript";
+    if (strcmp(ext, ".svg") == 0) return "image/svg+xml";
+    if (strcmp(ext, ".png") == 0) return "image/png";
+    if (strcmp(ext, ".ico") == 0) return "image/x-icon";
+    return nullptr;
+}
+
+// "/nom.<8 chiffres hexa>.ext", tel qu'écrit par compress_assets.py.
+bool StaticAssetHandler::isFingerprinted(const char* url) {
+    const char* ext = strrchr(url, '.');
+    if (ext == nullptr || ext - url < 10 || ext[-9] != '.') return false;
+    for (const char* c = ext - 8; c < ext; c++) {
+        if (!isxdigit((unsigned char)*c)) return false;
+    }
+    return true;
+}
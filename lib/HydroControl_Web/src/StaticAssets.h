@@ -0,0 +1,54 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FS.h>
+#include <ESPAsyncWebServer.h>
+
+#define STATIC_ASSETS_MAX      16
+#define STATIC_ASSET_PATH_LEN  40
+
+/**
+ * @brief Sert les fichiers web préparés par scripts/compress_assets.py.
+ *
+ * Les pages et leurs fichiers sont stockés compressés ("/index.html.gz") et tout
+ * ce qui n'est pas une page porte une empreinte de son contenu dans son nom
+ * ("/style.1a2b3c4d.css.gz"). Les réponses partent avec Content-Encoding: gzip
+ * et un ETag fort (CRC32 du fichier stocké). Les pages sont revalidées à chaque
+ * chargement (no-cache, 304 si l'ETag correspond) ; les fichiers empreintés ne
+ * changent jamais sous le même nom et sont mis en cache un an (immutable).
+ */
+class StaticAssetHandler : public AsyncWebHandler {
+public:
+    /**
+     * @param fs Le système de fichiers (LittleFS).
+     * @param indexFile Le fichier servi pour "/".
+     */
+    StaticAssetHandler(fs::FS& fs, const char* indexFile);
+
+    /**
+     * @brief Indexe les fichiers web à la racine. À appeler une fois le système
+     * de fichiers monté ; les autres fichiers (.bin, ...) sont ignorés.
+     */
+    void begin();
+
+    bool canHandle(AsyncWebServerRequest* request) override;
+    void handleRequest(AsyncWebServerRequest* request) override;
+
+private:
+    struct Asset {
+        char url[STATIC_ASSET_PATH_LEN];  // Tel que demandé, sans ".gz"
+        char path[STATIC_ASSET_PATH_LEN]; // Tel que stocké
+        char etag[12];                    // CRC32 entre guillemets
+        bool gzip;
+        bool immutable;                   // Nom empreinté
+    };
+
+    fs::FS& fs;
+    const char* indexFile;
+    Asset assets[STATIC_ASSETS_MAX];
+    uint8_t count = 0;
+
+    const Asset* find(const String& url) const;
+    static const char* contentType(const char* url);
+    static bool isFingerprinted(const char* url);
+};
@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+"""Gzip and fingerprint the web assets of data/ for the LittleFS image.
+
+PlatformIO runs this before every build (extra_scripts = pre:...) and points
+buildfs/uploadfs at the generated directory, so data/ keeps the readable
+sources. It can also be run by hand: compress_assets.py data/ out/
+
+- Pages (.html) keep their name, since they are opened by URL.
+- Every other file gets a content hash in its name (style.css ->
+  style.1a2b3c4d.css) and the references to it in pages and style sheets are
+  rewritten. The server caches these as immutable.
+- Files that gzip smaller are stored as name.gz only; the server sends them
+  with Content-Encoding: gzip.
+"""
+
+import gzip
+import hashlib
+import os
+import re
+import shutil
+import sys
+
+PAGES = (".html",)
+STYLES = (".css",)
+REFERENCE = re.compile(r"""((?:src|href)\s*=\s*["']|url\(\s*["']?)([^"')?#]+)""")
+
+
+def fingerprint(name, content):
+    base, ext = os.path.splitext(name)
+    return "%s.%s%s" % (base, hashlib.sha256(content).hexdigest()[:8], ext)
+
+
+def rewrite(content, renamed):
+    def replace(match):
+        prefix, name = re.match(r"(\.?/)?(.*)", match.group(2)).groups()
+        return match.group(1) + (prefix or "") + renamed.get(name, name)
+
+    return REFERENCE.sub(replace, content.decode("utf-8")).encode("utf-8")
+
+
+def store(out_dir, name, content):
+    # mtime=0: the same sources give the same image.
+    packed = gzip.compress(content, compresslevel=9, mtime=0)
+    if len(packed) < len(content):
+        name, content = name + ".gz", packed
+    with open(os.path.join(out_dir, name), "wb") as f:
+        f.write(content)
+    return name, len(content)
+
+
+def build(src_dir, out_dir):
+    if os.path.isdir(out_dir):
+        shutil.rmtree(out_dir)
+    os.makedirs(out_dir)
+
+    files = {}
+    for name in sorted(os.listdir(src_dir)):
+        path = os.path.join(src_dir, name)
+        if os.path.isfile(path) and not name.startswith("."):
+            with open(path, "rb") as f:
+                files[name] = f.read()
+
+    # Leaves first, then style sheets (may reference images), then pages.
+    def order(name):
+        ext = os.path.splitext(name)[1]
+        return 2 if ext in PAGES else 1 if ext in STYLES else 0
+
+    renamed = {}
+    total_in = total_out = 0
+    for name in sorted(files, key=order):
+        content = files[name]
+        ext = os.path.splitext(name)[1]
+        if ext in PAGES or ext in STYLES:
+            content = rewrite(content, renamed)
+        stored_name = name if ext in PAGES else fingerprint(name, content)
+        renamed[name] = stored_name
+        stored_name, size = store(out_dir, stored_name, content)
+        total_in += len(files[name])
+        total_out += size
+        print("  %-28s %6d -> %6d  %s" % (name, len(files[name]), size, stored_name))
+    print("Web assets: %d -> %d bytes" % (total_in, total_out))
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit("Usage: compress_assets.py data_dir out_dir")
+    build(sys.argv[1], sys.argv[2])
+
+
+if __name__ == "__main__":
+    main()
+else:
+    Import("env")  # noqa: F821 (PlatformIO/SCons)
+    out = os.path.join(env.subst("$BUILD_DIR"), "data")  # noqa: F821
+    build(env.subst("$PROJECT_DATA_DIR"), out)  # noqa: F821
+    env.Replace(PROJECT_DATA_DIR=out)  # noqa: F821